@@ -0,0 +1,134 @@
+/**
+ * @file udp_echo_bench.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief udp echo 服务器吞吐量测试 多个客户端批量收发
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/socket.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/iomanager.h"
+#include "../ljrServer/clock.h"
+
+#include <atomic>
+#include <string.h>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+// 服务器地址
+static std::string s_address = "127.0.0.1:8024";
+
+// 客户端个数
+static int s_clients = 4;
+
+// 测试时长 秒
+static int s_seconds = 5;
+
+// 数据报大小
+static const int s_size = 64;
+
+// 每批的数据报个数
+static const int s_batch = 32;
+
+// 收到的回复个数
+static std::atomic<uint64_t> s_received{0};
+
+// 结束时间
+static uint64_t s_deadline = 0;
+
+/**
+ * @brief 一个客户端 每轮批量发送 s_batch 个数据报 再批量接收回复
+ *
+ * @param addr 服务器地址
+ */
+void run_client(ljrserver::Address::ptr addr) {
+    auto sock = ljrserver::Socket::CreateUDP(addr);
+    if (!sock->connect(addr)) {
+        LJRSERVER_LOG_ERROR(g_logger) << "connect " << *addr << " fail";
+        return;
+    }
+    // 丢包时不会一直等待
+    sock->setRecvTimeout(100);
+
+    char buf[s_batch][s_size];
+    memset(buf, 'x', sizeof(buf));
+    iovec iovs[s_batch];
+    mmsghdr msgs[s_batch];
+    for (int i = 0; i < s_batch; ++i) {
+        iovs[i].iov_base = buf[i];
+        iovs[i].iov_len = s_size;
+    }
+
+    while (ljrserver::Clock::NowUS() < s_deadline) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < s_batch; ++i) {
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = sock->sendBatch(msgs, s_batch);
+        if (sent <= 0) {
+            break;
+        }
+
+        int received = 0;
+        while (received < sent) {
+            int rt = sock->recvBatch(msgs, sent - received);
+            if (rt <= 0) {
+                // 超时 认为剩下的丢了
+                break;
+            }
+            received += rt;
+        }
+        s_received += received;
+    }
+    sock->close();
+}
+
+/**
+ * @brief 启动客户端 结束后打印吞吐量
+ *
+ */
+void run() {
+    auto addr = ljrserver::Address::LookupAny(s_address);
+    if (!addr) {
+        LJRSERVER_LOG_ERROR(g_logger) << "invalid address " << s_address;
+        return;
+    }
+
+    uint64_t start = ljrserver::Clock::NowUS();
+    s_deadline = start + s_seconds * 1000 * 1000ul;
+    for (int i = 0; i < s_clients; ++i) {
+        ljrserver::IOManager::GetThis()->schedule(std::bind(run_client, addr));
+    }
+
+    // 等待客户端结束
+    sleep(s_seconds + 1);
+    LJRSERVER_LOG_INFO(g_logger)
+        << "clients=" << s_clients << " size=" << s_size
+        << " echoed=" << s_received
+        << " pps=" << s_received / s_seconds;
+}
+
+/**
+ * @brief udp echo 吞吐量测试
+ *
+ * @param argc
+ * @param argv [address] [clients] [seconds] 默认 127.0.0.1:8024 4 5
+ * @return int
+ */
+int main(int argc, char const *argv[]) {
+    if (argc > 1) {
+        s_address = argv[1];
+    }
+    if (argc > 2) {
+        s_clients = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        s_seconds = atoi(argv[3]);
+    }
+    ljrserver::IOManager iom(1, false, "bench");
+    iom.schedule(run);
+    return 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file udp_echo_server.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief udp echo 服务器 原样发回收到的数据报
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/udp_server.h"
+#include "../ljrServer/log.h"
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+/**
+ * @brief udp echo 服务器
+ *
+ */
+class UdpEchoServer : public ljrserver::UdpServer {
+public:
+    typedef std::shared_ptr<UdpEchoServer> ptr;
+
+protected:
+    /**
+     * @brief 原样发回数据报
+     *
+     * @param sock 收到数据报的 socket
+     * @param data 数据报
+     * @param from 来源地址
+     */
+    void handleDatagram(ljrserver::Socket::ptr sock,
+                        ljrserver::ByteArray::ptr data,
+                        ljrserver::Address::ptr from) override {
+        std::vector<iovec> iovs;
+        data->getReadBuffers(iovs, data->getReadSize());
+        if (sock->sendTo(&iovs[0], iovs.size(), from) < 0) {
+            LJRSERVER_LOG_ERROR(g_logger)
+                << "sendto " << *from << " errno = " << errno
+                << " errno-string = " << strerror(errno);
+        }
+    }
+
+    /**
+     * @brief 一批数据报用 sendmmsg 一次发回
+     *
+     * @param sock 收到数据报的 socket
+     * @param batch 数据报
+     */
+    void handleBatch(ljrserver::Socket::ptr sock,
+                     std::vector<Datagram> &batch) override {
+        std::vector<ljrserver::ByteArray::ptr> datas;
+        std::vector<ljrserver::Address::ptr> tos;
+        for (auto &dgram : batch) {
+            datas.push_back(dgram.first);
+            tos.push_back(dgram.second);
+        }
+        if (sock->sendBatch(datas, tos) < 0) {
+            LJRSERVER_LOG_ERROR(g_logger)
+                << "sendmmsg errno = " << errno
+                << " errno-string = " << strerror(errno);
+        }
+    }
+};
+
+// 监听地址
+static std::string s_address = "0.0.0.0:8024";
+
+/**
+ * @brief 启动服务器
+ *
+ */
+void run() {
+    UdpEchoServer::ptr server(new UdpEchoServer);
+    auto addr = ljrserver::Address::LookupAny(s_address);
+    while (!server->bind(addr)) {
+        sleep(2);
+    }
+    server->start();
+}
+
+/**
+ * @brief udp echo 服务器
+ *
+ * @param argc
+ * @param argv [address] 默认 0.0.0.0:8024
+ * @return int
+ */
+int main(int argc, char const *argv[]) {
+    if (argc > 1) {
+        s_address = argv[1];
+    }
+    ljrserver::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
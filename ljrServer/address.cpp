@@ -2,6 +2,8 @@
 #include "address.h"
 #include "endian.h"
 #include "log.h"
+// 域名解析
+#include "dns.h"
 
 // string stream 字符串流
 #include <sstream>
@@ -11,6 +13,8 @@
 #include <ifaddrs.h>
 // offsetof
 #include <stddef.h>
+// inet_pton
+#include <arpa/inet.h>
 
 namespace ljrserver {
 
@@ -45,6 +49,63 @@ static uint32_t CountBytes(T value) {
     return result;
 }
 
+/**
+ * @brief 通过域名解析器解析 数字地址 非数字端口等交给 getaddrinfo
+ *
+ * @param result 保存解析结果
+ * @param node 域名
+ * @param service 端口
+ * @param family 协议族
+ * @return true 已经由解析器处理 (成功或失败)
+ * @return false 需要 getaddrinfo 处理
+ */
+static bool ResolveByDns(std::vector<Address::ptr> &result,
+                         const std::string &node, const char *service,
+                         int family) {
+    if (!DnsResolver::IsEnabled() || node.empty() ||
+        (family != AF_INET && family != AF_INET6 && family != AF_UNSPEC)) {
+        return false;
+    }
+
+    // 数字地址 getaddrinfo 不会查询 dns
+    unsigned char buf[sizeof(in6_addr)];
+    if (inet_pton(AF_INET, node.c_str(), buf) == 1 ||
+        inet_pton(AF_INET6, node.c_str(), buf) == 1) {
+        return false;
+    }
+
+    // 服务名需要查 /etc/services
+    uint16_t port = 0;
+    if (service && *service) {
+        for (const char *p = service; *p; ++p) {
+            if (!isdigit(*p)) {
+                return false;
+            }
+        }
+        port = atoi(service);
+    }
+
+    std::vector<IPAddress::ptr> addrs;
+    DnsResolver::Result rt =
+        DnsMgr::GetInstance()->resolve(addrs, node, family);
+    if (rt == DnsResolver::NO_SERVER) {
+        // 没有域名服务器 交给 getaddrinfo
+        return false;
+    }
+    if (rt != DnsResolver::SUCCESS) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "Address::Lookup resolve(" << node << ", " << family
+            << ") result = " << rt;
+        return true;
+    }
+
+    for (auto &i : addrs) {
+        i->setPort(port);
+        result.push_back(i);
+    }
+    return true;
+}
+
 /***************
 Address 抽象类
 ***************/
@@ -108,6 +169,11 @@ bool Address::Lookup(std::vector<Address::ptr> &result, const std::string &host,
         node = host;
     }
 
+    // 域名交给解析器 查询时协程让出执行权 不阻塞线程
+    if (ResolveByDns(result, node, service, family)) {
+        return !result.empty();
+    }
+
     // 获取 node:service
     int error = getaddrinfo(node.c_str(), service, &hints, &results);
     if (error) {
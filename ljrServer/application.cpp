@@ -12,6 +12,14 @@
 #include "log.h"
 #include "env.h"
 #include "iomanager.h"
+#include "upgrade.h"
+#include "worker.h"
+#include "clock.h"
+
+// signalfd
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
 
 namespace ljrserver {
 
@@ -28,6 +36,34 @@ static ljrserver::ConfigVar<std::string>::ptr g_server_pid_file =
     ljrserver::Config::Lookup("server.pid_file", std::string("ljrserver.pid"),
                               "server pid file");
 
+// 配置 热升级时旧进程等待连接处理完的最长时间 毫秒
+static ljrserver::ConfigVar<uint64_t>::ptr g_server_drain_timeout =
+    ljrserver::Config::Lookup("server.drain_timeout", (uint64_t)(30 * 1000),
+                              "server drain timeout in ms on hot upgrade");
+
+// 配置 prefork 工作进程数 0 不 fork 单进程 -1 可用的 CPU 个数
+static ljrserver::ConfigVar<int32_t>::ptr g_server_worker_processes =
+    ljrserver::Config::Lookup("server.worker_processes", (int32_t)0,
+                              "server prefork worker processes, -1 cpu count");
+
+// prefork 工作进程上报统计的间隔 1s
+static const uint64_t s_worker_stats_interval_ms = 1000;
+
+// 排空连接时的检查间隔 100ms
+static const uint64_t s_drain_interval_us = 100 * 1000;
+
+/**
+ * @brief 写出缓存的日志后 _exit 退出进程
+ *
+ * 不走 exit 不执行全局析构 其他线程还在运行
+ *
+ * @param status 退出码
+ */
+static void exit_process(int status) {
+    LoggerMgr::GetInstance()->flush();
+    _exit(status);
+}
+
 /**
  * @brief http 服务器配置
  *
@@ -37,15 +73,39 @@ struct HttpServerConf {
     int keepalive = 0;                 // 非长连接
     int timeout = 1000 * 2 * 60;       // 2 min
     std::string name;                  // 名称
+    TcpSocketOptions socket;           // socket 选项
+    int ssl = 0;                       // 是否 https
+    std::string cert_file;             // 证书文件
+    std::string key_file;              // 私钥文件
+    std::string accept_worker;         // accept 的调度器 空为主调度器
+    std::string worker;                // 处理连接的调度器 空为主调度器
 
     bool isValid() const { return !address.empty(); }
 
     bool operator==(const HttpServerConf& oth) const {
         return address == oth.address && keepalive == oth.keepalive &&
-               timeout == oth.timeout && name == oth.name;
+               timeout == oth.timeout && name == oth.name &&
+               socket == oth.socket && ssl == oth.ssl &&
+               cert_file == oth.cert_file && key_file == oth.key_file &&
+               accept_worker == oth.accept_worker && worker == oth.worker;
     }
 };
 
+// socket 选项字段
+#define LJRSERVER_SOCKET_OPTIONS(XX) \
+    XX(nodelay)                      \
+    XX(defer_accept)                 \
+    XX(fastopen)                     \
+    XX(rcvbuf)                       \
+    XX(sndbuf)                       \
+    XX(quickack)                     \
+    XX(keepalive)                    \
+    XX(keepidle)                     \
+    XX(keepintvl)                    \
+    XX(keepcnt)                      \
+    XX(backlog)                      \
+    XX(zerocopy)
+
 template <>
 class LexicalCast<std::string, HttpServerConf> {
 public:
@@ -55,11 +115,23 @@ public:
         conf.keepalive = node["keepalive"].as<int>(conf.keepalive);
         conf.timeout = node["timeout"].as<int>(conf.timeout);
         conf.name = node["name"].as<std::string>(conf.name);
+        conf.ssl = node["ssl"].as<int>(conf.ssl);
+        conf.cert_file = node["cert_file"].as<std::string>(conf.cert_file);
+        conf.key_file = node["key_file"].as<std::string>(conf.key_file);
+        conf.accept_worker =
+            node["accept_worker"].as<std::string>(conf.accept_worker);
+        conf.worker = node["worker"].as<std::string>(conf.worker);
         if (node["address"].IsDefined()) {
             for (size_t i = 0; i < node["address"].size(); ++i) {
                 conf.address.push_back(node["address"][i].as<std::string>());
             }
         }
+        if (node["socket"].IsMap()) {
+            YAML::Node sock = node["socket"];
+#define XX(name) conf.socket.name = sock[#name].as<int>(conf.socket.name);
+            LJRSERVER_SOCKET_OPTIONS(XX);
+#undef XX
+        }
         return conf;
     }
 };
@@ -72,9 +144,17 @@ public:
         node["keepalive"] = conf.keepalive;
         node["timeout"] = conf.timeout;
         node["name"] = conf.name;
+        node["ssl"] = conf.ssl;
+        node["cert_file"] = conf.cert_file;
+        node["key_file"] = conf.key_file;
+        node["accept_worker"] = conf.accept_worker;
+        node["worker"] = conf.worker;
         for (auto& addr : conf.address) {
             node["address"].push_back(addr);
         }
+#define XX(name) node["socket"][#name] = conf.socket.name;
+        LJRSERVER_SOCKET_OPTIONS(XX);
+#undef XX
 
         std::stringstream ss;
         ss << node;
@@ -87,6 +167,69 @@ static ljrserver::ConfigVar<std::vector<HttpServerConf>>::ptr
     g_http_servers_conf = ljrserver::Config::Lookup(
         "http_servers", std::vector<HttpServerConf>(), "http servers config");
 
+/**
+ * @brief 解析 http 服务器配置的地址
+ *
+ * @param conf http 服务器配置
+ * @param address 构建成功的地址
+ * @return true
+ * @return false 有地址无法构建
+ */
+static bool parse_address(const HttpServerConf& conf,
+                          std::vector<Address::ptr>& address) {
+    for (auto& addr : conf.address) {
+        // 查找 :
+        size_t pos = addr.find(":");
+        if (pos == std::string::npos) {
+            // 找不到 : 端口
+            LJRSERVER_LOG_ERROR(g_logger) << "invalid address: " << addr;
+            // address.push_back(UnixAddress::ptr(new UnixAddress(addr)));
+            continue;
+        }
+        // 端口号
+        int32_t port = atoi(addr.substr(pos + 1).c_str());
+
+        // 127.0.0.1
+        auto ipaddr =
+            ljrserver::IPAddress::Create(addr.substr(0, pos).c_str(), port);
+        if (ipaddr) {
+            // 成功
+            address.push_back(ipaddr);
+            continue;
+        }
+
+        // 本机网卡地址
+        std::vector<std::pair<Address::ptr, uint32_t>> result;
+        if (ljrserver::Address::GetInterfaceAddresses(
+                result, addr.substr(0, pos))) {
+            // 遍历网卡
+            for (auto& x : result) {
+                // 获取地址
+                auto ipaddr = std::dynamic_pointer_cast<IPAddress>(x.first);
+                if (ipaddr) {
+                    ipaddr->setPort(port);
+                }
+                address.push_back(ipaddr);
+            }
+            // 成功
+            continue;
+        }
+
+        // 找其他地址
+        auto other_addr = ljrserver::Address::LookupAny(addr);
+        if (other_addr) {
+            // 成功
+            address.push_back(other_addr);
+            continue;
+        }
+
+        // 构建配置地址失败
+        LJRSERVER_LOG_ERROR(g_logger) << "invalid address: " << addr;
+        return false;
+    }
+    return true;
+}
+
 // 类中的静态成员需要在类外定义
 Application* Application::s_instance = nullptr;
 
@@ -166,10 +309,11 @@ bool Application::init(int argc, char** argv) {
         return false;
     }
 
-    // 检测不要重复启动服务器
+    // 检测不要重复启动服务器 热升级时旧进程还在运行
     std::string pidfile =
         g_server_work_path->getValue() + "/" + g_server_pid_file->getValue();
-    if (ljrserver::FSUtil::IsRunningPidfile(pidfile)) {
+    if (!HotUpgradeMgr::GetInstance()->isUpgrading() &&
+        ljrserver::FSUtil::IsRunningPidfile(pidfile)) {
         LJRSERVER_LOG_ERROR(g_logger) << "server is running:" << pidfile;
         return false;
     }
@@ -193,8 +337,9 @@ bool Application::init(int argc, char** argv) {
  * @return false
  */
 bool Application::run() {
-    // 是否守护进程
-    bool is_daemon = ljrserver::EnvMgr::GetInstance()->has("d");
+    // 是否守护进程 热升级启动的新进程由原来的守护进程收养
+    bool is_daemon = ljrserver::EnvMgr::GetInstance()->has("d") &&
+                     !HotUpgradeMgr::GetInstance()->isUpgrading();
     // 执行
     return start_daemon(m_argc, m_argv,
                         std::bind(&Application::main, this,
@@ -232,10 +377,48 @@ int Application::main(int argc, char** argv) {
     //         << LexicalCast<HttpServerConf, std::string>()(conf);
     // }
 
+    // prefork 工作进程数
+    int32_t workers = g_server_worker_processes->getValue();
+    if (workers < 0) {
+        workers = GetCpuCount();
+    }
+    if (workers == 0) {
+        // 单进程
+        return run_worker(0);
+    }
+
+    // prefork 主进程 bind 监听地址 工作进程 fork 后按地址接管
+    if (!listen_all()) {
+        return -1;
+    }
+    // 热升级 监听已经就绪 旧主进程通知工作进程处理完连接后退出
+    HotUpgradeMgr::GetInstance()->notifyParent();
+    return start_prefork(workers,
+                         std::bind(&Application::run_worker, this,
+                                   std::placeholders::_1),
+                         std::bind(&Application::upgrade, this));
+}
+
+/**
+ * @brief 工作进程主函数 单进程时也在主进程中调用
+ *
+ * @param index 工作进程序号
+ * @return int
+ */
+int Application::run_worker(uint32_t index) {
+    // 热升级相关信号由 signalfd 处理 IO 调度器的线程继承屏蔽字
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR2);
+    sigaddset(&mask, SIGQUIT);
+    sigaddset(&mask, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
     // IO 调度器
     ljrserver::IOManager iom(1);
     // 调度任务
     iom.schedule(std::bind(&Application::run_fiber, this));
+    iom.schedule(std::bind(&Application::signal_fiber, this, mask));
     // 停止调度
     // iom.stop();
     // 程序结束
@@ -248,6 +431,11 @@ int Application::main(int argc, char** argv) {
  * @return int
  */
 int Application::run_fiber() {
+    // 命名的 IO 调度器 prefork 时在工作进程中创建
+    if (!WorkerMgr::GetInstance()->init()) {
+        exit_process(0);
+    }
+
     // http 服务器配置
     auto http_confs = g_http_servers_conf->getValue();
     for (auto& conf : http_confs) {
@@ -257,60 +445,42 @@ int Application::run_fiber() {
 
         // 构建成功的地址
         std::vector<Address::ptr> address;
-        for (auto& addr : conf.address) {
-            // 查找 :
-            size_t pos = addr.find(":");
-            if (pos == std::string::npos) {
-                // 找不到 : 端口
-                LJRSERVER_LOG_ERROR(g_logger) << "invalid address: " << addr;
-                // address.push_back(UnixAddress::ptr(new UnixAddress(addr)));
-                continue;
-            }
-            // 端口号
-            int32_t port = atoi(addr.substr(pos + 1).c_str());
-
-            // 127.0.0.1
-            auto ipaddr =
-                ljrserver::IPAddress::Create(addr.substr(0, pos).c_str(), port);
-            if (ipaddr) {
-                // 成功
-                address.push_back(ipaddr);
-                continue;
-            }
-
-            // 本机网卡地址
-            std::vector<std::pair<Address::ptr, uint32_t>> result;
-            if (ljrserver::Address::GetInterfaceAddresses(
-                    result, addr.substr(0, pos))) {
-                // 遍历网卡
-                for (auto& x : result) {
-                    // 获取地址
-                    auto ipaddr = std::dynamic_pointer_cast<IPAddress>(x.first);
-                    if (ipaddr) {
-                        ipaddr->setPort(port);
-                    }
-                    address.push_back(ipaddr);
-                }
-                // 成功
-                continue;
-            }
-
-            // 找其他地址
-            auto other_addr = ljrserver::Address::LookupAny(addr);
-            if (other_addr) {
-                // 成功
-                address.push_back(other_addr);
-                continue;
-            }
+        if (!parse_address(conf, address)) {
+            exit_process(0);
+        }
 
-            // 构建配置地址失败
-            LJRSERVER_LOG_ERROR(g_logger) << "invalid address: " << addr;
-            _exit(0);
+        // 调度器 没有配置时用主调度器
+        IOManager* worker = IOManager::GetThis();
+        IOManager* accept_worker = IOManager::GetThis();
+        if (!conf.worker.empty()) {
+            worker = WorkerMgr::GetInstance()->get(conf.worker);
+        }
+        if (!conf.accept_worker.empty()) {
+            accept_worker = WorkerMgr::GetInstance()->get(conf.accept_worker);
+        }
+        if (!worker || !accept_worker) {
+            LJRSERVER_LOG_ERROR(g_logger)
+                << "iomanager not exists worker = " << conf.worker
+                << " accept_worker = " << conf.accept_worker;
+            exit_process(0);
         }
 
         // http 服务器
         ljrserver::http::HttpServer::ptr server(
-            new ljrserver::http::HttpServer(conf.keepalive));
+            new ljrserver::http::HttpServer(conf.keepalive, worker,
+                                            accept_worker));
+        // socket 选项 bind 前设置
+        server->setSocketOptions(conf.socket);
+        // https 证书 bind 前加载
+        if (conf.ssl &&
+            !server->loadCertificates(
+                EnvMgr::GetInstance()->getAbsolutePath(conf.cert_file),
+                EnvMgr::GetInstance()->getAbsolutePath(conf.key_file))) {
+            LJRSERVER_LOG_ERROR(g_logger)
+                << "load certificates fail cert_file = " << conf.cert_file
+                << " key_file = " << conf.key_file;
+            exit_process(0);
+        }
         // bind 失败的地址
         std::vector<Address::ptr> fails;
         if (!server->bind(address, fails)) {
@@ -319,14 +489,186 @@ int Application::run_fiber() {
                 // 打印失败的地址
                 LJRSERVER_LOG_ERROR(g_logger) << "bind address fail:" << *addr;
             }
-            _exit(0);
+            exit_process(0);
         }
 
         // 启动服务器
         server->start();
         m_httpservers.push_back(server);
     }
+
+    // 热升级 没有接管的监听句柄关闭 通知旧进程退出
+    HotUpgradeMgr::GetInstance()->closeUnused();
+    HotUpgradeMgr::GetInstance()->notifyParent();
+
+    // prefork 工作进程定时上报统计
+    WorkerInfo* info = GetWorkerInfo();
+    if (info) {
+        IOManager::GetThis()->addTimer(
+            s_worker_stats_interval_ms,
+            [this, info]() {
+                uint64_t connections = 0;
+                uint64_t accepted = 0;
+                uint64_t rejected = 0;
+                for (auto& server : m_httpservers) {
+                    connections += server->getConnectionCount();
+                    accepted += server->getAcceptedCount();
+                    rejected += server->getRejectedCount();
+                }
+                info->connections = connections;
+                info->accepted = accepted;
+                info->rejected = rejected;
+            },
+            true);
+    }
     return 0;
 }
 
+/**
+ * @brief prefork 主进程 bind 所有监听地址
+ *
+ * 监听句柄登记到 HotUpgradeMgr 工作进程的 TcpServer::bind 按地址接管
+ * 设置 SO_REUSEPORT 工作进程开启 tcp_server.reuse_port 时每线程的
+ * 监听 socket 能加入同一个组
+ *
+ * @return true
+ * @return false
+ */
+bool Application::listen_all() {
+    auto http_confs = g_http_servers_conf->getValue();
+    for (auto& conf : http_confs) {
+        std::vector<Address::ptr> address;
+        if (!parse_address(conf, address)) {
+            return false;
+        }
+        for (auto& addr : address) {
+            Socket::ptr sock = Socket::CreateTCP(addr);
+            // 热升级时接管旧主进程的监听句柄
+            int fd = HotUpgradeMgr::GetInstance()->take(addr);
+            if (fd != -1 && !sock->attach(fd)) {
+                close(fd);
+                fd = -1;
+            }
+            if (fd == -1) {
+                sock->setReusePort(true);
+                if (!sock->bind(addr) || !sock->listen(conf.socket.backlog)) {
+                    LJRSERVER_LOG_ERROR(g_logger)
+                        << "bind address fail:" << *addr;
+                    return false;
+                }
+            }
+            m_listenSocks.push_back(sock);
+        }
+    }
+
+    HotUpgradeMgr::GetInstance()->closeUnused();
+    for (auto& sock : m_listenSocks) {
+        HotUpgradeMgr::GetInstance()->add(sock->getSocket());
+    }
+    return true;
+}
+
+/**
+ * @brief 热升级 启动新的二进制文件 监听句柄传给新进程
+ *
+ */
+void Application::upgrade() {
+    std::vector<int> fds;
+    // prefork 主进程
+    for (auto& sock : m_listenSocks) {
+        fds.push_back(sock->getSocket());
+    }
+    // 单进程
+    for (auto& server : m_httpservers) {
+        for (auto& sock : server->getSocks()) {
+            fds.push_back(sock->getSocket());
+        }
+    }
+    LJRSERVER_LOG_INFO(g_logger) << "hot upgrade listen fds = " << fds.size();
+    HotUpgradeMgr::GetInstance()->exec(m_argv, fds);
+}
+
+/**
+ * @brief 信号协程
+ *
+ * SIGUSR2 热升级 启动新的二进制文件 监听句柄传给新进程
+ * SIGQUIT 停止 accept 处理完已有的连接后退出 新进程启动完成后发送
+ * SIGCHLD 回收热升级启动失败的子进程
+ *
+ * @param mask 处理的信号
+ */
+void Application::signal_fiber(sigset_t mask) {
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "signalfd fail errno = " << errno
+            << " errno-string = " << strerror(errno);
+        return;
+    }
+
+    while (true) {
+        signalfd_siginfo info;
+        ssize_t n = read(fd, &info, sizeof(info));
+        if (n != sizeof(info)) {
+            if (n == -1 && errno == EAGAIN) {
+                // 没有信号时挂起协程
+                IOManager::GetThis()->addEvent(fd, IOManager::READ);
+                Fiber::YieldToHold();
+            }
+            continue;
+        }
+
+        if (info.ssi_signo == SIGUSR2) {
+            // 热升级 prefork 时由主进程处理
+            if (!GetWorkerInfo()) {
+                upgrade();
+            }
+        } else if (info.ssi_signo == SIGQUIT) {
+            drain();
+        } else if (info.ssi_signo == SIGCHLD) {
+            int status = 0;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                LJRSERVER_LOG_ERROR(g_logger)
+                    << "hot upgrade child exit pid = " << pid
+                    << " status = " << status;
+            }
+        }
+    }
+}
+
+/**
+ * @brief 停止接受新连接 等已有的连接处理完后退出进程
+ *
+ * 监听句柄在新进程中还打开着 连接排队在新进程 不会被拒绝
+ * 超过 server.drain_timeout 时不再等待
+ *
+ */
+void Application::drain() {
+    LJRSERVER_LOG_INFO(g_logger) << "drain start pid = " << getpid();
+    for (auto &server : m_httpservers) {
+        server->stop();
+    }
+
+    uint64_t start = ljrserver::Clock::NowMS();
+    uint64_t timeout = g_server_drain_timeout->getValue();
+    while (true) {
+        uint64_t connections = 0;
+        for (auto &server : m_httpservers) {
+            connections += server->getConnectionCount();
+        }
+        if (connections == 0) {
+            break;
+        }
+        if (ljrserver::Clock::NowMS() - start >= timeout) {
+            LJRSERVER_LOG_WARN(g_logger)
+                << "drain timeout connections = " << connections;
+            break;
+        }
+        usleep(s_drain_interval_us);
+    }
+    LJRSERVER_LOG_INFO(g_logger) << "drain finished pid = " << getpid();
+    exit_process(0);
+}
+
 };  // namespace ljrserver
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 #include "http/http_server.h"
 
+#include <signal.h>
 #include <vector>
 
 namespace ljrserver {
@@ -26,8 +27,18 @@ public:
 private:
     int main(int argc, char** argv);
 
+    int run_worker(uint32_t index);
+
     int run_fiber();
 
+    bool listen_all();
+
+    void upgrade();
+
+    void signal_fiber(sigset_t mask);
+
+    void drain();
+
 private:
     int m_argc = 0;
 
@@ -36,6 +47,9 @@ private:
     static Application* s_instance;
 
     std::vector<ljrserver::http::HttpServer::ptr> m_httpservers;
+
+    // prefork 主进程的监听 socket
+    std::vector<Socket::ptr> m_listenSocks;
 };
 
 };  // namespace ljrserver
\ No newline at end of file
@@ -0,0 +1,199 @@
+/**
+ * @file async_file.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 异步文件 IO
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "async_file.h"
+
+// IO 管理
+#include "iomanager.h"
+// 系统函数
+#include "hook.h"
+// 配置
+#include "config.h"
+// 日志
+#include "log.h"
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+
+namespace ljrserver {
+
+// system 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
+
+// 文件 IO 线程池的线程数
+static ljrserver::ConfigVar<int>::ptr g_fileio_threads =
+    ljrserver::Config::Lookup("fileio.threads", 4, "file io thread pool size");
+
+/**
+ * @brief 文件 IO 线程池 第一次使用时创建
+ *
+ * 使用 IOManager 空闲时阻塞在 epoll_wait 上 不会空转
+ * 随进程退出 不析构
+ *
+ * @return IOManager*
+ */
+static IOManager *GetFileIOPool() {
+    static IOManager *s_pool =
+        new IOManager(std::max(1, g_fileio_threads->getValue()), false,
+                      "fileio");
+    return s_pool;
+}
+
+/**
+ * @brief 打开文件
+ *
+ * @param path 路径
+ * @param flags O_RDONLY O_WRONLY O_CREAT ...
+ * @param mode 创建文件的权限 [= 0644]
+ * @return AsyncFile::ptr 失败返回 nullptr
+ */
+AsyncFile::ptr AsyncFile::Open(const std::string &path, int flags,
+                               mode_t mode) {
+    int fd = -1;
+    int error = 0;
+    // 打开文件也可能阻塞在磁盘上
+    Run([&]() {
+        fd = ::open(path.c_str(), flags | O_CLOEXEC, mode);
+        error = errno;
+    });
+
+    if (fd < 0) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "AsyncFile::Open path=" << path << " errno=" << error
+            << " errno-string=" << strerror(error);
+        errno = error;
+        return nullptr;
+    }
+    return AsyncFile::ptr(new AsyncFile(fd));
+}
+
+/**
+ * @brief 执行阻塞的任务 当前协程挂起直到完成
+ *
+ * @param cb 任务
+ */
+void AsyncFile::Run(std::function<void()> cb) {
+    IOManager *iom = IOManager::GetThis();
+    if (!is_hook_enable() || !iom || iom == GetFileIOPool()) {
+        // 不在 IOManager 协程中 或者已经在线程池中 直接执行
+        cb();
+        return;
+    }
+
+    // 线程池执行完毕后 把当前协程调度回原来的 IOManager
+    Fiber::ptr fiber = Fiber::GetThis();
+    GetFileIOPool()->schedule([cb, fiber, iom]() {
+        cb();
+        iom->schedule(fiber);
+    });
+
+    // 挂起 cb 引用的栈上变量在挂起期间有效
+    Fiber::YieldToHold();
+}
+
+/**
+ * @brief 异步文件构造函数
+ *
+ * @param fd 文件句柄
+ * @param owner 析构是否关闭文件 [= true]
+ */
+AsyncFile::AsyncFile(int fd, bool owner) : m_fd(fd), m_owner(owner) {}
+
+/**
+ * @brief 异步文件析构函数
+ *
+ */
+AsyncFile::~AsyncFile() {
+    if (m_owner) {
+        close();
+    }
+}
+
+/**
+ * @brief 从 offset 处读取
+ *
+ * @param buffer
+ * @param length
+ * @param offset
+ * @return ssize_t 读取的字节数 -1 失败
+ */
+ssize_t AsyncFile::pread(void *buffer, size_t length, off_t offset) {
+    ssize_t rt = -1;
+    int error = 0;
+    Run([&]() {
+        rt = pread_f(m_fd, buffer, length, offset);
+        error = errno;
+    });
+    errno = error;
+    return rt;
+}
+
+/**
+ * @brief 写入到 offset 处
+ *
+ * @param buffer
+ * @param length
+ * @param offset
+ * @return ssize_t 写入的字节数 -1 失败
+ */
+ssize_t AsyncFile::pwrite(const void *buffer, size_t length, off_t offset) {
+    ssize_t rt = -1;
+    int error = 0;
+    Run([&]() {
+        rt = pwrite_f(m_fd, buffer, length, offset);
+        error = errno;
+    });
+    errno = error;
+    return rt;
+}
+
+/**
+ * @brief 刷新到磁盘
+ *
+ * @return int
+ */
+int AsyncFile::fsync() {
+    int rt = -1;
+    int error = 0;
+    Run([&]() {
+        rt = ::fsync(m_fd);
+        error = errno;
+    });
+    errno = error;
+    return rt;
+}
+
+/**
+ * @brief 文件大小
+ *
+ * @return int64_t -1 失败
+ */
+int64_t AsyncFile::getSize() {
+    struct stat st;
+    if (fstat(m_fd, &st)) {
+        return -1;
+    }
+    return st.st_size;
+}
+
+/**
+ * @brief 关闭文件
+ *
+ * @return int
+ */
+int AsyncFile::close() {
+    if (m_fd < 0) {
+        return 0;
+    }
+    int rt = ::close(m_fd);
+    m_fd = -1;
+    return rt;
+}
+
+}  // namespace ljrserver
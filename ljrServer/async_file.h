@@ -0,0 +1,122 @@
+/**
+ * @file async_file.h
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 异步文件 IO
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <functional>
+
+// off_t mode_t
+#include <sys/types.h>
+
+namespace ljrserver {
+
+/**
+ * @brief Class 异步文件
+ *
+ * 普通文件不能用 epoll 等待 直接读写会在缺页和磁盘延迟上阻塞调度线程
+ * 在开启 hook 的 IOManager 协程中 阻塞的文件操作交给文件 IO 线程池执行
+ * 当前协程挂起 完成后由线程池把协程调度回原来的 IOManager
+ * 其他线程中直接执行
+ */
+class AsyncFile {
+public:
+    // 智能指针
+    typedef std::shared_ptr<AsyncFile> ptr;
+
+    /**
+     * @brief 打开文件
+     *
+     * @param path 路径
+     * @param flags O_RDONLY O_WRONLY O_CREAT ...
+     * @param mode 创建文件的权限 [= 0644]
+     * @return AsyncFile::ptr 失败返回 nullptr
+     */
+    static AsyncFile::ptr Open(const std::string &path, int flags,
+                               mode_t mode = 0644);
+
+    /**
+     * @brief 执行阻塞的任务 当前协程挂起直到完成
+     *
+     * @param cb 任务
+     */
+    static void Run(std::function<void()> cb);
+
+public:
+    /**
+     * @brief 异步文件构造函数
+     *
+     * @param fd 文件句柄
+     * @param owner 析构是否关闭文件 [= true]
+     */
+    AsyncFile(int fd, bool owner = true);
+
+    /**
+     * @brief 异步文件析构函数
+     *
+     */
+    ~AsyncFile();
+
+    /**
+     * @brief 从 offset 处读取
+     *
+     * @param buffer
+     * @param length
+     * @param offset
+     * @return ssize_t 读取的字节数 -1 失败
+     */
+    ssize_t pread(void *buffer, size_t length, off_t offset);
+
+    /**
+     * @brief 写入到 offset 处
+     *
+     * @param buffer
+     * @param length
+     * @param offset
+     * @return ssize_t 写入的字节数 -1 失败
+     */
+    ssize_t pwrite(const void *buffer, size_t length, off_t offset);
+
+    /**
+     * @brief 刷新到磁盘
+     *
+     * @return int
+     */
+    int fsync();
+
+    /**
+     * @brief 文件大小
+     *
+     * @return int64_t -1 失败
+     */
+    int64_t getSize();
+
+    /**
+     * @brief 关闭文件
+     *
+     * @return int
+     */
+    int close();
+
+    /**
+     * @brief 获取文件句柄
+     *
+     * @return int
+     */
+    int getFd() const { return m_fd; }
+
+private:
+    // 文件句柄
+    int m_fd;
+
+    // 析构是否关闭文件
+    bool m_owner;
+};
+
+}  // namespace ljrserver
@@ -0,0 +1,296 @@
+/**
+ * @file buffered_stream.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 带缓存的流
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "buffered_stream.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace ljrserver {
+
+/**
+ * @brief 带缓存的流构造函数
+ *
+ * @param stream 被装饰的流
+ * @param read_buffer_size 读缓存大小
+ * @param write_buffer_size 写缓存大小
+ * @param owner close 时是否关闭被装饰的流
+ */
+BufferedStream::BufferedStream(Stream::ptr stream, size_t read_buffer_size,
+                               size_t write_buffer_size, bool owner)
+    : m_stream(stream),
+      m_readBuffer(std::max<size_t>(read_buffer_size, 1)),
+      m_writeBuffer(write_buffer_size),
+      m_owner(owner) {}
+
+/**
+ * @brief 发送写缓存 owner 时关闭被装饰的流
+ *
+ */
+void BufferedStream::close() {
+    flush();
+    if (m_owner) {
+        m_stream->close();
+    }
+}
+
+/**
+ * @brief 读取数据到 buffer 先取缓存中的数据
+ *
+ * @param buffer
+ * @param length
+ * @return int
+ */
+int BufferedStream::read(void *buffer, size_t length) {
+    if (getReadSize() == 0) {
+        if (length >= m_readBuffer.size()) {
+            // 大块读取 不经过缓存
+            return m_stream->read(buffer, length);
+        }
+        int rt = fill(1);
+        if (rt <= 0) {
+            return rt;
+        }
+    }
+    size_t len = std::min(length, getReadSize());
+    memcpy(buffer, &m_readBuffer[m_readPos], len);
+    consume(len);
+    return len;
+}
+
+/**
+ * @brief 读取数据到 byte array 先取缓存中的数据
+ *
+ * @param ba
+ * @param length
+ * @return int
+ */
+int BufferedStream::read(ByteArray::ptr ba, size_t length) {
+    if (getReadSize() == 0) {
+        if (length >= m_readBuffer.size()) {
+            return m_stream->read(ba, length);
+        }
+        int rt = fill(1);
+        if (rt <= 0) {
+            return rt;
+        }
+    }
+    size_t len = std::min(length, getReadSize());
+    ba->write(&m_readBuffer[m_readPos], len);
+    consume(len);
+    return len;
+}
+
+/**
+ * @brief 读取到缓存中至少有 length 字节
+ *
+ * @param length
+ * @return int 缓存中的字节数 0 对端关闭 < 0 失败
+ */
+int BufferedStream::fill(size_t length) {
+    size_t capacity = m_readBuffer.size();
+    if (length > capacity) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    while (getReadSize() < length) {
+        if (m_readPos + length > capacity) {
+            // 后面的空间不够 没有读取的数据移到开头
+            size_t size = getReadSize();
+            memmove(&m_readBuffer[0], &m_readBuffer[m_readPos], size);
+            m_readPos = 0;
+            m_readEnd = size;
+        }
+        int rt =
+            m_stream->read(&m_readBuffer[m_readEnd], capacity - m_readEnd);
+        if (rt <= 0) {
+            return rt;
+        }
+        m_readEnd += rt;
+    }
+    return getReadSize();
+}
+
+/**
+ * @brief 查看缓存中的数据 不消费
+ *
+ * @param data 指向缓存的指针
+ * @param length 至少需要的字节数
+ * @return int 同 fill
+ */
+int BufferedStream::peek(const char *&data, size_t length) {
+    int rt = fill(length);
+    data = &m_readBuffer[m_readPos];
+    return rt;
+}
+
+/**
+ * @brief 消费缓存中的数据
+ *
+ * @param length
+ */
+void BufferedStream::consume(size_t length) {
+    m_readPos += std::min(length, getReadSize());
+    if (m_readPos == m_readEnd) {
+        // 读完了 下次从头开始
+        m_readPos = m_readEnd = 0;
+    }
+}
+
+/**
+ * @brief 读取到分隔符为止 包含分隔符
+ *
+ * @param delim 分隔符
+ * @param delim_len 分隔符长度
+ * @param data 指向缓存的指针
+ * @param max 最大长度
+ * @return int 长度 0 对端关闭 < 0 失败
+ */
+int BufferedStream::readUntil(const char *delim, size_t delim_len,
+                              const char *&data, size_t max) {
+    if (max == 0 || max > m_readBuffer.size()) {
+        max = m_readBuffer.size();
+    }
+    // 已经查找过的字节数 新数据到达后从分隔符可能跨越的位置继续查找
+    size_t scanned = 0;
+    while (true) {
+        const char *begin = &m_readBuffer[m_readPos];
+        size_t size = getReadSize();
+        size_t start = scanned >= delim_len ? scanned - delim_len + 1 : 0;
+        const char *found = (const char *)memmem(begin + start, size - start,
+                                                 delim, delim_len);
+        if (found) {
+            size_t len = found - begin + delim_len;
+            if (len > max) {
+                errno = EMSGSIZE;
+                return -1;
+            }
+            data = begin;
+            consume(len);
+            return len;
+        }
+        if (size >= max) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        scanned = size;
+        int rt = fill(size + 1);
+        if (rt <= 0) {
+            return rt;
+        }
+    }
+}
+
+/**
+ * @brief 读取一行 包含结尾的 \n
+ *
+ * @param data 指向缓存的指针
+ * @param max 最大长度
+ * @return int 同 readUntil
+ */
+int BufferedStream::readLine(const char *&data, size_t max) {
+    return readUntil("\n", 1, data, max);
+}
+
+/**
+ * @brief 写入 buffer 中的数据 小块数据攒在缓存中
+ *
+ * @param buffer
+ * @param length
+ * @return int
+ */
+int BufferedStream::write(const void *buffer, size_t length) {
+    if (m_writeSize + length <= m_writeBuffer.size()) {
+        memcpy(m_writeBuffer.data() + m_writeSize, buffer, length);
+        m_writeSize += length;
+        return length;
+    }
+    // 超过阈值 先发送缓存
+    if (!flush()) {
+        return -1;
+    }
+    if (length >= m_writeBuffer.size()) {
+        // 大块数据直接写入
+        return m_stream->write(buffer, length);
+    }
+    memcpy(m_writeBuffer.data(), buffer, length);
+    m_writeSize = length;
+    return length;
+}
+
+/**
+ * @brief 写入 byte array 中的数据 小块数据攒在缓存中
+ *
+ * @param ba
+ * @param length
+ * @return int
+ */
+int BufferedStream::write(ByteArray::ptr ba, size_t length) {
+    if (m_writeSize + length > m_writeBuffer.size()) {
+        if (!flush()) {
+            return -1;
+        }
+        if (length >= m_writeBuffer.size()) {
+            return m_stream->write(ba, length);
+        }
+    }
+    ba->read(m_writeBuffer.data() + m_writeSize, length);
+    m_writeSize += length;
+    return length;
+}
+
+/**
+ * @brief 分散写入 小块数据攒在缓存中
+ *
+ * @param buffers 数据块
+ * @param length 数据块个数
+ * @return int 写入的字节数
+ */
+int BufferedStream::writev(const iovec *buffers, size_t length) {
+    size_t total = 0;
+    for (size_t i = 0; i < length; ++i) {
+        total += buffers[i].iov_len;
+    }
+    if (m_writeSize + total <= m_writeBuffer.size()) {
+        for (size_t i = 0; i < length; ++i) {
+            memcpy(m_writeBuffer.data() + m_writeSize, buffers[i].iov_base,
+                   buffers[i].iov_len);
+            m_writeSize += buffers[i].iov_len;
+        }
+        return total;
+    }
+    // 写缓存在前 一次发送
+    std::vector<iovec> iovs;
+    iovs.reserve(length + 1);
+    if (m_writeSize) {
+        iovs.push_back({m_writeBuffer.data(), m_writeSize});
+    }
+    iovs.insert(iovs.end(), buffers, buffers + length);
+    int rt = m_stream->writeFixSizeV(&iovs[0], iovs.size());
+    m_writeSize = 0;
+    return rt <= 0 ? rt : total;
+}
+
+/**
+ * @brief 发送写缓存中的数据
+ *
+ * @return true
+ * @return false
+ */
+bool BufferedStream::flush() {
+    if (m_writeSize == 0) {
+        return true;
+    }
+    int rt = m_stream->writeFixSize(m_writeBuffer.data(), m_writeSize);
+    m_writeSize = 0;
+    return rt > 0;
+}
+
+}  // namespace ljrserver
@@ -0,0 +1,191 @@
+/**
+ * @file buffered_stream.h
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 带缓存的流
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "stream.h"
+
+namespace ljrserver {
+
+/**
+ * @brief 带缓存的流 装饰任意 Stream
+ *
+ * 读 预读到复用的缓存中 小块读取不再每次都调用 recv
+ * peek readLine readUntil 返回指向缓存的指针 不拷贝
+ * 指针在下一次读取前有效
+ *
+ * 写 小块数据先攒在缓存中 flush 或超过阈值时一次发送
+ * 大块数据先 flush 再直接写入 不经过缓存
+ *
+ * 继承自 Stream
+ */
+class BufferedStream : public Stream {
+public:
+    // 智能指针
+    typedef std::shared_ptr<BufferedStream> ptr;
+
+    /**
+     * @brief 带缓存的流构造函数
+     *
+     * @param stream 被装饰的流
+     * @param read_buffer_size 读缓存大小 也是 readUntil 单帧的上限 [= 4096]
+     * @param write_buffer_size 写缓存大小 写入超过时发送 [= 4096]
+     * @param owner close 时是否关闭被装饰的流 [= true]
+     */
+    BufferedStream(Stream::ptr stream, size_t read_buffer_size = 4096,
+                   size_t write_buffer_size = 4096, bool owner = true);
+
+    /**
+     * @brief 发送写缓存 owner 时关闭被装饰的流
+     *
+     */
+    void close() override;
+
+public:  /// 读取
+    /**
+     * @brief 读取数据到 buffer 先取缓存中的数据
+     *
+     * 缓存为空且 length 不小于读缓存时直接读取
+     *
+     * @param buffer
+     * @param length
+     * @return int
+     */
+    int read(void *buffer, size_t length) override;
+
+    /**
+     * @brief 读取数据到 byte array 先取缓存中的数据
+     *
+     * @param ba
+     * @param length
+     * @return int
+     */
+    int read(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 读取到缓存中至少有 length 字节
+     *
+     * @param length
+     * @return int 缓存中的字节数 0 对端关闭 < 0 失败
+     *         length 超过读缓存时返回 -1 errno = EMSGSIZE
+     */
+    int fill(size_t length);
+
+    /**
+     * @brief 查看缓存中的数据 不消费
+     *
+     * @param data 指向缓存的指针
+     * @param length 至少需要的字节数 [= 1]
+     * @return int 同 fill
+     */
+    int peek(const char *&data, size_t length = 1);
+
+    /**
+     * @brief 消费缓存中的数据
+     *
+     * @param length 不超过 getReadSize
+     */
+    void consume(size_t length);
+
+    /**
+     * @brief 读取到分隔符为止 包含分隔符
+     *
+     * @param delim 分隔符
+     * @param delim_len 分隔符长度
+     * @param data 指向缓存的指针
+     * @param max 最大长度 [= 0 读缓存大小]
+     * @return int 长度 0 对端关闭 < 0 失败
+     *         超过 max 还没有分隔符时返回 -1 errno = EMSGSIZE
+     */
+    int readUntil(const char *delim, size_t delim_len, const char *&data,
+                  size_t max = 0);
+
+    /**
+     * @brief 读取一行 包含结尾的 \n
+     *
+     * @param data 指向缓存的指针
+     * @param max 最大长度 [= 0 读缓存大小]
+     * @return int 同 readUntil
+     */
+    int readLine(const char *&data, size_t max = 0);
+
+    // 缓存中还没有读取的字节数
+    size_t getReadSize() const { return m_readEnd - m_readPos; }
+
+    // 读缓存大小
+    size_t getReadBufferSize() const { return m_readBuffer.size(); }
+
+public:  /// 写入
+    /**
+     * @brief 写入 buffer 中的数据 小块数据攒在缓存中
+     *
+     * @param buffer
+     * @param length
+     * @return int
+     */
+    int write(const void *buffer, size_t length) override;
+
+    /**
+     * @brief 写入 byte array 中的数据 小块数据攒在缓存中
+     *
+     * @param ba
+     * @param length
+     * @return int
+     */
+    int write(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 分散写入 小块数据攒在缓存中
+     *
+     * 超过阈值时写缓存和数据块一起 writev 不拼接
+     *
+     * @param buffers 数据块
+     * @param length 数据块个数
+     * @return int 写入的字节数
+     */
+    int writev(const iovec *buffers, size_t length) override;
+
+    /**
+     * @brief 发送写缓存中的数据
+     *
+     * @return true
+     * @return false
+     */
+    bool flush();
+
+    // 写缓存中还没有发送的字节数
+    size_t getWriteSize() const { return m_writeSize; }
+
+public:
+    // 被装饰的流
+    Stream::ptr getStream() const { return m_stream; }
+
+private:
+    // 被装饰的流
+    Stream::ptr m_stream;
+
+    // 读缓存
+    std::vector<char> m_readBuffer;
+
+    // 读缓存中没有读取的数据 [m_readPos, m_readEnd)
+    size_t m_readPos = 0;
+    size_t m_readEnd = 0;
+
+    // 写缓存
+    std::vector<char> m_writeBuffer;
+
+    // 写缓存中的数据大小
+    size_t m_writeSize = 0;
+
+    // close 时是否关闭被装饰的流
+    bool m_owner;
+};
+
+}  // namespace ljrserver
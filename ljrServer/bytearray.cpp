@@ -5,8 +5,22 @@
 #include "endian.h"
 // 日志
 #include "log.h"
+// 配置
+#include "config.h"
+// 互斥量
+#include "thread.h"
+// placement new
+#include <new>
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+#include <map>
 // 字符串
 #include <string.h>
+// SSE
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 // #include <sstream>
 // io << std::hex
 #include <iomanip>
@@ -16,27 +30,452 @@ namespace ljrserver {
 // 系统日志
 static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
 
+// 约定 内存块池缓存的最大内存块
+static ljrserver::ConfigVar<uint64_t>::ptr g_pool_max_block_size =
+    ljrserver::Config::Lookup("bytearray.pool.max_block_size",
+                              (uint64_t)(64 * 1024),
+                              "bytearray pool max block size");
+
+// 约定 每个线程每种大小缓存的内存块上限
+static ljrserver::ConfigVar<uint32_t>::ptr g_pool_thread_cache =
+    ljrserver::Config::Lookup("bytearray.pool.thread_cache", (uint32_t)64,
+                              "bytearray pool thread cache blocks");
+
+// 约定 全局每种大小缓存的内存块上限
+static ljrserver::ConfigVar<uint32_t>::ptr g_pool_global_cache =
+    ljrserver::Config::Lookup("bytearray.pool.global_cache", (uint32_t)1024,
+                              "bytearray pool global cache blocks");
+
+// 配置值的缓存 避免每次分配都读配置加锁
+static uint64_t s_pool_max_block_size = 64 * 1024;
+static uint32_t s_pool_thread_cache = 64;
+static uint32_t s_pool_global_cache = 1024;
+
+/**
+ * @brief 匿名命名空间
+ *
+ */
+namespace {
+
+/**
+ * @brief 初始化内存块池配置
+ *
+ */
+struct _PoolIniter {
+    _PoolIniter() {
+        s_pool_max_block_size = g_pool_max_block_size->getValue();
+        s_pool_thread_cache = g_pool_thread_cache->getValue();
+        s_pool_global_cache = g_pool_global_cache->getValue();
+
+        // 添加配置变更监听事件 及时更新配置
+        g_pool_max_block_size->addListener(
+            [](const uint64_t &old_value, const uint64_t &new_value) {
+                s_pool_max_block_size = new_value;
+            });
+        g_pool_thread_cache->addListener(
+            [](const uint32_t &old_value, const uint32_t &new_value) {
+                s_pool_thread_cache = new_value;
+            });
+        g_pool_global_cache->addListener(
+            [](const uint32_t &old_value, const uint32_t &new_value) {
+                s_pool_global_cache = new_value;
+            });
+    }
+};
+
+static _PoolIniter _pool_init;
+
+/**
+ * @brief 空闲内存块链表 空闲块的开头存放下一块的地址
+ *
+ */
+struct FreeList {
+    // 内存块大小
+    size_t size = 0;
+    // 链表头
+    void *head = nullptr;
+    // 内存块数
+    size_t count = 0;
+
+    void push(void *p) {
+        *(void **)p = head;
+        head = p;
+        ++count;
+    }
+
+    void *pop() {
+        void *p = head;
+        head = *(void **)p;
+        --count;
+        return p;
+    }
+};
+
+/**
+ * @brief 全局缓存 按大小分组
+ *
+ */
+struct GlobalCache {
+    Mutex mutex;
+    std::map<size_t, FreeList> lists;
+};
+
+/**
+ * @brief 获取全局缓存 不析构 线程退出和静态对象析构时仍可以归还
+ *
+ * @return GlobalCache&
+ */
+static GlobalCache &GetGlobalCache() {
+    static GlobalCache *s_cache = new GlobalCache;
+    return *s_cache;
+}
+
+/**
+ * @brief 统计 只保证计数本身原子
+ *
+ */
+struct AtomicStats {
+#define XX(name) std::atomic<uint64_t> name{0};
+    XX(alloc)
+    XX(free)
+    XX(thread_hit)
+    XX(global_hit)
+    XX(miss)
+    XX(release)
+#undef XX
+};
+
+static AtomicStats s_stats;
+
+// 统计计数 +n
+#define STAT_ADD(name, n) \
+    s_stats.name.fetch_add(n, std::memory_order_relaxed)
+
+/**
+ * @brief 从全局缓存取最多 n 块
+ *
+ * @param size 内存块大小
+ * @param n 块数
+ * @param to 除返回的一块外 其余放入 to
+ * @return void* 没有缓存返回 nullptr
+ */
+static void *GlobalFetch(size_t size, size_t n, FreeList *to) {
+    GlobalCache &g = GetGlobalCache();
+    Mutex::Lock lock(g.mutex);
+    auto it = g.lists.find(size);
+    if (it == g.lists.end() || it->second.count == 0) {
+        return nullptr;
+    }
+    FreeList &list = it->second;
+    void *p = list.pop();
+    while (to && --n > 0 && list.count > 0) {
+        to->push(list.pop());
+    }
+    return p;
+}
+
+/**
+ * @brief 从 from 归还 n 块到全局缓存 超过上限的 delete
+ *
+ * @param from
+ * @param n
+ */
+static void GlobalPut(FreeList &from, size_t n) {
+    FreeList overflow;
+    {
+        GlobalCache &g = GetGlobalCache();
+        Mutex::Lock lock(g.mutex);
+        FreeList &list = g.lists[from.size];
+        list.size = from.size;
+        while (n-- > 0 && from.count > 0) {
+            void *p = from.pop();
+            if (list.count < s_pool_global_cache) {
+                list.push(p);
+            } else {
+                overflow.push(p);
+            }
+        }
+    }
+    STAT_ADD(release, overflow.count);
+    while (overflow.count > 0) {
+        delete[] (char *)overflow.pop();
+    }
+}
+
+// 线程缓存是否已经析构
+static thread_local bool t_cache_destroyed = false;
+
+/**
+ * @brief 线程缓存 按大小分组 一般只有一两种大小
+ *
+ */
+struct ThreadCache {
+    std::vector<FreeList> lists;
+
+    /**
+     * @brief 线程退出 全部归还到全局缓存
+     *
+     */
+    ~ThreadCache() {
+        for (auto &list : lists) {
+            GlobalPut(list, list.count);
+        }
+        t_cache_destroyed = true;
+    }
+
+    FreeList &get(size_t size) {
+        for (auto &list : lists) {
+            if (list.size == size) {
+                return list;
+            }
+        }
+        lists.push_back(FreeList());
+        lists.back().size = size;
+        return lists.back();
+    }
+};
+
+static thread_local ThreadCache t_cache;
+
+}  // namespace
+
+/**
+ * @brief 分配 size 字节的内存块
+ *
+ * @param size
+ * @return void*
+ */
+void *ByteArrayPool::Alloc(size_t size) {
+    STAT_ADD(alloc, 1);
+    if (size <= s_pool_max_block_size) {
+        void *p = nullptr;
+        if (!t_cache_destroyed && s_pool_thread_cache > 0) {
+            FreeList &list = t_cache.get(size);
+            if (list.count > 0) {
+                STAT_ADD(thread_hit, 1);
+                return list.pop();
+            }
+            // 线程缓存为空 从全局缓存批量取一半
+            p = GlobalFetch(size, std::max<size_t>(1, s_pool_thread_cache / 2),
+                            &list);
+        } else {
+            p = GlobalFetch(size, 1, nullptr);
+        }
+        if (p) {
+            STAT_ADD(global_hit, 1);
+            return p;
+        }
+    }
+    STAT_ADD(miss, 1);
+    return new char[size];
+}
+
+/**
+ * @brief 释放 Alloc 分配的内存块
+ *
+ * @param ptr
+ * @param size
+ */
+void ByteArrayPool::Free(void *ptr, size_t size) {
+    STAT_ADD(free, 1);
+    if (size > s_pool_max_block_size) {
+        STAT_ADD(release, 1);
+        delete[] (char *)ptr;
+        return;
+    }
+    if (!t_cache_destroyed && s_pool_thread_cache > 0) {
+        FreeList &list = t_cache.get(size);
+        list.push(ptr);
+        if (list.count > s_pool_thread_cache) {
+            // 线程缓存满了 归还一半到全局缓存
+            GlobalPut(list, list.count / 2);
+        }
+        return;
+    }
+    FreeList tmp;
+    tmp.size = size;
+    tmp.push(ptr);
+    GlobalPut(tmp, 1);
+}
+
+/**
+ * @brief 获取统计
+ *
+ * @return ByteArrayPool::Stats
+ */
+ByteArrayPool::Stats ByteArrayPool::GetStats() {
+    Stats stats;
+#define XX(name) stats.name = s_stats.name.load(std::memory_order_relaxed);
+    XX(alloc)
+    XX(free)
+    XX(thread_hit)
+    XX(global_hit)
+    XX(miss)
+    XX(release)
+#undef XX
+    GlobalCache &g = GetGlobalCache();
+    Mutex::Lock lock(g.mutex);
+    for (auto &i : g.lists) {
+        stats.global_cached += i.second.count;
+    }
+    return stats;
+}
+
+/**
+ * @brief 释放全局缓存中的所有内存块
+ *
+ */
+void ByteArrayPool::Trim() {
+    FreeList all;
+    {
+        GlobalCache &g = GetGlobalCache();
+        Mutex::Lock lock(g.mutex);
+        for (auto &i : g.lists) {
+            while (i.second.count > 0) {
+                all.push(i.second.pop());
+            }
+        }
+    }
+    STAT_ADD(release, all.count);
+    while (all.count > 0) {
+        delete[] (char *)all.pop();
+    }
+}
+
+/**
+ * @brief 输出统计和全局缓存
+ *
+ * @param os
+ * @return std::ostream&
+ */
+std::ostream &ByteArrayPool::Dump(std::ostream &os) {
+    Stats stats = GetStats();
+    os << "[ByteArrayPool alloc=" << stats.alloc << " free=" << stats.free
+       << " thread_hit=" << stats.thread_hit
+       << " global_hit=" << stats.global_hit << " miss=" << stats.miss
+       << " release=" << stats.release
+       << " global_cached=" << stats.global_cached << "]" << std::endl;
+    GlobalCache &g = GetGlobalCache();
+    Mutex::Lock lock(g.mutex);
+    for (auto &i : g.lists) {
+        os << "    [block size=" << i.first << " cached=" << i.second.count
+           << "]" << std::endl;
+    }
+    return os;
+}
+
+#undef STAT_ADD
+
+/**
+ * @brief 内存块 头部带引用计数 数据紧跟在头部之后
+ *
+ * 头部 16 字节 数据按 16 字节对齐
+ */
+struct alignas(16) ByteArray::Block {
+    // 引用计数
+    std::atomic<uint32_t> ref;
+    // 数据大小
+    size_t size;
+
+    // 数据
+    char *data() { return (char *)(this + 1); }
+};
+
+/**
+ * @brief 分配内存块
+ *
+ * @param size 数据大小
+ * @param ref 初始引用计数
+ * @return ByteArray::Block*
+ */
+static ByteArray::Block *NewBlock(size_t size, uint32_t ref) {
+    void *p = ByteArrayPool::Alloc(sizeof(ByteArray::Block) + size);
+    ByteArray::Block *block = new (p) ByteArray::Block;
+    block->ref.store(ref, std::memory_order_relaxed);
+    block->size = size;
+    return block;
+}
+
+/**
+ * @brief 释放内存块的一个引用 归零时归还到内存块池
+ *
+ * @param block
+ */
+static void ReleaseBlock(ByteArray::Block *block) {
+    // 唯一的引用 不需要原子减
+    if (block->ref.load(std::memory_order_acquire) != 1 &&
+        block->ref.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    size_t total = sizeof(ByteArray::Block) + block->size;
+    block->~Block();
+    ByteArrayPool::Free(block, total);
+}
+
+/**
+ * @brief 节点的内存块是否还被其他节点引用
+ *
+ * @param node
+ * @return true
+ * @return false
+ */
+static bool IsShared(ByteArray::Node *node) {
+    return node->block &&
+           node->block->ref.load(std::memory_order_acquire) > 1;
+}
+
+/**
+ * @brief 释放 node 开始的节点链表
+ *
+ * @param node
+ */
+static void DeleteNodes(ByteArray::Node *node) {
+    while (node) {
+        ByteArray::Node *next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
 /**
  * @brief 数据节点构造函数 重载
  *
+ * 从内存块池分配
+ *
  * @param s
  */
-ByteArray::Node::Node(size_t s) : ptr(new char[s]), size(s), next(nullptr) {}
+ByteArray::Node::Node(size_t s)
+    : ptr(nullptr), size(s), next(nullptr), block(NewBlock(s, 1)) {
+    ptr = block->data();
+}
+
+/**
+ * @brief 数据节点构造函数 引用已有的内存块
+ *
+ * @param b 内存块
+ * @param p 节点数据的起始地址
+ * @param s 节点大小
+ */
+ByteArray::Node::Node(Block *b, char *p, size_t s)
+    : ptr(p), size(s), next(nullptr), block(b) {
+    block->ref.fetch_add(1, std::memory_order_relaxed);
+}
 
 /**
  * @brief 数据节点构造函数 默认
  *
  * 默认内存块大小为零
  */
-ByteArray::Node::Node() : ptr(nullptr), size(0), next(nullptr) {}
+ByteArray::Node::Node()
+    : ptr(nullptr), size(0), next(nullptr), block(nullptr) {}
 
 /**
  * @brief 数据节点析构函数
  *
  */
 ByteArray::Node::~Node() {
-    if (ptr) {
-        delete[] ptr;
+    if (block) {
+        ReleaseBlock(block);
     }
 }
 
@@ -54,7 +493,9 @@ ByteArray::ByteArray(size_t base_size)
       m_size(0),
       m_endian(LJRSERVER_BIG_ENDIAN),
       m_root(new Node(base_size)),
-      m_cur(m_root) {
+      m_cur(m_root),
+      m_tail(m_root),
+      m_curPos(0) {
     // 默认大端存储
 }
 
@@ -83,11 +524,8 @@ ByteArray::~ByteArray() {
  * @return uint32_t
  */
 static uint32_t EncodeZigzag32(const int32_t &v) {
-    if (v < 0) {
-        return ((uint32_t)(-v)) * 2 - 1;
-    } else {
-        return v * 2;
-    }
+    // 负数 -1 -2 ... 编码为 1 3 ... 非负数编码为 0 2 4 ...
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
 }
 
 /**
@@ -104,12 +542,9 @@ static int32_t DecodeZigzag32(const uint32_t &v) { return (v >> 1) ^ -(v & 1); }
  * @param v
  * @return uint64_t
  */
-static uint64_t EncodeZigzag64(const uint64_t &v) {
-    if (v < 0) {
-        return ((uint64_t)(-v)) * 2 - 1;
-    } else {
-        return v * 2;
-    }
+static uint64_t EncodeZigzag64(const int64_t &v) {
+    // 负数 -1 -2 ... 编码为 1 3 ... 非负数编码为 0 2 4 ...
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
 }
 
 /**
@@ -121,102 +556,359 @@ static uint64_t EncodeZigzag64(const uint64_t &v) {
 static int64_t DecodeZigzag64(const uint64_t &v) { return (v >> 1) ^ -(v & 1); }
 
 /******************************
-Write 写入
+批量 varint 编码解码
 ******************************/
 
-/// 固定长度
 /**
- * @brief 写入固定长度 int8 类型的数据
+ * @brief 编码一个 varint 到连续的内存 调用方保证空间足够
  *
+ * @tparam T uint32_t uint64_t
+ * @param p
  * @param value
+ * @return uint8_t* 编码之后的位置
  */
-void ByteArray::writeFint8(int8_t value) { write(&value, sizeof(value)); }
+template <class T>
+static inline uint8_t *EncodeVarint(uint8_t *p, T value) {
+    while (value >= 0x80) {
+        *p++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
 
 /**
- * @brief 写入固定长度 uint8 类型的数据
+ * @brief 从连续的内存解码一个 varint 调用方保证最大长度的数据可读
+ *
+ * 与 readUint32 readUint64 相同 最多读取 5 10 字节
  *
+ * @tparam T uint32_t uint64_t
+ * @param p
  * @param value
+ * @return const uint8_t* 解码之后的位置
+ */
+template <class T>
+static inline const uint8_t *DecodeVarint(const uint8_t *p, T &value) {
+    T result = 0;
+    for (int i = 0; i < (int)sizeof(T) * 8; i += 7) {
+        uint8_t b = *p++;
+        if (b < 0x80) {
+            result |= ((T)b) << i;
+            break;
+        }
+        result |= ((T)(b & 0x7F)) << i;
+    }
+    value = result;
+    return p;
+}
+
+#if defined(__x86_64__)
+
+/**
+ * @brief CPU 是否支持 SSSE3 (pshufb)
+ *
+ * @return true
+ * @return false
+ */
+static bool HasSSSE3() {
+    static bool s_has = []() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3") != 0;
+    }();
+    return s_has;
+}
+
+/**
+ * @brief masked-VByte 解码表 按 12 字节的最高位掩码索引
+ *
+ * 最多 4 个 不超过 4 字节的 varint 重排到 4 个 32bit 通道
  */
-void ByteArray::writeFuint8(uint8_t value) { write(&value, sizeof(value)); }
+struct VarintShuffle {
+    // 解码的个数 0 第一个超过 4 字节 退回逐个解码
+    uint8_t count;
+    // 消耗的字节数
+    uint8_t consumed;
+    // pshufb 重排 0x80 置零
+    uint8_t shuffle[16];
+};
 
 /**
- * @brief 写入固定长度 int16 类型的数据
+ * @brief 生成解码表 SSSE3 不可用时为空
  *
- * @param value
+ * @return const VarintShuffle*
  */
-void ByteArray::writeFint16(int16_t value) {
-    if (m_endian != LJRSERVER_BYTE_ORDER) {
-        // 转换字节序
-        value = byteswap(value);
+static const VarintShuffle *GetVarintShuffleTable() {
+    static VarintShuffle *s_table = []() -> VarintShuffle * {
+        if (!HasSSSE3()) {
+            return nullptr;
+        }
+        VarintShuffle *table = new VarintShuffle[1 << 12];
+        for (int mask = 0; mask < (1 << 12); ++mask) {
+            VarintShuffle &e = table[mask];
+            memset(e.shuffle, 0x80, sizeof(e.shuffle));
+            int pos = 0;
+            int count = 0;
+            while (count < 4) {
+                // 第一个最高位为 0 的字节是这个 varint 的结尾
+                int end = pos;
+                while (end < 12 && (mask & (1 << end))) {
+                    ++end;
+                }
+                if (end >= 12 || end - pos >= 4) {
+                    break;
+                }
+                for (int j = pos; j <= end; ++j) {
+                    e.shuffle[count * 4 + j - pos] = j;
+                }
+                ++count;
+                pos = end + 1;
+            }
+            e.count = count;
+            e.consumed = pos;
+        }
+        return table;
+    }();
+    return s_table;
+}
+
+/**
+ * @brief SSSE3 masked-VByte 解码 varint32
+ *
+ * 16 字节 8 字节最高位都为 0 时直接展开
+ * 否则查表重排后每个 32bit 通道合并 7bit 分组
+ *
+ * @param p 当前位置 返回时移到解码之后
+ * @param end 可读的结尾
+ * @param values
+ * @param count
+ * @param table 解码表
+ * @return size_t 解码的个数
+ */
+__attribute__((target("ssse3"))) static size_t DecodeVarint32SSSE3(
+    const uint8_t *&p, const uint8_t *end, uint32_t *values, size_t count,
+    const VarintShuffle *table) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low7 = _mm_set1_epi32(0x7F);
+    const __m128i mask1 = _mm_set1_epi32(0x7F << 7);
+    const __m128i mask2 = _mm_set1_epi32(0x7F << 14);
+    const __m128i mask3 = _mm_set1_epi32(0x7F << 21);
+
+    size_t n = 0;
+    while (count - n >= 16 && end - p >= 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)p);
+        int mask = _mm_movemask_epi8(in);
+        if (mask == 0) {
+            // 16 个单字节
+            __m128i lo = _mm_unpacklo_epi8(in, zero);
+            __m128i hi = _mm_unpackhi_epi8(in, zero);
+            _mm_storeu_si128((__m128i *)(values + n),
+                             _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128((__m128i *)(values + n + 4),
+                             _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128((__m128i *)(values + n + 8),
+                             _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128((__m128i *)(values + n + 12),
+                             _mm_unpackhi_epi16(hi, zero));
+            p += 16;
+            n += 16;
+            continue;
+        }
+
+        if ((mask & 0xFF) == 0) {
+            // 前 8 个单字节
+            __m128i lo = _mm_unpacklo_epi8(in, zero);
+            _mm_storeu_si128((__m128i *)(values + n),
+                             _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128((__m128i *)(values + n + 4),
+                             _mm_unpackhi_epi16(lo, zero));
+            p += 8;
+            n += 8;
+            continue;
+        }
+
+        const VarintShuffle &e = table[mask & 0xFFF];
+        if (e.count == 0) {
+            // 超过 4 字节的 varint
+            p = DecodeVarint(p, values[n++]);
+            continue;
+        }
+        __m128i x = _mm_shuffle_epi8(
+            in, _mm_loadu_si128((const __m128i *)e.shuffle));
+        __m128i r = _mm_and_si128(x, low7);
+        r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(x, 1), mask1));
+        r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(x, 2), mask2));
+        r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(x, 3), mask3));
+        _mm_storeu_si128((__m128i *)(values + n), r);
+        p += e.consumed;
+        n += e.count;
     }
-    write(&value, sizeof(value));
+    return n;
 }
 
 /**
- * @brief 写入固定长度 uint16 类型的数据
+ * @brief SSE2 解码 varint64 16 字节最高位都为 0 时直接展开成 16 个值
  *
- * @param value
+ * @param p 当前位置 返回时移到解码之后
+ * @param end 可读的结尾
+ * @param values
+ * @param count
+ * @return size_t 解码的个数
  */
-void ByteArray::writeFuint16(uint16_t value) {
-    if (m_endian != LJRSERVER_BYTE_ORDER) {
-        // 转换字节序
-        value = byteswap(value);
+static size_t DecodeVarint64SSE2(const uint8_t *&p, const uint8_t *end,
+                                 uint64_t *values, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t n = 0;
+    while (count - n >= 16 && end - p >= 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)p);
+        if (_mm_movemask_epi8(in) != 0) {
+            p = DecodeVarint(p, values[n++]);
+            continue;
+        }
+        __m128i w[2] = {_mm_unpacklo_epi8(in, zero),
+                        _mm_unpackhi_epi8(in, zero)};
+        for (int i = 0; i < 2; ++i) {
+            __m128i d[2] = {_mm_unpacklo_epi16(w[i], zero),
+                            _mm_unpackhi_epi16(w[i], zero)};
+            for (int j = 0; j < 2; ++j) {
+                uint64_t *out = values + n + i * 8 + j * 4;
+                _mm_storeu_si128((__m128i *)out,
+                                 _mm_unpacklo_epi32(d[j], zero));
+                _mm_storeu_si128((__m128i *)(out + 2),
+                                 _mm_unpackhi_epi32(d[j], zero));
+            }
+        }
+        p += 16;
+        n += 16;
     }
-    write(&value, sizeof(value));
+    return n;
 }
 
+#endif
+
 /**
- * @brief 写入固定长度 int32 类型的数据
+ * @brief 从连续的内存批量解码 varint32
  *
- * @param value
+ * @param p 当前位置 返回时移到解码之后
+ * @param end 可读的结尾 剩余不足一个最大长度时停止
+ * @param values
+ * @param count
+ * @return size_t 解码的个数
  */
-void ByteArray::writeFint32(int32_t value) {
-    if (m_endian != LJRSERVER_BYTE_ORDER) {
-        // 转换字节序
-        value = byteswap(value);
+static size_t DecodeVarints(const uint8_t *&p, const uint8_t *end,
+                            uint32_t *values, size_t count) {
+    size_t n = 0;
+#if defined(__x86_64__)
+    const VarintShuffle *table = GetVarintShuffleTable();
+    if (table) {
+        n = DecodeVarint32SSSE3(p, end, values, count, table);
     }
-    write(&value, sizeof(value));
+#endif
+    while (n < count && end - p >= 5) {
+        p = DecodeVarint(p, values[n++]);
+    }
+    return n;
 }
 
 /**
- * @brief 写入固定长度 uint32 类型的数据
+ * @brief 从连续的内存批量解码 varint64
  *
- * @param value
+ * @param p 当前位置 返回时移到解码之后
+ * @param end 可读的结尾 剩余不足一个最大长度时停止
+ * @param values
+ * @param count
+ * @return size_t 解码的个数
  */
-void ByteArray::writeFuint32(uint32_t value) {
-    if (m_endian != LJRSERVER_BYTE_ORDER) {
-        // 转换字节序
-        value = byteswap(value);
+static size_t DecodeVarints(const uint8_t *&p, const uint8_t *end,
+                            uint64_t *values, size_t count) {
+    size_t n = 0;
+#if defined(__x86_64__)
+    n = DecodeVarint64SSE2(p, end, values, count);
+#endif
+    while (n < count && end - p >= 10) {
+        p = DecodeVarint(p, values[n++]);
     }
-    write(&value, sizeof(value));
+    return n;
 }
 
+/******************************
+批量固定长度 字节序转换
+******************************/
+
+#if defined(__x86_64__)
+
 /**
- * @brief 写入固定长度 int64 类型的数据
+ * @brief SSSE3 批量字节序转换 每次 16 字节
  *
- * @param value
+ * @param dst 可以与 src 相同
+ * @param src
+ * @param count 个数
+ * @param width 每个的字节数 2 4 8
+ * @return size_t 转换的个数 剩余不足 16 字节的由调用方处理
  */
-void ByteArray::writeFint64(int64_t value) {
-    if (m_endian != LJRSERVER_BYTE_ORDER) {
-        // 转换字节序
-        value = byteswap(value);
+__attribute__((target("ssse3"))) static size_t SwapBytesSSSE3(
+    char *dst, const char *src, size_t count, size_t width) {
+    // 每个元素内的字节倒序
+    char shuffle[16];
+    for (int i = 0; i < 16; ++i) {
+        shuffle[i] = (i / width) * width + (width - 1 - i % width);
     }
-    write(&value, sizeof(value));
+    const __m128i mask = _mm_loadu_si128((const __m128i *)shuffle);
+    size_t per = 16 / width;
+    size_t n = 0;
+    for (; count - n >= per; n += per) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + n * width));
+        _mm_storeu_si128((__m128i *)(dst + n * width),
+                         _mm_shuffle_epi8(x, mask));
+    }
+    return n;
 }
 
+#endif
+
 /**
- * @brief 写入固定长度 uint64 类型的数据
+ * @brief 批量字节序转换
  *
- * @param value
+ * @param dst 可以与 src 相同
+ * @param src
+ * @param count 个数
+ * @param width 每个的字节数 1 2 4 8
  */
-void ByteArray::writeFuint64(uint64_t value) {
-    if (m_endian != LJRSERVER_BYTE_ORDER) {
-        // 转换字节序
-        value = byteswap(value);
+static void SwapBytes(char *dst, const char *src, size_t count,
+                      size_t width) {
+    if (width == 1) {
+        if (dst != src) {
+            memcpy(dst, src, count);
+        }
+        return;
+    }
+    size_t n = 0;
+#if defined(__x86_64__)
+    if (HasSSSE3()) {
+        n = SwapBytesSSSE3(dst, src, count, width);
+    }
+#endif
+#define XX(type)                                              \
+    for (; n < count; ++n) {                                  \
+        type v;                                               \
+        memcpy(&v, src + n * sizeof(v), sizeof(v));           \
+        v = byteswap(v);                                      \
+        memcpy(dst + n * sizeof(v), &v, sizeof(v));           \
+    }
+
+    if (width == 2) {
+        XX(uint16_t);
+    } else if (width == 4) {
+        XX(uint32_t);
+    } else {
+        XX(uint64_t);
     }
-    write(&value, sizeof(value));
+#undef XX
 }
 
+/******************************
+Write 写入
+******************************/
+
 /// 变长
 /**
  * @brief 写入有符号 Varint32 类型的数据
@@ -272,31 +964,67 @@ void ByteArray::writeUint64(uint64_t value) {
     write(tmp, i);
 }
 
-/// 浮点数
+/// 变长 批量
 /**
- * @brief 写入 float 类型的数据
+ * @brief 批量写入无符号 Varint32 类型的数据
  *
- * @param value
+ * @param values
+ * @param count
  */
-void ByteArray::writeFloat(float value) {
-    uint32_t v;
-    // 复制出来
-    memcpy(&v, &value, sizeof(value));
-    // 写入 32bit 无符号 int
-    writeFuint32(v);
+void ByteArray::writeUint32Array(const uint32_t *values, size_t count) {
+    writeVarints(values, count, VARINT_RAW);
 }
 
 /**
- * @brief 写入 double 类型的数据
+ * @brief 批量写入有符号 Varint32 类型的数据 zigzag 编码
  *
- * @param value
+ * @param values
+ * @param count
+ */
+void ByteArray::writeInt32Array(const int32_t *values, size_t count) {
+    writeVarints((const uint32_t *)values, count, VARINT_ZIGZAG);
+}
+
+/**
+ * @brief 批量写入有符号 Varint32 类型的数据 与前一个值的差 zigzag 编码
+ *
+ * 适合有序或变化缓慢的序列
+ *
+ * @param values
+ * @param count
+ */
+void ByteArray::writeInt32ArrayDelta(const int32_t *values, size_t count) {
+    writeVarints((const uint32_t *)values, count, VARINT_DELTA);
+}
+
+/**
+ * @brief 批量写入无符号 Varint64 类型的数据
+ *
+ * @param values
+ * @param count
+ */
+void ByteArray::writeUint64Array(const uint64_t *values, size_t count) {
+    writeVarints(values, count, VARINT_RAW);
+}
+
+/**
+ * @brief 批量写入有符号 Varint64 类型的数据 zigzag 编码
+ *
+ * @param values
+ * @param count
+ */
+void ByteArray::writeInt64Array(const int64_t *values, size_t count) {
+    writeVarints((const uint64_t *)values, count, VARINT_ZIGZAG);
+}
+
+/**
+ * @brief 批量写入有符号 Varint64 类型的数据 与前一个值的差 zigzag 编码
+ *
+ * @param values
+ * @param count
  */
-void ByteArray::writeDouble(double value) {
-    uint64_t v;
-    // 复制出来
-    memcpy(&v, &value, sizeof(value));
-    // 64bit 无符号 int
-    writeFuint64(v);
+void ByteArray::writeInt64ArrayDelta(const int64_t *values, size_t count) {
+    writeVarints((const uint64_t *)values, count, VARINT_DELTA);
 }
 
 /// 字符串
@@ -372,58 +1100,6 @@ void ByteArray::writeStringWithoutLength(const std::string &value) {
 Read 读取
 ******************************/
 
-/**
- * @brief 读取 int8 类型的数据
- *
- * @return int8_t
- */
-int8_t ByteArray::readFint8() {
-    int8_t v;
-    read(&v, sizeof(v));
-    return v;
-}
-
-/**
- * @brief 读取 uint8 类型的数据
- *
- * @return uint8_t
- */
-uint8_t ByteArray::readFuint8() {
-    uint8_t v;
-    read(&v, sizeof(v));
-    return v;
-}
-
-/**
- * @brief 读取数据
- *
- * int16 uint16 int32 uint32 int64 uint64
- *
- * 判断大小端
- *
- */
-#define XX(type)                            \
-    type v;                                 \
-    read(&v, sizeof(v));                    \
-    if (m_endian == LJRSERVER_BYTE_ORDER) { \
-        return v;                           \
-    } else {                                \
-        return byteswap(v);                 \
-    }
-
-int16_t ByteArray::readFint16() { XX(int16_t); }
-
-uint16_t ByteArray::readFuint16() { XX(uint16_t); }
-
-int32_t ByteArray::readFint32() { XX(int32_t); }
-
-uint32_t ByteArray::readFuint32() { XX(uint32_t); }
-
-int64_t ByteArray::readFint64() { XX(int64_t); }
-
-uint64_t ByteArray::readFuint64() { XX(uint64_t); }
-#undef XX
-
 /// 变长
 /**
  * @brief 读取有符号 Varint32 类型的数据
@@ -465,7 +1141,7 @@ int64_t ByteArray::readInt64() { return DecodeZigzag64(readUint64()); }
  */
 uint64_t ByteArray::readUint64() {
     uint64_t result = 0;
-    for (int i = 0; i < 32; i += 7) {
+    for (int i = 0; i < 64; i += 7) {
         uint8_t b = readFint8();
         if (b < 0x80) {
             result |= ((uint64_t)b) << i;
@@ -477,33 +1153,65 @@ uint64_t ByteArray::readUint64() {
     return result;
 }
 
-/// 浮点数
+/// 变长 批量
+/**
+ * @brief 批量读取无符号 Varint32 类型的数据
+ *
+ * @param values
+ * @param count
+ */
+void ByteArray::readUint32Array(uint32_t *values, size_t count) {
+    readVarints(values, count, VARINT_RAW);
+}
+
+/**
+ * @brief 批量读取有符号 Varint32 类型的数据 zigzag 编码
+ *
+ * @param values
+ * @param count
+ */
+void ByteArray::readInt32Array(int32_t *values, size_t count) {
+    readVarints((uint32_t *)values, count, VARINT_ZIGZAG);
+}
+
+/**
+ * @brief 批量读取有符号 Varint32 类型的数据 与前一个值的差 zigzag 编码
+ *
+ * @param values
+ * @param count
+ */
+void ByteArray::readInt32ArrayDelta(int32_t *values, size_t count) {
+    readVarints((uint32_t *)values, count, VARINT_DELTA);
+}
+
+/**
+ * @brief 批量读取无符号 Varint64 类型的数据
+ *
+ * @param values
+ * @param count
+ */
+void ByteArray::readUint64Array(uint64_t *values, size_t count) {
+    readVarints(values, count, VARINT_RAW);
+}
+
 /**
- * @brief 读取 float 类型的数据
+ * @brief 批量读取有符号 Varint64 类型的数据 zigzag 编码
  *
- * @return float
+ * @param values
+ * @param count
  */
-float ByteArray::readFloat() {
-    // 读取 32bit 数据
-    uint32_t v = readFuint32();
-    // 转为 float
-    float value;
-    memcpy(&value, &v, sizeof(v));
-    return value;
+void ByteArray::readInt64Array(int64_t *values, size_t count) {
+    readVarints((uint64_t *)values, count, VARINT_ZIGZAG);
 }
 
 /**
- * @brief 读取 double 类型的数据
+ * @brief 批量读取有符号 Varint64 类型的数据 与前一个值的差 zigzag 编码
  *
- * @return double
+ * @param values
+ * @param count
  */
-double ByteArray::readDouble() {
-    // 读取 64bit 数据
-    uint64_t v = readFuint64();
-    // 转为 double
-    double value;
-    memcpy(&value, &v, sizeof(v));
-    return value;
+void ByteArray::readInt64ArrayDelta(int64_t *values, size_t count) {
+    readVarints((uint64_t *)values, count, VARINT_DELTA);
 }
 
 /// 字符串
@@ -597,9 +1305,7 @@ std::string ByteArray::readStringVint() {
  */
 void ByteArray::clear() {
     // 位置 容量 清零
-    m_position = m_size = 0;
-    // 容量等于基础内存块大小 4kb
-    m_capacity = m_baseSize;
+    m_position = m_size = m_curPos = 0;
 
     // 清零内存
     Node *tmp = m_root->next;
@@ -609,12 +1315,135 @@ void ByteArray::clear() {
         delete m_cur;
     }
 
+    if (m_root->size != m_baseSize || IsShared(m_root)) {
+        // 头部节点是切片 或与其他 ByteArray 共享 换成新的内存块
+        // 避免之后的写入覆盖别人的数据
+        delete m_root;
+        m_root = new Node(m_baseSize);
+    }
+
+    // 容量等于基础内存块大小 4kb
+    m_capacity = m_baseSize;
     // 当前指针指向内存块头部
-    m_cur = m_root;
+    m_cur = m_tail = m_root;
     // 只有一块存储
     m_root->next = NULL;
 }
 
+/**
+ * @brief 切片 与当前 ByteArray 共享 [position, position + len) 的内存块
+ *
+ * @param position 起始位置
+ * @param len 长度
+ * @return ByteArray::ptr
+ */
+ByteArray::ptr ByteArray::slice(size_t position, size_t len) const {
+    if (position > m_size || len > m_size - position) {
+        // 超过数据范围 抛出异常
+        throw std::out_of_range("slice out of range");
+    }
+    ByteArray::ptr rt(new ByteArray(m_baseSize));
+    rt->m_endian = m_endian;
+    if (len == 0) {
+        return rt;
+    }
+
+    // 引用 position 开始的内存块 最后一个节点截断到 len
+    size_t npos = 0;
+    Node *cur = findNode(position, npos);
+    Node *head = NULL;
+    Node *tail = NULL;
+    while (len > 0) {
+        size_t n = std::min(cur->size - npos, len);
+        Node *node = new Node(cur->block, cur->ptr + npos, n);
+        if (tail) {
+            tail->next = node;
+        } else {
+            head = node;
+        }
+        tail = node;
+        rt->m_size += n;
+        len -= n;
+        npos = 0;
+        cur = cur->next;
+    }
+
+    delete rt->m_root;
+    rt->m_root = rt->m_cur = head;
+    rt->m_tail = tail;
+    rt->m_capacity = rt->m_size;
+    return rt;
+}
+
+/**
+ * @brief 把 other 中可读的数据 [position, size) 接到数据末尾
+ *
+ * @param other 之后为空
+ */
+void ByteArray::append(ByteArray &&other) {
+    if (&other == this) {
+        return;
+    }
+    size_t len = other.getReadSize();
+    if (len == 0) {
+        other.clear();
+        return;
+    }
+
+    // 从 other 取下可读数据所在的节点 释放之前已读的节点
+    size_t npos = 0;
+    Node *first = other.findNode(other.m_position, npos);
+    Node *tmp = other.m_root;
+    while (tmp != first) {
+        Node *next = tmp->next;
+        delete tmp;
+        tmp = next;
+    }
+    first->ptr += npos;
+    first->size -= npos;
+
+    // 截断最后一个有数据的节点 释放之后未使用的节点
+    Node *last = first;
+    size_t left = len;
+    while (left > last->size) {
+        left -= last->size;
+        last = last->next;
+    }
+    last->size = left;
+    DeleteNodes(last->next);
+    last->next = NULL;
+
+    // other 重置为空
+    other.m_root = other.m_cur = other.m_tail = new Node(other.m_baseSize);
+    other.m_position = other.m_size = other.m_curPos = 0;
+    other.m_capacity = other.m_baseSize;
+
+    if (m_size == 0) {
+        // 没有数据 直接替换
+        DeleteNodes(m_root);
+        m_root = first;
+    } else {
+        // 截断数据末尾所在的节点 释放之后未使用的节点
+        Node *tail = findNode(m_size - 1, npos);
+        tail->size = npos + 1;
+        DeleteNodes(tail->next);
+        tail->next = first;
+    }
+    m_tail = last;
+    m_size += len;
+    m_capacity = m_size;
+
+    // 重新定位当前节点
+    setPostion(m_position);
+}
+
+/**
+ * @brief 预留容量 从当前位置起至少可以写入 size 字节
+ *
+ * @param size 容量大小
+ */
+void ByteArray::reserve(size_t size) { addCapacity(size, true); }
+
 /**
  * @brief 写入 size 长度的数据
  *
@@ -629,7 +1458,7 @@ void ByteArray::write(const void *buf, size_t size) {
     addCapacity(size);
 
     // 当前节点位置 node pos
-    size_t npos = m_position % m_baseSize;
+    size_t npos = m_position - m_curPos;
     // 当前节点的可用容量
     size_t ncap = m_cur->size - npos;
     // 指向 buf 当前位置 buffer pos
@@ -643,6 +1472,7 @@ void ByteArray::write(const void *buf, size_t size) {
 
             if (m_cur->size == (npos + size)) {
                 // 下一个内存块
+                m_curPos += m_cur->size;
                 m_cur = m_cur->next;
             }
 
@@ -660,6 +1490,7 @@ void ByteArray::write(const void *buf, size_t size) {
             size -= ncap;
 
             // 下一个内存块
+            m_curPos += m_cur->size;
             m_cur = m_cur->next;
             ncap = m_cur->size;
             npos = 0;
@@ -685,9 +1516,12 @@ void ByteArray::read(void *buf, size_t size) {
         // 大于可以读取的长度 抛出异常
         throw std::out_of_range("not enough len");
     }
+    if (size == 0) {
+        return;
+    }
 
     // 当前块号
-    size_t npos = m_position % m_baseSize;
+    size_t npos = m_position - m_curPos;
     // 当前块容量
     size_t ncap = m_cur->size - npos;
     // 结果缓存位置
@@ -700,6 +1534,7 @@ void ByteArray::read(void *buf, size_t size) {
 
             if (m_cur->size == npos + size) {
                 // 下一块存储
+                m_curPos += m_cur->size;
                 m_cur = m_cur->next;
             }
 
@@ -717,6 +1552,7 @@ void ByteArray::read(void *buf, size_t size) {
             size -= ncap;
 
             // 下一块存储
+            m_curPos += m_cur->size;
             m_cur = m_cur->next;
             ncap = m_cur->size;
             npos = 0;
@@ -739,14 +1575,19 @@ void ByteArray::read(void *buf, size_t size, size_t position) const {
         throw std::out_of_range("not enough len");
     }
 
-    // 当前块号
-    size_t npos = position % m_baseSize;
+    if (size == 0) {
+        return;
+    }
+
+    // 找到 position 所在的存储块 和块内偏移
+    size_t npos = 0;
+    Node *cur = findNode(position, npos);
+
     // 当前块容量
-    size_t ncap = m_cur->size - npos;
+    size_t ncap = cur->size - npos;
     // 结果缓存位置
     size_t bpos = 0;
 
-    Node *cur = m_cur;
     while (size > 0) {
         if (ncap >= size) {
             // 直接读取
@@ -807,13 +1648,16 @@ void ByteArray::setPostion(size_t v) {
 
     // 当前内存块指针指向头部
     m_cur = m_root;
+    m_curPos = 0;
     while (v > m_cur->size) {
         // 循环访问下一块
         v -= m_cur->size;
+        m_curPos += m_cur->size;
         m_cur = m_cur->next;
     }
     if (v == m_cur->size) {
         // 当前内存块已经满了 下一个
+        m_curPos += m_cur->size;
         m_cur = m_cur->next;
     }
     // m_cur 已经指向当前操作的内存块了 即 m_position 所在
@@ -839,29 +1683,11 @@ bool ByteArray::writeToFile(const std::string &name) const {
         return false;
     }
 
-    // 可读取长度
-    int64_t read_size = getReadSize();
-    // 当前位置
-    int64_t pos = m_position;
-    // 当前内存块
-    Node *cur = m_cur;
-
-    while (read_size > 0) {
-        // 内存块偏移
-        int diff = pos % m_baseSize;
-        // 读取长度
-        int64_t len =
-            (read_size > (int64_t)m_baseSize ? m_baseSize : read_size) - diff;
-
-        // 向文件写入
-        ofs.write(cur->ptr + diff, len);
-
-        // 下一内存块
-        cur = cur->next;
-        // 当前位置
-        pos += len;
-        // 还剩多少
-        read_size -= len;
+    // 可读取的内存块 依次写入文件
+    std::vector<iovec> buffers;
+    getReadBuffers(buffers);
+    for (auto &iov : buffers) {
+        ofs.write((const char *)iov.iov_base, iov.iov_len);
     }
 
     return true;
@@ -992,7 +1818,7 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers,
     uint64_t size = len;
 
     // 当前内存块的偏移
-    size_t npos = m_position % m_baseSize;
+    size_t npos = m_position - m_curPos;
     // 当前内存块可读取的容量
     size_t ncap = m_cur->size - npos;
 
@@ -1038,24 +1864,19 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers,
 uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers, uint64_t len,
                                    uint64_t position) const {
     // 读取长度
-    len = len > getReadSize() ? getReadSize() : len;
+    if (position >= m_size) {
+        return 0;
+    }
+    len = len > (m_size - position) ? (m_size - position) : len;
     if (len == 0) {
         return 0;
     }
     // 返回实际数据的长度
     uint64_t size = len;
 
-    // 内存块的偏移
-    size_t npos = position % m_baseSize;
-    // 存储块数
-    size_t count = position / m_baseSize;
-
-    // 找到 position 所在的存储块
-    Node *cur = m_root;
-    while (count > 0) {
-        cur = cur->next;
-        --count;
-    }
+    // 找到 position 所在的存储块 和块内偏移
+    size_t npos = 0;
+    Node *cur = findNode(position, npos);
 
     // 当前内存块可读取的容量
     size_t ncap = cur->size - npos;
@@ -1107,7 +1928,7 @@ uint64_t ByteArray::getWriteBuffers(std::vector<iovec> &buffers, uint64_t len) {
     size_t size = len;
 
     // 当前内存块偏移
-    size_t npos = m_position % m_baseSize;
+    size_t npos = m_position - m_curPos;
     // 当前内存块可读取的容量
     size_t ncap = m_cur->size - npos;
 
@@ -1116,7 +1937,7 @@ uint64_t ByteArray::getWriteBuffers(std::vector<iovec> &buffers, uint64_t len) {
 
     Node *cur = m_cur;
     while (len > 0) {
-        if (ncap >= size) {
+        if (ncap >= len) {
             // 直接读取
             iov.iov_base = cur->ptr + npos;
             iov.iov_len = len;
@@ -1141,12 +1962,219 @@ uint64_t ByteArray::getWriteBuffers(std::vector<iovec> &buffers, uint64_t len) {
 }
 
 /// private
+/**
+ * @brief 查找 position 所在的节点 private
+ *
+ * 从当前节点或头部开始查找 position 必须小于容量
+ *
+ * @param position 位置
+ * @param npos 节点内的偏移
+ * @return ByteArray::Node*
+ */
+ByteArray::Node *ByteArray::findNode(size_t position, size_t &npos) const {
+    Node *cur = m_cur;
+    size_t begin = m_curPos;
+    if (!cur || position < begin) {
+        // 从头部开始找
+        cur = m_root;
+        begin = 0;
+    }
+    while (position - begin >= cur->size) {
+        begin += cur->size;
+        cur = cur->next;
+    }
+    npos = position - begin;
+    return cur;
+}
+
+/**
+ * @brief 在当前节点内前进 n 字节 private
+ *
+ * @param n 不超过当前节点的剩余大小
+ */
+void ByteArray::advance(size_t n) {
+    m_position += n;
+    if (m_position - m_curPos == m_cur->size) {
+        // 当前节点用完 下一个
+        m_curPos += m_cur->size;
+        m_cur = m_cur->next;
+    }
+}
+
+/**
+ * @brief 批量写入固定长度的数据 private
+ *
+ * 字节序与主机相同时直接 write
+ * 否则在当前节点中放得下的部分直接转换写入节点 跨越节点的一个经过临时缓存
+ *
+ * @param values
+ * @param count 个数
+ * @param width 每个的字节数 1 2 4 8
+ */
+void ByteArray::writeFixedBytes(const void *values, size_t count,
+                                size_t width) {
+    if (m_endian == LJRSERVER_BYTE_ORDER || width == 1) {
+        write(values, count * width);
+        return;
+    }
+    addCapacity(count * width);
+
+    const char *src = (const char *)values;
+    while (count > 0) {
+        size_t npos = m_position - m_curPos;
+        size_t n = std::min(count, (m_cur->size - npos) / width);
+        if (n > 0) {
+            SwapBytes(m_cur->ptr + npos, src, n, width);
+            advance(n * width);
+        } else {
+            // 跨越节点
+            char tmp[8];
+            SwapBytes(tmp, src, 1, width);
+            write(tmp, width);
+            n = 1;
+        }
+        src += n * width;
+        count -= n;
+    }
+    if (m_position > m_size) {
+        // 更新数据总大小
+        m_size = m_position;
+    }
+}
+
+/**
+ * @brief 批量读取固定长度的数据 private
+ *
+ * 整块 read 之后就地转换字节序
+ *
+ * @param values
+ * @param count 个数
+ * @param width 每个的字节数 1 2 4 8
+ */
+void ByteArray::readFixedBytes(void *values, size_t count, size_t width) {
+    read(values, count * width);
+    if (m_endian != LJRSERVER_BYTE_ORDER) {
+        SwapBytes((char *)values, (const char *)values, count, width);
+    }
+}
+
+/**
+ * @brief 批量写入 varint private
+ *
+ * 当前节点剩余空间放得下最长的 varint 时直接编码到节点中
+ * 否则调用 writeUint32 writeUint64 写入一个 可能跨越节点或扩容
+ *
+ * @tparam T uint32_t uint64_t
+ * @param values
+ * @param count
+ * @param mode 编码方式
+ */
+template <class T>
+void ByteArray::writeVarints(const T *values, size_t count, VarintMode mode) {
+    typedef typename std::make_signed<T>::type S;
+    // varint 的最大长度
+    const size_t max_size = sizeof(T) == 4 ? 5 : 10;
+    T prev = 0;
+
+    // 编码前的转换
+    auto transform = [&prev, mode](T v) -> T {
+        if (mode == VARINT_RAW) {
+            return v;
+        }
+        T d = v;
+        if (mode == VARINT_DELTA) {
+            d = v - prev;
+            prev = v;
+        }
+        // zigzag
+        return (d << 1) ^ (T)((S)d >> (sizeof(T) * 8 - 1));
+    };
+
+    size_t i = 0;
+    while (i < count) {
+        if (!m_cur || m_cur->size - (m_position - m_curPos) < max_size) {
+            // 当前节点放不下 逐个写入
+            T v = transform(values[i++]);
+            if (sizeof(T) == 4) {
+                writeUint32(v);
+            } else {
+                writeUint64(v);
+            }
+            continue;
+        }
+
+        uint8_t *begin = (uint8_t *)m_cur->ptr + (m_position - m_curPos);
+        uint8_t *last = (uint8_t *)m_cur->ptr + m_cur->size - max_size;
+        uint8_t *p = begin;
+        while (i < count && p <= last) {
+            p = EncodeVarint(p, transform(values[i++]));
+        }
+        advance(p - begin);
+        if (m_position > m_size) {
+            // 更新数据总大小
+            m_size = m_position;
+        }
+    }
+}
+
+/**
+ * @brief 批量读取 varint private
+ *
+ * 当前节点中可读的数据不少于最长的 varint 时直接从节点解码
+ * 否则调用 readUint32 readUint64 读取一个 可能跨越节点
+ * 解码之后再统一做 zigzag 和差值的还原
+ *
+ * @tparam T uint32_t uint64_t
+ * @param values
+ * @param count
+ * @param mode 编码方式
+ */
+template <class T>
+void ByteArray::readVarints(T *values, size_t count, VarintMode mode) {
+    // varint 的最大长度
+    const size_t max_size = sizeof(T) == 4 ? 5 : 10;
+    size_t i = 0;
+    while (i < count) {
+        size_t avail = 0;
+        if (m_cur) {
+            avail = std::min(m_cur->size - (m_position - m_curPos),
+                             m_size - m_position);
+        }
+        if (avail < max_size) {
+            // 可能跨越节点 逐个读取
+            values[i++] = sizeof(T) == 4 ? readUint32() : readUint64();
+            continue;
+        }
+
+        const uint8_t *begin = (const uint8_t *)m_cur->ptr +
+                               (m_position - m_curPos);
+        const uint8_t *p = begin;
+        i += DecodeVarints(p, begin + avail, values + i, count - i);
+        advance(p - begin);
+    }
+
+    if (mode == VARINT_RAW) {
+        return;
+    }
+    T prev = 0;
+    for (size_t j = 0; j < count; ++j) {
+        // zigzag
+        T v = (values[j] >> 1) ^ -(values[j] & 1);
+        if (mode == VARINT_DELTA) {
+            v += prev;
+            prev = v;
+        }
+        values[j] = v;
+    }
+}
+
 /**
  * @brief 扩容 private
  *
  * @param size 容量大小
+ * @param contiguous 新增的多个内存块是否一次连续分配
  */
-void ByteArray::addCapacity(size_t size) {
+void ByteArray::addCapacity(size_t size, bool contiguous) {
     if (size == 0) {
         return;
     }
@@ -1161,18 +2189,26 @@ void ByteArray::addCapacity(size_t size) {
     size = size - old_cap;
     // 新增 count 个内存块
     size_t count =
-        (size / m_baseSize) + (((size % m_baseSize) > old_cap) ? 1 : 0);
+        (size / m_baseSize) + (((size % m_baseSize) > 0) ? 1 : 0);
 
-    // 找到节点尾部
-    Node *tmp = m_root;
-    while (tmp->next) {
-        tmp = tmp->next;
+    // 节点尾部
+    Node *tmp = m_tail;
+
+    // 连续分配时所有新节点共享一个内存块
+    Block *block = NULL;
+    if (contiguous && count > 1) {
+        block = NewBlock(count * m_baseSize, 0);
     }
 
     Node *first = NULL;
     for (size_t i = 0; i < count; ++i) {
         // 新建节点插入尾部
-        tmp->next = new Node(m_baseSize);
+        if (block) {
+            tmp->next =
+                new Node(block, block->data() + i * m_baseSize, m_baseSize);
+        } else {
+            tmp->next = new Node(m_baseSize);
+        }
         if (first == NULL) {
             // 指向首个新增节点
             first = tmp->next;
@@ -1183,9 +2219,12 @@ void ByteArray::addCapacity(size_t size) {
         m_capacity += m_baseSize;
     }
 
+    m_tail = tmp;
+
     if (old_cap == 0) {
         // 首次扩容
         m_cur = first;
+        m_curPos = m_position;
     }
 }
 
@@ -3,14 +3,90 @@
 #define __LJRSERVER_BYTEARRAY_H__
 
 #include <memory>
+#include <ostream>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
+// 大小端字节序
+#include "endian.h"
+
 namespace ljrserver {
 
+/**
+ * @brief Class ByteArray 内存块池
+ *
+ * 按大小分组缓存释放的内存块 避免每个消息的 ByteArray 反复 new delete
+ * 分配先取本线程的缓存 为空时从全局缓存批量取一批
+ * 释放先放回本线程的缓存 满了时归还一半到全局缓存 全局也满了才 delete
+ * 超过 bytearray.pool.max_block_size 的内存块不缓存
+ */
+class ByteArrayPool {
+public:
+    /**
+     * @brief 内存块池的统计
+     *
+     * alloc = thread_hit + global_hit + miss
+     */
+    struct Stats {
+        // 分配次数
+        uint64_t alloc = 0;
+        // 释放次数
+        uint64_t free = 0;
+        // 命中线程缓存的次数
+        uint64_t thread_hit = 0;
+        // 命中全局缓存的次数
+        uint64_t global_hit = 0;
+        // 没有缓存 new 的次数
+        uint64_t miss = 0;
+        // 缓存已满 delete 的次数
+        uint64_t release = 0;
+        // 全局缓存中的内存块数
+        uint64_t global_cached = 0;
+    };
+
+    /**
+     * @brief 分配 size 字节的内存块
+     *
+     * @param size
+     * @return void*
+     */
+    static void *Alloc(size_t size);
+
+    /**
+     * @brief 释放 Alloc 分配的内存块
+     *
+     * @param ptr
+     * @param size 与 Alloc 时相同
+     */
+    static void Free(void *ptr, size_t size);
+
+    /**
+     * @brief 获取统计
+     *
+     * @return Stats
+     */
+    static Stats GetStats();
+
+    /**
+     * @brief 释放全局缓存中的所有内存块
+     *
+     */
+    static void Trim();
+
+    /**
+     * @brief 输出统计和全局缓存
+     *
+     * @param os
+     * @return std::ostream&
+     */
+    static std::ostream &Dump(std::ostream &os);
+};
+
 /**
  * @brief Class 二进制数组
  *
@@ -22,6 +98,13 @@ public:
     // 智能指针
     typedef std::shared_ptr<ByteArray> ptr;
 
+    /**
+     * @brief 内存块 头部带引用计数 数据紧跟在头部之后
+     *
+     * 从 ByteArrayPool 分配 可以被多个节点引用 引用计数归零时释放
+     */
+    struct Block;
+
     /**
      * @brief ByteArray 的存储节点 内存块
      *
@@ -37,6 +120,15 @@ public:
          */
         Node(size_t s);
 
+        /**
+         * @brief 数据节点构造函数 引用已有的内存块
+         *
+         * @param b 内存块 增加引用计数
+         * @param p 节点数据的起始地址 在 b 的数据中
+         * @param s 节点大小
+         */
+        Node(Block *b, char *p, size_t s);
+
         /**
          * @brief 数据节点构造函数 默认
          *
@@ -59,6 +151,9 @@ public:
 
         /// 下一个内存块地址
         Node *next;
+
+        /// 数据所在的内存块
+        Block *block;
     };
 
     /**
@@ -75,16 +170,27 @@ public:
     ~ByteArray();
 
 public:  /// Write 写入
-    /// 固定长度
-
-    void writeFint8(int8_t value);
-    void writeFuint8(uint8_t value);
-    void writeFint16(int16_t value);
-    void writeFuint16(uint16_t value);
-    void writeFint32(int32_t value);
-    void writeFuint32(uint32_t value);
-    void writeFint64(int64_t value);
-    void writeFuint64(uint64_t value);
+    /// 固定长度 当前节点放得下时内联直接写入节点
+
+    void writeFint8(int8_t value) { writeFixed(value); }
+    void writeFuint8(uint8_t value) { writeFixed(value); }
+    void writeFint16(int16_t value) { writeFixed(value); }
+    void writeFuint16(uint16_t value) { writeFixed(value); }
+    void writeFint32(int32_t value) { writeFixed(value); }
+    void writeFuint32(uint32_t value) { writeFixed(value); }
+    void writeFint64(int64_t value) { writeFixed(value); }
+    void writeFuint64(uint64_t value) { writeFixed(value); }
+
+    /// 固定长度 批量 字节序与主机不同时 x86 上使用 SIMD 转换
+
+    template <class T>
+    void writeFixedArray(const T *values, size_t count) {
+        static_assert(std::is_arithmetic<T>::value &&
+                          (sizeof(T) == 1 || sizeof(T) == 2 ||
+                           sizeof(T) == 4 || sizeof(T) == 8),
+                      "fixed width arithmetic type required");
+        writeFixedBytes(values, count, sizeof(T));
+    }
 
     /// 变长
     // void writeInt8(const int8_t &value);
@@ -97,10 +203,20 @@ public:  /// Write 写入
     void writeInt64(int64_t value);
     void writeUint64(uint64_t value);
 
+    /// 变长 批量 当前节点放得下时直接编码到节点中
+    /// Int zigzag 编码 Delta 写入与前一个值的差 zigzag 编码
+
+    void writeUint32Array(const uint32_t *values, size_t count);
+    void writeInt32Array(const int32_t *values, size_t count);
+    void writeInt32ArrayDelta(const int32_t *values, size_t count);
+    void writeUint64Array(const uint64_t *values, size_t count);
+    void writeInt64Array(const int64_t *values, size_t count);
+    void writeInt64ArrayDelta(const int64_t *values, size_t count);
+
     /// 浮点数
 
-    void writeFloat(float value);
-    void writeDouble(double value);
+    void writeFloat(float value) { writeFixed(value); }
+    void writeDouble(double value) { writeFixed(value); }
 
     /// 字符串
 
@@ -111,16 +227,27 @@ public:  /// Write 写入
     void writeStringWithoutLength(const std::string &value);
 
 public:  /// Read 读取
-    /// 固定长度
-
-    int8_t readFint8();
-    uint8_t readFuint8();
-    int16_t readFint16();
-    uint16_t readFuint16();
-    int32_t readFint32();
-    uint32_t readFuint32();
-    int64_t readFint64();
-    uint64_t readFuint64();
+    /// 固定长度 当前节点中可读时内联直接从节点读取
+
+    int8_t readFint8() { return readFixed<int8_t>(); }
+    uint8_t readFuint8() { return readFixed<uint8_t>(); }
+    int16_t readFint16() { return readFixed<int16_t>(); }
+    uint16_t readFuint16() { return readFixed<uint16_t>(); }
+    int32_t readFint32() { return readFixed<int32_t>(); }
+    uint32_t readFuint32() { return readFixed<uint32_t>(); }
+    int64_t readFint64() { return readFixed<int64_t>(); }
+    uint64_t readFuint64() { return readFixed<uint64_t>(); }
+
+    /// 固定长度 批量 字节序与主机不同时 x86 上使用 SIMD 转换
+
+    template <class T>
+    void readFixedArray(T *values, size_t count) {
+        static_assert(std::is_arithmetic<T>::value &&
+                          (sizeof(T) == 1 || sizeof(T) == 2 ||
+                           sizeof(T) == 4 || sizeof(T) == 8),
+                      "fixed width arithmetic type required");
+        readFixedBytes(values, count, sizeof(T));
+    }
 
     /// 变长
 
@@ -129,10 +256,19 @@ public:  /// Read 读取
     int64_t readInt64();
     uint64_t readUint64();
 
+    /// 变长 批量 当前节点中的数据直接解码 x86 上使用 SIMD
+
+    void readUint32Array(uint32_t *values, size_t count);
+    void readInt32Array(int32_t *values, size_t count);
+    void readInt32ArrayDelta(int32_t *values, size_t count);
+    void readUint64Array(uint64_t *values, size_t count);
+    void readInt64Array(int64_t *values, size_t count);
+    void readInt64ArrayDelta(int64_t *values, size_t count);
+
     /// 浮点数
 
-    float readFloat();
-    double readDouble();
+    float readFloat() { return readFixed<float>(); }
+    double readDouble() { return readFixed<double>(); }
 
     /// 字符串
 
@@ -148,6 +284,37 @@ public:  /// 内部操作
      */
     void clear();
 
+    /**
+     * @brief 预留容量 从当前位置起至少可以写入 size 字节
+     *
+     * 需要新增多个内存块时一次分配连续的内存 由这些节点共享
+     *
+     * @param size 容量大小
+     */
+    void reserve(size_t size);
+
+    /**
+     * @brief 切片 与当前 ByteArray 共享 [position, position + len) 的内存块
+     *
+     * 不拷贝数据 切片的位置从 0 开始 容量等于 len 之后的写入分配新的内存块
+     * 修改共享部分的数据双方都可见 clear 不会影响切片
+     *
+     * @param position 起始位置
+     * @param len 长度
+     * @return ByteArray::ptr
+     */
+    ptr slice(size_t position, size_t len) const;
+
+    /**
+     * @brief 把 other 中可读的数据 [position, size) 接到数据末尾
+     *
+     * 直接接上 other 的节点链表 不拷贝数据 不修改当前位置
+     * 当前数据末尾之后未使用的容量被释放
+     *
+     * @param other 之后为空
+     */
+    void append(ByteArray &&other);
+
     /**
      * @brief 写入 size 长度的数据
      *
@@ -308,8 +475,144 @@ private:
      * @brief 扩容 private
      *
      * @param size 容量大小
+     * @param contiguous 新增的多个内存块是否一次连续分配 [= false]
      */
-    void addCapacity(size_t size);
+    void addCapacity(size_t size, bool contiguous = false);
+
+    /**
+     * @brief 查找 position 所在的节点 private
+     *
+     * @param position 位置 必须小于容量
+     * @param npos 节点内的偏移
+     * @return Node*
+     */
+    Node *findNode(size_t position, size_t &npos) const;
+
+    /**
+     * @brief 在当前节点内前进 n 字节 private
+     *
+     * @param n 不超过当前节点的剩余大小
+     */
+    void advance(size_t n);
+
+    /**
+     * @brief 与 T 大小相同的无符号整数 private
+     *
+     */
+    template <class T>
+    using FixedUint = typename std::conditional<
+        sizeof(T) == 1, uint8_t,
+        typename std::conditional<
+            sizeof(T) == 2, uint16_t,
+            typename std::conditional<sizeof(T) == 4, uint32_t,
+                                      uint64_t>::type>::type>::type;
+
+    /**
+     * @brief 写入固定长度的数据 private
+     *
+     * 当前节点放得下且不会写满时直接写入节点 否则调用 write
+     *
+     * @tparam T
+     * @param value
+     */
+    template <class T>
+    void writeFixed(T value) {
+        FixedUint<T> v;
+        memcpy(&v, &value, sizeof(v));
+        if (m_endian != LJRSERVER_BYTE_ORDER) {
+            // 转换字节序
+            v = byteswap(v);
+        }
+        if (m_cur && m_cur->size - (m_position - m_curPos) > sizeof(v)) {
+            memcpy(m_cur->ptr + (m_position - m_curPos), &v, sizeof(v));
+            m_position += sizeof(v);
+            if (m_position > m_size) {
+                m_size = m_position;
+            }
+            return;
+        }
+        write(&v, sizeof(v));
+    }
+
+    /**
+     * @brief 读取固定长度的数据 private
+     *
+     * 当前节点中可读且不会读完时直接从节点读取 否则调用 read
+     *
+     * @tparam T
+     * @return T
+     */
+    template <class T>
+    T readFixed() {
+        FixedUint<T> v;
+        if (m_cur && m_size - m_position >= sizeof(v) &&
+            m_cur->size - (m_position - m_curPos) > sizeof(v)) {
+            memcpy(&v, m_cur->ptr + (m_position - m_curPos), sizeof(v));
+            m_position += sizeof(v);
+        } else {
+            read(&v, sizeof(v));
+        }
+        if (m_endian != LJRSERVER_BYTE_ORDER) {
+            // 转换字节序
+            v = byteswap(v);
+        }
+        T value;
+        memcpy(&value, &v, sizeof(v));
+        return value;
+    }
+
+    /**
+     * @brief 批量写入固定长度的数据 private
+     *
+     * @param values
+     * @param count 个数
+     * @param width 每个的字节数 1 2 4 8
+     */
+    void writeFixedBytes(const void *values, size_t count, size_t width);
+
+    /**
+     * @brief 批量读取固定长度的数据 private
+     *
+     * @param values
+     * @param count 个数
+     * @param width 每个的字节数 1 2 4 8
+     */
+    void readFixedBytes(void *values, size_t count, size_t width);
+
+    /**
+     * @brief 批量 varint 的编码方式 private
+     *
+     */
+    enum VarintMode {
+        // 原值
+        VARINT_RAW = 0,
+        // zigzag
+        VARINT_ZIGZAG = 1,
+        // 与前一个值的差 zigzag
+        VARINT_DELTA = 2
+    };
+
+    /**
+     * @brief 批量写入 varint private
+     *
+     * @tparam T uint32_t uint64_t
+     * @param values
+     * @param count
+     * @param mode 编码方式
+     */
+    template <class T>
+    void writeVarints(const T *values, size_t count, VarintMode mode);
+
+    /**
+     * @brief 批量读取 varint private
+     *
+     * @tparam T uint32_t uint64_t
+     * @param values
+     * @param count
+     * @param mode 编码方式
+     */
+    template <class T>
+    void readVarints(T *values, size_t count, VarintMode mode);
 
 private:
     // 内存块大小
@@ -332,6 +635,12 @@ private:
 
     // 当前操作的内存块指针
     Node *m_cur;
+
+    // 最后一个内存块指针 扩容时接在之后
+    Node *m_tail;
+
+    // 当前操作的内存块的起始位置 节点大小可以不同 切片 append
+    size_t m_curPos;
 };
 
 }  // namespace ljrserver
@@ -0,0 +1,147 @@
+/**
+ * @file clock.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 时钟
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "clock.h"
+
+namespace ljrserver {
+
+/**
+ * @brief 线程局部的时间缓存
+ *
+ */
+struct ClockCache {
+    // 是否由 IOManager 维护
+    bool valid = false;
+
+    // 单调时间 us
+    uint64_t mono_us = 0;
+
+    // 系统时间 s
+    time_t wall_sec = 0;
+
+    // http Date 对应的秒数
+    time_t date_sec = -1;
+
+    // http Date 字符串
+    std::string date;
+};
+
+// 线程局部变量 时间缓存
+static thread_local ClockCache t_clock;
+
+/**
+ * @brief 读取指定时钟 us
+ *
+ * @param id 时钟类型
+ * @return uint64_t
+ */
+static uint64_t ReadClockUS(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief 精确的单调时间 ms
+ *
+ * @return uint64_t
+ */
+uint64_t Clock::NowMS() { return ReadClockUS(CLOCK_MONOTONIC) / 1000; }
+
+/**
+ * @brief 精确的单调时间 us
+ *
+ * @return uint64_t
+ */
+uint64_t Clock::NowUS() { return ReadClockUS(CLOCK_MONOTONIC); }
+
+/**
+ * @brief 粗略的单调时间 ms 读取线程缓存
+ *
+ * @return uint64_t
+ */
+uint64_t Clock::CoarseMS() { return CoarseUS() / 1000; }
+
+/**
+ * @brief 粗略的单调时间 us 读取线程缓存
+ *
+ * @return uint64_t
+ */
+uint64_t Clock::CoarseUS() {
+    if (t_clock.valid) {
+        return t_clock.mono_us;
+    }
+    // 没有缓存 vdso 读取粗略时钟 不陷入内核
+    return ReadClockUS(CLOCK_MONOTONIC_COARSE);
+}
+
+/**
+ * @brief 粗略的系统时间 s 读取线程缓存 用于日志等
+ *
+ * @return time_t
+ */
+time_t Clock::CoarseTime() {
+    if (t_clock.valid) {
+        return t_clock.wall_sec;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return ts.tv_sec;
+}
+
+/**
+ * @brief 刷新当前线程的时间缓存
+ *
+ */
+void Clock::Update() {
+    t_clock.mono_us = ReadClockUS(CLOCK_MONOTONIC);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    t_clock.wall_sec = ts.tv_sec;
+
+    t_clock.valid = true;
+}
+
+/**
+ * @brief 当前线程维护时间缓存时刷新
+ *
+ */
+void Clock::Refresh() {
+    if (t_clock.valid) {
+        Update();
+    }
+}
+
+/**
+ * @brief 当前线程不再维护时间缓存
+ *
+ */
+void Clock::Invalidate() { t_clock.valid = false; }
+
+/**
+ * @brief http Date 头部 (RFC 7231 格式)
+ *
+ * @return const std::string&
+ */
+const std::string &Clock::HttpDate() {
+    time_t now = CoarseTime();
+    if (now != t_clock.date_sec) {
+        // 进入新的一秒 重新格式化
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        char buf[64];
+        size_t n =
+            strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        t_clock.date.assign(buf, n);
+        t_clock.date_sec = now;
+    }
+    return t_clock.date;
+}
+
+}  // namespace ljrserver
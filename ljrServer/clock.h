@@ -0,0 +1,97 @@
+/**
+ * @file clock.h
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 时钟
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#pragma once
+
+// uint64_t
+#include <stdint.h>
+// time_t
+#include <time.h>
+
+#include <string>
+
+namespace ljrserver {
+
+/**
+ * @brief Class 时钟
+ *
+ * 精确时间: 每次调用都读取 CLOCK_MONOTONIC 单调时钟 不受系统时间调整影响
+ * 粗略时间: 读取线程局部的缓存 由 IOManager::idle() 每轮循环刷新一次
+ *           调度线程每取出一个任务也刷新一次 队列一直不空时不会过期
+ *           没有 IOManager 驱动的线程退化为 *_COARSE 时钟
+ */
+class Clock {
+public:
+    /**
+     * @brief 精确的单调时间 ms
+     *
+     * @return uint64_t
+     */
+    static uint64_t NowMS();
+
+    /**
+     * @brief 精确的单调时间 us
+     *
+     * @return uint64_t
+     */
+    static uint64_t NowUS();
+
+    /**
+     * @brief 粗略的单调时间 ms 读取线程缓存
+     *
+     * @return uint64_t
+     */
+    static uint64_t CoarseMS();
+
+    /**
+     * @brief 粗略的单调时间 us 读取线程缓存
+     *
+     * @return uint64_t
+     */
+    static uint64_t CoarseUS();
+
+    /**
+     * @brief 粗略的系统时间 s 读取线程缓存 用于日志等
+     *
+     * @return time_t
+     */
+    static time_t CoarseTime();
+
+    /**
+     * @brief 刷新当前线程的时间缓存
+     *
+     * 由 IOManager::idle() 在每轮 epoll_wait 返回后调用
+     */
+    static void Update();
+
+    /**
+     * @brief 当前线程维护时间缓存时刷新
+     *
+     * 由 Scheduler::run() 在每个任务执行前调用
+     * 不会让没有 IOManager 驱动的线程开始使用缓存
+     */
+    static void Refresh();
+
+    /**
+     * @brief 当前线程不再维护时间缓存
+     *
+     * 之后的粗略时间退化为直接读取 *_COARSE 时钟
+     */
+    static void Invalidate();
+
+    /**
+     * @brief http Date 头部 (RFC 7231 格式)
+     *
+     * 每秒只格式化一次 线程局部缓存
+     *
+     * @return const std::string&
+     */
+    static const std::string &HttpDate();
+};
+
+}  // namespace ljrserver
@@ -0,0 +1,487 @@
+/**
+ * @file codec.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 分帧编解码 长度前缀 分隔符
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "codec.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace ljrserver {
+
+// 系统日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
+
+// 配置 帧内容的默认上限 64KB
+static ljrserver::ConfigVar<uint32_t>::ptr g_codec_max_frame_size =
+    ljrserver::Config::Lookup("codec.max_frame_size", (uint32_t)(64 * 1024),
+                              "codec max frame size");
+
+// varint 的最大字节数
+static const size_t s_varint_max_size = 10;
+
+/**
+ * @brief 分帧编解码构造函数
+ *
+ * @param max_frame_size 帧内容的上限
+ */
+FrameCodec::FrameCodec(size_t max_frame_size)
+    : m_maxFrameSize(max_frame_size ? max_frame_size
+                                    : g_codec_max_frame_size->getValue()) {}
+
+/**
+ * @brief 读取时流的读缓存至少要有的大小
+ *
+ * @return size_t 最大的帧内容加上帧头和帧尾
+ */
+size_t FrameCodec::getMinReadBufferSize() {
+    char head[s_varint_max_size];
+    return encodeHead(m_maxFrameSize, head) + m_maxFrameSize +
+           getTail().size();
+}
+
+/**
+ * @brief 从带缓存的流中读取一帧
+ *
+ * @param stream 带缓存的流
+ * @param frame 帧内容 指向流的读缓存
+ * @return int 1 成功 0 对端关闭 < 0 失败
+ */
+int FrameCodec::read(BufferedStream::ptr stream, Frame &frame) {
+    // 读缓存放不下最大的帧 不到上限的帧也会读取失败
+    size_t min_size = getMinReadBufferSize();
+    if (stream->getReadBufferSize() < min_size) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "codec read buffer size = " << stream->getReadBufferSize()
+            << " less than max frame size = " << min_size;
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t need = 1;
+    while (true) {
+        // 帧超过读缓存时 peek 返回 -1 errno = EMSGSIZE
+        const char *data = nullptr;
+        int len = stream->peek(data, need);
+        if (len <= 0) {
+            return len;
+        }
+        int rt = decode(data, len, frame);
+        if (rt < 0) {
+            return rt;
+        }
+        if (rt > 0) {
+            // consume 不移动缓存中的数据 帧指针仍然有效
+            stream->consume(rt);
+            return 1;
+        }
+        need = len + 1;
+    }
+}
+
+/**
+ * @brief 从带缓存的流中批量读取
+ *
+ * @param stream 带缓存的流
+ * @param frames 帧内容 指向流的读缓存
+ * @param max_frames 最多解码的帧数
+ * @return int 帧数 0 对端关闭 < 0 失败
+ */
+int FrameCodec::readBatch(BufferedStream::ptr stream,
+                          std::vector<Frame> &frames, size_t max_frames) {
+    frames.clear();
+    Frame frame;
+    int rt = read(stream, frame);
+    if (rt <= 0) {
+        return rt;
+    }
+    frames.push_back(frame);
+
+    // 只解码缓存中已有的数据
+    while (!max_frames || frames.size() < max_frames) {
+        size_t size = stream->getReadSize();
+        if (size == 0) {
+            break;
+        }
+        const char *data = nullptr;
+        stream->peek(data, size);
+        // 后面的帧不完整或有错误 留到下一次读取
+        rt = decode(data, size, frame);
+        if (rt <= 0) {
+            break;
+        }
+        stream->consume(rt);
+        frames.push_back(frame);
+    }
+    return frames.size();
+}
+
+/**
+ * @brief 编码帧尾 虚函数
+ *
+ * @return const std::string& 帧尾 默认没有
+ */
+const std::string &FrameCodec::getTail() const {
+    static const std::string s_empty;
+    return s_empty;
+}
+
+/**
+ * @brief 编码一帧写入流 帧头 帧内容 帧尾一次 writeFixSizeV
+ *
+ * @param stream 流
+ * @param data 帧内容
+ * @param length 帧内容长度
+ * @return int 写入的字节数 <= 0 失败
+ */
+int FrameCodec::encode(Stream::ptr stream, const void *data, size_t length) {
+    if (length > m_maxFrameSize) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    char head[s_varint_max_size];
+    const std::string &tail = getTail();
+    iovec iovs[3];
+    size_t count = 0;
+    size_t head_size = encodeHead(length, head);
+    if (head_size) {
+        iovs[count++] = {head, head_size};
+    }
+    iovs[count++] = {(void *)data, length};
+    if (!tail.empty()) {
+        iovs[count++] = {(void *)tail.c_str(), tail.size()};
+    }
+    return stream->writeFixSizeV(iovs, count);
+}
+
+/**
+ * @brief 编码一帧写入 ByteArray
+ *
+ * @param ba
+ * @param data 帧内容
+ * @param length 帧内容长度
+ * @return true
+ * @return false 帧超过上限
+ */
+bool FrameCodec::encode(ByteArray::ptr ba, const void *data, size_t length) {
+    if (length > m_maxFrameSize) {
+        errno = EMSGSIZE;
+        return false;
+    }
+    char head[s_varint_max_size];
+    size_t head_size = encodeHead(length, head);
+    ba->write(head, head_size);
+    ba->write(data, length);
+    const std::string &tail = getTail();
+    ba->write(tail.c_str(), tail.size());
+    return true;
+}
+
+/********************************************
+ *  LengthFieldCodec 长度前缀分帧
+ ********************************************/
+
+/**
+ * @brief 长度前缀分帧构造函数
+ *
+ * @param width 长度字段字节数 0 varint 或 1 2 4 8
+ * @param max_frame_size 帧内容的上限
+ */
+LengthFieldCodec::LengthFieldCodec(uint8_t width, size_t max_frame_size)
+    : FrameCodec(max_frame_size), m_width(width) {
+    LJRSERVER_ASSERT2(width == 0 || width == 1 || width == 2 || width == 4 ||
+                          width == 8,
+                      "invalid length field width");
+}
+
+/**
+ * @brief 解析长度字段
+ *
+ * @param data
+ * @param length
+ * @param value 帧内容长度
+ * @return int > 0 长度字段字节数 0 数据不够 < 0 格式错误或超过上限
+ */
+int LengthFieldCodec::decodeHead(const char *data, size_t length,
+                                 uint64_t &value) {
+    const uint8_t *p = (const uint8_t *)data;
+    size_t head_size = 0;
+    value = 0;
+    if (m_width == 0) {
+        // varint 低位在前 每字节 7 位
+        size_t n = std::min(length, s_varint_max_size);
+        for (size_t i = 0; i < n; ++i) {
+            value |= (uint64_t)(p[i] & 0x7F) << (7 * i);
+            if (p[i] < 0x80) {
+                head_size = i + 1;
+                break;
+            }
+        }
+        if (!head_size) {
+            if (length < s_varint_max_size) {
+                return 0;
+            }
+            errno = EBADMSG;
+            return -1;
+        }
+    } else {
+        // 大端
+        if (length < m_width) {
+            return 0;
+        }
+        for (size_t i = 0; i < m_width; ++i) {
+            value = (value << 8) | p[i];
+        }
+        head_size = m_width;
+    }
+    if (value > m_maxFrameSize) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return head_size;
+}
+
+/**
+ * @brief 从连续的内存中解码一帧
+ *
+ * @param data 数据
+ * @param length 数据长度
+ * @param frame 帧内容 指向 data
+ * @return int
+ */
+int LengthFieldCodec::decode(const char *data, size_t length, Frame &frame) {
+    uint64_t value = 0;
+    int head_size = decodeHead(data, length, value);
+    if (head_size <= 0) {
+        return head_size;
+    }
+    if (length - head_size < value) {
+        return 0;
+    }
+    frame = Frame(data + head_size, value);
+    return head_size + value;
+}
+
+/**
+ * @brief 从 ByteArray 的当前位置解码一帧
+ *
+ * @param ba 数据
+ * @param frame 帧内容 指向 ByteArray 的内存块
+ * @return int
+ */
+int LengthFieldCodec::decode(ByteArray::ptr ba, std::vector<iovec> &frame) {
+    // 只拷贝长度字段
+    char head[s_varint_max_size];
+    size_t size = ba->getReadSize();
+    if (size == 0) {
+        return 0;
+    }
+    size_t n = std::min(size, m_width ? (size_t)m_width : s_varint_max_size);
+    size_t position = ba->getPosition();
+    ba->read(head, n, position);
+
+    uint64_t value = 0;
+    int head_size = decodeHead(head, n, value);
+    if (head_size <= 0) {
+        return head_size;
+    }
+    if (size - head_size < value) {
+        return 0;
+    }
+    frame.clear();
+    ba->getReadBuffers(frame, value, position + head_size);
+    ba->setPostion(position + head_size + value);
+    return head_size + value;
+}
+
+/**
+ * @brief 编码帧头
+ *
+ * @param length 帧内容长度
+ * @param head 帧头
+ * @return size_t 帧头长度
+ */
+size_t LengthFieldCodec::encodeHead(size_t length, char *head) {
+    uint8_t *p = (uint8_t *)head;
+    uint64_t value = length;
+    if (m_width == 0) {
+        size_t i = 0;
+        while (value >= 0x80) {
+            p[i++] = (value & 0x7F) | 0x80;
+            value >>= 7;
+        }
+        p[i++] = value;
+        return i;
+    }
+    for (size_t i = m_width; i > 0; --i) {
+        p[i - 1] = value & 0xFF;
+        value >>= 8;
+    }
+    return m_width;
+}
+
+/********************************************
+ *  DelimiterCodec 分隔符分帧
+ ********************************************/
+
+/**
+ * @brief 分隔符分帧构造函数
+ *
+ * @param delimiter 分隔符
+ * @param max_frame_size 帧内容的上限
+ */
+DelimiterCodec::DelimiterCodec(const std::string &delimiter,
+                               size_t max_frame_size)
+    : FrameCodec(max_frame_size), m_delimiter(delimiter) {
+    LJRSERVER_ASSERT2(!delimiter.empty(), "empty delimiter");
+}
+
+/**
+ * @brief 从连续的内存中解码一帧
+ *
+ * @param data 数据
+ * @param length 数据长度
+ * @param frame 帧内容 指向 data
+ * @return int
+ */
+int DelimiterCodec::decode(const char *data, size_t length, Frame &frame) {
+    // 超过上限的部分不用查找
+    size_t limit = std::min(length, m_maxFrameSize + m_delimiter.size());
+    const char *found = (const char *)memmem(data, limit, m_delimiter.c_str(),
+                                             m_delimiter.size());
+    if (!found) {
+        if (length >= m_maxFrameSize + m_delimiter.size()) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        return 0;
+    }
+    frame = Frame(data, found - data);
+    return found - data + m_delimiter.size();
+}
+
+/**
+ * @brief 从 ByteArray 的当前位置解码一帧
+ *
+ * 分隔符可能跨越 ByteArray 的两个内存块
+ *
+ * @param ba 数据
+ * @param frame 帧内容 指向 ByteArray 的内存块
+ * @return int
+ */
+int DelimiterCodec::decode(ByteArray::ptr ba, std::vector<iovec> &frame) {
+    size_t dlen = m_delimiter.size();
+    size_t size = ba->getReadSize();
+    size_t limit = std::min(size, m_maxFrameSize + dlen);
+    size_t position = ba->getPosition();
+
+    std::vector<iovec> buffers;
+    ba->getReadBuffers(buffers, limit);
+    // 分隔符相对当前位置的偏移
+    size_t found = (size_t)-1;
+    size_t offset = 0;
+    std::string tmp(dlen, 0);
+    for (auto &iov : buffers) {
+        const char *begin = (const char *)iov.iov_base;
+        const char *end = begin + iov.iov_len;
+        const char *p = begin;
+        while ((p = (const char *)memchr(p, m_delimiter[0], end - p))) {
+            size_t pos = offset + (p - begin);
+            if (pos + dlen > limit) {
+                break;
+            }
+            if (p + dlen <= end) {
+                if (memcmp(p, m_delimiter.c_str(), dlen) == 0) {
+                    found = pos;
+                    break;
+                }
+            } else {
+                // 跨越内存块
+                ba->read(&tmp[0], dlen, position + pos);
+                if (tmp == m_delimiter) {
+                    found = pos;
+                    break;
+                }
+            }
+            ++p;
+        }
+        if (found != (size_t)-1) {
+            break;
+        }
+        offset += iov.iov_len;
+    }
+
+    if (found == (size_t)-1) {
+        if (size >= m_maxFrameSize + dlen) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        return 0;
+    }
+    frame.clear();
+    ba->getReadBuffers(frame, found, position);
+    ba->setPostion(position + found + dlen);
+    return found + dlen;
+}
+
+/********************************************
+ *  LineCodec 按行分帧
+ ********************************************/
+
+/**
+ * @brief 按行分帧构造函数
+ *
+ * @param max_frame_size 行的上限
+ */
+LineCodec::LineCodec(size_t max_frame_size)
+    : DelimiterCodec("\n", max_frame_size), m_tail("\r\n") {}
+
+/**
+ * @brief 从连续的内存中解码一行 去掉结尾的 \r
+ *
+ * @param data 数据
+ * @param length 数据长度
+ * @param frame 帧内容 指向 data
+ * @return int
+ */
+int LineCodec::decode(const char *data, size_t length, Frame &frame) {
+    int rt = DelimiterCodec::decode(data, length, frame);
+    if (rt > 0 && frame.second && frame.first[frame.second - 1] == '\r') {
+        --frame.second;
+    }
+    return rt;
+}
+
+/**
+ * @brief 从 ByteArray 的当前位置解码一行 去掉结尾的 \r
+ *
+ * @param ba 数据
+ * @param frame 帧内容 指向 ByteArray 的内存块
+ * @return int
+ */
+int LineCodec::decode(ByteArray::ptr ba, std::vector<iovec> &frame) {
+    int rt = DelimiterCodec::decode(ba, frame);
+    while (rt > 0 && !frame.empty() && frame.back().iov_len == 0) {
+        frame.pop_back();
+    }
+    if (rt > 0 && !frame.empty()) {
+        iovec &last = frame.back();
+        if (((const char *)last.iov_base)[last.iov_len - 1] == '\r') {
+            if (--last.iov_len == 0) {
+                frame.pop_back();
+            }
+        }
+    }
+    return rt;
+}
+
+}  // namespace ljrserver
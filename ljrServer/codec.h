@@ -0,0 +1,253 @@
+/**
+ * @file codec.h
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 分帧编解码 长度前缀 分隔符
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#pragma once
+
+#include <sys/uio.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "buffered_stream.h"
+#include "bytearray.h"
+#include "stream.h"
+
+namespace ljrserver {
+
+/**
+ * @brief 分帧编解码的基类
+ *
+ * 解码不拷贝帧内容
+ * 从 BufferedStream 读取时帧指向流的读缓存 下一次读取前有效
+ * 帧不能超过流的读缓存 读缓存不能小于 getMinReadBufferSize
+ * 从 ByteArray 解码时帧为指向 ByteArray 内存块的 iovec
+ *
+ * 编码时帧头和帧内容分开 writev 或依次写入 ByteArray 不拼接
+ */
+class FrameCodec {
+public:
+    // 智能指针
+    typedef std::shared_ptr<FrameCodec> ptr;
+
+    // 帧 指针 长度
+    typedef std::pair<const char *, size_t> Frame;
+
+    /**
+     * @brief 分帧编解码构造函数
+     *
+     * @param max_frame_size 帧内容的上限 [= 0 配置 codec.max_frame_size]
+     */
+    FrameCodec(size_t max_frame_size = 0);
+
+    /**
+     * @brief 析构函数
+     *
+     */
+    virtual ~FrameCodec() {}
+
+    // 帧内容的上限
+    size_t getMaxFrameSize() const { return m_maxFrameSize; }
+
+    /**
+     * @brief 读取时流的读缓存至少要有的大小
+     *
+     * 最大的帧内容加上帧头和帧尾
+     *
+     * @return size_t
+     */
+    size_t getMinReadBufferSize();
+
+public:  /// 解码
+    /**
+     * @brief 从连续的内存中解码一帧 纯虚函数
+     *
+     * @param data 数据
+     * @param length 数据长度
+     * @param frame 帧内容 指向 data
+     * @return int > 0 这一帧占用的字节数 包含帧头和分隔符
+     *             0 数据不够一帧
+     *             < 0 帧超过上限 errno = EMSGSIZE 或格式错误 errno = EBADMSG
+     */
+    virtual int decode(const char *data, size_t length, Frame &frame) = 0;
+
+    /**
+     * @brief 从 ByteArray 的当前位置解码一帧 纯虚函数
+     *
+     * 成功时 ByteArray 的位置移到这一帧之后
+     *
+     * @param ba 数据
+     * @param frame 帧内容 指向 ByteArray 的内存块
+     * @return int 同 decode
+     */
+    virtual int decode(ByteArray::ptr ba, std::vector<iovec> &frame) = 0;
+
+    /**
+     * @brief 从带缓存的流中读取一帧
+     *
+     * @param stream 带缓存的流
+     * @param frame 帧内容 指向流的读缓存
+     * @return int 1 成功 0 对端关闭 < 0 失败
+     *         读缓存小于 getMinReadBufferSize 时返回 -1 errno = EINVAL
+     */
+    int read(BufferedStream::ptr stream, Frame &frame);
+
+    /**
+     * @brief 从带缓存的流中批量读取
+     *
+     * 至少读到一帧 然后解码读缓存中所有完整的帧 不再读取
+     *
+     * @param stream 带缓存的流
+     * @param frames 帧内容 指向流的读缓存
+     * @param max_frames 最多解码的帧数 [= 0 不限制]
+     * @return int 帧数 0 对端关闭 < 0 失败
+     */
+    int readBatch(BufferedStream::ptr stream, std::vector<Frame> &frames,
+                  size_t max_frames = 0);
+
+public:  /// 编码
+    /**
+     * @brief 编码帧头 纯虚函数
+     *
+     * @param length 帧内容长度
+     * @param head 帧头
+     * @return size_t 帧头长度
+     */
+    virtual size_t encodeHead(size_t length, char *head) = 0;
+
+    /**
+     * @brief 编码帧尾 虚函数
+     *
+     * @return const std::string& 帧尾 分隔符
+     */
+    virtual const std::string &getTail() const;
+
+    /**
+     * @brief 编码一帧写入流 帧头 帧内容 帧尾一次 writeFixSizeV
+     *
+     * @param stream 流
+     * @param data 帧内容
+     * @param length 帧内容长度
+     * @return int 写入的字节数 <= 0 失败 帧超过上限返回 -1 errno = EMSGSIZE
+     */
+    int encode(Stream::ptr stream, const void *data, size_t length);
+
+    /**
+     * @brief 编码一帧写入 ByteArray
+     *
+     * @param ba
+     * @param data 帧内容
+     * @param length 帧内容长度
+     * @return true
+     * @return false 帧超过上限
+     */
+    bool encode(ByteArray::ptr ba, const void *data, size_t length);
+
+protected:
+    // 帧内容的上限
+    size_t m_maxFrameSize;
+};
+
+/**
+ * @brief 长度前缀分帧
+ *
+ * 帧头为帧内容长度 varint 或 1 2 4 8 字节大端
+ * varint 与 ByteArray::writeUint64 相同
+ */
+class LengthFieldCodec : public FrameCodec {
+public:
+    // 智能指针
+    typedef std::shared_ptr<LengthFieldCodec> ptr;
+
+    /**
+     * @brief 长度前缀分帧构造函数
+     *
+     * @param width 长度字段字节数 0 varint 或 1 2 4 8 [= 0]
+     * @param max_frame_size 帧内容的上限 [= 0 配置 codec.max_frame_size]
+     */
+    LengthFieldCodec(uint8_t width = 0, size_t max_frame_size = 0);
+
+    int decode(const char *data, size_t length, Frame &frame) override;
+    int decode(ByteArray::ptr ba, std::vector<iovec> &frame) override;
+    size_t encodeHead(size_t length, char *head) override;
+
+    // 长度字段字节数 0 varint
+    uint8_t getWidth() const { return m_width; }
+
+private:
+    /**
+     * @brief 解析长度字段
+     *
+     * @param data
+     * @param length
+     * @param value 帧内容长度
+     * @return int > 0 长度字段字节数 0 数据不够 < 0 格式错误或超过上限
+     */
+    int decodeHead(const char *data, size_t length, uint64_t &value);
+
+private:
+    // 长度字段字节数 0 varint
+    uint8_t m_width;
+};
+
+/**
+ * @brief 分隔符分帧
+ *
+ * 帧内容不包含分隔符
+ */
+class DelimiterCodec : public FrameCodec {
+public:
+    // 智能指针
+    typedef std::shared_ptr<DelimiterCodec> ptr;
+
+    /**
+     * @brief 分隔符分帧构造函数
+     *
+     * @param delimiter 分隔符 不能为空
+     * @param max_frame_size 帧内容的上限 [= 0 配置 codec.max_frame_size]
+     */
+    DelimiterCodec(const std::string &delimiter, size_t max_frame_size = 0);
+
+    int decode(const char *data, size_t length, Frame &frame) override;
+    int decode(ByteArray::ptr ba, std::vector<iovec> &frame) override;
+    size_t encodeHead(size_t length, char *head) override { return 0; }
+    const std::string &getTail() const override { return m_delimiter; }
+
+protected:
+    // 分隔符
+    std::string m_delimiter;
+};
+
+/**
+ * @brief 按行分帧
+ *
+ * 以 \n 分隔 帧内容去掉结尾的 \r 编码时以 \r\n 结尾
+ */
+class LineCodec : public DelimiterCodec {
+public:
+    // 智能指针
+    typedef std::shared_ptr<LineCodec> ptr;
+
+    /**
+     * @brief 按行分帧构造函数
+     *
+     * @param max_frame_size 行的上限 包含 \r [= 0 配置 codec.max_frame_size]
+     */
+    LineCodec(size_t max_frame_size = 0);
+
+    int decode(const char *data, size_t length, Frame &frame) override;
+    int decode(ByteArray::ptr ba, std::vector<iovec> &frame) override;
+    const std::string &getTail() const override { return m_tail; }
+
+private:
+    // 编码的行尾 \r\n
+    std::string m_tail;
+};
+
+}  // namespace ljrserver
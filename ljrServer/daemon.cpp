@@ -20,6 +20,14 @@
 // waitpid
 #include <sys/types.h>
 #include <sys/wait.h>
+// PR_SET_CHILD_SUBREAPER
+#include <sys/prctl.h>
+// 工作进程信息的共享内存
+#include <sys/mman.h>
+// sigtimedwait
+#include <signal.h>
+// 等待重启的工作进程
+#include <vector>
 
 namespace ljrserver {
 
@@ -31,6 +39,14 @@ static ljrserver::ConfigVar<uint32_t>::ptr g_daemon_restart_interval =
     ljrserver::Config::Lookup("daemon.restart_interval", (uint32_t)5,
                               "daemon restart interval");
 
+// 配置 prefork 汇总统计的输出间隔 秒 0 不输出
+static ljrserver::ConfigVar<uint32_t>::ptr g_daemon_stats_interval =
+    ljrserver::Config::Lookup("daemon.stats_interval", (uint32_t)60,
+                              "prefork worker stats interval");
+
+// 当前工作进程的信息 在共享内存中
+static WorkerInfo* s_worker_info = nullptr;
+
 /**
  * @brief 进程信息转字符串
  *
@@ -45,6 +61,28 @@ std::string ProcessInfo::toString() const {
     return ss.str();
 }
 
+/**
+ * @brief 工作进程信息转字符串
+ *
+ * @return std::string
+ */
+std::string WorkerInfo::toString() const {
+    std::stringstream ss;
+    ss << "[WorkerInfo index=" << index << " pid=" << pid
+       << " start_time=" << ljrserver::Time2Str(start_time)
+       << " restart_count=" << restart_count
+       << " connections=" << connections << " accepted=" << accepted
+       << " rejected=" << rejected << "]";
+    return ss.str();
+}
+
+/**
+ * @brief 获取当前工作进程的信息
+ *
+ * @return WorkerInfo* 不是 prefork 的工作进程返回 nullptr
+ */
+WorkerInfo* GetWorkerInfo() { return s_worker_info; }
+
 /**
  * @brief 主函数
  *
@@ -63,6 +101,18 @@ static int real_start(int argc, char** argv,
     return main_cb(argc, argv);
 }
 
+/**
+ * @brief 是否还有子进程
+ *
+ * @return true
+ * @return false
+ */
+static bool has_child() {
+    siginfo_t info;
+    // 不回收 只检查 没有子进程时返回 ECHILD
+    return waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == 0;
+}
+
 /**
  * @brief 守护进程
  *
@@ -81,6 +131,9 @@ static int real_daemon(int argc, char** argv,
     // 设置父进程启动时间
     ProcessInfoMgr::GetInstance()->parent_start_time = time(0);
 
+    // 热升级启动的新进程在旧进程退出后由守护进程收养
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+
     // 循环守护
     while (true) {
         // fork 子进程
@@ -106,7 +159,21 @@ static int real_daemon(int argc, char** argv,
         } else {
             // 父进程等待子进程
             int status = 0;
-            waitpid(pid, &status, 0);
+            while (true) {
+                pid_t rt = waitpid(-1, &status, 0);
+                if (rt == -1 && errno == EINTR) {
+                    continue;
+                }
+                if (rt > 0) {
+                    pid = rt;
+                }
+                if (rt == -1 || status || !has_child()) {
+                    break;
+                }
+                // 正常退出且还有收养的子进程 热升级 等待新进程
+                LJRSERVER_LOG_INFO(g_logger)
+                    << "child upgraded pid=" << rt << " wait new process";
+            }
 
             // 子进程结束
             if (status) {
@@ -152,4 +219,203 @@ int start_daemon(int argc, char** argv,
     return real_daemon(argc, argv, main_cb);
 }
 
+/**
+ * @brief fork 一个工作进程
+ *
+ * @param info 工作进程信息
+ * @param mask 工作进程恢复的信号屏蔽字
+ * @return pid_t 主进程返回工作进程 id 工作进程返回 0 失败返回 -1
+ */
+static pid_t fork_worker(WorkerInfo* info, const sigset_t& mask) {
+    pid_t master = getpid();
+    pid_t pid = fork();
+    if (pid == 0) {
+        // 主进程退出时工作进程跟着退出
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != master) {
+            // 主进程已经退出 刷新 fork 前缓冲的日志
+            LoggerMgr::GetInstance()->flush();
+            _exit(0);
+        }
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+        s_worker_info = info;
+        ProcessInfoMgr::GetInstance()->main_id = getpid();
+        ProcessInfoMgr::GetInstance()->main_start_time = time(0);
+        LJRSERVER_LOG_INFO(g_logger)
+            << "worker start index=" << info->index << " pid=" << getpid();
+        return 0;
+    } else if (pid < 0) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "fork worker fail index=" << info->index << " errno=" << errno
+            << " errstr=" << strerror(errno);
+        return -1;
+    }
+
+    info->pid = pid;
+    info->start_time = time(0);
+    info->connections = 0;
+    return pid;
+}
+
+/**
+ * @brief 输出工作进程的汇总统计
+ *
+ * @param infos 工作进程信息
+ * @param workers 工作进程个数
+ */
+static void log_worker_stats(WorkerInfo* infos, uint32_t workers) {
+    uint64_t connections = 0;
+    uint64_t accepted = 0;
+    uint64_t rejected = 0;
+    std::stringstream ss;
+    for (uint32_t i = 0; i < workers; ++i) {
+        connections += infos[i].connections;
+        accepted += infos[i].accepted;
+        rejected += infos[i].rejected;
+        ss << std::endl << infos[i].toString();
+    }
+    LJRSERVER_LOG_INFO(g_logger)
+        << "workers=" << workers << " connections=" << connections
+        << " accepted=" << accepted << " rejected=" << rejected << ss.str();
+}
+
+/**
+ * @brief prefork 启动工作进程并守护 主进程调用
+ *
+ * @param workers 工作进程个数
+ * @param worker_cb 工作进程主函数 参数为工作进程序号
+ * @param upgrade_cb 热升级 [= nullptr]
+ * @return int 主进程返回 0 工作进程返回 worker_cb 的返回值
+ */
+int start_prefork(uint32_t workers, std::function<int(uint32_t index)> worker_cb,
+                  std::function<void()> upgrade_cb) {
+    if (workers == 0) {
+        workers = 1;
+    }
+
+    // 工作进程信息放在共享内存中 fork 后主进程能读到工作进程的统计
+    void* mem = mmap(nullptr, sizeof(WorkerInfo) * workers,
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "mmap worker info fail errno=" << errno
+            << " errstr=" << strerror(errno);
+        return -1;
+    }
+    WorkerInfo* infos = (WorkerInfo*)mem;
+    for (uint32_t i = 0; i < workers; ++i) {
+        new (&infos[i]) WorkerInfo();
+        infos[i].index = i;
+    }
+
+    // 主进程的信号由 sigtimedwait 同步处理
+    sigset_t mask;
+    sigset_t oldmask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGQUIT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    // 等待重启的时间 0 不需要重启
+    std::vector<uint64_t> restart_at(workers, 0);
+    uint32_t interval = g_daemon_restart_interval->getValue();
+    for (uint32_t i = 0; i < workers; ++i) {
+        pid_t pid = fork_worker(&infos[i], oldmask);
+        if (pid == 0) {
+            return worker_cb(i);
+        }
+        if (pid < 0) {
+            restart_at[i] = time(0) + interval;
+        }
+    }
+
+    bool stopping = false;
+    uint64_t last_stats = time(0);
+    while (true) {
+        // 回收退出的工作进程
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (uint32_t i = 0; i < workers; ++i) {
+                if (infos[i].pid != pid) {
+                    continue;
+                }
+                infos[i].pid = 0;
+                infos[i].connections = 0;
+                if (status && !stopping) {
+                    // 异常退出 稍后重启
+                    LJRSERVER_LOG_ERROR(g_logger)
+                        << "worker crash index=" << i << " pid=" << pid
+                        << " status=" << status;
+                    restart_at[i] = time(0) + interval;
+                } else {
+                    LJRSERVER_LOG_INFO(g_logger)
+                        << "worker finished index=" << i << " pid=" << pid
+                        << " status=" << status;
+                }
+                break;
+            }
+        }
+
+        uint64_t now = time(0);
+        bool alive = false;
+        for (uint32_t i = 0; i < workers; ++i) {
+            if (infos[i].pid) {
+                alive = true;
+                continue;
+            }
+            if (stopping || !restart_at[i]) {
+                continue;
+            }
+            alive = true;
+            if (now < restart_at[i]) {
+                continue;
+            }
+            // 重启工作进程
+            infos[i].restart_count += 1;
+            ProcessInfoMgr::GetInstance()->restart_count += 1;
+            pid_t pid = fork_worker(&infos[i], oldmask);
+            if (pid == 0) {
+                return worker_cb(i);
+            }
+            restart_at[i] = pid < 0 ? now + interval : 0;
+        }
+        if (!alive) {
+            break;
+        }
+
+        uint32_t stats_interval = g_daemon_stats_interval->getValue();
+        if (stats_interval && now >= last_stats + stats_interval) {
+            log_worker_stats(infos, workers);
+            last_stats = now;
+        }
+
+        // 等待信号 最多 1 秒
+        timespec ts = {1, 0};
+        siginfo_t info;
+        int sig = sigtimedwait(&mask, &info, &ts);
+        if (sig == SIGQUIT || sig == SIGTERM || sig == SIGINT) {
+            // SIGQUIT 工作进程处理完已有的连接再退出
+            LJRSERVER_LOG_INFO(g_logger) << "master stopping signal=" << sig;
+            stopping = true;
+            for (uint32_t i = 0; i < workers; ++i) {
+                if (infos[i].pid) {
+                    kill(infos[i].pid, sig == SIGQUIT ? SIGQUIT : SIGTERM);
+                }
+            }
+        } else if (sig == SIGUSR2 && upgrade_cb) {
+            upgrade_cb();
+        }
+    }
+
+    log_worker_stats(infos, workers);
+    sigprocmask(SIG_SETMASK, &oldmask, nullptr);
+    munmap(mem, sizeof(WorkerInfo) * workers);
+    return 0;
+}
+
 };  // namespace ljrserver
\ No newline at end of file
@@ -12,6 +12,9 @@
 #include <unistd.h>
 // 函数包装
 #include <functional>
+// 工作进程统计
+#include <atomic>
+#include <string>
 
 // 单例模式
 #include "singleton.h"
@@ -48,6 +51,48 @@ struct ProcessInfo {
 
 typedef ljrserver::Singleton<ProcessInfo> ProcessInfoMgr;
 
+/**
+ * @brief prefork 工作进程信息
+ *
+ * 放在主进程 fork 前映射的共享内存中 工作进程上报统计 主进程汇总
+ */
+struct WorkerInfo {
+    // 工作进程序号
+    uint32_t index = 0;
+
+    // 工作进程 id 0 没有运行
+    pid_t pid = 0;
+
+    // 工作进程启动时间
+    uint64_t start_time = 0;
+
+    // 工作进程重启次数
+    uint32_t restart_count = 0;
+
+    // 当前连接数
+    std::atomic<uint64_t> connections{0};
+
+    // 接受的连接数
+    std::atomic<uint64_t> accepted{0};
+
+    // 超过上限被关闭的连接数
+    std::atomic<uint64_t> rejected{0};
+
+    /**
+     * @brief 工作进程信息转字符串
+     *
+     * @return std::string
+     */
+    std::string toString() const;
+};
+
+/**
+ * @brief 获取当前工作进程的信息
+ *
+ * @return WorkerInfo* 不是 prefork 的工作进程返回 nullptr
+ */
+WorkerInfo* GetWorkerInfo();
+
 /**
  * @brief 启动守护进程
  *
@@ -61,4 +106,20 @@ int start_daemon(int argc, char** argv,
                  std::function<int(int argc, char** argv)> main_cb,
                  bool is_daemon);
 
+/**
+ * @brief prefork 启动工作进程并守护 主进程调用
+ *
+ * 工作进程异常退出时等待 daemon.restart_interval 后重启
+ * 主进程收到 SIGQUIT 时转发给工作进程 等工作进程处理完连接退出
+ * 收到 SIGTERM SIGINT 时结束工作进程 收到 SIGUSR2 时调用 upgrade_cb
+ * 每 daemon.stats_interval 秒输出一次工作进程的汇总统计
+ *
+ * @param workers 工作进程个数
+ * @param worker_cb 工作进程主函数 参数为工作进程序号
+ * @param upgrade_cb 热升级 [= nullptr]
+ * @return int 主进程返回 0 工作进程返回 worker_cb 的返回值
+ */
+int start_prefork(uint32_t workers, std::function<int(uint32_t index)> worker_cb,
+                  std::function<void()> upgrade_cb = nullptr);
+
 };  // namespace ljrserver
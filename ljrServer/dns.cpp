@@ -0,0 +1,705 @@
+/**
+ * @file dns.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 域名解析
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "dns.h"
+
+// socket
+#include "socket.h"
+// 配置
+#include "config.h"
+// 日志
+#include "log.h"
+// 单调时钟
+#include "clock.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include <ctype.h>
+#include <string.h>
+#include <sys/random.h>
+
+namespace ljrserver {
+
+// system 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
+
+// 是否使用域名解析器
+static ljrserver::ConfigVar<bool>::ptr g_dns_enable =
+    ljrserver::Config::Lookup("dns.enable", true, "dns resolver enable");
+
+// resolv.conf 路径
+static ljrserver::ConfigVar<std::string>::ptr g_dns_resolv_conf =
+    ljrserver::Config::Lookup("dns.resolv_conf",
+                              std::string("/etc/resolv.conf"),
+                              "dns resolv.conf path");
+
+// hosts 路径
+static ljrserver::ConfigVar<std::string>::ptr g_dns_hosts =
+    ljrserver::Config::Lookup("dns.hosts", std::string("/etc/hosts"),
+                              "dns hosts path");
+
+// 单次查询超时 ms
+static ljrserver::ConfigVar<int>::ptr g_dns_timeout =
+    ljrserver::Config::Lookup("dns.timeout", 2000, "dns query timeout ms");
+
+// 每个服务器的尝试次数
+static ljrserver::ConfigVar<int>::ptr g_dns_attempts =
+    ljrserver::Config::Lookup("dns.attempts", 2, "dns query attempts");
+
+// 负缓存时间 s
+static ljrserver::ConfigVar<int>::ptr g_dns_negative_ttl =
+    ljrserver::Config::Lookup("dns.negative_ttl", 30,
+                              "dns negative cache ttl seconds");
+
+// 缓存时间上限 s
+static ljrserver::ConfigVar<int>::ptr g_dns_max_ttl =
+    ljrserver::Config::Lookup("dns.max_ttl", 3600,
+                              "dns cache max ttl seconds");
+
+// 缓存容量
+static ljrserver::ConfigVar<int>::ptr g_dns_cache_size =
+    ljrserver::Config::Lookup("dns.cache_size", 16384, "dns cache size");
+
+// 记录类型
+static const uint16_t DNS_TYPE_A = 1;
+static const uint16_t DNS_TYPE_AAAA = 28;
+
+// 查询 id 取不到随机数时使用
+static std::atomic<uint16_t> s_query_id = {0};
+
+/**
+ * @brief 随机的查询 id 不能被猜到 防止伪造响应污染缓存
+ *
+ * @return uint16_t
+ */
+static uint16_t RandomQueryId() {
+    uint16_t id = 0;
+    if (getrandom(&id, sizeof(id), GRND_NONBLOCK) == sizeof(id)) {
+        return id;
+    }
+    LJRSERVER_LOG_WARN(g_logger)
+        << "dns getrandom errno=" << errno << " errno-string=" << strerror(errno);
+    return (uint16_t)(++s_query_id ^ Clock::NowUS());
+}
+
+/**
+ * @brief 读取大端 16 位整数
+ *
+ * @param p
+ * @return uint16_t
+ */
+static uint16_t ReadU16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+
+/**
+ * @brief 读取大端 32 位整数
+ *
+ * @param p
+ * @return uint32_t
+ */
+static uint32_t ReadU32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief 写入大端 16 位整数
+ *
+ * @param out
+ * @param v
+ */
+static void WriteU16(std::string &out, uint16_t v) {
+    out.push_back((char)(v >> 8));
+    out.push_back((char)(v & 0xff));
+}
+
+/**
+ * @brief 复制地址 缓存中的地址不交给调用方修改
+ *
+ * @param addr
+ * @return IPAddress::ptr
+ */
+static IPAddress::ptr Clone(IPAddress::ptr addr) {
+    return std::dynamic_pointer_cast<IPAddress>(
+        Address::Create(addr->getAddr(), addr->getAddrLen()));
+}
+
+/**
+ * @brief 构造查询报文
+ *
+ * @param out 报文
+ * @param id 查询 id
+ * @param name 域名
+ * @param qtype 记录类型
+ * @return true
+ * @return false 域名格式错误
+ */
+static bool BuildQuery(std::string &out, uint16_t id, const std::string &name,
+                       uint16_t qtype) {
+    // header: id flags(RD) qdcount=1 ancount nscount arcount
+    WriteU16(out, id);
+    WriteU16(out, 0x0100);
+    WriteU16(out, 1);
+    WriteU16(out, 0);
+    WriteU16(out, 0);
+    WriteU16(out, 0);
+
+    // question: 标签序列
+    size_t begin = 0;
+    while (begin < name.size()) {
+        size_t end = name.find('.', begin);
+        if (end == std::string::npos) {
+            end = name.size();
+        }
+        size_t len = end - begin;
+        if (len == 0 || len > 63) {
+            return false;
+        }
+        out.push_back((char)len);
+        out.append(name, begin, len);
+        begin = end + 1;
+    }
+    out.push_back(0);
+    if (out.size() - 12 > 255) {
+        return false;
+    }
+
+    WriteU16(out, qtype);
+    // class IN
+    WriteU16(out, 1);
+    return true;
+}
+
+/**
+ * @brief 跳过报文中的域名 支持压缩指针
+ *
+ * @param data
+ * @param len
+ * @param pos
+ * @return true
+ * @return false
+ */
+static bool SkipName(const uint8_t *data, size_t len, size_t &pos) {
+    while (pos < len) {
+        uint8_t l = data[pos];
+        if (l == 0) {
+            ++pos;
+            return true;
+        }
+        if ((l & 0xc0) == 0xc0) {
+            // 压缩指针 两个字节
+            pos += 2;
+            return pos <= len;
+        }
+        pos += 1 + l;
+    }
+    return false;
+}
+
+/**
+ * @brief 响应的问题是否和查询的一致 域名不区分大小写
+ *
+ * @param data 响应报文
+ * @param len 长度
+ * @param query 查询报文
+ * @return true
+ * @return false
+ */
+static bool MatchQuestion(const uint8_t *data, size_t len,
+                          const std::string &query) {
+    // 查询只有一个问题 响应中的域名不会压缩
+    if (ReadU16(data + 4) != 1 || len < query.size()) {
+        return false;
+    }
+    size_t qtail = query.size() - 4;
+    for (size_t i = 12; i < qtail; ++i) {
+        if (tolower(data[i]) != tolower((uint8_t)query[i])) {
+            return false;
+        }
+    }
+    // qtype qclass
+    return memcmp(data + qtail, query.data() + qtail, 4) == 0;
+}
+
+/**
+ * @brief 解析响应报文
+ *
+ * @param data 报文
+ * @param len 长度
+ * @param query 查询报文 核对 id 和问题
+ * @param qtype 记录类型
+ * @param result 保存地址
+ * @param ttl 记录的最小 TTL
+ * @return int rcode -1 不是对应的响应或格式错误
+ */
+static int ParseResponse(const uint8_t *data, size_t len,
+                         const std::string &query, uint16_t qtype,
+                         std::vector<IPAddress::ptr> &result, uint32_t &ttl) {
+    if (len < 12 ||
+        ReadU16(data) != ReadU16((const uint8_t *)query.data())) {
+        return -1;
+    }
+    uint16_t flags = ReadU16(data + 2);
+    if (!(flags & 0x8000)) {
+        // 不是响应
+        return -1;
+    }
+    if (!MatchQuestion(data, len, query)) {
+        // id 碰巧相同的其他查询的响应或伪造的响应
+        return -1;
+    }
+    int rcode = flags & 0x0f;
+    if (rcode) {
+        return rcode;
+    }
+
+    uint16_t qdcount = ReadU16(data + 4);
+    uint16_t ancount = ReadU16(data + 6);
+    size_t pos = 12;
+    for (uint16_t i = 0; i < qdcount; ++i) {
+        if (!SkipName(data, len, pos) || pos + 4 > len) {
+            return -1;
+        }
+        pos += 4;
+    }
+
+    std::vector<IPAddress::ptr> addrs;
+    uint32_t min_ttl = ~0u;
+    for (uint16_t i = 0; i < ancount; ++i) {
+        if (!SkipName(data, len, pos) || pos + 10 > len) {
+            return -1;
+        }
+        uint16_t type = ReadU16(data + pos);
+        uint16_t klass = ReadU16(data + pos + 2);
+        uint32_t rr_ttl = ReadU32(data + pos + 4);
+        uint16_t rdlen = ReadU16(data + pos + 8);
+        pos += 10;
+        if (pos + rdlen > len) {
+            return -1;
+        }
+
+        // CNAME 等其他记录跳过 递归服务器会一并返回最终的地址记录
+        if (type == qtype && klass == 1) {
+            if (type == DNS_TYPE_A && rdlen == 4) {
+                addrs.push_back(
+                    IPAddress::ptr(new IPv4Address(ReadU32(data + pos))));
+                min_ttl = std::min(min_ttl, rr_ttl);
+            } else if (type == DNS_TYPE_AAAA && rdlen == 16) {
+                addrs.push_back(IPAddress::ptr(new IPv6Address(data + pos)));
+                min_ttl = std::min(min_ttl, rr_ttl);
+            }
+        }
+        pos += rdlen;
+    }
+
+    result.insert(result.end(), addrs.begin(), addrs.end());
+    ttl = addrs.empty() ? 0 : min_ttl;
+    return 0;
+}
+
+/**
+ * @brief 是否使用域名解析器
+ *
+ * @return true
+ * @return false
+ */
+bool DnsResolver::IsEnabled() { return g_dns_enable->getValue(); }
+
+/**
+ * @brief 域名解析器构造函数 读取配置的 resolv.conf 和 hosts
+ *
+ */
+DnsResolver::DnsResolver() {
+    loadResolvConf(g_dns_resolv_conf->getValue());
+    loadHosts(g_dns_hosts->getValue());
+}
+
+/**
+ * @brief 解析域名
+ *
+ * @param result 保存解析到的地址 端口为 0
+ * @param name 域名
+ * @param family AF_INET AF_INET6 AF_UNSPEC [= AF_INET]
+ * @return Result
+ */
+DnsResolver::Result DnsResolver::resolve(std::vector<IPAddress::ptr> &result,
+                                         const std::string &name, int family) {
+    if (name.empty() || name.size() > 254) {
+        return INVALID_NAME;
+    }
+
+    // 域名不区分大小写
+    std::string host = name;
+    std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+
+    // 以点结尾为完整域名 不加 search 域
+    bool absolute = host.back() == '.';
+    if (absolute) {
+        host.pop_back();
+    }
+
+    if (lookupHosts(result, host, family)) {
+        return SUCCESS;
+    }
+
+    // 待查询的完整域名
+    std::vector<std::string> names;
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        if (absolute) {
+            names.push_back(host);
+        } else {
+            int dots = std::count(host.begin(), host.end(), '.');
+            if (dots >= m_ndots) {
+                names.push_back(host);
+            }
+            for (auto &i : m_search) {
+                names.push_back(host + "." + i);
+            }
+            if (dots < m_ndots) {
+                names.push_back(host);
+            }
+        }
+    }
+
+    Result rt = NOT_FOUND;
+    for (auto &n : names) {
+        Result r = NOT_FOUND;
+        if (family == AF_INET || family == AF_UNSPEC) {
+            r = lookup(result, n, DNS_TYPE_A);
+        }
+        if (family == AF_INET6 || family == AF_UNSPEC) {
+            Result r6 = lookup(result, n, DNS_TYPE_AAAA);
+            if (r != SUCCESS) {
+                r = r6;
+            }
+        }
+
+        if (r == SUCCESS) {
+            return SUCCESS;
+        }
+        if (r != NOT_FOUND) {
+            // 记录错误 继续尝试其他 search 域
+            rt = r;
+        }
+    }
+    return rt;
+}
+
+/**
+ * @brief 查询一种记录 先查缓存
+ *
+ * @param result 保存地址
+ * @param name 完整域名
+ * @param qtype 记录类型 A AAAA
+ * @return Result
+ */
+DnsResolver::Result DnsResolver::lookup(std::vector<IPAddress::ptr> &result,
+                                        const std::string &name,
+                                        uint16_t qtype) {
+    std::string key = name + "/" + std::to_string(qtype);
+    CacheShard &shard = m_shards[std::hash<std::string>()(key) % kShards];
+
+    {
+        MutexType::Lock lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end() &&
+            it->second.expire > Clock::NowMS()) {
+            ++m_cacheHits;
+            for (auto &i : it->second.addrs) {
+                result.push_back(Clone(i));
+            }
+            return it->second.addrs.empty() ? NOT_FOUND : SUCCESS;
+        }
+    }
+    ++m_cacheMisses;
+
+    std::vector<IPAddress::ptr> addrs;
+    uint32_t ttl = 0;
+    Result rt = query(addrs, name, qtype, ttl);
+    if (rt != SUCCESS && rt != NOT_FOUND) {
+        // 超时等错误不缓存
+        return rt;
+    }
+
+    // 成功按记录 TTL 缓存 不存在按负缓存时间缓存
+    uint64_t seconds = rt == SUCCESS
+                           ? std::min<uint64_t>(ttl, g_dns_max_ttl->getValue())
+                           : g_dns_negative_ttl->getValue();
+    if (seconds > 0) {
+        size_t max_size =
+            std::max(1, g_dns_cache_size->getValue() / kShards);
+        uint64_t now = Clock::NowMS();
+
+        MutexType::Lock lock(shard.mutex);
+        if (shard.entries.size() >= max_size) {
+            // 清理过期的缓存项 仍然满则随意淘汰一项
+            for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+                if (it->second.expire <= now) {
+                    it = shard.entries.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            if (shard.entries.size() >= max_size) {
+                shard.entries.erase(shard.entries.begin());
+            }
+        }
+        CacheEntry &entry = shard.entries[key];
+        entry.addrs = addrs;
+        entry.expire = now + seconds * 1000;
+    }
+
+    for (auto &i : addrs) {
+        result.push_back(Clone(i));
+    }
+    return rt;
+}
+
+/**
+ * @brief 向域名服务器查询一种记录
+ *
+ * @param result 保存地址
+ * @param name 完整域名
+ * @param qtype 记录类型 A AAAA
+ * @param ttl 记录的最小 TTL 秒
+ * @return Result
+ */
+DnsResolver::Result DnsResolver::query(std::vector<IPAddress::ptr> &result,
+                                       const std::string &name, uint16_t qtype,
+                                       uint32_t &ttl) {
+    std::vector<IPAddress::ptr> servers = getNameservers();
+    if (servers.empty()) {
+        return NO_SERVER;
+    }
+
+    uint16_t id = RandomQueryId();
+    std::string packet;
+    if (!BuildQuery(packet, id, name, qtype)) {
+        return INVALID_NAME;
+    }
+
+    uint8_t buf[1500];
+    for (int attempt = 0; attempt < g_dns_attempts->getValue(); ++attempt) {
+        for (auto &server : servers) {
+            ++m_queries;
+            // hook 的 socket 等待响应时协程让出执行权
+            Socket::ptr sock = Socket::CreateUDP(server);
+            if (!sock->connect(server)) {
+                continue;
+            }
+            sock->setRecvTimeout(g_dns_timeout->getValue());
+            if (sock->send(packet.c_str(), packet.size()) !=
+                (int)packet.size()) {
+                continue;
+            }
+
+            while (true) {
+                int n = sock->recv(buf, sizeof(buf));
+                if (n <= 0) {
+                    // 超时 换下一个服务器
+                    LJRSERVER_LOG_DEBUG(g_logger)
+                        << "dns query " << name << " server="
+                        << server->toString() << " errno=" << errno
+                        << " errno-string=" << strerror(errno);
+                    break;
+                }
+
+                int rcode = ParseResponse(buf, n, packet, qtype, result, ttl);
+                if (rcode == -1) {
+                    // 不是这次查询的响应
+                    continue;
+                }
+                if (rcode == 0) {
+                    // 没有对应类型的记录也算不存在
+                    return result.empty() ? NOT_FOUND : SUCCESS;
+                }
+                if (rcode == 3) {
+                    // NXDOMAIN
+                    return NOT_FOUND;
+                }
+                // SERVFAIL REFUSED 等 换下一个服务器
+                LJRSERVER_LOG_DEBUG(g_logger)
+                    << "dns query " << name << " server=" << server->toString()
+                    << " rcode=" << rcode;
+                break;
+            }
+        }
+    }
+    return TIMEOUT;
+}
+
+/**
+ * @brief 查询 hosts
+ *
+ * @param result 保存地址
+ * @param name 域名
+ * @param family 协议簇
+ * @return true 找到
+ * @return false
+ */
+bool DnsResolver::lookupHosts(std::vector<IPAddress::ptr> &result,
+                              const std::string &name, int family) {
+    RWMutexType::ReadLock lock(m_mutex);
+    auto it = m_hosts.find(name);
+    if (it == m_hosts.end()) {
+        return false;
+    }
+
+    bool found = false;
+    for (auto &i : it->second) {
+        if (family == AF_UNSPEC || family == i->getFamily()) {
+            result.push_back(Clone(i));
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief 读取 resolv.conf 的 nameserver search options
+ *
+ * @param path 路径
+ * @return true
+ * @return false
+ */
+bool DnsResolver::loadResolvConf(const std::string &path) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+        LJRSERVER_LOG_WARN(g_logger) << "dns open " << path << " fail";
+        return false;
+    }
+
+    std::vector<IPAddress::ptr> servers;
+    std::vector<std::string> search;
+    int ndots = 1;
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream ss(line);
+        std::string key;
+        if (!(ss >> key) || key[0] == '#' || key[0] == ';') {
+            continue;
+        }
+        if (key == "nameserver") {
+            std::string ip;
+            ss >> ip;
+            IPAddress::ptr addr = IPAddress::Create(ip.c_str(), 53);
+            if (addr) {
+                servers.push_back(addr);
+            }
+        } else if (key == "search" || key == "domain") {
+            search.clear();
+            std::string domain;
+            while (ss >> domain) {
+                search.push_back(domain);
+            }
+        } else if (key == "options") {
+            std::string opt;
+            while (ss >> opt) {
+                if (opt.compare(0, 6, "ndots:") == 0) {
+                    ndots = atoi(opt.c_str() + 6);
+                }
+            }
+        }
+    }
+
+    RWMutexType::WriteLock lock(m_mutex);
+    m_servers.swap(servers);
+    m_search.swap(search);
+    m_ndots = ndots;
+    return true;
+}
+
+/**
+ * @brief 读取 hosts 文件
+ *
+ * @param path 路径
+ * @return true
+ * @return false
+ */
+bool DnsResolver::loadHosts(const std::string &path) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+        LJRSERVER_LOG_WARN(g_logger) << "dns open " << path << " fail";
+        return false;
+    }
+
+    std::unordered_map<std::string, std::vector<IPAddress::ptr> > hosts;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        // 去掉注释
+        size_t pos = line.find('#');
+        if (pos != std::string::npos) {
+            line.resize(pos);
+        }
+
+        std::istringstream ss(line);
+        std::string ip;
+        if (!(ss >> ip)) {
+            continue;
+        }
+        IPAddress::ptr addr = IPAddress::Create(ip.c_str(), 0);
+        if (!addr) {
+            continue;
+        }
+
+        std::string host;
+        while (ss >> host) {
+            std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+            hosts[host].push_back(addr);
+        }
+    }
+
+    RWMutexType::WriteLock lock(m_mutex);
+    m_hosts.swap(hosts);
+    return true;
+}
+
+/**
+ * @brief 设置域名服务器 端口为 0 时使用 53
+ *
+ * @param servers
+ */
+void DnsResolver::setNameservers(const std::vector<IPAddress::ptr> &servers) {
+    std::vector<IPAddress::ptr> tmp;
+    for (auto &i : servers) {
+        IPAddress::ptr addr = Clone(i);
+        if (addr->getPort() == 0) {
+            addr->setPort(53);
+        }
+        tmp.push_back(addr);
+    }
+
+    RWMutexType::WriteLock lock(m_mutex);
+    m_servers.swap(tmp);
+}
+
+/**
+ * @brief 获取域名服务器
+ *
+ * @return std::vector<IPAddress::ptr>
+ */
+std::vector<IPAddress::ptr> DnsResolver::getNameservers() {
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_servers;
+}
+
+/**
+ * @brief 清空缓存
+ *
+ */
+void DnsResolver::clearCache() {
+    for (int i = 0; i < kShards; ++i) {
+        MutexType::Lock lock(m_shards[i].mutex);
+        m_shards[i].entries.clear();
+    }
+}
+
+}  // namespace ljrserver
@@ -0,0 +1,239 @@
+/**
+ * @file dns.h
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 域名解析
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+
+// 地址
+#include "address.h"
+// 锁
+#include "thread.h"
+// 单例模式
+#include "singleton.h"
+
+namespace ljrserver {
+
+/**
+ * @brief Class 域名解析器
+ *
+ * 通过 hook 的 UDP socket 向 resolv.conf 中的服务器查询 协程中不阻塞线程
+ * 先查 /etc/hosts 再查缓存 缓存按 TTL 过期 分片加锁
+ * 不存在的域名也缓存 (负缓存) 避免重复查询
+ */
+class DnsResolver {
+public:
+    // 智能指针
+    typedef std::shared_ptr<DnsResolver> ptr;
+
+    // 互斥锁
+    typedef Mutex MutexType;
+
+    // 读写锁
+    typedef RWMutex RWMutexType;
+
+    /**
+     * @brief 解析结果
+     *
+     */
+    enum Result {
+        // 成功
+        SUCCESS = 0,
+        // 域名不存在或没有对应类型的记录
+        NOT_FOUND = 1,
+        // 没有可用的域名服务器
+        NO_SERVER = 2,
+        // 所有服务器都超时或返回错误
+        TIMEOUT = 3,
+        // 域名格式错误
+        INVALID_NAME = 4
+    };
+
+    /**
+     * @brief 是否使用域名解析器 配置 dns.enable
+     *
+     * @return true
+     * @return false
+     */
+    static bool IsEnabled();
+
+    /**
+     * @brief 域名解析器构造函数 读取配置的 resolv.conf 和 hosts
+     *
+     */
+    DnsResolver();
+
+    /**
+     * @brief 解析域名
+     *
+     * @param result 保存解析到的地址 端口为 0
+     * @param name 域名
+     * @param family AF_INET AF_INET6 AF_UNSPEC [= AF_INET]
+     * @return Result
+     */
+    Result resolve(std::vector<IPAddress::ptr> &result, const std::string &name,
+                   int family = AF_INET);
+
+    /**
+     * @brief 读取 resolv.conf 的 nameserver search options
+     *
+     * @param path 路径
+     * @return true
+     * @return false
+     */
+    bool loadResolvConf(const std::string &path);
+
+    /**
+     * @brief 读取 hosts 文件
+     *
+     * @param path 路径
+     * @return true
+     * @return false
+     */
+    bool loadHosts(const std::string &path);
+
+    /**
+     * @brief 设置域名服务器 端口为 0 时使用 53
+     *
+     * @param servers
+     */
+    void setNameservers(const std::vector<IPAddress::ptr> &servers);
+
+    /**
+     * @brief 获取域名服务器
+     *
+     * @return std::vector<IPAddress::ptr>
+     */
+    std::vector<IPAddress::ptr> getNameservers();
+
+    /**
+     * @brief 清空缓存
+     *
+     */
+    void clearCache();
+
+    /**
+     * @brief 缓存命中次数
+     *
+     * @return uint64_t
+     */
+    uint64_t getCacheHits() const { return m_cacheHits; }
+
+    /**
+     * @brief 缓存未命中次数
+     *
+     * @return uint64_t
+     */
+    uint64_t getCacheMisses() const { return m_cacheMisses; }
+
+    /**
+     * @brief 发出的查询次数
+     *
+     * @return uint64_t
+     */
+    uint64_t getQueries() const { return m_queries; }
+
+private:
+    /**
+     * @brief 查询一种记录 先查缓存
+     *
+     * @param result 保存地址
+     * @param name 完整域名
+     * @param qtype 记录类型 A AAAA
+     * @return Result
+     */
+    Result lookup(std::vector<IPAddress::ptr> &result, const std::string &name,
+                  uint16_t qtype);
+
+    /**
+     * @brief 向域名服务器查询一种记录
+     *
+     * @param result 保存地址
+     * @param name 完整域名
+     * @param qtype 记录类型 A AAAA
+     * @param ttl 记录的最小 TTL 秒
+     * @return Result
+     */
+    Result query(std::vector<IPAddress::ptr> &result, const std::string &name,
+                 uint16_t qtype, uint32_t &ttl);
+
+    /**
+     * @brief 查询 hosts
+     *
+     * @param result 保存地址
+     * @param name 域名
+     * @param family 协议簇
+     * @return true 找到
+     * @return false
+     */
+    bool lookupHosts(std::vector<IPAddress::ptr> &result,
+                     const std::string &name, int family);
+
+private:
+    /**
+     * @brief 缓存项
+     *
+     */
+    struct CacheEntry {
+        // 地址 空为负缓存
+        std::vector<IPAddress::ptr> addrs;
+        // 过期时间 单调时钟 ms
+        uint64_t expire = 0;
+    };
+
+    /**
+     * @brief 缓存分片
+     *
+     */
+    struct CacheShard {
+        // 互斥锁
+        MutexType mutex;
+        // 域名/类型 -> 缓存项
+        std::unordered_map<std::string, CacheEntry> entries;
+    };
+
+    // 缓存分片数
+    static const int kShards = 16;
+
+private:
+    // 配置锁 服务器 search hosts
+    RWMutexType m_mutex;
+
+    // 域名服务器
+    std::vector<IPAddress::ptr> m_servers;
+
+    // search 域
+    std::vector<std::string> m_search;
+
+    // 域名中的点少于 ndots 时先尝试 search 域
+    int m_ndots = 1;
+
+    // hosts 域名 -> 地址
+    std::unordered_map<std::string, std::vector<IPAddress::ptr> > m_hosts;
+
+    // 缓存分片
+    CacheShard m_shards[kShards];
+
+    // 缓存命中次数
+    std::atomic<uint64_t> m_cacheHits = {0};
+
+    // 缓存未命中次数
+    std::atomic<uint64_t> m_cacheMisses = {0};
+
+    // 查询次数
+    std::atomic<uint64_t> m_queries = {0};
+};
+
+// 单例模式
+typedef Singleton<DnsResolver> DnsMgr;
+
+}  // namespace ljrserver
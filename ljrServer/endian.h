@@ -11,7 +11,8 @@
 #include <byteswap.h>
 // int
 #include <stdint.h>
-// #include <type_traits>
+// enable_if
+#include <type_traits>
 
 namespace ljrserver {
 
@@ -57,6 +58,20 @@ typename std::enable_if<sizeof(T) == sizeof(uint16_t), T>::type byteswap(
     return (T)bswap_16((uint16_t)value);
 }
 
+/**
+ * @brief 模版函数 1 字节类型的字节序转换 不需要转换
+ * 8bit
+ *
+ * @tparam T
+ * @param value
+ * @return std::enable_if<sizeof(T) == sizeof(uint8_t), T>::type
+ */
+template <class T>
+typename std::enable_if<sizeof(T) == sizeof(uint8_t), T>::type byteswap(
+    T value) {
+    return value;
+}
+
 #if BYTE_ORDER == BIG_ENDIAN
 // 大端字节序
 #define LJRSERVER_BYTE_ORDER LJRSERVER_BIG_ENDIAN
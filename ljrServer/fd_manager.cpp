@@ -12,9 +12,9 @@
 namespace ljrserver {
 
 /**
- * @brief 句柄构造函数
+ * @brief 句柄构造函数 不初始化 由 FdManager 创建时初始化
  *
- * @param fd
+ * @param fd [= -1]
  */
 FdCtx::FdCtx(int fd)
     : m_isInit(false),
@@ -24,19 +24,19 @@ FdCtx::FdCtx(int fd)
       m_isClosed(false),
       m_fd(fd),
       m_recvTimeout(-1),
-      m_sendTimeout(-1) {
+      m_sendTimeout(-1),
+      m_generation(0) {
     // 初始化列表要和成员变量声明顺序一致
-    // 初始化
-    init();
 }
 
 /**
  * @brief 句柄初始化
  *
+ * @param nonblock_socket 已知是非阻塞 socket 跳过 fstat fcntl [= false]
  * @return true
  * @return false
  */
-bool FdCtx::init() {
+bool FdCtx::init(bool nonblock_socket) {
     // 是否初始化
     if (m_isInit) {
         // 已经初始化
@@ -47,6 +47,15 @@ bool FdCtx::init() {
     m_recvTimeout = -1;
     m_sendTimeout = -1;
 
+    if (nonblock_socket) {
+        m_isInit = true;
+        m_isSocket = true;
+        m_sysNonblock = true;
+        m_userNonblock = false;
+        m_isClosed = false;
+        return true;
+    }
+
     struct stat fd_stat;
     if (-1 == fstat(m_fd, &fd_stat)) {
         // 句柄还没有初始化
@@ -125,54 +134,61 @@ uint64_t FdCtx::getTimeout(int type) {
  *
  */
 FdManager::FdManager() {
-    // 初始化句柄数组大小
-    m_datas.resize(64);
+    for (int i = 0; i < kMaxBlocks; ++i) {
+        m_blocks[i].store(nullptr, std::memory_order_relaxed);
+    }
 }
 
 /**
- * @brief 获取句柄对象
+ * @brief 句柄管理器的析构函数
  *
- * @param fd 句柄
- * @param auto_create 不存在是否创建 [= false]
- * @return FdCtx::ptr
  */
-FdCtx::ptr FdManager::get(int fd, bool auto_create) {
-    if (fd == -1) {
-        return nullptr;
+FdManager::~FdManager() {
+    for (int i = 0; i < kMaxBlocks; ++i) {
+        delete[] m_blocks[i].load(std::memory_order_relaxed);
     }
+}
 
-    // 上读锁
-    RWmutexType::ReadLock lock(m_mutex);
-    if ((int)m_datas.size() < fd) {
-        // 没有句柄
-        if (auto_create == false) {
-            // 不自动创建
-            return nullptr;
-        }
-        // 自动创建
-    } else {
-        // 有句柄 不自动创建
-        if (m_datas[fd] || !auto_create) {
-            return m_datas[fd];
+/**
+ * @brief 获取句柄所在的块 没有则分配 调用方持有 m_mutex
+ *
+ * @param index 块号
+ * @return FdCtx*
+ */
+FdCtx *FdManager::getBlock(int index) {
+    FdCtx *block = m_blocks[index].load(std::memory_order_acquire);
+    if (!block) {
+        block = new FdCtx[kBlockSize];
+        for (int i = 0; i < kBlockSize; ++i) {
+            block[i].m_fd = index * kBlockSize + i;
         }
+        // 发布 get 读到非空时块已经初始化完毕
+        m_blocks[index].store(block, std::memory_order_release);
     }
-    // 解读锁
-    lock.unlock();
-
-    // 上写锁
-    RWmutexType::WriteLock lock2(m_mutex);
-    // 创建新句柄对象
-    FdCtx::ptr ctx(new FdCtx(fd));
-
-    // 是否需要扩容
-    if (fd >= (int)m_datas.size()) {
-        // 1.5 倍扩容
-        m_datas.resize(fd * 1.5);
-    }
+    return block;
+}
 
-    // 加入句柄对象数组
-    m_datas[fd] = ctx;
+/**
+ * @brief 创建句柄
+ *
+ * @param fd 句柄
+ * @param nonblock_socket 已知是非阻塞 socket [= false]
+ * @return FdCtx::ptr
+ */
+FdCtx::ptr FdManager::create(int fd, bool nonblock_socket) {
+    MutexType::Lock lock(m_mutex);
+    FdCtx *ctx = &getBlock(fd / kBlockSize)[fd % kBlockSize];
+
+    uint32_t gen = ctx->m_generation.load(std::memory_order_relaxed);
+    if (gen & 1) {
+        // 其他线程已经创建
+        return ctx;
+    }
 
+    // 重新初始化 再发布为使用中
+    ctx->m_isInit = false;
+    ctx->init(nonblock_socket);
+    ctx->m_generation.store(gen + 1, std::memory_order_release);
     return ctx;
 }
 
@@ -182,16 +198,26 @@ FdCtx::ptr FdManager::get(int fd, bool auto_create) {
  * @param fd 句柄
  */
 void FdManager::del(int fd) {
-    // 上写锁
-    RWmutexType::WriteLock lock(m_mutex);
+    if (fd < 0 || fd >= kBlockSize * kMaxBlocks) {
+        return;
+    }
 
-    if ((int)m_datas.size() <= fd) {
+    MutexType::Lock lock(m_mutex);
+    FdCtx *block = m_blocks[fd / kBlockSize].load(std::memory_order_acquire);
+    if (!block) {
         // 没有句柄
         return;
     }
 
-    // 清空句柄
-    m_datas[fd].reset();
+    FdCtx *ctx = &block[fd % kBlockSize];
+    uint32_t gen = ctx->m_generation.load(std::memory_order_relaxed);
+    if (!(gen & 1)) {
+        return;
+    }
+
+    // 仍持有记录的调用方可以看到已经关闭
+    ctx->m_isClosed = true;
+    ctx->m_generation.store(gen + 1, std::memory_order_release);
 }
 
 }  // namespace ljrserver
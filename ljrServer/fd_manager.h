@@ -2,10 +2,8 @@
 #ifndef __LJRSERVER_FD_MANAGER_H__
 #define __LJRSERVER_FD_MANAGER_H__
 
-// 智能指针
-#include <memory>
-// 动态数组
-#include <vector>
+// 原子操作
+#include <atomic>
 
 // 线程
 #include "thread.h"
@@ -19,18 +17,21 @@ namespace ljrserver {
 /**
  * @brief Class 句柄
  *
+ * 内嵌在 FdManager 的句柄表中 随句柄号复用 不引用计数
  */
-class FdCtx : public std::enable_shared_from_this<FdCtx> {
+class FdCtx {
+    friend class FdManager;
+
 public:
-    // 智能指针
-    typedef std::shared_ptr<FdCtx> ptr;
+    // 句柄表中的记录 生命周期由 FdManager 管理
+    typedef FdCtx *ptr;
 
     /**
-     * @brief 句柄构造函数
+     * @brief 句柄构造函数 不初始化 由 FdManager 创建时初始化
      *
-     * @param fd
+     * @param fd [= -1]
      */
-    FdCtx(int fd);
+    FdCtx(int fd = -1);
 
     /**
      * @brief 句柄析构函数
@@ -41,10 +42,11 @@ public:
     /**
      * @brief 句柄初始化
      *
+     * @param nonblock_socket 已知是非阻塞 socket 跳过 fstat fcntl [= false]
      * @return true
      * @return false
      */
-    bool init();
+    bool init(bool nonblock_socket = false);
 
     /**
      * @brief 是否初始化
@@ -71,6 +73,17 @@ public:
     bool isClosed() const { return m_isClosed; }
     // bool close();
 
+    /**
+     * @brief 获取代数 句柄每次创建和删除都加一 奇数为使用中
+     *
+     * 句柄号复用后代数不同 用于判断持有的记录是否还是原来的句柄
+     *
+     * @return uint32_t
+     */
+    uint32_t getGeneration() const {
+        return m_generation.load(std::memory_order_acquire);
+    }
+
     /**
      * @brief 用户设置非阻塞 fnctl
      *
@@ -146,6 +159,9 @@ private:
     // 接收超时时间
     uint64_t m_sendTimeout;
 
+    // 代数 奇数为使用中
+    std::atomic<uint32_t> m_generation;
+
     // 文件IO管理器
     // ljrserver::IOManager *m_manager;
 };
@@ -153,11 +169,20 @@ private:
 /**
  * @brief Class 句柄管理器
  *
+ * 按句柄号索引的两级表 每块 kBlockSize 个内嵌的 FdCtx
+ * 块在创建句柄时按需分配 分配后不再移动 随管理器析构释放
+ * get 的热路径无锁 不引用计数 只有创建和删除需要加锁
  */
 class FdManager {
 public:
-    // 读写锁
-    typedef RWMutex RWmutexType;
+    // 互斥锁 创建和删除
+    typedef Mutex MutexType;
+
+    // 每块的句柄个数
+    static const int kBlockSize = 1024;
+
+    // 最多的块数 支持的句柄号上限 kBlockSize * kMaxBlocks
+    static const int kMaxBlocks = 4096;
 
     /**
      * @brief 句柄管理器的构造函数
@@ -165,14 +190,50 @@ public:
      */
     FdManager();
 
+    /**
+     * @brief 句柄管理器的析构函数
+     *
+     */
+    ~FdManager();
+
     /**
      * @brief 获取句柄对象
      *
      * @param fd 句柄
      * @param auto_create 不存在是否创建 [= false]
-     * @return FdCtx::ptr
+     * @return FdCtx::ptr 不存在返回 nullptr
+     */
+    FdCtx::ptr get(int fd, bool auto_create = false) {
+        if (fd < 0 || fd >= kBlockSize * kMaxBlocks) {
+            return nullptr;
+        }
+        FdCtx *block =
+            m_blocks[fd / kBlockSize].load(std::memory_order_acquire);
+        if (block) {
+            FdCtx *ctx = &block[fd % kBlockSize];
+            if (ctx->getGeneration() & 1) {
+                // 使用中
+                return ctx;
+            }
+        }
+        if (!auto_create) {
+            return nullptr;
+        }
+        return create(fd);
+    }
+
+    /**
+     * @brief 创建已知是非阻塞 socket 的句柄 accept4(SOCK_NONBLOCK) 的结果
+     *
+     * @param fd 句柄
+     * @return FdCtx::ptr 句柄号越界返回 nullptr
      */
-    FdCtx::ptr get(int fd, bool auto_create = false);
+    FdCtx::ptr createNonblockSocket(int fd) {
+        if (fd < 0 || fd >= kBlockSize * kMaxBlocks) {
+            return nullptr;
+        }
+        return create(fd, true);
+    }
 
     /**
      * @brief 删除句柄
@@ -182,11 +243,29 @@ public:
     void del(int fd);
 
 private:
-    // 读写锁
-    RWmutexType m_mutex;
+    /**
+     * @brief 创建句柄
+     *
+     * @param fd 句柄
+     * @param nonblock_socket 已知是非阻塞 socket [= false]
+     * @return FdCtx::ptr
+     */
+    FdCtx::ptr create(int fd, bool nonblock_socket = false);
+
+    /**
+     * @brief 获取句柄所在的块 没有则分配 调用方持有 m_mutex
+     *
+     * @param index 块号
+     * @return FdCtx*
+     */
+    FdCtx *getBlock(int index);
+
+private:
+    // 互斥锁
+    MutexType m_mutex;
 
-    // 句柄数组
-    std::vector<FdCtx::ptr> m_datas;
+    // 句柄表
+    std::atomic<FdCtx *> m_blocks[kMaxBlocks];
 };
 
 // 单例模式
@@ -14,6 +14,13 @@
 #include "fd_manager.h"
 // 配置
 #include "config.h"
+// 单调时钟
+#include "clock.h"
+// 异步文件
+#include "async_file.h"
+
+#include <algorithm>
+#include <map>
 
 // system 日志
 static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
@@ -39,16 +46,29 @@ static uint64_t s_connect_timeout = -1;
     XX(socket)       \
     XX(connect)      \
     XX(accept)       \
+    XX(accept4)      \
     XX(read)         \
     XX(readv)        \
     XX(recv)         \
     XX(recvfrom)     \
     XX(recvmsg)      \
+    XX(recvmmsg)     \
     XX(write)        \
     XX(writev)       \
     XX(send)         \
     XX(sendto)       \
     XX(sendmsg)      \
+    XX(sendmmsg)     \
+    XX(pread)        \
+    XX(pwrite)       \
+    XX(sendfile)     \
+    XX(splice)       \
+    XX(tee)          \
+    XX(preadv)       \
+    XX(pwritev)      \
+    XX(poll)         \
+    XX(select)       \
+    XX(epoll_wait)   \
     XX(close)        \
     XX(fcntl)        \
     XX(ioctl)        \
@@ -177,6 +197,8 @@ static ssize_t do_io(int fd, OriginFun fun, const char *hook_fun_name,
 
     // 获取发送/接收超时
     uint64_t timeout = ctx->getTimeout(timeout_so);
+    // 代数 挂起期间句柄被关闭或复用会改变
+    uint32_t generation = ctx->getGeneration();
     // 定时器条件 该函数执行完毕后智能指针析构 条件为假
     std::shared_ptr<timer_info> tinfo(new timer_info);
 
@@ -224,7 +246,10 @@ retry:
         }
 
         // 当前 IO 没消息 注册当前 IO 任务等待后续调度执行
-        int rt = iom->addEvent(fd, (ljrserver::IOManager::Event)(event));
+        // 句柄在此期间被关闭时不注册 号码可能已被其他句柄复用
+        int rt = iom->addEventIf(
+            fd, (ljrserver::IOManager::Event)(event),
+            [ctx, generation]() { return ctx->getGeneration() == generation; });
         if (rt) {
             // 失败
             LJRSERVER_LOG_ERROR(g_logger)
@@ -246,6 +271,12 @@ retry:
                 timer->cancel();
             }
 
+            // 挂起期间句柄被关闭 不能在复用的句柄上重试
+            if (ctx->getGeneration() != generation) {
+                errno = EBADF;
+                return -1;
+            }
+
             // 判断是否超时
             if (tinfo->cancelled) {
                 // 已经超时 e timed out
@@ -262,6 +293,165 @@ retry:
     return n;
 }
 
+/**
+ * @brief poll 等待状态
+ *
+ */
+struct poll_info {
+    // 是否已经唤醒 只唤醒一次
+    std::atomic<bool> woken = {false};
+};
+
+// hook poll 最多注册的句柄个数 超过则直接调用系统函数
+static const nfds_t s_poll_max_fds = 64;
+
+// 不能注册事件时 定时器轮询的间隔 ms
+static const uint64_t s_poll_fallback_ms = 10;
+
+/**
+ * @brief 在 IO 管理器上等待 poll 的句柄 协程让出执行权
+ *
+ * 先非阻塞 poll 一次 没有就绪则把句柄注册到 IO 管理器
+ * 任一事件触发或超时唤醒后注销事件 再次 poll 获取 revents
+ * 句柄不能注册 (其他协程已在等待同一事件 或不支持 epoll)
+ * 时退化为定时器轮询 不阻塞线程
+ *
+ * @param fds
+ * @param nfds
+ * @param timeout ms -1 永久
+ * @return int
+ */
+static int do_poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    ljrserver::IOManager *iom = ljrserver::IOManager::GetThis();
+    if (!ljrserver::t_hook_enable || !iom || timeout == 0 ||
+        nfds > s_poll_max_fds) {
+        return poll_f(fds, nfds, timeout);
+    }
+
+    // 截止时间
+    uint64_t deadline =
+        timeout < 0 ? ~0ull : ljrserver::Clock::NowMS() + timeout;
+    // 是否退化为定时器轮询
+    bool fallback = false;
+
+    while (true) {
+        int rt = poll_f(fds, nfds, 0);
+        if (rt != 0) {
+            // 已经就绪 或者出错
+            return rt;
+        }
+
+        uint64_t now = ljrserver::Clock::NowMS();
+        if (now >= deadline) {
+            // 超时
+            return 0;
+        }
+
+        // 唤醒当前协程 事件和定时器中先到的一个生效
+        std::shared_ptr<poll_info> info(new poll_info);
+        ljrserver::Fiber::ptr fiber = ljrserver::Fiber::GetThis();
+        auto wake = [info, fiber, iom]() {
+            if (!info->woken.exchange(true)) {
+                iom->schedule(fiber);
+            }
+        };
+
+        // 注册事件
+        std::vector<std::pair<int, ljrserver::IOManager::Event> > added;
+        if (!fallback) {
+            // 同一个句柄的事件合并
+            std::map<int, uint32_t> events;
+            for (nfds_t i = 0; i < nfds; ++i) {
+                if (fds[i].fd < 0) {
+                    continue;
+                }
+                if (fds[i].events & (POLLIN | POLLPRI | POLLRDHUP)) {
+                    events[fds[i].fd] |= ljrserver::IOManager::READ;
+                }
+                if (fds[i].events & POLLOUT) {
+                    events[fds[i].fd] |= ljrserver::IOManager::WRITE;
+                }
+            }
+
+            for (auto &i : events) {
+                for (auto ev : {ljrserver::IOManager::READ,
+                                ljrserver::IOManager::WRITE}) {
+                    if (!(i.second & ev)) {
+                        continue;
+                    }
+                    if (iom->tryAddEvent(i.first, ev, wake)) {
+                        fallback = true;
+                        break;
+                    }
+                    added.push_back(std::make_pair(i.first, ev));
+                }
+                if (fallback) {
+                    break;
+                }
+            }
+
+            if (fallback) {
+                // 已注册的事件注销 之后用定时器轮询
+                for (auto &i : added) {
+                    iom->delEvent(i.first, i.second);
+                }
+                added.clear();
+                LJRSERVER_LOG_DEBUG(g_logger)
+                    << "poll fallback to timer errno=" << errno;
+            }
+        }
+
+        // 设置定时器 模拟超时 轮询时最多等 s_poll_fallback_ms
+        uint64_t wait = deadline == ~0ull ? ~0ull : deadline - now;
+        if (fallback) {
+            wait = std::min(wait, s_poll_fallback_ms);
+        }
+        ljrserver::Timer::ptr timer;
+        if (wait != ~0ull) {
+            timer = iom->addTimer(wait, wake);
+        }
+
+        // 让出执行权 等待事件或超时唤醒
+        ljrserver::Fiber::YieldToHold();
+
+        if (timer) {
+            timer->cancel();
+        }
+        // 注销还没触发的事件 不会触发任务
+        for (auto &i : added) {
+            iom->delEvent(i.first, i.second);
+        }
+    }
+}
+
+/**
+ * @brief 普通文件读写交给文件 IO 线程池 当前协程挂起
+ *
+ * @tparam OriginFun 原系统调用函数
+ * @tparam Args 函数参数
+ * @param fd 句柄
+ * @param fun 原系统调用函数
+ * @param args 其他参数
+ * @return ssize_t
+ */
+template <typename OriginFun, typename... Args>
+static ssize_t do_file_io(int fd, OriginFun fun, Args... args) {
+    ljrserver::FdCtx::ptr ctx = ljrserver::FdMgr::GetInstance()->get(fd);
+    if (ctx && ctx->isSocket()) {
+        // socket 不支持 offset 直接返回系统调用的错误
+        return fun(fd, args...);
+    }
+
+    ssize_t rt = -1;
+    int error = 0;
+    ljrserver::AsyncFile::Run([&]() {
+        rt = fun(fd, args...);
+        error = errno;
+    });
+    errno = error;
+    return rt;
+}
+
 /***********************************
  * C 代码
  ***********************************/
@@ -319,12 +509,13 @@ int usleep(useconds_t usec) {
 
     ljrserver::Fiber::ptr fiber = ljrserver::Fiber::GetThis();
     ljrserver::IOManager *iom = ljrserver::IOManager::GetThis();
-    iom->addTimer(usec / 1000,
-                  std::bind((void(ljrserver::Scheduler::*)(
-                                ljrserver::Fiber::ptr, int thread)) &
-                                ljrserver::IOManager::schedule,
-                            iom, fiber, -1));
-    // iom->addTimer(usec / 1000, [iom, fiber]() {
+    // us 精度 高精度模式下由 timerfd 唤醒
+    iom->addTimerUS(usec,
+                    std::bind((void(ljrserver::Scheduler::*)(
+                                  ljrserver::Fiber::ptr, int thread)) &
+                                  ljrserver::IOManager::schedule,
+                              iom, fiber, -1));
+    // iom->addTimerUS(usec, [iom, fiber]() {
     //     iom->schedule(fiber);
     // });
     ljrserver::Fiber::YieldToHold();
@@ -336,16 +527,16 @@ int nanosleep(const struct timespec *req, struct timespec *rem) {
         return nanosleep_f(req, rem);
     }
 
-    int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
+    uint64_t timeout_us = req->tv_sec * 1000 * 1000ul + req->tv_nsec / 1000;
 
     ljrserver::Fiber::ptr fiber = ljrserver::Fiber::GetThis();
     ljrserver::IOManager *iom = ljrserver::IOManager::GetThis();
-    iom->addTimer(timeout_ms,
-                  std::bind((void(ljrserver::Scheduler::*)(
-                                ljrserver::Fiber::ptr, int thread)) &
-                                ljrserver::IOManager::schedule,
-                            iom, fiber, -1));
-    // iom->addTimer(timeout_ms, [iom, fiber]() {
+    iom->addTimerUS(timeout_us,
+                    std::bind((void(ljrserver::Scheduler::*)(
+                                  ljrserver::Fiber::ptr, int thread)) &
+                                  ljrserver::IOManager::schedule,
+                              iom, fiber, -1));
+    // iom->addTimerUS(timeout_us, [iom, fiber]() {
     //     iom->schedule(fiber);
     // });
     ljrserver::Fiber::YieldToHold();
@@ -428,6 +619,8 @@ int connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addrlen,
 
     // 获取当前 IO 管理器
     ljrserver::IOManager *iom = ljrserver::IOManager::GetThis();
+    // 代数 等待期间句柄被关闭或复用会改变
+    uint32_t generation = ctx->getGeneration();
     // 定时器
     ljrserver::Timer::ptr timer;
     // 智能指针条件 表示是否完成本次连接操作
@@ -457,7 +650,9 @@ int connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addrlen,
     }
 
     // 注册当前 connect 的操作事件
-    int rt = iom->addEvent(fd, ljrserver::IOManager::WRITE);
+    int rt = iom->addEventIf(
+        fd, ljrserver::IOManager::WRITE,
+        [ctx, generation]() { return ctx->getGeneration() == generation; });
     if (rt == 0) {
         // 注册成功 移至后台
         ljrserver::Fiber::YieldToHold();
@@ -468,6 +663,12 @@ int connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addrlen,
             timer->cancel();
         }
 
+        if (ctx->getGeneration() != generation) {
+            // 等待期间句柄被关闭
+            errno = EBADF;
+            return -1;
+        }
+
         if (tinfo->cancelled) {
             // 是否已经超时取消
             errno = tinfo->cancelled;
@@ -483,6 +684,9 @@ int connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addrlen,
 
         LJRSERVER_LOG_ERROR(g_logger)
             << "connect addEvent(" << fd << ", WRITE) error";
+        if (errno == EBADF) {
+            return -1;
+        }
     }
 
     // 检查是否成功
@@ -537,6 +741,31 @@ int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
     return fd;
 }
 
+/**
+ * @brief socket accept4 新连接直接带上 flags 省去 fcntl
+ *
+ * @param s
+ * @param addr
+ * @param addrlen
+ * @param flags SOCK_NONBLOCK SOCK_CLOEXEC
+ * @return int
+ */
+int accept4(int s, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+    int fd = do_io(s, accept4_f, "accept4", ljrserver::IOManager::READ,
+                   SO_RCVTIMEO, addr, addrlen, flags);
+    if (fd >= 0) {
+        // accept 成功 加入句柄管理器
+        if (flags & SOCK_NONBLOCK) {
+            // 已经是非阻塞 socket 不用 fstat fcntl
+            ljrserver::FdMgr::GetInstance()->createNonblockSocket(fd);
+        } else {
+            ljrserver::FdMgr::GetInstance()->get(fd, true);
+        }
+    }
+
+    return fd;
+}
+
 /***********************
  * socket read
  ***********************/
@@ -568,6 +797,13 @@ ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
                  SO_RCVTIMEO, msg, flags);
 }
 
+int recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+             struct timespec *timeout) {
+    // timeout 只约束已经收到第一个数据报之后 等待由 SO_RCVTIMEO 控制
+    return do_io(sockfd, recvmmsg_f, "recvmmsg", ljrserver::IOManager::READ,
+                 SO_RCVTIMEO, msgvec, vlen, flags, timeout);
+}
+
 /***********************
  * socket write
  ***********************/
@@ -598,6 +834,181 @@ ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
                  SO_SNDTIMEO, msg, flags);
 }
 
+int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+             int flags) {
+    return do_io(sockfd, sendmmsg_f, "sendmmsg", ljrserver::IOManager::WRITE,
+                 SO_SNDTIMEO, msgvec, vlen, flags);
+}
+
+/***********************
+ * zero copy
+ ***********************/
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    // 文件 -> socket 在 out_fd 上等待可写
+    return do_io(out_fd, sendfile_f, "sendfile", ljrserver::IOManager::WRITE,
+                 SO_SNDTIMEO, in_fd, offset, count);
+}
+
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out,
+               size_t len, unsigned int flags) {
+    // 等待 socket 一端 管道一端由调用方负责
+    auto fun = [=](int) {
+        return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+    };
+
+    ljrserver::FdCtx::ptr ctx = ljrserver::FdMgr::GetInstance()->get(fd_out);
+    if (ctx && ctx->isSocket()) {
+        // 管道 -> socket 在 fd_out 上等待可写
+        return do_io(fd_out, fun, "splice", ljrserver::IOManager::WRITE,
+                     SO_SNDTIMEO);
+    }
+    // socket -> 管道 在 fd_in 上等待可读
+    return do_io(fd_in, fun, "splice", ljrserver::IOManager::READ,
+                 SO_RCVTIMEO);
+}
+
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+    // tee 两端都是管道 不在句柄管理器中 do_io 直接调用系统函数
+    return do_io(fd_in, tee_f, "tee", ljrserver::IOManager::READ, SO_RCVTIMEO,
+                 fd_out, len, flags);
+}
+
+/***********************
+ * 普通文件
+ ***********************/
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+    return do_file_io(fd, pread_f, buf, count, offset);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    return do_file_io(fd, pwrite_f, buf, count, offset);
+}
+
+ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+    return do_file_io(fd, preadv_f, iov, iovcnt, offset);
+}
+
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+    return do_file_io(fd, pwritev_f, iov, iovcnt, offset);
+}
+
+/***********************
+ * 多路复用
+ ***********************/
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    return do_poll(fds, nfds, timeout);
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+           struct timeval *timeout) {
+    if (!ljrserver::t_hook_enable) {
+        return select_f(nfds, readfds, writefds, exceptfds, timeout);
+    }
+
+    // 转换为 pollfd
+    std::vector<struct pollfd> fds;
+    for (int fd = 0; fd < nfds; ++fd) {
+        short events = 0;
+        if (readfds && FD_ISSET(fd, readfds)) {
+            events |= POLLIN;
+        }
+        if (writefds && FD_ISSET(fd, writefds)) {
+            events |= POLLOUT;
+        }
+        if (exceptfds && FD_ISSET(fd, exceptfds)) {
+            events |= POLLPRI;
+        }
+        if (events) {
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = events;
+            pfd.revents = 0;
+            fds.push_back(pfd);
+        }
+    }
+
+    int ms = -1;
+    if (timeout) {
+        ms = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+    }
+
+    int rt = do_poll(fds.empty() ? nullptr : &fds[0], fds.size(), ms);
+    if (rt < 0) {
+        return rt;
+    }
+
+    // 转换回 fd_set
+    if (readfds) {
+        FD_ZERO(readfds);
+    }
+    if (writefds) {
+        FD_ZERO(writefds);
+    }
+    if (exceptfds) {
+        FD_ZERO(exceptfds);
+    }
+
+    int count = 0;
+    for (auto &i : fds) {
+        if (i.revents & POLLNVAL) {
+            errno = EBADF;
+            return -1;
+        }
+        if (readfds && (i.events & POLLIN) &&
+            (i.revents & (POLLIN | POLLHUP | POLLERR))) {
+            FD_SET(i.fd, readfds);
+            ++count;
+        }
+        if (writefds && (i.events & POLLOUT) &&
+            (i.revents & (POLLOUT | POLLERR))) {
+            FD_SET(i.fd, writefds);
+            ++count;
+        }
+        if (exceptfds && (i.events & POLLPRI) && (i.revents & POLLPRI)) {
+            FD_SET(i.fd, exceptfds);
+            ++count;
+        }
+    }
+    return count;
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+               int timeout) {
+    if (!ljrserver::t_hook_enable || timeout == 0) {
+        return epoll_wait_f(epfd, events, maxevents, timeout);
+    }
+
+    // 截止时间
+    uint64_t deadline =
+        timeout < 0 ? ~0ull : ljrserver::Clock::NowMS() + timeout;
+
+    while (true) {
+        // epoll 句柄本身可读代表有就绪事件 在 IO 管理器上等待它
+        struct pollfd pfd;
+        pfd.fd = epfd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ms = -1;
+        if (deadline != ~0ull) {
+            uint64_t now = ljrserver::Clock::NowMS();
+            ms = now >= deadline ? 0 : deadline - now;
+        }
+        int rt = do_poll(&pfd, 1, ms);
+        if (rt <= 0) {
+            return rt;
+        }
+
+        rt = epoll_wait_f(epfd, events, maxevents, 0);
+        if (rt != 0 || ms == 0) {
+            return rt;
+        }
+        // 事件已经被别处取走 继续等待
+    }
+}
+
 /***********************
  * socket close
  ***********************/
@@ -610,15 +1021,15 @@ int close(int fd) {
     // 获取句柄对象
     ljrserver::FdCtx::ptr ctx = ljrserver::FdMgr::GetInstance()->get(fd);
     if (ctx) {
+        // 先从句柄管理器中删除 代数改变 之后的 addEventIf 不会再注册
+        ljrserver::FdMgr::GetInstance()->del(fd);
+
         // 获取当前 IO 管理器
         auto iom = ljrserver::IOManager::GetThis();
         if (iom) {
-            // 取消所有事件 并执行
+            // 取消删除前已经注册的事件 并执行
             iom->cancelAll(fd);
         }
-
-        // 从句柄管理器中删除句柄对象
-        ljrserver::FdMgr::GetInstance()->del(fd);
     }
 
     // 返回系统调用
@@ -10,6 +10,16 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
+// sendfile
+#include <sys/sendfile.h>
+// preadv pwritev
+#include <sys/uio.h>
+
+// poll select epoll_wait
+#include <poll.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
+
 // sleep
 #include <time.h>
 #include <unistd.h>
@@ -63,6 +73,10 @@ extern connect_fun connect_f;
 typedef int (*accept_fun)(int s, struct sockaddr *addr, socklen_t *addrlen);
 extern accept_fun accept_f;
 
+typedef int (*accept4_fun)(int s, struct sockaddr *addr, socklen_t *addrlen,
+                           int flags);
+extern accept4_fun accept4_f;
+
 // socket read
 typedef ssize_t (*read_fun)(int fd, void *buf, size_t count);
 extern read_fun read_f;
@@ -80,6 +94,11 @@ extern recvfrom_fun recvfrom_f;
 typedef ssize_t (*recvmsg_fun)(int sockfd, struct msghdr *msg, int flags);
 extern recvmsg_fun recvmsg_f;
 
+typedef int (*recvmmsg_fun)(int sockfd, struct mmsghdr *msgvec,
+                            unsigned int vlen, int flags,
+                            struct timespec *timeout);
+extern recvmmsg_fun recvmmsg_f;
+
 // socket write
 typedef ssize_t (*write_fun)(int fd, const void *buf, size_t count);
 extern write_fun write_f;
@@ -97,6 +116,51 @@ extern sendto_fun sendto_f;
 typedef ssize_t (*sendmsg_fun)(int s, const struct msghdr *msg, int flags);
 extern sendmsg_fun sendmsg_f;
 
+typedef int (*sendmmsg_fun)(int sockfd, struct mmsghdr *msgvec,
+                            unsigned int vlen, int flags);
+extern sendmmsg_fun sendmmsg_f;
+
+// 普通文件
+typedef ssize_t (*pread_fun)(int fd, void *buf, size_t count, off_t offset);
+extern pread_fun pread_f;
+
+typedef ssize_t (*pwrite_fun)(int fd, const void *buf, size_t count,
+                              off_t offset);
+extern pwrite_fun pwrite_f;
+
+// zero copy
+typedef ssize_t (*sendfile_fun)(int out_fd, int in_fd, off_t *offset,
+                                size_t count);
+extern sendfile_fun sendfile_f;
+
+typedef ssize_t (*splice_fun)(int fd_in, loff_t *off_in, int fd_out,
+                              loff_t *off_out, size_t len, unsigned int flags);
+extern splice_fun splice_f;
+
+typedef ssize_t (*tee_fun)(int fd_in, int fd_out, size_t len,
+                           unsigned int flags);
+extern tee_fun tee_f;
+
+typedef ssize_t (*preadv_fun)(int fd, const struct iovec *iov, int iovcnt,
+                              off_t offset);
+extern preadv_fun preadv_f;
+
+typedef ssize_t (*pwritev_fun)(int fd, const struct iovec *iov, int iovcnt,
+                               off_t offset);
+extern pwritev_fun pwritev_f;
+
+// 多路复用
+typedef int (*poll_fun)(struct pollfd *fds, nfds_t nfds, int timeout);
+extern poll_fun poll_f;
+
+typedef int (*select_fun)(int nfds, fd_set *readfds, fd_set *writefds,
+                          fd_set *exceptfds, struct timeval *timeout);
+extern select_fun select_f;
+
+typedef int (*epoll_wait_fun)(int epfd, struct epoll_event *events,
+                              int maxevents, int timeout);
+extern epoll_wait_fun epoll_wait_f;
+
 // socket close
 typedef int (*close_fun)(int fd);
 extern close_fun close_f;
@@ -196,6 +196,10 @@ bool HttpRequest::hasCookie(const std::string &key, std::string *val) {
 /// 打印输出 http 报文
 
 std::ostream &HttpRequest::dump(std::ostream &os) const {
+    return dumpHead(os) << m_body;
+}
+
+std::ostream &HttpRequest::dumpHead(std::ostream &os) const {
     /**
      * GET /uri HTTP/1.1
      * host: www.baidu.com
@@ -217,10 +221,9 @@ std::ostream &HttpRequest::dump(std::ostream &os) const {
     }
 
     if (!m_body.empty()) {
-        os << "content-length: " << m_body.size() << "\r\n\r\n" << m_body;
-    } else {
-        os << "\r\n";
+        os << "content-length: " << m_body.size() << "\r\n";
     }
+    os << "\r\n";
 
     return os;
 }
@@ -263,6 +266,10 @@ void HttpResponse::delHeader(const std::string &key) { m_headers.erase(key); }
 /// 打印输出 http 报文
 
 std::ostream &HttpResponse::dump(std::ostream &os) const {
+    return dumpHead(os) << m_body;
+}
+
+std::ostream &HttpResponse::dumpHead(std::ostream &os) const {
     os << "HTTP/" << ((uint32_t)(m_version >> 4)) << "."
        << ((uint32_t)(m_version & 0x0F)) << " " << (uint32_t)m_status << " "
        << (m_reason.empty() ? HttpStatusToString(m_status) : m_reason)
@@ -276,10 +283,9 @@ std::ostream &HttpResponse::dump(std::ostream &os) const {
     os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
 
     if (!m_body.empty()) {
-        os << "content-length: " << m_body.size() << "\r\n\r\n" << m_body;
-    } else {
-        os << "\r\n";
+        os << "content-length: " << m_body.size() << "\r\n";
     }
+    os << "\r\n";
     return os;
 }
 
@@ -359,6 +359,9 @@ public:
 public:
     std::ostream &dump(std::ostream &os) const;
 
+    // 只输出报文头 包含结尾的空行 报文体单独发送时使用
+    std::ostream &dumpHead(std::ostream &os) const;
+
     std::string toString() const;
 
 private:
@@ -446,6 +449,9 @@ public:
 public:
     std::ostream &dump(std::ostream &os) const;
 
+    // 只输出报文头 包含结尾的空行 报文体单独发送时使用
+    std::ostream &dumpHead(std::ostream &os) const;
+
     std::string toString() const;
 
 private:
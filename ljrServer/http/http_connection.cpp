@@ -39,6 +39,10 @@ std::string HttpResult::toString() const {
 HttpConnection::HttpConnection(Socket::ptr sock, bool owner)
     : SocketStream(sock, owner) {
     // 初始化构造 SocketStream 对象
+    // 读缓存为 http 响应头的上限
+    m_stream = std::make_shared<BufferedStream>(
+        std::make_shared<SocketStream>(sock, false),
+        HttpRequestParser::GetHttpRequestBufferSize());
 }
 
 /**
@@ -49,6 +53,28 @@ HttpConnection::~HttpConnection() {
     LJRSERVER_LOG_DEBUG(g_logger) << "HttpConnetion::~HttpConnetion";
 }
 
+/**
+ * @brief 读取数据 先取预读缓存中的数据
+ *
+ * @param buffer
+ * @param length
+ * @return int
+ */
+int HttpConnection::read(void *buffer, size_t length) {
+    return m_stream->read(buffer, length);
+}
+
+/**
+ * @brief 读取数据到 byte array 先取预读缓存中的数据
+ *
+ * @param ba
+ * @param length
+ * @return int
+ */
+int HttpConnection::read(ByteArray::ptr ba, size_t length) {
+    return m_stream->read(ba, length);
+}
+
 /**
  * @brief 客户端通过 socket stream 发送请求
  *
@@ -57,66 +83,66 @@ HttpConnection::~HttpConnection() {
  */
 int HttpConnection::sendRequest(HttpRequest::ptr req) {
     std::stringstream ss;
-    // 输出 http 请求报文
-    ss << *req;
-    std::string data = ss.str();
-    // 通过继承方法 Stream::writeFixSize 传输 http 请求报文
-    return writeFixSize(data.c_str(), data.size());
+    // 输出 http 请求报文头 请求体不拷贝 一起 writev
+    req->dumpHead(ss);
+    std::string head = ss.str();
+    const std::string &body = req->getBody();
+    iovec iovs[2];
+    iovs[0].iov_base = (void *)head.c_str();
+    iovs[0].iov_len = head.size();
+    iovs[1].iov_base = (void *)body.c_str();
+    iovs[1].iov_len = body.size();
+    // 小的请求在写缓存中攒成一次发送
+    int rt = m_stream->writeFixSizeV(iovs, body.empty() ? 1 : 2);
+    if (rt <= 0 || !m_stream->flush()) {
+        return rt <= 0 ? rt : -1;
+    }
+    return rt;
 }
 
 /**
- * @brief 客户端接收请求响应
+ * @brief 解析响应头或分块头 数据来自预读缓存
  *
- * @return HttpResponse::ptr
+ * @param stream 带缓存的流
+ * @param parser http 响应解析器
+ * @param chunck 是否解析分块头
+ * @return true
+ * @return false 读取失败 解析错误 或头部超过缓存
  */
-HttpResponse::ptr HttpConnection::recvResponse() {
-    // http 响应解析器
-    HttpResponseParser::ptr parser(new HttpResponseParser);
-    // 获取约定好的配置属性 http 请求缓存大小
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
-    // 缓存
-    std::shared_ptr<char> buffer(new char[buff_size + 1], [](char *ptr) {
-        // 自定义析构方法
-        delete[] ptr;
-    });
-
-    // 裸指针
-    char *data = buffer.get();
-    // 缓存偏移 数据量大小
-    int offset = 0;
-    // 循环接收响应
+static bool parse_head(BufferedStream::ptr stream,
+                       HttpResponseParser::ptr parser, bool chunck) {
+    size_t need = 1;
     do {
-        // 通过 SocketStream::read 读取
-        int len = read(data + offset, buff_size - offset);
+        const char *data = nullptr;
+        int len = stream->peek(data, need);
         if (len <= 0) {
-            // 没有数据 关闭 SocketStream::close
-            close();
-            return nullptr;
+            return false;
         }
-
-        len += offset;
-        data[len] = '\0';
-        // 解析 http 响应内容
-        size_t nparse = parser->execute(data, len, false);
+        // 分块头从第一次解析时重置解析器
+        size_t nparse = parser->parse(data, len, chunck);
+        chunck = false;
         if (parser->hasError()) {
-            // 有错误 关闭 SocketStream::close
-            close();
-            return nullptr;
-        }
-
-        offset = len - nparse;
-        if (offset == (int)buff_size) {
-            // 缓存已经满了
-            close();
-            return nullptr;
-        }
-
-        if (parser->isFinished()) {
-            // 解析已经完成
-            break;
+            return false;
         }
+        stream->consume(nparse);
+        need = len - nparse + 1;
+    } while (!parser->isFinished());
+    return true;
+}
 
-    } while (true);
+/**
+ * @brief 客户端接收请求响应
+ *
+ * @return HttpResponse::ptr
+ */
+HttpResponse::ptr HttpConnection::recvResponse() {
+    // http 响应解析器
+    HttpResponseParser::ptr parser(new HttpResponseParser);
+    if (!parse_head(m_stream, parser, false)) {
+        // 接收失败 关闭 SocketStream::close
+        close();
+        return nullptr;
+    }
 
     // 获取响应解析器
     auto &client_parser = parser->getParser();
@@ -125,114 +151,45 @@ HttpResponse::ptr HttpConnection::recvResponse() {
 
     if (client_parser.chunked) {
         // 如果分块了
-        int len = offset;
         do {
-            bool begin = true;
-            // 循环接收数据
-            do {
-                if (!begin || len == 0) {
-                    int rt = read(data + len, buff_size - len);
-                    if (rt <= 0) {
-                        // 接收失败
-                        close();
-                        return nullptr;
-                    }
-                    len += rt;
-                }
-
-                data[len] = '\0';
-                // 解析内容
-                size_t nparse = parser->execute(data, len, true);
-                if (parser->hasError()) {
-                    // 有错误
-                    close();
-                    return nullptr;
-                }
-
-                len -= nparse;
-
-                if (len == (int)buff_size) {
-                    // 缓存满了
-                    close();
-                    return nullptr;
-                }
-
-                begin = false;
-            } while (!parser->isFinished());
-            // 解析完毕
-
-            // len -= 2;
+            // 分块头
+            if (!parse_head(m_stream, parser, true)) {
+                close();
+                return nullptr;
+            }
 
             LJRSERVER_LOG_DEBUG(g_logger)
                 << "content_len=" << client_parser.content_len;
 
-            if (client_parser.content_len + 2 <= len) {
-                body.append(data, client_parser.content_len);
-
-                memmove(data, data + client_parser.content_len + 2,
-                        len - client_parser.content_len - 2);
-
-                len -= client_parser.content_len + 2;
-
-            } else {
-                body.append(data, len);
-                int left = client_parser.content_len - len + 2;
-
-                while (left > 0) {
-                    int rt = read(
-                        data, left > (int)buff_size ? (int)buff_size : left);
-                    if (rt <= 0) {
-                        close();
-                        return nullptr;
-                    }
-
-                    body.append(data, rt);
-                    left -= rt;
-                }
-
-                body.resize(body.size() - 2);
-                len = 0;
+            // 分块内容和结尾的 \r\n
+            size_t offset = body.size();
+            size_t length = client_parser.content_len;
+            body.resize(offset + length + 2);
+            if (readFixSize(&body[offset], length + 2) <= 0) {
+                close();
+                return nullptr;
             }
+            body.resize(offset + length);
         } while (!client_parser.chunks_done);
         // 分块结束
 
-        // 设置 http 响应对象的内容体
-        parser->getData()->setBody(body);
-
     } else {
         // 没有分块 获取 content-length
         int64_t length = parser->getContentLength();
         if (length > 0) {
-            // 缓存
-            // std::string body;
             body.resize(length);
-
-            int len = 0;
-            if (length >= offset) {
-                // body.append(data, offset);
-                memcpy(&body[0], data, offset);
-                len = offset;
-            } else {
-                // body.append(data, length);
-                memcpy(&body[0], data, length);
-                len = length;
-            }
-
-            length -= offset;
-            if (length > 0) {
-                // 还没接收完成 调用 Stream::readFixSize 继续接受剩下数据
-                if (readFixSize(&body[len], length) <= 0) {
-                    // 接收失败 关闭
-                    close();
-                    return nullptr;
-                }
+            // 先取缓存中的数据 剩下的调用 Stream::readFixSize 继续接收
+            if (readFixSize(&body[0], length) <= 0) {
+                // 接收失败 关闭
+                close();
+                return nullptr;
             }
-
-            // 设置 http 响应对象的内容体
-            // parser->getData()->setBody(body);
         }
     }
 
+    // 设置 http 响应对象的内容体
+    parser->getData()->setBody(body);
+
     // 返回 http 响应对象
     return parser->getData();
 }
@@ -6,6 +6,8 @@
 #include "http.h"
 // socket 流
 #include "../socket_stream.h"
+// 带缓存的流
+#include "../buffered_stream.h"
 // 线程
 #include "../thread.h"
 // 工具函数
@@ -83,6 +85,8 @@ class HttpConnectionPool;
  *
  * 继承自 SocketStream 实现 http 客户端
  *
+ * 读取经过 BufferedStream 预读 分块响应的块头不再逐次 recv
+ *
  */
 class HttpConnection : public SocketStream {
     // 友元类
@@ -158,7 +162,28 @@ public:
      */
     HttpResponse::ptr recvResponse();
 
+    /**
+     * @brief 读取数据 先取预读缓存中的数据
+     *
+     * @param buffer
+     * @param length
+     * @return int
+     */
+    int read(void *buffer, size_t length) override;
+
+    /**
+     * @brief 读取数据到 byte array 先取预读缓存中的数据
+     *
+     * @param ba
+     * @param length
+     * @return int
+     */
+    int read(ByteArray::ptr ba, size_t length) override;
+
 private:
+    // 带缓存的流 连接池复用连接时缓存随连接保留
+    BufferedStream::ptr m_stream;
+
     // 连接创建时间
     uint64_t m_createTime = 0;
 
@@ -213,7 +213,7 @@ size_t HttpRequestParser::execute(char *data, size_t len) {
     // 1  成功
     // -1 有错误
     // >0 已经处理的字节数，且data有效数据为 len - v
-    size_t offset = http_parser_execute(&m_parser, data, len, 0);
+    size_t offset = parse(data, len);
     // if (offset == -1)
     // {
     //     LJRSERVER_LOG_WARN(g_logger) << "invalid request:" <<
@@ -227,6 +227,17 @@ size_t HttpRequestParser::execute(char *data, size_t len) {
     return offset;
 }
 
+/**
+ * @brief 解析 http 请求 不移动没有解析的数据
+ *
+ * @param data
+ * @param len
+ * @return size_t 已经解析的字节数
+ */
+size_t HttpRequestParser::parse(const char *data, size_t len) {
+    return http_parser_execute(&m_parser, data, len, 0);
+}
+
 /**
  * @brief 是否解析完成
  *
@@ -340,12 +351,24 @@ HttpResponseParser::HttpResponseParser() : m_error(0) {
  * @return size_t
  */
 size_t HttpResponseParser::execute(char *data, size_t len, bool chunck) {
+    size_t offset = parse(data, len, chunck);
+    memmove(data, data + offset, len - offset);
+    return offset;
+}
+
+/**
+ * @brief 解析 http 响应 不移动没有解析的数据
+ *
+ * @param data
+ * @param len
+ * @param chunck 是否开始解析一个分块头
+ * @return size_t 已经解析的字节数
+ */
+size_t HttpResponseParser::parse(const char *data, size_t len, bool chunck) {
     if (chunck) {
         httpclient_parser_init(&m_parser);
     }
-    size_t offset = httpclient_parser_execute(&m_parser, data, len, 0);
-    memmove(data, data + offset, len - offset);
-    return offset;
+    return httpclient_parser_execute(&m_parser, data, len, 0);
 }
 
 /**
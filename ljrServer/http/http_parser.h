@@ -38,6 +38,17 @@ public:
      */
     size_t execute(char *data, size_t len);
 
+    /**
+     * @brief 解析 http 请求 不移动没有解析的数据
+     *
+     * 数据在 BufferedStream 的缓存中 调用者按返回值 consume
+     *
+     * @param data
+     * @param len
+     * @return size_t 已经解析的字节数
+     */
+    size_t parse(const char *data, size_t len);
+
     /**
      * @brief 是否解析完成
      *
@@ -124,6 +135,16 @@ public:
      */
     size_t execute(char *data, size_t len, bool chunck);
 
+    /**
+     * @brief 解析 http 响应 不移动没有解析的数据
+     *
+     * @param data
+     * @param len
+     * @param chunck 是否开始解析一个分块头
+     * @return size_t 已经解析的字节数
+     */
+    size_t parse(const char *data, size_t len, bool chunck);
+
     /**
      * @brief 是否解析完成
      *
@@ -2,6 +2,8 @@
 #include "http_server.h"
 // 日志
 #include "../log.h"
+// 时钟
+#include "../clock.h"
 
 namespace ljrserver {
 
@@ -51,8 +53,11 @@ void HttpServer::handleClient(Socket::ptr client) {
         }
 
         // 构建响应对象
+        // 服务器停止后不再保持连接 热升级时旧进程尽快排空
         HttpResponse::ptr rsp(new HttpResponse(
-            req->getVersion(), req->isCose() || !m_isKeepalive));
+            req->getVersion(), req->isCose() || !m_isKeepalive || isStop()));
+        // Date 头部 读取线程缓存的时间 每秒只格式化一次
+        rsp->setHeader("Date", ljrserver::Clock::HttpDate());
 
         // rsp->setBody("hello lijianran");
 
@@ -65,7 +70,7 @@ void HttpServer::handleClient(Socket::ptr client) {
         // 服务端通过 socket stream 发送响应
         session->sendResponse(rsp);
 
-        if (!m_isKeepalive || req->isCose()) {
+        if (!m_isKeepalive || req->isCose() || isStop()) {
             break;
         }
 
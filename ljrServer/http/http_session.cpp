@@ -16,6 +16,32 @@ namespace http {
 HttpSession::HttpSession(Socket::ptr sock, bool owner)
     : SocketStream(sock, owner) {
     // 初始化构造 SocketStream 对象
+    // 读缓存为 http 请求头的上限
+    m_stream = std::make_shared<BufferedStream>(
+        std::make_shared<SocketStream>(sock, false),
+        HttpRequestParser::GetHttpRequestBufferSize());
+}
+
+/**
+ * @brief 读取数据 先取预读缓存中的数据
+ *
+ * @param buffer
+ * @param length
+ * @return int
+ */
+int HttpSession::read(void *buffer, size_t length) {
+    return m_stream->read(buffer, length);
+}
+
+/**
+ * @brief 读取数据到 byte array 先取预读缓存中的数据
+ *
+ * @param ba
+ * @param length
+ * @return int
+ */
+int HttpSession::read(ByteArray::ptr ba, size_t length) {
+    return m_stream->read(ba, length);
 }
 
 /**
@@ -26,53 +52,33 @@ HttpSession::HttpSession(Socket::ptr sock, bool owner)
 HttpRequest::ptr HttpSession::recvRequest() {
     // http 请求解析器
     HttpRequestParser::ptr parser(new HttpRequestParser);
-    // 获取约定好的配置属性 http 请求缓存大小
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
-
-    // uint64_t buff_size = 100;
-    // 创建缓存
-    std::shared_ptr<char> buffer(new char[buff_size], [](char *ptr) {
-        // 自定义析构方法
-        delete[] ptr;
-    });
-
-    // 裸指针
-    char *data = buffer.get();
-    // 缓存偏移
-    int offset = 0;
 
+    // 解析预读缓存中的数据 没有解析的部分下次和新数据一起解析
+    size_t need = 1;
     do {
-        // 通过 SocketStream::read 读取
-        int len = read(data + offset, buff_size - offset);
+        const char *data = nullptr;
+        int len = m_stream->peek(data, need);
         if (len <= 0) {
-            // 读取失败
+            // 读取失败 或请求头超过缓存
             close();
             return nullptr;
         }
 
-        len += offset;
         // 解析客户端发送来的 http 请求报文
-        size_t nparse = parser->execute(data, len);
+        size_t nparse = parser->parse(data, len);
         if (parser->hasError()) {
             // 解析有错误
             close();
             return nullptr;
         }
+        m_stream->consume(nparse);
+        need = len - nparse + 1;
+    } while (!parser->isFinished());
 
-        // 请求体存入缓存
-        offset = len - nparse;
-        if (offset == (int)buff_size) {
-            // 缓存已经满了
-            close();
-            return nullptr;
-        }
-
-        if (parser->isFinished()) {
-            // 解析已经完成
-            break;
-        }
-
-    } while (true);
+    // 客户端发来了下一个请求 之前响应的零拷贝发送通常已经完成 回收 holder
+    if (m_socket->getZeroCopyPending()) {
+        m_socket->reapZeroCopy();
+    }
 
     // 获取头部的 content-length
     int64_t length = parser->getContentLength();
@@ -81,25 +87,11 @@ HttpRequest::ptr HttpSession::recvRequest() {
         std::string body;
         body.resize(length);
 
-        int len = 0;
-        if (length >= offset) {
-            // body.append(data, offset);
-            memcpy(&body[0], data, offset);
-            len = offset;
-        } else {
-            // body.append(data, length);
-            memcpy(&body[0], data, length);
-            len = length;
-        }
-
-        length -= offset;
-        if (length > 0) {
-            // 还没读取完毕 读取完剩下的内容到 body 缓存
-            if (readFixSize(&body[len], length) <= 0) {
-                // 读取失败
-                close();
-                return nullptr;
-            }
+        // 先取缓存中的数据 剩下的直接读取
+        if (readFixSize(&body[0], length) <= 0) {
+            // 读取失败
+            close();
+            return nullptr;
         }
 
         // 设置 http 请求对象的内容体
@@ -128,11 +120,38 @@ HttpRequest::ptr HttpSession::recvRequest() {
  */
 int HttpSession::sendResponse(HttpResponse::ptr rsp) {
     std::stringstream ss;
-    // 输出 http 响应报文
-    ss << *rsp;
-    std::string data = ss.str();
-    //  通过继承方法 Stream::writeFixSize 传输 http 响应报文
-    return writeFixSize(data.c_str(), data.size());
+    // 输出 http 响应报文头 响应体不拷贝
+    rsp->dumpHead(ss);
+    std::string head = ss.str();
+    const std::string &body = rsp->getBody();
+
+    if (m_socket->isZeroCopy() && !body.empty()) {
+        // 零拷贝 报文头拷贝发送 响应体由 rsp 持有到内核发送完成
+        int rt = m_stream->writeFixSize(head.c_str(), head.size());
+        if (rt <= 0 || !m_stream->flush()) {
+            return rt <= 0 ? rt : -1;
+        }
+        rt = writeZeroCopy(body.c_str(), body.size(), rsp);
+        if (rt <= 0) {
+            return rt;
+        }
+        // 回收已经完成的发送 释放 holder
+        m_socket->reapZeroCopy();
+        return head.size() + rt;
+    }
+
+    // 报文头和响应体一起 writev
+    iovec iovs[2];
+    iovs[0].iov_base = (void *)head.c_str();
+    iovs[0].iov_len = head.size();
+    iovs[1].iov_base = (void *)body.c_str();
+    iovs[1].iov_len = body.size();
+    // 小的响应在写缓存中攒成一次发送
+    int rt = m_stream->writeFixSizeV(iovs, body.empty() ? 1 : 2);
+    if (rt <= 0 || !m_stream->flush()) {
+        return rt <= 0 ? rt : -1;
+    }
+    return rt;
 }
 
 }  // namespace http
@@ -4,6 +4,7 @@
 
 #include "http.h"
 #include "../socket_stream.h"
+#include "../buffered_stream.h"
 
 namespace ljrserver {
 
@@ -14,6 +15,8 @@ namespace http {
  *
  * 继承自 SocketStream 实现的 http 服务端
  *
+ * 读取经过 BufferedStream 预读 长连接上流水线发来的下一个请求留在缓存中
+ *
  */
 class HttpSession : public SocketStream {
 public:
@@ -28,6 +31,24 @@ public:
      */
     HttpSession(Socket::ptr sock, bool owner = true);
 
+    /**
+     * @brief 读取数据 先取预读缓存中的数据
+     *
+     * @param buffer
+     * @param length
+     * @return int
+     */
+    int read(void *buffer, size_t length) override;
+
+    /**
+     * @brief 读取数据到 byte array 先取预读缓存中的数据
+     *
+     * @param ba
+     * @param length
+     * @return int
+     */
+    int read(ByteArray::ptr ba, size_t length) override;
+
     /**
      * @brief 服务端接收请求
      *
@@ -38,10 +59,16 @@ public:
     /**
      * @brief 服务端通过 socket stream 发送响应
      *
+     * 零拷贝时响应体由 rsp 持有到内核发送完成 发送后不要再修改 rsp
+     *
      * @param rsp http 响应对象
      * @return int
      */
     int sendResponse(HttpResponse::ptr rsp);
+
+private:
+    // 带缓存的流 装饰不持有 socket 的 SocketStream
+    BufferedStream::ptr m_stream;
 };
 
 }  // namespace http
@@ -2,6 +2,9 @@
 #include "iomanager.h"
 #include "log.h"
 #include "macro.h"
+#include "clock.h"
+#include "config.h"
+#include "hook.h"
 
 // pipe
 #include <unistd.h>
@@ -9,6 +12,8 @@
 #include <fcntl.h>
 // epoll
 #include <sys/epoll.h>
+// timerfd
+#include <sys/timerfd.h>
 // error
 #include <errno.h>
 // string
@@ -19,6 +24,11 @@ namespace ljrserver {
 // system 日志
 static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
 
+// 配置 是否使用 timerfd 高精度定时器 us
+static ljrserver::ConfigVar<bool>::ptr g_iomanager_hires_timer =
+    ljrserver::Config::Lookup("iomanager.hires_timer", false,
+                              "iomanager timerfd high resolution timer");
+
 /**
  * @brief 获得事件上下文
  *
@@ -109,6 +119,24 @@ IOManager::IOManager(size_t threads, bool use_caller, const std::string &name)
     rt = epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
     LJRSERVER_ASSERT(!rt);
 
+    // 高精度定时器 timerfd 到期时 epoll 可读 唤醒 idle
+    if (g_iomanager_hires_timer->getValue()) {
+        m_timerFd =
+            timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_timerFd == -1) {
+            // 创建失败 退回 ms 精度
+            LJRSERVER_LOG_ERROR(g_logger)
+                << "timerfd_create errno=" << errno
+                << " errno-string=" << strerror(errno);
+        } else {
+            memset(&event, 0, sizeof(epoll_event));
+            event.events = EPOLLIN | EPOLLET;
+            event.data.fd = m_timerFd;
+            rt = epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_timerFd, &event);
+            LJRSERVER_ASSERT(!rt);
+        }
+    }
+
     // 句柄数组 resize
     // m_fdContexts.resize(64);
     contextResize(32);
@@ -129,6 +157,9 @@ IOManager::~IOManager() {
     close(m_epollfd);
     close(m_tickleFds[0]);
     close(m_tickleFds[1]);
+    if (m_timerFd != -1) {
+        close(m_timerFd);
+    }
 
     // 清理内存
     for (size_t i = 0; i < m_fdContexts.size(); ++i) {
@@ -165,6 +196,46 @@ void IOManager::contextResize(size_t size) {
  * @return int 0 success
  */
 int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
+    return doAddEvent(fd, event, cb, false);
+}
+
+/**
+ * @brief 添加事件 事件已经存在时返回 -1
+ *
+ * @param fd 事件句柄
+ * @param event 事件类型
+ * @param cb 事件函数 [= nullptr]
+ * @return int 0 success
+ */
+int IOManager::tryAddEvent(int fd, Event event, std::function<void()> cb) {
+    return doAddEvent(fd, event, cb, true);
+}
+
+/**
+ * @brief 句柄仍然有效时添加事件
+ *
+ * @param fd 事件句柄
+ * @param event 事件类型
+ * @param valid 句柄是否仍然有效
+ * @return int 0 success
+ */
+int IOManager::addEventIf(int fd, Event event,
+                          const std::function<bool()> &valid) {
+    return doAddEvent(fd, event, nullptr, false, valid);
+}
+
+/**
+ * @brief 添加事件
+ *
+ * @param fd 事件句柄
+ * @param event 事件类型
+ * @param cb 事件函数
+ * @param may_exist 事件已存在时返回 -1 否则 assert
+ * @param valid 不为空时 句柄失效则返回 -1
+ * @return int 0 success
+ */
+int IOManager::doAddEvent(int fd, Event event, std::function<void()> cb,
+                          bool may_exist, const std::function<bool()> &valid) {
     // 创建句柄事件上下文
     FdContext *fd_ctx = nullptr;
     // 上读锁
@@ -190,8 +261,18 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     // 句柄上下文互斥锁
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
 
+    // 句柄已经关闭 号码可能已被复用 事件属于新的句柄
+    if (valid && !valid()) {
+        errno = EBADF;
+        return -1;
+    }
+
     // 已经有该事件
     if (fd_ctx->events & event) {
+        if (may_exist) {
+            errno = EEXIST;
+            return -1;
+        }
         LJRSERVER_LOG_ERROR(g_logger)
             << "addEvent assert fd = " << fd << " event = " << event
             << " fd_ctx.events = " << fd_ctx->events;
@@ -474,8 +555,8 @@ bool IOManager::stopping() {
  * @return false
  */
 bool IOManager::stopping(uint64_t &timeout) {
-    // 下一个定时任务执行还要多久
-    timeout = getNextTimer();
+    // 下一个定时任务执行还要多久 us
+    timeout = getNextTimerUS();
 
     // 没有定时任务且要处理的事件个数为 0 且调度器 Scheduler::stopping();
     return timeout == ~0ull && m_pendingEventCount == 0 &&
@@ -506,7 +587,7 @@ void IOManager::idle() {
         //     break;
         // }
 
-        // 下一个定时任务执行还要多久
+        // 下一个定时任务执行还要多久 us
         uint64_t next_timeout = 0;
         if (stopping(next_timeout)) {
             // next_timeout = getNextTimer();
@@ -514,29 +595,35 @@ void IOManager::idle() {
             // {
             LJRSERVER_LOG_INFO(g_logger)
                 << "name=" << getName() << " idle_fiber stopping exit";
+            // 线程不再由 IOManager 驱动 时间缓存失效
+            ljrserver::Clock::Invalidate();
             break;
             // }
         }
 
+        // epoll_wait __timeout 等待时间 ms
+        static const uint64_t MAX_TIMEOUT = 5000;
+        // epoll_wait 等待时间 ms
+        int epoll_timeout = MAX_TIMEOUT;
+
+        if (m_timerFd != -1) {
+            // 高精度模式 由 timerfd 在 us 精度唤醒 epoll_wait
+            // 没有定时任务时关闭 timerfd 避免旧的到期时间造成空转唤醒
+            armTimerFd(next_timeout);
+        } else if (next_timeout != ~0ull) {
+            // 不足 1ms 向上取整 避免提前唤醒后空转
+            uint64_t next_ms = (next_timeout + 999) / 1000;
+            // 下一个定时任务执行时间是否大于 5s 是否需要在下一次任务前唤醒
+            epoll_timeout = (int)(next_ms > MAX_TIMEOUT ? MAX_TIMEOUT : next_ms);
+        }
+
         // epoll_wait 返回值 -1 代表有错误 >0 为事件个数
         int rt = 0;
         // 循环等待 IO 事件
         do {
-            // epoll_wait __timeout 等待时间
-            static const int MAX_TIMEOUT = 5000;
-
-            // 是否有定时任务
-            if (next_timeout != ~0ull) {
-                // 下一个定时任务执行时间是否大于 5s 是否需要在下一次任务前唤醒
-                next_timeout = (int)next_timeout > MAX_TIMEOUT ? MAX_TIMEOUT
-                                                               : next_timeout;
-            } else {
-                // 没有定时任务
-                next_timeout = MAX_TIMEOUT;
-            }
-
             // rt = epoll_wait(m_epollfd, events, 64, MAX_TIMEOUT);
-            rt = epoll_wait(m_epollfd, events, 64, (int)next_timeout);
+            // 调度线程开启了 hook 必须直接调用系统函数
+            rt = epoll_wait_f(m_epollfd, events, 64, epoll_timeout);
 
             if (rt < 0 && errno == EINTR) {
                 // rt 为事件个数 rt = -1 并且中断产生了 EINTR
@@ -548,6 +635,9 @@ void IOManager::idle() {
 
         } while (true);
 
+        // 每轮循环刷新一次线程时间缓存 定时器 日志等直接读取缓存
+        ljrserver::Clock::Update();
+
         // 列出要执行的定时任务
         std::vector<std::function<void()>> cbs;
         listExpiredCb(cbs);
@@ -577,6 +667,18 @@ void IOManager::idle() {
                 continue;
             }
 
+            // timerfd 到期 定时任务已经在上面统一处理
+            if (m_timerFd != -1 && event.data.fd == m_timerFd) {
+                uint64_t expirations;
+                while (read(m_timerFd, &expirations, sizeof(expirations)) ==
+                       sizeof(expirations)) {
+                    // 读空 timerfd
+                }
+                // 一次性到期 已经不再处于设置状态
+                m_timerFdArmed = false;
+                continue;
+            }
+
             // 取出句柄事件上下文
             FdContext *fd_ctx = (FdContext *)event.data.ptr;
             // 上锁
@@ -660,4 +762,35 @@ void IOManager::onTimerInsertedAtFront() {
     tickle();
 }
 
+/**
+ * @brief 设置 timerfd 的到期时间
+ *
+ * @param timeout_us 多久后到期 us
+ */
+void IOManager::armTimerFd(uint64_t timeout_us) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (timeout_us == ~0ull) {
+        // 没有定时任务 it_value 全零关闭 timerfd 已经关闭的不再重复调用
+        if (!m_timerFdArmed.exchange(false)) {
+            return;
+        }
+    } else if (timeout_us == 0) {
+        // it_value 全零会关闭 timerfd 已经到期的定时器立即唤醒
+        its.it_value.tv_nsec = 1;
+    } else {
+        its.it_value.tv_sec = timeout_us / 1000000;
+        its.it_value.tv_nsec = (timeout_us % 1000000) * 1000;
+    }
+    if (timeout_us != ~0ull) {
+        m_timerFdArmed = true;
+    }
+
+    if (timerfd_settime(m_timerFd, 0, &its, nullptr)) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "timerfd_settime(" << m_timerFd << ", " << timeout_us
+            << "us) errno=" << errno << " errno-string=" << strerror(errno);
+    }
+}
+
 }  // namespace ljrserver
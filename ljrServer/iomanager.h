@@ -119,6 +119,31 @@ public:
      */
     int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
 
+    /**
+     * @brief 添加事件 事件已经存在时不 assert 返回 -1
+     *
+     * 给 hook 的 poll 用 别的协程可能已经在该句柄上等待同一个事件
+     *
+     * @param fd 事件句柄
+     * @param event 事件类型
+     * @param cb 事件函数 [= nullptr]
+     * @return int 0-success -1 事件已存在 errno = EEXIST 或 epoll_ctl 失败
+     */
+    int tryAddEvent(int fd, Event event, std::function<void()> cb = nullptr);
+
+    /**
+     * @brief 句柄仍然有效时添加事件
+     *
+     * 给 hook 的 IO 用 检查和添加都在句柄的事件锁内
+     * 关闭句柄时先标记失效再 cancelAll 协程不会把事件注册到被复用的句柄上
+     *
+     * @param fd 事件句柄
+     * @param event 事件类型
+     * @param valid 句柄是否仍然有效
+     * @return int 0-success -1 句柄已失效 errno = EBADF 或 epoll_ctl 失败
+     */
+    int addEventIf(int fd, Event event, const std::function<bool()> &valid);
+
     /**
      * @brief 删除事件 不会触发事件
      *
@@ -148,6 +173,14 @@ public:
      */
     bool cancelAll(int fd);
 
+    /**
+     * @brief 是否开启了 timerfd 高精度定时器
+     *
+     * @return true us 精度
+     * @return false ms 精度 由 epoll_wait 超时驱动
+     */
+    bool isHighResolution() const { return m_timerFd != -1; }
+
     /**
      * @brief 获取当前的 IO 管理器
      * static
@@ -176,7 +209,7 @@ protected:
      *
      * 定时器实现
      *
-     * @param timeout 下一个定时任务执行还要多久
+     * @param timeout 下一个定时任务执行还要多久 us
      * @return true
      * @return false
      */
@@ -203,6 +236,27 @@ protected:
      */
     void contextResize(size_t size);
 
+    /**
+     * @brief 添加事件
+     *
+     * @param fd 事件句柄
+     * @param event 事件类型
+     * @param cb 事件函数
+     * @param may_exist 事件已存在时返回 -1 否则 assert
+     * @param valid 不为空时 句柄失效则返回 -1
+     * @return int 0-success
+     */
+    int doAddEvent(int fd, Event event, std::function<void()> cb,
+                   bool may_exist,
+                   const std::function<bool()> &valid = nullptr);
+
+    /**
+     * @brief 设置 timerfd 的到期时间
+     *
+     * @param timeout_us 多久后到期 us ~0ull 表示关闭 timerfd
+     */
+    void armTimerFd(uint64_t timeout_us);
+
 private:
     // epoll 句柄
     int m_epollfd = 0;
@@ -210,6 +264,12 @@ private:
     // pipe管道
     int m_tickleFds[2];
 
+    // 高精度定时器 timerfd 未开启为 -1
+    int m_timerFd = -1;
+
+    // timerfd 是否设置了到期时间
+    std::atomic<bool> m_timerFdArmed = {false};
+
     // 等待执行的事件数量
     std::atomic<size_t> m_pendingEventCount = {0};
 
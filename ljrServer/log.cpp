@@ -536,6 +536,18 @@ void Logger::clearAppenders() {
     m_appenders.clear();
 }
 
+/**
+ * @brief 写出所有 appender 缓存的日志
+ *
+ */
+void Logger::flush() {
+    MutexType::Lock lock(m_mutex);
+
+    for (auto &i : m_appenders) {
+        i->flush();
+    }
+}
+
 /**
  * @brief 日志器 logger 打印日志
  *
@@ -598,6 +610,16 @@ void StdoutLogAppender::log(Logger::ptr logger, LogLevel::Level level,
     }
 }
 
+/**
+ * @brief 刷新 std::cout
+ *
+ */
+void StdoutLogAppender::flush() {
+    MutexType::Lock lock(m_mutex);
+
+    std::cout.flush();
+}
+
 /**
  * @brief 纯虚函数的重载实现 转 yaml 字符串
  *
@@ -646,7 +668,8 @@ void FileLogAppender::log(Logger::ptr logger, LogLevel::Level level,
                           LogEvent::ptr event) {
     // appender 的级别 <= 要打印的日志的级别
     if (m_level <= level) {
-        uint64_t now = time(0);
+        // 复用日志事件的时间戳 不再读取时钟
+        uint64_t now = event->getTime();
         if (now != m_lastTime) {
             reopen();
             m_lastTime = now;
@@ -699,6 +722,16 @@ bool FileLogAppender::reopen() {
     return !!m_filestream;
 }
 
+/**
+ * @brief 刷新文件流
+ *
+ */
+void FileLogAppender::flush() {
+    MutexType::Lock lock(m_mutex);
+
+    m_filestream.flush();
+}
+
 /***************
 LogFormatter
 ***************/
@@ -946,6 +979,18 @@ Logger::ptr LoggerManager::getLogger(const std::string &name) {
  *
  * @return std::string
  */
+/**
+ * @brief 写出所有日志器缓存的日志
+ *
+ */
+void LoggerManager::flush() {
+    MutexType::Lock lock(m_mutex);
+
+    for (auto &i : m_loggers) {
+        i.second->flush();
+    }
+}
+
 std::string LoggerManager::toYamlString() {
     MutexType::Lock lock(m_mutex);
 
@@ -13,6 +13,7 @@
 #include <stdarg.h>
 
 #include "util.h"
+#include "clock.h"
 #include "singleton.h"
 #include "thread.h"
 
@@ -22,7 +23,8 @@
     ljrserver::LogEventWrap(                                                  \
         ljrserver::LogEvent::ptr(new ljrserver::LogEvent(                     \
             logger, level, __FILE__, __LINE__, 0, ljrserver::GetThreadId(),   \
-            ljrserver::GetFiberId(), time(0), ljrserver::Thread::GetName()))) \
+            ljrserver::GetFiberId(), ljrserver::Clock::CoarseTime(),          \
+            ljrserver::Thread::GetName())))                                   \
         .getSS()
 
 #define LJRSERVER_LOG_DEBUG(logger) \
@@ -42,7 +44,8 @@
     ljrserver::LogEventWrap(                                                  \
         ljrserver::LogEvent::ptr(new ljrserver::LogEvent(                     \
             logger, level, __FILE__, __LINE__, 0, ljrserver::GetThreadId(),   \
-            ljrserver::GetFiberId(), time(0), ljrserver::Thread::GetName()))) \
+            ljrserver::GetFiberId(), ljrserver::Clock::CoarseTime(),          \
+            ljrserver::Thread::GetName())))                                   \
         .getEvent()                                                           \
         ->format(fmt, __VA_ARGS__)
 
@@ -365,6 +368,12 @@ public:
      */
     virtual std::string toYamlString() = 0;
 
+    /**
+     * @brief 写出缓存的日志 _exit 前调用
+     *
+     */
+    virtual void flush() {}
+
     /**
      * @brief 获取 appender 的日志格式
      *
@@ -467,6 +476,12 @@ public:
      */
     void clearAppenders();
 
+    /**
+     * @brief 写出所有 appender 缓存的日志
+     *
+     */
+    void flush();
+
     /**
      * @brief Get the Level object
      *
@@ -569,6 +584,12 @@ public:
      */
     std::string toYamlString() override;
 
+    /**
+     * @brief 刷新 std::cout
+     *
+     */
+    void flush() override;
+
 private:
 };
 
@@ -617,6 +638,12 @@ public:
      */
     bool reopen();
 
+    /**
+     * @brief 刷新文件流
+     *
+     */
+    void flush() override;
+
 private:
     // 日志文件名
     std::string m_filename;
@@ -671,6 +698,13 @@ public:
      */
     std::string toYamlString();
 
+    /**
+     * @brief 写出所有日志器缓存的日志
+     *
+     * _exit 不会刷新 stdio 和文件流 退出前调用
+     */
+    void flush();
+
 private:
     // 日志器列表 map
     std::map<std::string, Logger::ptr> m_loggers;
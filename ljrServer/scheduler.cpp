@@ -3,6 +3,7 @@
 #include "log.h"
 #include "macro.h"
 #include "hook.h"
+#include "clock.h"
 
 namespace ljrserver {
 
@@ -282,6 +283,12 @@ void Scheduler::run() {
                 is_active = true;
                 break;
             }
+
+            if (!is_active) {
+                // 在锁内登记闲置 之后加入的任务 tickle 时一定能看到闲置线程
+                // 否则检查完队列到进入 idle 之间加入的任务会丢失唤醒
+                ++m_idleThreadCount;
+            }
         }
 
         // 需要提醒其他线程
@@ -289,6 +296,11 @@ void Scheduler::run() {
             tickle();
         }
 
+        if (is_active) {
+            // 任务一直不断时不会进入 idle 在这里刷新线程时间缓存
+            ljrserver::Clock::Refresh();
+        }
+
         // 如果是协程形式且状态不是终止和意外
         if (ft.fiber && (ft.fiber->getState() != Fiber::TERM &&
                          ft.fiber->getState() != Fiber::EXCEPT)) {
@@ -361,12 +373,12 @@ void Scheduler::run() {
 
             // 协程任务队列中没有待处理的任务，则使用 idle 协程占用 cpu
             if (idle_fiber->getState() == Fiber::TERM) {
+                --m_idleThreadCount;
                 LJRSERVER_LOG_INFO(g_logger) << "idle fiber terminate";
                 break;
             }
 
-            // 进入 idle_fiber
-            ++m_idleThreadCount;
+            // 进入 idle_fiber 闲置计数已在取任务时加上
             idle_fiber->swapIn();
             --m_idleThreadCount;
 
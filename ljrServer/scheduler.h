@@ -51,6 +51,13 @@ public:
      */
     const std::string &getName() const { return m_name; }
 
+    /**
+     * @brief 获取调度线程的 id 使用 caller 时包含 caller 线程
+     *
+     * @return const std::vector<int>&
+     */
+    const std::vector<int> &getThreadIds() const { return m_threadIds; }
+
     /**
      * @brief 获取当前线程指向的调度器实例对象
      *
@@ -12,15 +12,36 @@
 // hook
 #include "hook.h"
 
+// 配置
+#include "config.h"
+// 时间
+#include "util.h"
+// 单调时钟
+#include "clock.h"
+
 // #include <limits.h>
 // TCP_NODELAY 不延迟发
 #include <netinet/tcp.h>
+// 零拷贝完成通知 sock_extended_err
+#include <linux/errqueue.h>
 
 namespace ljrserver {
 
 // system 日志
 static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
 
+// 配置 零拷贝发送的最小长度 更小的数据拷贝更快
+static ljrserver::ConfigVar<uint32_t>::ptr g_zerocopy_threshold =
+    ljrserver::Config::Lookup("socket.zerocopy_threshold",
+                              (uint32_t)(32 * 1024),
+                              "socket zerocopy send threshold");
+
+// 配置 关闭时等待零拷贝发送完成的时间 ms
+static ljrserver::ConfigVar<uint32_t>::ptr g_zerocopy_close_timeout =
+    ljrserver::Config::Lookup("socket.zerocopy_close_timeout",
+                              (uint32_t)1000,
+                              "socket zerocopy flush timeout on close ms");
+
 /******************************************
  * 便利函数
  ******************************************/
@@ -165,7 +186,9 @@ void Socket::setRecvTimeout(int64_t v) {
  *
  */
 bool Socket::getOption(int level, int option, void *result, size_t *len) {
-    int rt = getsockopt(m_sock, level, option, result, (socklen_t *)len);
+    socklen_t length = *len;
+    int rt = getsockopt(m_sock, level, option, result, &length);
+    *len = length;
     if (rt) {
         LJRSERVER_LOG_DEBUG(g_logger)
             << "getOption sock = " << m_sock << " level = " << level
@@ -202,7 +225,7 @@ bool Socket::setOption(int level, int option, const void *result, size_t len) {
  */
 Socket::ptr Socket::accept() {
     // 创建 socket 对象
-    Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
+    Socket::ptr sock = createAcceptSocket();
 
     // 接收 connect
     int newsock = ::accept(m_sock, nullptr, nullptr);
@@ -220,6 +243,68 @@ Socket::ptr Socket::accept() {
     return nullptr;
 }
 
+/**
+ * @brief 批量接受 connect 连接
+ *
+ * 没有连接时挂起协程等待 有连接后用 accept4 一次取完已完成的连接
+ * 新连接直接是非阻塞的 远程地址取自 accept4 本机地址用到时再获取
+ *
+ * @param clients 保存新连接的 socket
+ * @param max 最多接受的个数
+ * @return int 接受的个数 失败返回 -1 错误码 errno
+ */
+int Socket::acceptBatch(std::vector<Socket::ptr> &clients, size_t max) {
+    int count = 0;
+    while ((size_t)count < max) {
+        sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+        int newsock;
+        if (count == 0) {
+            // 第一个连接 没有时挂起协程
+            newsock = ::accept4(m_sock, (sockaddr *)&addr, &addrlen,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        } else {
+            // 后续不等待 backlog 取完为止
+            newsock = accept4_f(m_sock, (sockaddr *)&addr, &addrlen,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (newsock >= 0) {
+                FdMgr::GetInstance()->createNonblockSocket(newsock);
+            }
+        }
+
+        if (newsock == -1) {
+            if (count == 0) {
+                LJRSERVER_LOG_ERROR(g_logger)
+                    << "accept4(" << m_sock << ") errno = " << errno
+                    << " errno-string = " << strerror(errno);
+                return -1;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LJRSERVER_LOG_ERROR(g_logger)
+                    << "accept4(" << m_sock << ") errno = " << errno
+                    << " errno-string = " << strerror(errno);
+            }
+            break;
+        }
+
+        Socket::ptr sock = createAcceptSocket();
+        // TCP_NODELAY 等选项继承自监听 socket
+        if (!sock->init(newsock, true)) {
+            // 句柄没有加入句柄管理器
+            ::close(newsock);
+            continue;
+        }
+        if (m_family == AF_INET || m_family == AF_INET6) {
+            // unix 域对端一般没有地址 用到时再获取
+            sock->m_remoteAddress =
+                Address::Create((const sockaddr *)&addr, addrlen);
+        }
+        clients.push_back(sock);
+        ++count;
+    }
+    return count;
+}
+
 /**
  * @brief 服务器绑定一个监听地址
  *
@@ -246,6 +331,11 @@ bool Socket::bind(const Address::ptr addr) {
         return false;
     }
 
+    // 多个 socket 监听同一地址
+    if (m_reusePort && !setOption(SOL_SOCKET, SO_REUSEPORT, 1)) {
+        return false;
+    }
+
     // 绑定地址 Address::ptr 动态多态 bind 没有 hook
     if (::bind(m_sock, addr->getAddr(), addr->getAddrLen())) {
         LJRSERVER_LOG_ERROR(g_logger) << "bind error errno = " << errno
@@ -259,6 +349,37 @@ bool Socket::bind(const Address::ptr addr) {
     return true;
 }
 
+/**
+ * @brief 接管已经 bind 的 socket 句柄 热升级时继承自旧进程
+ *
+ * @param sock socket 句柄 协议簇要和 socket 对象一致
+ * @return true 接管成功
+ * @return false 不是 socket 或协议簇不一致
+ */
+bool Socket::attach(int sock) {
+    int family = 0;
+    socklen_t len = sizeof(family);
+    if (getsockopt(sock, SOL_SOCKET, SO_DOMAIN, &family, &len) ||
+        family != m_family) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "attach sock = " << sock << " family(" << family
+            << ") not equal sock.family(" << m_family << ")";
+        return false;
+    }
+    // 加入句柄管理器 设置非阻塞
+    FdCtx::ptr ctx = FdMgr::GetInstance()->get(sock, true);
+    if (!ctx || !ctx->isSocket() || ctx->isClosed()) {
+        return false;
+    }
+    if (isValid()) {
+        close();
+    }
+    m_sock = sock;
+    // 获取本机地址
+    getLocalAddress();
+    return true;
+}
+
 /**
  * @brief 客户端连接服务器地址
  *
@@ -359,8 +480,28 @@ bool Socket::close() {
         return true;
     }
 
+    // 内核可能还在引用零拷贝的数据 先等待完成再释放 holder
+    uint32_t zc_timeout = g_zerocopy_close_timeout->getValue();
+    if (!m_zcPending.empty() && m_sock != -1 && !flushZeroCopy(zc_timeout)) {
+        LJRSERVER_LOG_WARN(g_logger)
+            << "close sock=" << m_sock
+            << " zerocopy pending=" << m_zcPending.size() << " timeout reset";
+        // 复位连接 close 时内核丢弃发送队列 holder 释放后被改写的内存不会发出
+        linger lg = {1, 0};
+        setOption(SOL_SOCKET, SO_LINGER, lg);
+        // 网卡队列中的 skb 还可能引用 再保留一个超时时间后释放
+        IOManager *iom = IOManager::GetThis();
+        if (iom) {
+            typedef decltype(m_zcPending) Pending;
+            auto pending = std::make_shared<Pending>(std::move(m_zcPending));
+            iom->addTimer(zc_timeout, [pending]() { pending->clear(); });
+        }
+    }
+
     // 关闭连接
     m_isConnected = false;
+    // 关闭后不会再有完成通知
+    m_zcPending.clear();
     if (m_sock != -1) {
         // 关闭
         ::close(m_sock);
@@ -391,9 +532,160 @@ int Socket::send(const iovec *buffers, size_t length, int flags) {
     return -1;
 }
 
+/******************************************
+ * 零拷贝发送
+ ******************************************/
+
+/**
+ * @brief 开启或关闭零拷贝发送 SO_ZEROCOPY
+ *
+ * @param v
+ * @return true
+ * @return false 内核不支持
+ */
+bool Socket::setZeroCopy(bool v) {
+    if (v && !setOption(SOL_SOCKET, SO_ZEROCOPY, 1)) {
+        return false;
+    }
+    m_zeroCopy = v;
+    return true;
+}
+
+/**
+ * @brief 零拷贝发送 MSG_ZEROCOPY
+ *
+ * @param buffer 数据
+ * @param length 长度
+ * @param holder 持有数据的对象
+ * @param flags [= 0]
+ * @return int 发送的字节数 失败返回 -1
+ */
+int Socket::sendZeroCopy(const void *buffer, size_t length,
+                         std::shared_ptr<void> holder, int flags) {
+    iovec iov;
+    iov.iov_base = (void *)buffer;
+    iov.iov_len = length;
+    return sendZeroCopy(&iov, 1, holder, flags);
+}
+
+/**
+ * @brief 零拷贝发送多块数据 MSG_ZEROCOPY
+ *
+ * @param buffers 数据块
+ * @param length 块数
+ * @param holder 持有数据的对象
+ * @param flags [= 0]
+ * @return int 发送的字节数 失败返回 -1
+ */
+int Socket::sendZeroCopy(const iovec *buffers, size_t length,
+                         std::shared_ptr<void> holder, int flags) {
+    size_t total = 0;
+    for (size_t i = 0; i < length; ++i) {
+        total += buffers[i].iov_len;
+    }
+    if (!m_zeroCopy || total < g_zerocopy_threshold->getValue()) {
+        // 小数据拷贝发送
+        return send(buffers, length, flags);
+    }
+    if (!isConnected()) {
+        return -1;
+    }
+
+    // 顺便回收已经完成的发送
+    reapZeroCopy();
+
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (iovec *)buffers;
+    msg.msg_iovlen = length;
+    int rt = ::sendmsg(m_sock, &msg, flags | MSG_ZEROCOPY);
+    if (rt < 0 && errno == ENOBUFS) {
+        // 锁定的内存超过 optmem_max 退回拷贝发送
+        return ::sendmsg(m_sock, &msg, flags);
+    }
+    if (rt > 0) {
+        // 内核为每次成功的零拷贝发送分配一个序号
+        m_zcPending.push_back(std::make_pair(m_zcNext++, holder));
+    }
+    return rt;
+}
+
+/**
+ * @brief 读取错误队列中的完成通知 释放已经完成的数据 不阻塞
+ *
+ * @return size_t 还没有完成的发送个数
+ */
+size_t Socket::reapZeroCopy() {
+    while (!m_zcPending.empty()) {
+        char control[128];
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        // 错误队列为空时直接返回 EAGAIN 不用 hook
+        if (recvmsg_f(m_sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            break;
+        }
+
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+             cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == SOL_IPV6 &&
+                  cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            sock_extended_err *err = (sock_extended_err *)CMSG_DATA(cm);
+            if (err->ee_errno != 0 ||
+                err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                // 内核仍然拷贝了数据 (loopback 或网卡不支持) 后续直接拷贝发送
+                ++m_zcCopied;
+                m_zeroCopy = false;
+            }
+
+            // 序号区间 [lo, hi] 已经完成 序号回绕时按无符号差比较
+            uint32_t lo = err->ee_info;
+            uint32_t hi = err->ee_data;
+            for (auto it = m_zcPending.begin(); it != m_zcPending.end();) {
+                if (it->first - lo <= hi - lo) {
+                    it = m_zcPending.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+    return m_zcPending.size();
+}
+
+/**
+ * @brief 等待所有零拷贝发送完成 等待时协程挂起
+ *
+ * 完成通知只在错误队列上触发 EPOLLERR 不能单独注册
+ * 所以按 0.1ms 到 10ms 指数退避地检查 在协程中 usleep 由定时器唤醒
+ *
+ * @param timeout_ms 超时时间 毫秒
+ * @return true 全部完成
+ * @return false 超时
+ */
+bool Socket::flushZeroCopy(uint64_t timeout_ms) {
+    uint64_t deadline = ljrserver::Clock::NowMS() + timeout_ms;
+    useconds_t wait_us = 100;
+    while (reapZeroCopy()) {
+        if (!isValid() || ljrserver::Clock::NowMS() >= deadline) {
+            return false;
+        }
+        usleep(wait_us);
+        wait_us = std::min<useconds_t>(wait_us * 2, 10 * 1000);
+    }
+    return true;
+}
+
 int Socket::sendTo(const void *buffer, size_t length, const Address::ptr to,
                    int flags) {
-    if (isConnected()) {
+    if (isValid()) {
         return ::sendto(m_sock, buffer, length, flags, to->getAddr(),
                         to->getAddrLen());
     }
@@ -402,7 +694,7 @@ int Socket::sendTo(const void *buffer, size_t length, const Address::ptr to,
 
 int Socket::sendTo(const iovec *buffers, size_t length, const Address::ptr to,
                    int flags) {
-    if (isConnected()) {
+    if (isValid()) {
         msghdr msg;
         memset(&msg, 0, sizeof(msg));
         msg.msg_iov = (iovec *)buffers;
@@ -438,7 +730,7 @@ int Socket::recv(iovec *buffers, size_t length, int flags) {
 
 int Socket::recvFrom(void *buffer, size_t length, Address::ptr from,
                      int flags) {
-    if (isConnected()) {
+    if (isValid()) {
         socklen_t len = from->getAddrLen();
         return ::recvfrom(m_sock, buffer, length, flags, from->getAddr(), &len);
     }
@@ -447,7 +739,7 @@ int Socket::recvFrom(void *buffer, size_t length, Address::ptr from,
 
 int Socket::recvFrom(iovec *buffers, size_t length, Address::ptr from,
                      int flags) {
-    if (isConnected()) {
+    if (isValid()) {
         msghdr msg;
         memset(&msg, 0, sizeof(msg));
         msg.msg_iov = (iovec *)buffers;
@@ -459,6 +751,134 @@ int Socket::recvFrom(iovec *buffers, size_t length, Address::ptr from,
     return -1;
 }
 
+/******************************************
+ * 批量收发
+ ******************************************/
+
+int Socket::sendBatch(mmsghdr *msgs, unsigned int count, int flags) {
+    if (isValid()) {
+        return ::sendmmsg(m_sock, msgs, count, flags);
+    }
+    return -1;
+}
+
+int Socket::sendBatch(const std::vector<ByteArray::ptr> &datas,
+                      const std::vector<Address::ptr> &tos, int flags) {
+    if (!isValid() || (!tos.empty() && tos.size() != datas.size())) {
+        return -1;
+    }
+
+    size_t count = datas.size();
+    if (count == 0) {
+        return 0;
+    }
+    std::vector<mmsghdr> msgs(count);
+    // 每个数据报的 iovec 先全部收集 再回填指针 避免 vector 扩容失效
+    std::vector<iovec> iovs;
+    std::vector<size_t> offsets(count + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        datas[i]->getReadBuffers(iovs, datas[i]->getReadSize());
+        offsets[i + 1] = iovs.size();
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        msghdr &msg = msgs[i].msg_hdr;
+        memset(&msg, 0, sizeof(msg));
+        // 空的数据报没有 iovec 不能对末尾取下标
+        msg.msg_iovlen = offsets[i + 1] - offsets[i];
+        msg.msg_iov = msg.msg_iovlen ? iovs.data() + offsets[i] : nullptr;
+        if (!tos.empty()) {
+            msg.msg_name = tos[i]->getAddr();
+            msg.msg_namelen = tos[i]->getAddrLen();
+        }
+    }
+
+    int rt = ::sendmmsg(m_sock, &msgs[0], count, flags);
+    for (int i = 0; i < rt; ++i) {
+        // 发送成功 修改 position
+        datas[i]->setPostion(datas[i]->getPosition() + msgs[i].msg_len);
+    }
+    return rt;
+}
+
+int Socket::recvBatch(mmsghdr *msgs, unsigned int count, int flags) {
+    if (isValid()) {
+        return ::recvmmsg(m_sock, msgs, count, flags, nullptr);
+    }
+    return -1;
+}
+
+int Socket::recvBatch(std::vector<ByteArray::ptr> &datas,
+                      std::vector<Address::ptr> &froms, size_t max_size,
+                      int flags) {
+    if (!isValid()) {
+        // 已经关闭 调用方按 errno 判断是否继续接收
+        errno = EBADF;
+        return -1;
+    }
+    if (!froms.empty() && froms.size() != datas.size()) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t count = datas.size();
+    if (count == 0) {
+        return 0;
+    }
+    std::vector<mmsghdr> msgs(count);
+    std::vector<iovec> iovs;
+    std::vector<size_t> offsets(count + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        // 不修改 position
+        datas[i]->getWriteBuffers(iovs, max_size);
+        offsets[i + 1] = iovs.size();
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        msghdr &msg = msgs[i].msg_hdr;
+        memset(&msg, 0, sizeof(msg));
+        // 空的数据报没有 iovec 不能对末尾取下标
+        msg.msg_iovlen = offsets[i + 1] - offsets[i];
+        msg.msg_iov = msg.msg_iovlen ? iovs.data() + offsets[i] : nullptr;
+        if (!froms.empty()) {
+            msg.msg_name = froms[i]->getAddr();
+            msg.msg_namelen = froms[i]->getAddrLen();
+        }
+    }
+
+    int rt = ::recvmmsg(m_sock, &msgs[0], count, flags, nullptr);
+    for (int i = 0; i < rt; ++i) {
+        // 接收到了数据 设置 position
+        datas[i]->setPostion(datas[i]->getPosition() + msgs[i].msg_len);
+    }
+    return rt;
+}
+
+/******************************************
+ * 零拷贝
+ ******************************************/
+
+int Socket::sendFile(int in_fd, off_t *offset, size_t length) {
+    if (isConnected()) {
+        return ::sendfile(m_sock, in_fd, offset, length);
+    }
+    return -1;
+}
+
+int Socket::spliceFrom(int pipe_fd, size_t length, unsigned int flags) {
+    if (isConnected()) {
+        return ::splice(pipe_fd, nullptr, m_sock, nullptr, length, flags);
+    }
+    return -1;
+}
+
+int Socket::spliceTo(int pipe_fd, size_t length, unsigned int flags) {
+    if (isConnected()) {
+        return ::splice(m_sock, nullptr, pipe_fd, nullptr, length, flags);
+    }
+    return -1;
+}
+
 /******************************************
  * 属性
  ******************************************/
@@ -661,14 +1081,14 @@ bool Socket::cancelAll() {
  ******************************************/
 
 /**
- * @brief accept 初始化 socket
- * private
+ * @brief accept 初始化 socket 虚函数
  *
  * @param sock socket 句柄
+ * @param lazy 选项继承自监听 socket 不再设置 地址用到时再获取 [= false]
  * @return true
  * @return false
  */
-bool Socket::init(int sock) {
+bool Socket::init(int sock, bool lazy) {
     // 获取句柄对象
     FdCtx::ptr ctx = FdMgr::GetInstance()->get(sock);
     // 获取成功且是 socket 且没有关闭
@@ -678,18 +1098,29 @@ bool Socket::init(int sock) {
         // 连接成功
         m_isConnected = true;
 
-        // 初始化 socket
-        initSock();
-        // 获取本机地址
-        getLocalAddress();
-        // 获取远程地址
-        getRemoteAddress();
+        if (!lazy) {
+            // 初始化 socket
+            initSock();
+            // 获取本机地址
+            getLocalAddress();
+            // 获取远程地址
+            getRemoteAddress();
+        }
 
         return true;
     }
     return false;
 }
 
+/**
+ * @brief 创建 accept 到的连接的 socket 对象 虚函数
+ *
+ * @return Socket::ptr
+ */
+Socket::ptr Socket::createAcceptSocket() {
+    return Socket::ptr(new Socket(m_family, m_type, m_protocol));
+}
+
 /**
  * @brief 初始化 socket
  * private
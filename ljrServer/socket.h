@@ -4,9 +4,13 @@
 
 // 智能指针
 #include <memory>
+// 零拷贝发送中的数据
+#include <deque>
 
 // 地址
 #include "address.h"
+// 批量收发
+#include "bytearray.h"
 // 不可复制
 #include "noncopyable.h"
 
@@ -59,7 +63,7 @@ public:  /// 构造析构
      * @brief socket 析构函数
      *
      */
-    ~Socket();
+    virtual ~Socket();
 
 public:  /// 超时相关
     /**
@@ -98,8 +102,8 @@ public:  /// 句柄
     bool getOption(int level, int option, void *result, size_t *len);
     template <class T>
     bool getOption(int level, int option, T &result) {
-        // size_t length = sizeof(T);
-        return getOption(level, option, &result, sizeof(T));
+        size_t length = sizeof(T);
+        return getOption(level, option, &result, &length);
     }
 
     /**
@@ -120,6 +124,19 @@ public:  /// 连接
      */
     Socket::ptr accept();
 
+    /**
+     * @brief 批量接受 connect 连接
+     *
+     * 没有连接时挂起协程等待 有连接后用 accept4 一次取完已完成的连接
+     * 新连接直接是非阻塞的 远程地址取自 accept4 本机地址用到时再获取
+     *
+     * @pre Socket 必须 bind listen 成功
+     * @param clients 保存新连接的 socket
+     * @param max 最多接受的个数
+     * @return int 接受的个数 失败返回 -1 错误码 errno
+     */
+    int acceptBatch(std::vector<Socket::ptr> &clients, size_t max);
+
     /**
      * @brief 服务器绑定一个监听地址
      *
@@ -129,6 +146,24 @@ public:  /// 连接
      */
     bool bind(const Address::ptr addr);
 
+    /**
+     * @brief 接管已经 bind 的 socket 句柄 热升级时继承自旧进程
+     *
+     * @param sock socket 句柄 协议簇要和 socket 对象一致
+     * @return true 接管成功
+     * @return false 不是 socket 或协议簇不一致
+     */
+    bool attach(int sock);
+
+    /**
+     * @brief 设置 bind 前是否开启 SO_REUSEPORT
+     *
+     * 多个 socket 监听同一地址 由内核分配新连接
+     *
+     * @param v
+     */
+    void setReusePort(bool v) { m_reusePort = v; }
+
     /**
      * @brief 客户端连接服务器地址
      *
@@ -137,7 +172,7 @@ public:  /// 连接
      * @return true 连接成功
      * @return false 连接失败
      */
-    bool connect(const Address::ptr addr, uint64_t timeout_ms = -1);
+    virtual bool connect(const Address::ptr addr, uint64_t timeout_ms = -1);
 
     /**
      * @brief 服务器监听 socket 句柄
@@ -151,26 +186,171 @@ public:  /// 连接
     /**
      * @brief 关闭 socket
      *
+     * 先等待零拷贝发送完成 最多 socket.zerocopy_close_timeout
+     * 超时则复位连接丢弃发送队列 在 IO 协程中 holder 再保留一个超时时间
+     * 网卡队列中的 skb 可能还在引用 不在 IO 协程中时随关闭释放
+     *
      * @return true
      * @return false
      */
-    bool close();
+    virtual bool close();
 
 public:  /// 发送
-    int send(const void *buffer, size_t length, int flags = 0);
-    int send(const iovec *buffers, size_t length, int flags = 0);
+    virtual int send(const void *buffer, size_t length, int flags = 0);
+    virtual int send(const iovec *buffers, size_t length, int flags = 0);
     int sendTo(const void *buffer, size_t length, const Address::ptr to,
                int flags = 0);
     int sendTo(const iovec *buffers, size_t length, const Address::ptr to,
                int flags = 0);
 
+public:  /// 零拷贝发送
+    /**
+     * @brief 开启或关闭零拷贝发送 SO_ZEROCOPY
+     *
+     * @param v
+     * @return true
+     * @return false 内核不支持
+     */
+    virtual bool setZeroCopy(bool v);
+    bool isZeroCopy() const { return m_zeroCopy; }
+
+    /**
+     * @brief 零拷贝发送 MSG_ZEROCOPY
+     *
+     * 未开启零拷贝或长度小于 socket.zerocopy_threshold 时拷贝发送
+     * 内核发送完成前数据不能修改 由 holder 持有 完成通知到达后释放
+     *
+     * @param buffer 数据
+     * @param length 长度
+     * @param holder 持有数据的对象
+     * @param flags [= 0]
+     * @return int 发送的字节数 失败返回 -1
+     */
+    int sendZeroCopy(const void *buffer, size_t length,
+                     std::shared_ptr<void> holder, int flags = 0);
+
+    /**
+     * @brief 零拷贝发送多块数据 MSG_ZEROCOPY
+     *
+     * @param buffers 数据块
+     * @param length 块数
+     * @param holder 持有数据的对象
+     * @param flags [= 0]
+     * @return int 发送的字节数 失败返回 -1
+     */
+    int sendZeroCopy(const iovec *buffers, size_t length,
+                     std::shared_ptr<void> holder, int flags = 0);
+
+    /**
+     * @brief 读取错误队列中的完成通知 释放已经完成的数据 不阻塞
+     *
+     * @return size_t 还没有完成的发送个数
+     */
+    size_t reapZeroCopy();
+
+    /**
+     * @brief 等待所有零拷贝发送完成 等待时协程挂起
+     *
+     * @param timeout_ms 超时时间 毫秒
+     * @return true 全部完成
+     * @return false 超时
+     */
+    bool flushZeroCopy(uint64_t timeout_ms);
+
+    // 还没有完成的零拷贝发送个数
+    size_t getZeroCopyPending() const { return m_zcPending.size(); }
+
+    // 内核退回拷贝发送的次数 如 loopback 或网卡不支持 出现后关闭零拷贝
+    uint64_t getZeroCopyCopied() const { return m_zcCopied; }
+
 public:  /// 接收
-    int recv(void *buffer, size_t length, int flags = 0);
-    int recv(iovec *buffers, size_t length, int flags = 0);
+    virtual int recv(void *buffer, size_t length, int flags = 0);
+    virtual int recv(iovec *buffers, size_t length, int flags = 0);
     int recvFrom(void *buffer, size_t length, Address::ptr from, int flags = 0);
     int recvFrom(iovec *buffers, size_t length, Address::ptr from,
                  int flags = 0);
 
+public:  /// 批量收发
+    /**
+     * @brief 批量发送数据报 sendmmsg
+     *
+     * @param msgs 调用方填充的消息数组 发送后 msg_len 为每条发送的长度
+     * @param count 消息个数
+     * @param flags [= 0]
+     * @return int 发送的数据报个数 -1 失败
+     */
+    int sendBatch(mmsghdr *msgs, unsigned int count, int flags = 0);
+
+    /**
+     * @brief 批量发送 ByteArray 中的数据报
+     *
+     * 每个 ByteArray 从 position 开始的可读数据为一个数据报
+     * 发送成功的 ByteArray 的 position 移到末尾
+     *
+     * @param datas 数据
+     * @param tos 目标地址 空则发往已连接的地址 否则与 datas 一一对应
+     * @param flags [= 0]
+     * @return int 发送的数据报个数 -1 失败
+     */
+    int sendBatch(const std::vector<ByteArray::ptr> &datas,
+                  const std::vector<Address::ptr> &tos, int flags = 0);
+
+    /**
+     * @brief 批量接收数据报 recvmmsg
+     *
+     * @param msgs 调用方填充的消息数组 接收后 msg_len 为每条接收的长度
+     * @param count 消息个数
+     * @param flags [= 0]
+     * @return int 接收的数据报个数 -1 失败
+     */
+    int recvBatch(mmsghdr *msgs, unsigned int count, int flags = 0);
+
+    /**
+     * @brief 批量接收数据报到 ByteArray
+     *
+     * 每个 ByteArray 从 position 开始写入一个数据报 position 后移
+     *
+     * @param datas 接收缓存 个数为一次最多接收的数据报个数
+     * @param froms 来源地址 空则不获取 否则与 datas 一一对应
+     * @param max_size 单个数据报的最大长度
+     * @param flags [= 0]
+     * @return int 接收的数据报个数 -1 失败
+     */
+    int recvBatch(std::vector<ByteArray::ptr> &datas,
+                  std::vector<Address::ptr> &froms, size_t max_size,
+                  int flags = 0);
+
+public:  /// 零拷贝
+    /**
+     * @brief 发送文件 sendfile
+     *
+     * @param in_fd 文件句柄
+     * @param offset 文件偏移 发送后更新
+     * @param length 发送长度
+     * @return int 发送的字节数 -1 失败
+     */
+    virtual int sendFile(int in_fd, off_t *offset, size_t length);
+
+    /**
+     * @brief 从管道读取数据发送 splice 管道 -> socket
+     *
+     * @param pipe_fd 管道读端
+     * @param length 长度
+     * @param flags SPLICE_F_* [= 0]
+     * @return int 发送的字节数 -1 失败
+     */
+    virtual int spliceFrom(int pipe_fd, size_t length, unsigned int flags = 0);
+
+    /**
+     * @brief 接收数据写入管道 splice socket -> 管道
+     *
+     * @param pipe_fd 管道写端
+     * @param length 长度
+     * @param flags SPLICE_F_* [= 0]
+     * @return int 接收的字节数 0 对端关闭 -1 失败
+     */
+    virtual int spliceTo(int pipe_fd, size_t length, unsigned int flags = 0);
+
 public:  /// 属性
     /**
      * @brief 获取远程地址 getpeername
@@ -213,7 +393,7 @@ public:  /// 属性
      * @param os
      * @return std::ostream&
      */
-    std::ostream &dump(std::ostream &os) const;
+    virtual std::ostream &dump(std::ostream &os) const;
 
 public:  /// IO 事件管理
     /**
@@ -248,16 +428,27 @@ public:  /// IO 事件管理
      */
     bool cancelAll();
 
-private:  // socket 初始化相关 private
+protected:  // 子类扩展 protected
     /**
-     * @brief accept 初始化 socket
-     * private
+     * @brief accept 初始化 socket 虚函数
      *
      * @param sock socket 句柄
+     * @param lazy 选项继承自监听 socket 不再设置 地址用到时再获取 [= false]
      * @return true
      * @return false
      */
-    bool init(int sock);
+    virtual bool init(int sock, bool lazy = false);
+
+    /**
+     * @brief 创建 accept 到的连接的 socket 对象 虚函数
+     *
+     * 子类重载后 accept 返回子类对象 如 SslSocket
+     *
+     * @return Socket::ptr
+     */
+    virtual Socket::ptr createAcceptSocket();
+
+private:  // socket 初始化相关 private
 
     /**
      * @brief 初始化 socket
@@ -287,6 +478,21 @@ private:
     // 是否连接
     bool m_isConnected;
 
+    // bind 前是否开启 SO_REUSEPORT
+    bool m_reusePort = false;
+
+    // 是否开启零拷贝发送
+    bool m_zeroCopy = false;
+
+    // 下一个零拷贝发送的序号 和内核的计数一致
+    uint32_t m_zcNext = 0;
+
+    // 内核退回拷贝发送的次数
+    uint64_t m_zcCopied = 0;
+
+    // 还没有完成的零拷贝发送 序号 -> 持有数据的对象
+    std::deque<std::pair<uint32_t, std::shared_ptr<void> > > m_zcPending;
+
     // 本机地址
     Address::ptr m_localAddress;
 
@@ -1,6 +1,12 @@
 
 #include "socket_stream.h"
 
+// splice
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+
 namespace ljrserver {
 
 /**
@@ -115,6 +121,126 @@ int SocketStream::write(ByteArray::ptr ba, size_t length) {
     return rt;
 }
 
+/**
+ * @brief 分散写入 一次 sendmsg 发送多块数据
+ *
+ * @param buffers 数据块
+ * @param length 数据块个数
+ * @return int 写入的字节数
+ */
+int SocketStream::writev(const iovec *buffers, size_t length) {
+    if (!isConnected()) {
+        return -1;
+    }
+    return m_socket->send(buffers, length);
+}
+
+/**
+ * @brief 发送文件 sendfile 直到发送完 length 长度
+ *
+ * @param fd 文件句柄
+ * @param offset 文件偏移
+ * @param length 发送长度
+ * @return int64_t 发送的字节数 文件不足 length 时为实际发送的字节数
+ *         <= 0 失败
+ */
+int64_t SocketStream::sendFile(int fd, off_t offset, size_t length) {
+    if (!isConnected()) {
+        return -1;
+    }
+    size_t left = length;
+    while (left > 0) {
+        // sendfile 更新 offset
+        int rt = m_socket->sendFile(fd, &offset, left);
+        if (rt <= 0) {
+            // 文件提前结束或出错 返回已经发送的部分
+            return left < length ? (int64_t)(length - left) : rt;
+        }
+        left -= rt;
+    }
+    return length;
+}
+
+/**
+ * @brief 零拷贝发送 直到发送完 length 长度
+ *
+ * @param buffer 数据
+ * @param length 长度
+ * @param holder 持有数据的对象 内核发送完成后释放
+ * @return int 发送的字节数 <= 0 失败
+ */
+int SocketStream::writeZeroCopy(const void *buffer, size_t length,
+                                std::shared_ptr<void> holder) {
+    if (!isConnected()) {
+        return -1;
+    }
+    size_t offset = 0;
+    while (offset < length) {
+        int rt = m_socket->sendZeroCopy((const char *)buffer + offset,
+                                        length - offset, holder);
+        if (rt <= 0) {
+            return rt;
+        }
+        offset += rt;
+    }
+    return length;
+}
+
+/**
+ * @brief 经由管道 splice 转发数据到另一个 socket 用于代理
+ *
+ * @param dst 目标 socket
+ * @param length 最多转发的长度 [= -1 直到对端关闭]
+ * @return int64_t 转发的字节数 < 0 失败
+ */
+int64_t SocketStream::spliceTo(Socket::ptr dst, size_t length) {
+    if (!isConnected() || !dst || !dst->isConnected()) {
+        return -1;
+    }
+
+    // 管道作为内核中转缓冲 每轮都读空 不会阻塞在管道上
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC)) {
+        return -1;
+    }
+
+    int64_t total = 0;
+    while ((size_t)total < length) {
+        // socket -> 管道 每轮不超过管道容量
+        size_t chunk = std::min(length - total, (size_t)64 * 1024);
+        int n = m_socket->spliceTo(fds[1], chunk,
+                                   SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n <= 0) {
+            // 0 对端关闭
+            if (n < 0) {
+                total = -1;
+            }
+            break;
+        }
+
+        // 管道 -> 目标 socket
+        int left = n;
+        while (left > 0) {
+            int rt = dst->spliceFrom(fds[0], left,
+                                     SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (rt <= 0) {
+                left = -1;
+                break;
+            }
+            left -= rt;
+        }
+        if (left < 0) {
+            total = -1;
+            break;
+        }
+        total += n;
+    }
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+    return total;
+}
+
 /**
  * @brief 是否连接
  *
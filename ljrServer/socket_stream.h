@@ -46,6 +46,49 @@ public:  /// Stream 纯虚函数的实现
     int write(const void *buffer, size_t length) override;
     int write(ByteArray::ptr ba, size_t length) override;
 
+    /**
+     * @brief 分散写入 一次 sendmsg 发送多块数据
+     *
+     * @param buffers 数据块
+     * @param length 数据块个数
+     * @return int 写入的字节数
+     */
+    int writev(const iovec *buffers, size_t length) override;
+
+public:  /// 零拷贝
+    /**
+     * @brief 发送文件 sendfile 直到发送完 length 长度
+     *
+     * @param fd 文件句柄
+     * @param offset 文件偏移
+     * @param length 发送长度
+     * @return int64_t 发送的字节数 文件不足 length 时为实际发送的字节数
+     *         <= 0 失败
+     */
+    int64_t sendFile(int fd, off_t offset, size_t length);
+
+    /**
+     * @brief 零拷贝发送 直到发送完 length 长度
+     *
+     * socket 没有开启零拷贝或长度小于阈值时拷贝发送
+     *
+     * @param buffer 数据
+     * @param length 长度
+     * @param holder 持有数据的对象 内核发送完成后释放
+     * @return int 发送的字节数 <= 0 失败
+     */
+    int writeZeroCopy(const void *buffer, size_t length,
+                      std::shared_ptr<void> holder);
+
+    /**
+     * @brief 经由管道 splice 转发数据到另一个 socket 用于代理
+     *
+     * @param dst 目标 socket
+     * @param length 最多转发的长度 [= -1 直到对端关闭]
+     * @return int64_t 转发的字节数 < 0 失败
+     */
+    int64_t spliceTo(Socket::ptr dst, size_t length = -1);
+
 public:
     /**
      * @brief 是否连接
@@ -0,0 +1,1000 @@
+/**
+ * @file ssl_socket.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief tls socket
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "ssl_socket.h"
+#include "config.h"
+#include "log.h"
+#include "singleton.h"
+#include "thread.h"
+#include "iomanager.h"
+#include "fd_manager.h"
+#include "hook.h"
+#include "clock.h"
+
+#include <map>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+namespace ljrserver {
+
+// system 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
+
+// 配置 握手后是否尝试开启 kTLS
+static ljrserver::ConfigVar<bool>::ptr g_ssl_ktls =
+    ljrserver::Config::Lookup("ssl.ktls", true, "ssl enable kernel tls");
+
+// 配置 服务器会话缓存的会话个数
+static ljrserver::ConfigVar<uint32_t>::ptr g_ssl_session_cache_size =
+    ljrserver::Config::Lookup("ssl.session_cache_size", (uint32_t)20480,
+                              "ssl server session cache size");
+
+// 配置 会话的有效期 秒 会话缓存和 ticket 都是
+static ljrserver::ConfigVar<uint32_t>::ptr g_ssl_session_timeout =
+    ljrserver::Config::Lookup("ssl.session_timeout", (uint32_t)300,
+                              "ssl session timeout in seconds");
+
+// 配置 客户端会话缓存的服务器个数
+static ljrserver::ConfigVar<uint32_t>::ptr g_ssl_client_session_cache_size =
+    ljrserver::Config::Lookup("ssl.client_session_cache_size", (uint32_t)1024,
+                              "ssl client session cache size");
+
+// 一个 tls 记录的最大明文长度
+static const size_t s_ssl_record_size = 16 * 1024;
+
+/**
+ * @brief 客户端会话缓存 主机名 + 地址 -> 最近的会话
+ *
+ * 超过容量时淘汰最久没有使用的服务器
+ */
+class SslSessionCache {
+public:
+    // 互斥锁
+    typedef Mutex MutexType;
+
+    // 会话智能指针
+    typedef std::shared_ptr<SSL_SESSION> SessionPtr;
+
+    /**
+     * @brief 获取会话
+     *
+     * @param key
+     * @return SessionPtr 没有返回 nullptr
+     */
+    SessionPtr get(const std::string &key) {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_sessions.find(key);
+        if (it == m_sessions.end()) {
+            return nullptr;
+        }
+        // 移到最近使用
+        m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+        return it->second.first;
+    }
+
+    /**
+     * @brief 保存会话 接管 sess 的引用
+     *
+     * @param key
+     * @param sess
+     */
+    void set(const std::string &key, SSL_SESSION *sess) {
+        SessionPtr ptr(sess, SSL_SESSION_free);
+        MutexType::Lock lock(m_mutex);
+        auto it = m_sessions.find(key);
+        if (it != m_sessions.end()) {
+            it->second.first = ptr;
+            m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+            return;
+        }
+        // 淘汰最久没有使用的
+        while (!m_lru.empty() &&
+               m_sessions.size() >=
+                   g_ssl_client_session_cache_size->getValue()) {
+            m_sessions.erase(m_lru.back());
+            m_lru.pop_back();
+        }
+        m_lru.push_front(key);
+        m_sessions[key] = std::make_pair(ptr, m_lru.begin());
+    }
+
+private:
+    // 锁
+    MutexType m_mutex;
+
+    // 最近使用的在前
+    std::list<std::string> m_lru;
+
+    // 会话 和在 m_lru 中的位置
+    std::map<std::string,
+             std::pair<SessionPtr, std::list<std::string>::iterator> >
+        m_sessions;
+};
+
+typedef ljrserver::Singleton<SslSessionCache> SslSessionCacheMgr;
+
+/**
+ * @brief 客户端收到新会话 包括 TLSv1.3 握手后的 ticket
+ *
+ * @return int 1 接管会话的引用
+ */
+static int ssl_new_session_cb(SSL *ssl, SSL_SESSION *sess) {
+    SslSocket *sock = (SslSocket *)SSL_get_app_data(ssl);
+    if (!sock || sock->getSessionKey().empty()) {
+        return 0;
+    }
+    SslSessionCacheMgr::GetInstance()->set(sock->getSessionKey(), sess);
+    return 1;
+}
+
+/**
+ * @brief 取出 openssl 错误队列中的错误
+ *
+ * @return std::string
+ */
+static std::string ssl_error_string() {
+    std::string str;
+    unsigned long e;
+    char buf[256];
+    while ((e = ERR_get_error()) != 0) {
+        ERR_error_string_n(e, buf, sizeof(buf));
+        if (!str.empty()) {
+            str.append("; ");
+        }
+        str.append(buf);
+    }
+    return str;
+}
+
+/**
+ * @brief 屏蔽当前线程的 SIGPIPE 析构时丢弃期间产生的 SIGPIPE
+ *
+ * openssl 通过 write 发送 不能带 MSG_NOSIGNAL
+ */
+class SigPipeGuard {
+public:
+    SigPipeGuard(bool enable) : m_enable(enable) {
+        if (!m_enable) {
+            return;
+        }
+        sigemptyset(&m_set);
+        sigaddset(&m_set, SIGPIPE);
+        // 之前就有的 SIGPIPE 不丢弃
+        sigset_t pending;
+        sigpending(&pending);
+        m_pending = sigismember(&pending, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &m_set, &m_old);
+    }
+
+    ~SigPipeGuard() {
+        if (!m_enable) {
+            return;
+        }
+        if (!m_pending) {
+            int e = errno;
+            timespec ts = {0, 0};
+            sigtimedwait(&m_set, nullptr, &ts);
+            errno = e;
+        }
+        pthread_sigmask(SIG_SETMASK, &m_old, nullptr);
+    }
+
+private:
+    bool m_enable;
+    bool m_pending = false;
+    sigset_t m_set;
+    sigset_t m_old;
+};
+
+/**
+ * @brief 等待其他协程 openssl 调用的协程
+ *
+ * 其他协程的调用返回 句柄就绪和超时中先到的一个唤醒
+ */
+struct SslWaiter {
+    // 是否已经唤醒 只唤醒一次
+    std::atomic<bool> woken = {false};
+    // 协程所在的 IO 管理器
+    IOManager *iom = nullptr;
+    // 等待的协程
+    Fiber::ptr fiber;
+
+    void wake() {
+        if (!woken.exchange(true)) {
+            iom->schedule(fiber);
+        }
+    }
+};
+
+/**
+ * @brief 析构时唤醒协程 声明在锁之前 唤醒时锁已经释放
+ *
+ */
+struct SslWaiterWaker {
+    std::vector<std::shared_ptr<SslWaiter> > waiters;
+
+    ~SslWaiterWaker() {
+        for (auto &i : waiters) {
+            i->wake();
+        }
+    }
+};
+
+/**
+ * @brief SSL_CTX 的公共设置
+ *
+ * @param ctx
+ */
+static void ssl_ctx_common(SSL_CTX *ctx) {
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_timeout(ctx, g_ssl_session_timeout->getValue());
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // 对端不发 close_notify 直接关闭视为正常关闭
+    SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+#ifdef SSL_OP_ENABLE_KTLS
+    // 握手后 openssl 设置 TCP_ULP tls 内核不支持时继续用户态加解密
+    if (g_ssl_ktls->getValue()) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+}
+
+/******************************************
+ * 便利函数
+ ******************************************/
+
+SslSocket::ptr SslSocket::CreateTCP(ljrserver::Address::ptr address,
+                                    CtxPtr ctx) {
+    SslSocket::ptr sock(new SslSocket(address->getFamily(), TCP, 0));
+    sock->setContext(ctx);
+    return sock;
+}
+
+/**
+ * @brief 创建服务器的 SSL_CTX
+ *
+ * @param cert_file 证书文件 pem
+ * @param key_file 私钥文件 pem
+ * @return CtxPtr 失败返回 nullptr
+ */
+SslSocket::CtxPtr SslSocket::CreateServerContext(const std::string &cert_file,
+                                                 const std::string &key_file) {
+    CtxPtr ctx(SSL_CTX_new(TLS_server_method()), SSL_CTX_free);
+    if (!ctx) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "SSL_CTX_new fail " << ssl_error_string();
+        return nullptr;
+    }
+    if (SSL_CTX_use_certificate_chain_file(ctx.get(), cert_file.c_str()) !=
+            1 ||
+        SSL_CTX_use_PrivateKey_file(ctx.get(), key_file.c_str(),
+                                    SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx.get()) != 1) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "load certificates fail cert_file = " << cert_file
+            << " key_file = " << key_file << " " << ssl_error_string();
+        return nullptr;
+    }
+    ssl_ctx_common(ctx.get());
+
+    // 会话缓存 TLSv1.2 的 session id 恢复
+    static const unsigned char s_sid_ctx[] = "ljrserver";
+    SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx.get(), s_sid_ctx,
+                                   sizeof(s_sid_ctx) - 1);
+    SSL_CTX_sess_set_cache_size(ctx.get(),
+                                g_ssl_session_cache_size->getValue());
+    // ticket 恢复 密钥在 SSL_CTX 中 共享 SSL_CTX 的 socket 都能解开
+    SSL_CTX_clear_options(ctx.get(), SSL_OP_NO_TICKET);
+    return ctx;
+}
+
+/**
+ * @brief 创建客户端的 SSL_CTX
+ *
+ * @param ca_file 校验服务器证书的 ca 文件 [= "" 不校验]
+ * @return CtxPtr 失败返回 nullptr
+ */
+SslSocket::CtxPtr SslSocket::CreateClientContext(const std::string &ca_file) {
+    CtxPtr ctx(SSL_CTX_new(TLS_client_method()), SSL_CTX_free);
+    if (!ctx) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "SSL_CTX_new fail " << ssl_error_string();
+        return nullptr;
+    }
+    ssl_ctx_common(ctx.get());
+
+    if (!ca_file.empty()) {
+        if (SSL_CTX_load_verify_locations(ctx.get(), ca_file.c_str(),
+                                          nullptr) != 1) {
+            LJRSERVER_LOG_ERROR(g_logger) << "load ca fail ca_file = "
+                                          << ca_file << " " << ssl_error_string();
+            return nullptr;
+        }
+        SSL_CTX_set_verify(ctx.get(), SSL_VERIFY_PEER, nullptr);
+    }
+
+    // 会话不放在 SSL_CTX 中 回调保存到客户端会话缓存
+    SSL_CTX_set_session_cache_mode(
+        ctx.get(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx.get(), ssl_new_session_cb);
+    return ctx;
+}
+
+/**
+ * @brief 默认的客户端 SSL_CTX 不校验证书
+ *
+ * @return SslSocket::CtxPtr
+ */
+static SslSocket::CtxPtr default_client_context() {
+    static SslSocket::CtxPtr s_ctx = SslSocket::CreateClientContext();
+    return s_ctx;
+}
+
+/******************************************
+ * 构造析构
+ ******************************************/
+
+SslSocket::SslSocket(int family, int type, int protocol)
+    : Socket(family, type, protocol),
+      m_handshaked(false),
+      m_handshaking(false),
+      m_error(false) {}
+
+SslSocket::~SslSocket() {
+    // 基类析构时调用不到重载的 close
+    close();
+}
+
+/******************************************
+ * tls
+ ******************************************/
+
+/**
+ * @brief 加载证书 创建服务器的 SSL_CTX
+ *
+ * @param cert_file 证书文件 pem
+ * @param key_file 私钥文件 pem
+ * @return true
+ * @return false
+ */
+bool SslSocket::loadCertificates(const std::string &cert_file,
+                                 const std::string &key_file) {
+    CtxPtr ctx = CreateServerContext(cert_file, key_file);
+    if (!ctx) {
+        return false;
+    }
+    m_ctx = ctx;
+    return true;
+}
+
+/**
+ * @brief tls 握手
+ *
+ * @return true
+ * @return false
+ */
+bool SslSocket::handshake() {
+    // 截止时间 等待其他协程握手时按接收超时
+    uint64_t start = Clock::NowMS();
+    while (true) {
+        std::shared_ptr<SslWaiter> waiter;
+        int64_t wait_ms = -1;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_handshaked) {
+                return true;
+            }
+            if (!m_ssl || m_error || !isConnected()) {
+                return false;
+            }
+            if (!m_handshaking) {
+                m_handshaking = true;
+                break;
+            }
+            int64_t timeout = getRecvTimeout();
+            if (timeout >= 0) {
+                uint64_t used = Clock::NowMS() - start;
+                if (used >= (uint64_t)timeout) {
+                    errno = ETIMEDOUT;
+                    return false;
+                }
+                wait_ms = timeout - used;
+            }
+            waiter = addWaiterNoLock();
+        }
+        // 其他协程正在握手 挂起到握手结束
+        if (waiter) {
+            wait(waiter, 0, wait_ms);
+        } else {
+            // 不在 IO 协程中 只能稍后重试
+            usleep(1000);
+        }
+    }
+
+    // 握手的协程可以在读写两个方向上等待
+    int rt = doSsl("SSL_do_handshake",
+                   [this]() { return SSL_do_handshake(m_ssl.get()); },
+                   IOManager::READ | IOManager::WRITE, 0);
+    SslWaiterWaker waker;
+    MutexType::Lock lock(m_mutex);
+    m_handshaking = false;
+    // 唤醒等待握手结束的协程
+    waker.waiters.swap(m_waiters);
+    if (rt != 1) {
+        return false;
+    }
+    m_handshaked = true;
+    LJRSERVER_LOG_DEBUG(g_logger)
+        << "ssl handshake " << getVersion() << " " << getCipher()
+        << " reused = " << isSessionReused() << " ktls_send = " << isKtlsSend()
+        << " ktls_recv = " << isKtlsRecv();
+    return true;
+}
+
+bool SslSocket::isSessionReused() const {
+    return m_ssl && SSL_session_reused(m_ssl.get()) == 1;
+}
+
+bool SslSocket::isKtlsSend() const {
+#ifdef BIO_get_ktls_send
+    return m_ssl && BIO_get_ktls_send(SSL_get_wbio(m_ssl.get()));
+#else
+    return false;
+#endif
+}
+
+bool SslSocket::isKtlsRecv() const {
+#ifdef BIO_get_ktls_recv
+    return m_ssl && BIO_get_ktls_recv(SSL_get_rbio(m_ssl.get()));
+#else
+    return false;
+#endif
+}
+
+std::string SslSocket::getVersion() const {
+    return m_ssl ? SSL_get_version(m_ssl.get()) : "";
+}
+
+std::string SslSocket::getCipher() const {
+    return m_ssl ? SSL_get_cipher_name(m_ssl.get()) : "";
+}
+
+/******************************************
+ * 连接
+ ******************************************/
+
+/**
+ * @brief 连接服务器并 tls 握手
+ *
+ * 有同一服务器的会话时恢复会话
+ *
+ * @param addr 服务器地址
+ * @param timeout_ms 超时时间 毫秒 [= -1]
+ * @return true
+ * @return false
+ */
+bool SslSocket::connect(const Address::ptr addr, uint64_t timeout_ms) {
+    if (!m_ctx) {
+        m_ctx = default_client_context();
+        if (!m_ctx) {
+            return false;
+        }
+    }
+    if (!Socket::connect(addr, timeout_ms)) {
+        return false;
+    }
+    if (!newSsl()) {
+        close();
+        return false;
+    }
+    SSL_set_connect_state(m_ssl.get());
+
+    if (!m_hostname.empty()) {
+        // SNI
+        SSL_set_tlsext_host_name(m_ssl.get(), m_hostname.c_str());
+        if (SSL_CTX_get_verify_mode(m_ctx.get()) != SSL_VERIFY_NONE) {
+            // 校验证书中的主机名
+            SSL_set1_host(m_ssl.get(), m_hostname.c_str());
+        }
+    }
+
+    // 恢复会话 新会话由 ssl_new_session_cb 保存
+    m_sessionKey = m_hostname + "@" + addr->toString();
+    auto sess = SslSessionCacheMgr::GetInstance()->get(m_sessionKey);
+    if (sess && SSL_SESSION_is_resumable(sess.get())) {
+        SSL_set_session(m_ssl.get(), sess.get());
+    }
+
+    if (!handshake()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 发送 close_notify 并关闭 socket
+ *
+ * 不等待对端的 close_notify
+ *
+ * @return true
+ * @return false
+ */
+bool SslSocket::close() {
+    {
+        SslWaiterWaker waker;
+        MutexType::Lock lock(m_mutex);
+        // 等待的协程醒来后看到已经关闭
+        waker.waiters.swap(m_waiters);
+        if (m_ssl) {
+            if (m_handshaked && !m_error && isConnected()) {
+                // 非阻塞 发不出去就放弃 对端已关闭时不产生 SIGPIPE
+                SigPipeGuard guard(true);
+                ERR_clear_error();
+                SSL_shutdown(m_ssl.get());
+            }
+            m_ssl.reset();
+        }
+        m_handshaked = false;
+        m_error = false;
+    }
+    return Socket::close();
+}
+
+/******************************************
+ * 收发
+ ******************************************/
+
+// send 支持的 flags
+static const int s_ssl_send_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+
+// recv 支持的 flags
+static const int s_ssl_recv_flags = MSG_PEEK | MSG_DONTWAIT;
+
+int SslSocket::send(const void *buffer, size_t length, int flags) {
+    if (flags & ~s_ssl_send_flags) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    if (!handshake()) {
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    // 没有可写空间时挂起协程 返回时全部写完
+    return doSsl("SSL_write",
+                 [this, buffer, length]() {
+                     return SSL_write(m_ssl.get(), buffer, length);
+                 },
+                 IOManager::WRITE, flags);
+}
+
+int SslSocket::send(const iovec *buffers, size_t length, int flags) {
+    if (flags & ~s_ssl_send_flags) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < length; ++i) {
+        total += buffers[i].iov_len;
+    }
+    if (length == 1 || total > s_ssl_record_size) {
+        // 大数据逐个写 每个至少一个完整的记录
+        int sent = 0;
+        for (size_t i = 0; i < length; ++i) {
+            if (buffers[i].iov_len == 0) {
+                continue;
+            }
+            int rt = send(buffers[i].iov_base, buffers[i].iov_len, flags);
+            if (rt <= 0) {
+                return sent ? sent : rt;
+            }
+            sent += rt;
+        }
+        return sent;
+    }
+
+    // 小数据拼成一个记录
+    std::string buf;
+    buf.reserve(total);
+    for (size_t i = 0; i < length; ++i) {
+        buf.append((const char *)buffers[i].iov_base, buffers[i].iov_len);
+    }
+    return send(buf.data(), buf.size(), flags);
+}
+
+int SslSocket::recv(void *buffer, size_t length, int flags) {
+    if (flags & ~s_ssl_recv_flags) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    if (!handshake()) {
+        return -1;
+    }
+    // 没有数据时挂起协程
+    bool peek = flags & MSG_PEEK;
+    return doSsl(peek ? "SSL_peek" : "SSL_read",
+                 [this, buffer, length, peek]() {
+                     return peek ? SSL_peek(m_ssl.get(), buffer, length)
+                                 : SSL_read(m_ssl.get(), buffer, length);
+                 },
+                 IOManager::READ, flags);
+}
+
+int SslSocket::recv(iovec *buffers, size_t length, int flags) {
+    if (flags & ~s_ssl_recv_flags) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    int total = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (buffers[i].iov_len == 0) {
+            continue;
+        }
+        // 第一块等待数据 后面只取已解密的数据
+        if (total > 0) {
+            MutexType::Lock lock(m_mutex);
+            if (!m_ssl || SSL_pending(m_ssl.get()) <= 0) {
+                break;
+            }
+        }
+        int rt = recv(buffers[i].iov_base, buffers[i].iov_len, flags);
+        if (rt <= 0) {
+            return total ? total : rt;
+        }
+        total += rt;
+        if ((size_t)rt < buffers[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief 发送文件 kTLS 发送时 SSL_sendfile 否则读出后 SSL_write
+ *
+ * @param in_fd 文件句柄
+ * @param offset 文件偏移 成功后更新
+ * @param length 发送长度
+ * @return int 发送的字节数 < 0 失败
+ */
+int SslSocket::sendFile(int in_fd, off_t *offset, size_t length) {
+    if (!handshake()) {
+        return -1;
+    }
+    off_t pos = offset ? *offset : lseek(in_fd, 0, SEEK_CUR);
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (isKtlsSend()) {
+        // 内核加密 文件数据不经过用户态
+        int rt = doSsl("SSL_sendfile",
+                       [this, in_fd, pos, length]() {
+                           return (int)SSL_sendfile(m_ssl.get(), in_fd, pos,
+                                                    length, 0);
+                       },
+                       IOManager::WRITE, 0);
+        if (rt <= 0) {
+            return rt;
+        }
+        if (offset) {
+            *offset = pos + rt;
+        } else {
+            lseek(in_fd, pos + rt, SEEK_SET);
+        }
+        return rt;
+    }
+#endif
+
+    // 用户态加密 每次读出几个记录
+    std::vector<char> buf(std::min(length, s_ssl_record_size * 4));
+    ssize_t n = ::pread(in_fd, &buf[0], buf.size(), pos);
+    if (n <= 0) {
+        return n;
+    }
+    int rt = send(&buf[0], n, 0);
+    if (rt > 0) {
+        if (offset) {
+            *offset = pos + rt;
+        } else {
+            lseek(in_fd, pos + rt, SEEK_SET);
+        }
+    }
+    return rt;
+}
+
+int SslSocket::spliceFrom(int pipe_fd, size_t length, unsigned int flags) {
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+int SslSocket::spliceTo(int pipe_fd, size_t length, unsigned int flags) {
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+bool SslSocket::setZeroCopy(bool v) { return !v; }
+
+std::ostream &SslSocket::dump(std::ostream &os) const {
+    os << "[SslSocket";
+    if (m_handshaked) {
+        os << " version=" << getVersion() << " cipher=" << getCipher()
+           << " reused=" << isSessionReused() << " ktls_send=" << isKtlsSend()
+           << " ktls_recv=" << isKtlsRecv();
+    }
+    os << " ";
+    Socket::dump(os);
+    os << "]";
+    return os;
+}
+
+/******************************************
+ * 初始化
+ ******************************************/
+
+/**
+ * @brief accept 初始化 socket 创建服务器端的 SSL
+ *
+ * 握手在第一次收发时进行 不阻塞 accept 协程
+ *
+ * @param sock socket 句柄
+ * @param lazy 选项继承自监听 socket 不再设置
+ * @return true
+ * @return false
+ */
+bool SslSocket::init(int sock, bool lazy) {
+    if (!m_ctx) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "ssl socket init fail no SSL_CTX sock = " << sock;
+        return false;
+    }
+    if (!Socket::init(sock, lazy)) {
+        return false;
+    }
+    if (!newSsl()) {
+        return false;
+    }
+    SSL_set_accept_state(m_ssl.get());
+    return true;
+}
+
+Socket::ptr SslSocket::createAcceptSocket() {
+    SslSocket::ptr sock(new SslSocket(getFamily(), getType(), getProtocol()));
+    sock->setContext(m_ctx);
+    return sock;
+}
+
+/**
+ * @brief 创建 SSL 对象
+ *
+ * @return true
+ * @return false
+ */
+bool SslSocket::newSsl() {
+    m_handshaked = false;
+    m_error = false;
+    m_ssl.reset(SSL_new(m_ctx.get()), SSL_free);
+    if (!m_ssl || SSL_set_fd(m_ssl.get(), getSocket()) != 1) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "SSL_new fail sock = " << getSocket() << " "
+            << ssl_error_string();
+        m_ssl.reset();
+        return false;
+    }
+    SSL_set_app_data(m_ssl.get(), this);
+    // 写缓冲可以在重试时移动 (如 std::string 扩容)
+    SSL_set_mode(m_ssl.get(), SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    // hook 的读写不再挂起协程 由 doSsl 在锁外等待
+    FdCtx::ptr ctx = FdMgr::GetInstance()->get(getSocket());
+    if (ctx) {
+        ctx->setUserNonblock(true);
+    }
+    return true;
+}
+
+/**
+ * @brief 在锁内非阻塞地调用 openssl 需要等待时在锁外挂起后重试
+ *
+ * @param op 操作名
+ * @param fn openssl 调用
+ * @param event 调用者所在的方向 IOManager::READ WRITE
+ * @param flags MSG_DONTWAIT 不等待 MSG_NOSIGNAL 不产生 SIGPIPE
+ * @return int fn 的返回值 失败时同 handleError
+ */
+int SslSocket::doSsl(const char *op, const std::function<int()> &fn,
+                     int event, int flags) {
+    // 截止时间 按等待的方向取收发超时
+    uint64_t start = Clock::NowMS();
+    while (true) {
+        bool want_read = false;
+        // 等待的是否是另一个方向
+        bool other = false;
+        int wait_ms = -1;
+        // 等待另一个方向时登记 和调用在同一个锁内 不会错过唤醒
+        std::shared_ptr<SslWaiter> waiter;
+        {
+            // 调用返回后 openssl 的状态可能已经改变 唤醒等待的协程重试
+            SslWaiterWaker waker;
+            MutexType::Lock lock(m_mutex);
+            if (!m_ssl || m_error) {
+                errno = ENOTCONN;
+                return -1;
+            }
+            int rt = 0;
+            {
+                SigPipeGuard guard(flags & MSG_NOSIGNAL);
+                ERR_clear_error();
+                rt = fn();
+            }
+            waker.waiters.swap(m_waiters);
+            if (rt > 0) {
+                return rt;
+            }
+            int err = SSL_get_error(m_ssl.get(), rt);
+            if ((err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) ||
+                (flags & MSG_DONTWAIT)) {
+                int e = handleError(op, rt);
+                if (flags & MSG_DONTWAIT && e < 0 &&
+                    (err == SSL_ERROR_WANT_READ ||
+                     err == SSL_ERROR_WANT_WRITE)) {
+                    errno = EAGAIN;
+                }
+                return e;
+            }
+
+            // 不在 IO 协程中 句柄是阻塞的 不会走到这里
+            want_read = err == SSL_ERROR_WANT_READ;
+            int64_t timeout = want_read ? getRecvTimeout() : getSendTimeout();
+            if (timeout >= 0) {
+                uint64_t used = Clock::NowMS() - start;
+                if (used >= (uint64_t)timeout) {
+                    LJRSERVER_LOG_DEBUG(g_logger)
+                        << op << " sock = " << getSocket() << " timeout";
+                    errno = ETIMEDOUT;
+                    return -1;
+                }
+                wait_ms = timeout - used;
+            }
+            other = !(event & (want_read ? IOManager::READ : IOManager::WRITE));
+            if (other) {
+                waiter = addWaiterNoLock();
+            }
+        }
+
+        if (other) {
+            // 另一个方向一般由其他协程等待 挂起到它的调用返回
+            // 没有其他协程时 句柄就绪也会唤醒
+            if (waiter) {
+                wait(waiter, want_read ? IOManager::READ : IOManager::WRITE,
+                     wait_ms);
+            } else {
+                usleep(1000);
+            }
+            continue;
+        }
+        struct pollfd pfd;
+        pfd.fd = getSocket();
+        pfd.events = want_read ? POLLIN : POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, wait_ms) < 0) {
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief 登记当前协程 等待其他协程的 openssl 调用返回
+ *
+ * @return std::shared_ptr<SslWaiter> 不在 IO 协程中返回 nullptr
+ */
+std::shared_ptr<SslWaiter> SslSocket::addWaiterNoLock() {
+    IOManager *iom = IOManager::GetThis();
+    if (!iom) {
+        return nullptr;
+    }
+    std::shared_ptr<SslWaiter> waiter(new SslWaiter);
+    waiter->iom = iom;
+    waiter->fiber = Fiber::GetThis();
+    m_waiters.push_back(waiter);
+    return waiter;
+}
+
+/**
+ * @brief 挂起当前协程 直到被唤醒 句柄在 event 方向就绪或超时
+ *
+ * @param waiter addWaiterNoLock 的返回值
+ * @param event 同时等待的句柄事件 0 不等待句柄
+ * @param timeout_ms 超时 -1 永久
+ */
+void SslSocket::wait(std::shared_ptr<SslWaiter> waiter, int event,
+                     int64_t timeout_ms) {
+    IOManager *iom = waiter->iom;
+    auto wake = [waiter]() { waiter->wake(); };
+    // 其他协程已经在等待这个事件时 由它的调用返回唤醒
+    bool added =
+        event && !iom->tryAddEvent(getSocket(), (IOManager::Event)event, wake);
+    Timer::ptr timer;
+    if (timeout_ms >= 0) {
+        timer = iom->addTimer(timeout_ms, wake);
+    }
+
+    Fiber::YieldToHold();
+
+    if (timer) {
+        timer->cancel();
+    }
+    if (added) {
+        // 还没有触发的事件 注销时不会触发
+        iom->delEvent(getSocket(), (IOManager::Event)event);
+    }
+    // 超时或句柄就绪唤醒时 还在等待列表中
+    MutexType::Lock lock(m_mutex);
+    m_waiters.erase(std::remove(m_waiters.begin(), m_waiters.end(), waiter),
+                    m_waiters.end());
+}
+
+/**
+ * @brief 处理 openssl 的错误 设置 errno
+ *
+ * 致命错误后不能再收发 也不能再发 close_notify
+ *
+ * @param op 操作名
+ * @param rt 返回值
+ * @return int 对端正常关闭返回 0 否则 -1
+ */
+int SslSocket::handleError(const char *op, int rt) {
+    int err = SSL_get_error(m_ssl.get(), rt);
+    switch (err) {
+        case SSL_ERROR_ZERO_RETURN:
+            // 对端发送 close_notify
+            return 0;
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            // hook 的读写超时 errno 保留 ETIMEDOUT
+            LJRSERVER_LOG_DEBUG(g_logger)
+                << op << " sock = " << getSocket() << " timeout errno = "
+                << errno << " errno-string = " << strerror(errno);
+            return -1;
+        case SSL_ERROR_SYSCALL: {
+            int e = errno;
+            m_error = true;
+            ERR_clear_error();
+            if (e == 0) {
+                // 对端直接关闭
+                return 0;
+            }
+            LJRSERVER_LOG_DEBUG(g_logger)
+                << op << " sock = " << getSocket() << " errno = " << e
+                << " errno-string = " << strerror(e);
+            errno = e;
+            return -1;
+        }
+        default:
+            m_error = true;
+            LJRSERVER_LOG_ERROR(g_logger)
+                << op << " sock = " << getSocket() << " ssl_error = " << err
+                << " " << ssl_error_string();
+            errno = EPROTO;
+            return -1;
+    }
+}
+
+}  // namespace ljrserver
@@ -0,0 +1,307 @@
+/**
+ * @file ssl_socket.h
+ * @author lijianran (lijianran@outlook.com)
+ * @brief tls socket
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#pragma once
+
+#include <string>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "socket.h"
+#include "thread.h"
+
+// openssl 类型 不在头文件中引入 openssl
+struct ssl_st;
+struct ssl_ctx_st;
+
+namespace ljrserver {
+
+// 等待其他协程 openssl 调用的协程
+struct SslWaiter;
+
+/**
+ * @brief tls socket 基于 openssl
+ *
+ * 在 IO 协程中句柄设为用户非阻塞 openssl 的调用在锁内进行 不会挂起
+ * 需要等待时释放锁 在 IO 管理器上等待句柄可读写后重试
+ * 一个读协程和一个写协程可以同时使用 用起来和阻塞调用一样
+ *
+ * 服务器的会话缓存和 ticket 密钥在 SSL_CTX 中 多个监听 socket 共享一个
+ * SSL_CTX 即可恢复会话 客户端的会话按 主机名 + 地址 缓存在进程中
+ *
+ * 握手后 openssl 尝试开启 kTLS 开启后加解密在内核中 sendFile 走 SSL_sendfile
+ * 内核不支持时继续在用户态加解密
+ *
+ * 继承自 Socket
+ */
+class SslSocket : public Socket {
+public:
+    // 智能指针
+    typedef std::shared_ptr<SslSocket> ptr;
+
+    // SSL_CTX 智能指针
+    typedef std::shared_ptr<ssl_ctx_st> CtxPtr;
+
+    // 互斥锁
+    typedef Mutex MutexType;
+
+public:  /// 便利函数
+    /**
+     * @brief 创建 tls socket
+     *
+     * @param address 地址 用于确定协议簇
+     * @param ctx SSL_CTX [= nullptr 用到时按 服务器 / 客户端 创建]
+     * @return SslSocket::ptr
+     */
+    static SslSocket::ptr CreateTCP(ljrserver::Address::ptr address,
+                                    CtxPtr ctx = nullptr);
+
+    /**
+     * @brief 创建服务器的 SSL_CTX
+     *
+     * 开启服务器会话缓存和 ticket 配置 ssl.ktls 开启时尝试 kTLS
+     *
+     * @param cert_file 证书文件 pem
+     * @param key_file 私钥文件 pem
+     * @return CtxPtr 失败返回 nullptr
+     */
+    static CtxPtr CreateServerContext(const std::string &cert_file,
+                                      const std::string &key_file);
+
+    /**
+     * @brief 创建客户端的 SSL_CTX
+     *
+     * 新会话保存到进程内的客户端会话缓存 下次连接同一服务器时恢复
+     *
+     * @param ca_file 校验服务器证书的 ca 文件 [= "" 不校验]
+     * @return CtxPtr 失败返回 nullptr
+     */
+    static CtxPtr CreateClientContext(const std::string &ca_file = "");
+
+public:  /// 构造析构
+    /**
+     * @brief tls socket 构造函数
+     *
+     * @param family
+     * @param type
+     * @param protocol
+     */
+    SslSocket(int family, int type, int protocol = 0);
+
+    /**
+     * @brief tls socket 析构函数
+     *
+     */
+    ~SslSocket();
+
+public:  /// tls
+    /**
+     * @brief 设置 SSL_CTX 监听 socket 设置后 accept 的连接共享
+     *
+     * @param ctx
+     */
+    void setContext(CtxPtr ctx) { m_ctx = ctx; }
+    CtxPtr getContext() const { return m_ctx; }
+
+    /**
+     * @brief 加载证书 创建服务器的 SSL_CTX
+     *
+     * @param cert_file 证书文件 pem
+     * @param key_file 私钥文件 pem
+     * @return true
+     * @return false
+     */
+    bool loadCertificates(const std::string &cert_file,
+                          const std::string &key_file);
+
+    /**
+     * @brief 设置服务器主机名 connect 前设置 用于 SNI 和客户端会话缓存
+     *
+     * @param v
+     */
+    void setHostname(const std::string &v) { m_hostname = v; }
+    const std::string &getHostname() const { return m_hostname; }
+
+    // 客户端会话缓存的键 主机名@地址 connect 时生成
+    const std::string &getSessionKey() const { return m_sessionKey; }
+
+    /**
+     * @brief tls 握手 send recv 时没有握手会先握手
+     *
+     * 只由一个协程进行 其他协程挂起等待握手结束 最多等接收超时
+     *
+     * @return true
+     * @return false
+     */
+    bool handshake();
+
+    // 是否握手完成
+    bool isHandshaked() const { return m_handshaked; }
+
+    // 是否恢复了之前的会话
+    bool isSessionReused() const;
+
+    // 是否内核加密发送
+    bool isKtlsSend() const;
+
+    // 是否内核解密接收
+    bool isKtlsRecv() const;
+
+    // 协商的协议版本 如 TLSv1.3
+    std::string getVersion() const;
+
+    // 协商的加密套件
+    std::string getCipher() const;
+
+public:  /// 连接
+    /**
+     * @brief 连接服务器并 tls 握手
+     *
+     * @param addr 服务器地址
+     * @param timeout_ms 超时时间 毫秒 [= -1]
+     * @return true
+     * @return false
+     */
+    bool connect(const Address::ptr addr, uint64_t timeout_ms = -1) override;
+
+    /**
+     * @brief 发送 close_notify 并关闭 socket
+     *
+     * @return true
+     * @return false
+     */
+    bool close() override;
+
+public:  /// 收发
+    // send 支持 MSG_NOSIGNAL MSG_DONTWAIT recv 支持 MSG_PEEK MSG_DONTWAIT
+    // 其他 flags 返回 -1 errno = EOPNOTSUPP
+    int send(const void *buffer, size_t length, int flags = 0) override;
+    int send(const iovec *buffers, size_t length, int flags = 0) override;
+
+    int recv(void *buffer, size_t length, int flags = 0) override;
+    int recv(iovec *buffers, size_t length, int flags = 0) override;
+
+    /**
+     * @brief 发送文件 kTLS 发送时 SSL_sendfile 否则读出后 SSL_write
+     *
+     * @param in_fd 文件句柄
+     * @param offset 文件偏移 成功后更新
+     * @param length 发送长度
+     * @return int 发送的字节数 < 0 失败
+     */
+    int sendFile(int in_fd, off_t *offset, size_t length) override;
+
+    // 密文不能 splice 不支持 返回 -1 errno = EOPNOTSUPP
+    int spliceFrom(int pipe_fd, size_t length,
+                   unsigned int flags = 0) override;
+    int spliceTo(int pipe_fd, size_t length, unsigned int flags = 0) override;
+
+    // 数据要先加密 不支持零拷贝 返回 false
+    bool setZeroCopy(bool v) override;
+
+    std::ostream &dump(std::ostream &os) const override;
+
+protected:
+    /**
+     * @brief accept 初始化 socket 创建服务器端的 SSL
+     *
+     * @param sock socket 句柄
+     * @param lazy 选项继承自监听 socket 不再设置
+     * @return true
+     * @return false
+     */
+    bool init(int sock, bool lazy = false) override;
+
+    /**
+     * @brief 创建 accept 到的连接的 socket 对象 共享 SSL_CTX
+     *
+     * @return Socket::ptr
+     */
+    Socket::ptr createAcceptSocket() override;
+
+private:
+    /**
+     * @brief 创建 SSL 对象
+     *
+     * @return true
+     * @return false
+     */
+    bool newSsl();
+
+    /**
+     * @brief 在锁内非阻塞地调用 openssl 需要等待时在锁外挂起后重试
+     *
+     * 只在 event 包含的方向上等待句柄
+     * 另一个方向挂起到其他协程的 openssl 调用返回或句柄就绪后重试
+     * 避免读写协程在同一个句柄事件上重复等待
+     *
+     * @param op 操作名
+     * @param fn openssl 调用
+     * @param event 调用者所在的方向 IOManager::READ WRITE
+     * @param flags MSG_DONTWAIT 不等待 MSG_NOSIGNAL 不产生 SIGPIPE
+     * @return int fn 的返回值 失败时同 handleError
+     */
+    int doSsl(const char *op, const std::function<int()> &fn, int event,
+              int flags);
+
+    /**
+     * @brief 处理 openssl 的错误 设置 errno
+     *
+     * @param op 操作名
+     * @param rt 返回值
+     * @return int 对端正常关闭返回 0 否则 -1
+     */
+    int handleError(const char *op, int rt);
+
+    /**
+     * @brief 登记当前协程 等待其他协程的 openssl 调用返回 在 m_mutex 内调用
+     *
+     * @return std::shared_ptr<SslWaiter> 不在 IO 协程中返回 nullptr
+     */
+    std::shared_ptr<SslWaiter> addWaiterNoLock();
+
+    /**
+     * @brief 挂起当前协程 直到被唤醒 句柄在 event 方向就绪或超时
+     *
+     * @param waiter addWaiterNoLock 的返回值
+     * @param event 同时等待的句柄事件 0 不等待句柄
+     * @param timeout_ms 超时 -1 永久
+     */
+    void wait(std::shared_ptr<SslWaiter> waiter, int event, int64_t timeout_ms);
+
+private:
+    // SSL_CTX 服务器的会话缓存和 ticket 密钥
+    CtxPtr m_ctx;
+
+    // SSL 连接
+    std::shared_ptr<ssl_st> m_ssl;
+
+    // 服务器主机名
+    std::string m_hostname;
+
+    // 客户端会话缓存的键
+    std::string m_sessionKey;
+
+    // 是否握手完成
+    bool m_handshaked;
+
+    // 是否有协程正在握手
+    bool m_handshaking;
+
+    // 是否发生致命错误 之后不能再收发
+    bool m_error;
+
+    // 等待握手结束或另一个方向 openssl 调用返回的协程
+    std::vector<std::shared_ptr<SslWaiter> > m_waiters;
+
+    // 锁 保护 m_ssl 握手状态和 m_waiters
+    MutexType m_mutex;
+};
+
+}  // namespace ljrserver
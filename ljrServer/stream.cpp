@@ -1,6 +1,12 @@
 
 #include "stream.h"
 
+// IOV_MAX
+#include <limits.h>
+
+#include <algorithm>
+#include <vector>
+
 namespace ljrserver {
 
 /**
@@ -83,4 +89,70 @@ int Stream::writeFixSize(ByteArray::ptr ba, size_t length) {
     return length;
 }
 
+/**
+ * @brief 分散写入多块数据 虚函数
+ *
+ * @param buffers 数据块
+ * @param length 数据块个数
+ * @return int 写入的字节数 可能只写入一部分
+ */
+int Stream::writev(const iovec *buffers, size_t length) {
+    int total = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (buffers[i].iov_len == 0) {
+            continue;
+        }
+        int rt = write(buffers[i].iov_base, buffers[i].iov_len);
+        if (rt <= 0) {
+            return total ? total : rt;
+        }
+        total += rt;
+        if ((size_t)rt < buffers[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief 分散写入多块数据 直到全部写入 虚函数
+ *
+ * @param buffers 数据块
+ * @param length 数据块个数
+ * @return int 写入的总字节数 <= 0 失败
+ */
+int Stream::writeFixSizeV(const iovec *buffers, size_t length) {
+    // 拷贝 部分写入后修改第一块的起始位置
+    std::vector<iovec> iovs(buffers, buffers + length);
+    size_t total = 0;
+    for (auto &iov : iovs) {
+        total += iov.iov_len;
+    }
+    size_t index = 0;
+    size_t left = total;
+    while (left > 0) {
+        // 跳过写完的块
+        while (iovs[index].iov_len == 0) {
+            ++index;
+        }
+        size_t count = std::min<size_t>(iovs.size() - index, IOV_MAX);
+        int rt = writev(&iovs[index], count);
+        if (rt <= 0) {
+            return rt;
+        }
+        left -= rt;
+        size_t n = rt;
+        while (n > 0) {
+            size_t len = std::min(n, iovs[index].iov_len);
+            iovs[index].iov_base = (char *)iovs[index].iov_base + len;
+            iovs[index].iov_len -= len;
+            n -= len;
+            if (iovs[index].iov_len == 0) {
+                ++index;
+            }
+        }
+    }
+    return total;
+}
+
 }  // namespace ljrserver
@@ -4,6 +4,8 @@
 
 // 智能指针
 #include <memory>
+// iovec
+#include <sys/uio.h>
 // 二进制字节数组
 #include "bytearray.h"
 
@@ -105,6 +107,28 @@ public:  /// 写入
      * @return int
      */
     virtual int writeFixSize(ByteArray::ptr ba, size_t length);
+
+    /**
+     * @brief 分散写入多块数据 虚函数
+     *
+     * 默认依次 write 子类可以一次系统调用发送
+     *
+     * @param buffers 数据块
+     * @param length 数据块个数
+     * @return int 写入的字节数 可能只写入一部分
+     */
+    virtual int writev(const iovec *buffers, size_t length);
+
+    /**
+     * @brief 分散写入多块数据 直到全部写入 虚函数
+     *
+     * 协议头和协议体分开传入 不用拼接成一块
+     *
+     * @param buffers 数据块
+     * @param length 数据块个数
+     * @return int 写入的总字节数 <= 0 失败
+     */
+    virtual int writeFixSizeV(const iovec *buffers, size_t length);
 };
 
 }  // namespace ljrserver
@@ -2,6 +2,19 @@
 #include "tcp_server.h"
 #include "config.h"
 #include "log.h"
+#include "upgrade.h"
+#include "util.h"
+
+#include <algorithm>
+
+// TCP_DEFER_ACCEPT TCP_FASTOPEN TCP_QUICKACK
+#include <netinet/tcp.h>
+
+// SO_ATTACH_REUSEPORT_CBPF
+#include <linux/filter.h>
+// pthread_setaffinity_np
+#include <pthread.h>
+#include <unistd.h>
 
 namespace ljrserver {
 
@@ -11,6 +24,29 @@ static ljrserver::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
                               (uint64_t)(60 * 1000 * 2),
                               "tcp server read timeout");
 
+// 配置 tcp 服务器是否每个工作线程一个 SO_REUSEPORT 监听 socket
+static ljrserver::ConfigVar<bool>::ptr g_tcp_server_reuse_port =
+    ljrserver::Config::Lookup("tcp_server.reuse_port", false,
+                              "tcp server listen socket per worker thread");
+
+// 配置 tcp 服务器是否按 CPU 分配连接 需要开启 reuse_port
+static ljrserver::ConfigVar<bool>::ptr g_tcp_server_reuse_port_cbpf =
+    ljrserver::Config::Lookup("tcp_server.reuse_port_cbpf", false,
+                              "tcp server steer connections by cpu");
+
+// 配置 tcp 服务器最大连接数 0 不限制
+static ljrserver::ConfigVar<uint64_t>::ptr g_tcp_server_max_connections =
+    ljrserver::Config::Lookup("tcp_server.max_connections", (uint64_t)0,
+                              "tcp server max connections, 0 unlimited");
+
+// 配置 tcp 服务器每次 accept 最多取出的连接数
+static ljrserver::ConfigVar<uint32_t>::ptr g_tcp_server_accept_batch =
+    ljrserver::Config::Lookup("tcp_server.accept_batch", (uint32_t)32,
+                              "tcp server max connections per accept batch");
+
+// 暂停 accept 时的检查间隔 10ms
+static const uint64_t s_accept_pause_us = 10 * 1000;
+
 // system 日志
 static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
 
@@ -27,7 +63,15 @@ TcpServer::TcpServer(ljrserver::IOManager *worker,
       m_acceptWorker(acceptworker),
       m_recvTimeout(g_tcp_server_read_timeout->getValue()),
       m_name("ljrserver/1.0.0"),
-      m_isStop(true) {
+      m_isStop(true),
+      m_reusePort(g_tcp_server_reuse_port->getValue()),
+      m_reusePortCbpf(g_tcp_server_reuse_port_cbpf->getValue()),
+      m_maxConnections(g_tcp_server_max_connections->getValue()),
+      m_acceptBatch(std::max(g_tcp_server_accept_batch->getValue(), 1u)),
+      m_connections(0),
+      m_acceptedCount(0),
+      m_rejectedCount(0),
+      m_pausedCount(0) {
     // 初始化列表要和成员变量声明顺序一致
 }
 
@@ -43,6 +87,7 @@ TcpServer::~TcpServer() {
     }
     // 清空
     m_socks.clear();
+    m_sockThreads.clear();
 }
 
 /**
@@ -73,11 +118,19 @@ bool TcpServer::bind(const std::vector<Address::ptr> &addrs,
                      std::vector<Address::ptr> &fails) {
     // 循环访问要监听的地址
     for (auto &addr : addrs) {
+        // 每个工作线程一个监听 socket unix 域 socket 不支持
+        if (m_reusePort && addr->getFamily() != AF_UNIX) {
+            if (!bindReusePort(addr)) {
+                fails.push_back(addr);
+            }
+            continue;
+        }
+
         // 根据地址的协议簇创建 tcp socket
-        Socket::ptr sock = Socket::CreateTCP(addr);
+        Socket::ptr sock = createSocket(addr);
 
-        // 绑定地址
-        if (!sock->bind(addr)) {
+        // 绑定地址 热升级时接管旧进程的监听句柄
+        if (!bindOrAttach(sock, addr)) {
             // 绑定失败
             LJRSERVER_LOG_ERROR(g_logger)
                 << "bind fail errno = " << errno
@@ -88,8 +141,8 @@ bool TcpServer::bind(const std::vector<Address::ptr> &addrs,
             continue;
         }
 
-        // 监听地址 未 hook
-        if (!sock->listen()) {
+        // 设置选项 监听地址 未 hook
+        if (!listen(sock)) {
             // 监听失败
             LJRSERVER_LOG_ERROR(g_logger)
                 << "listen fail errno = " << errno
@@ -102,11 +155,13 @@ bool TcpServer::bind(const std::vector<Address::ptr> &addrs,
 
         // bind listen 成功的 socket 加入数组
         m_socks.push_back(sock);
+        m_sockThreads.push_back(-1);
     }
 
     if (!fails.empty()) {
         // 有连接失败的 清空
         m_socks.clear();
+        m_sockThreads.clear();
         // 返回 bind 失败
         return false;
     }
@@ -118,6 +173,162 @@ bool TcpServer::bind(const std::vector<Address::ptr> &addrs,
     return true;
 }
 
+/**
+ * @brief 绑定地址 有继承自旧进程的同地址监听句柄时接管
+ *
+ * 接管的句柄已经在 listen 之后 listen 只会更新选项和队列长度
+ * 旧进程的 SO_REUSEPORT 组也一起接管 新 bind 的 socket 加入同一个组
+ *
+ * @param sock 新建的 socket
+ * @param addr 监听地址
+ * @return true
+ * @return false
+ */
+bool TcpServer::bindOrAttach(Socket::ptr sock, Address::ptr addr) {
+    int fd = HotUpgradeMgr::GetInstance()->take(addr);
+    if (fd == -1) {
+        return sock->bind(addr);
+    }
+    if (!sock->attach(fd)) {
+        ::close(fd);
+        return sock->bind(addr);
+    }
+    LJRSERVER_LOG_INFO(g_logger)
+        << "attach inherited listen fd = " << fd << " addr = ["
+        << addr->toString() << "]";
+    return true;
+}
+
+/**
+ * @brief 加载证书 开启 tls bind 前设置
+ *
+ * @param cert_file 证书文件 pem
+ * @param key_file 私钥文件 pem
+ * @return true
+ * @return false
+ */
+bool TcpServer::loadCertificates(const std::string &cert_file,
+                                 const std::string &key_file) {
+    SslSocket::CtxPtr ctx =
+        SslSocket::CreateServerContext(cert_file, key_file);
+    if (!ctx) {
+        return false;
+    }
+    m_sslCtx = ctx;
+    return true;
+}
+
+/**
+ * @brief 创建监听 socket 开启 tls 时创建 SslSocket
+ *
+ * SslSocket accept 到的连接也是 SslSocket 共享 SSL_CTX
+ *
+ * @param addr 监听地址
+ * @return Socket::ptr
+ */
+Socket::ptr TcpServer::createSocket(Address::ptr addr) {
+    if (m_sslCtx) {
+        return SslSocket::CreateTCP(addr, m_sslCtx);
+    }
+    return Socket::CreateTCP(addr);
+}
+
+/**
+ * @brief 设置监听 socket 的选项并 listen
+ *
+ * 选项设置失败只打印警告 接受的连接继承监听 socket 的选项
+ *
+ * @param sock bind 成功的 socket
+ * @return true
+ * @return false
+ */
+bool TcpServer::listen(Socket::ptr sock) {
+    const TcpSocketOptions &opts = m_sockOptions;
+    bool is_tcp = sock->getFamily() != AF_UNIX;
+
+#define XX(cond, level, name, val)                                        \
+    if ((cond) && val >= 0 && !sock->setOption(level, name, (int)val)) { \
+        LJRSERVER_LOG_WARN(g_logger)                                      \
+            << "set " #name " = " << val << " fail errno = " << errno    \
+            << " errno-string = " << strerror(errno) << " " << *sock;     \
+    }
+
+    XX(true, SOL_SOCKET, SO_RCVBUF, opts.rcvbuf);
+    XX(true, SOL_SOCKET, SO_SNDBUF, opts.sndbuf);
+    XX(is_tcp, IPPROTO_TCP, TCP_NODELAY, opts.nodelay);
+    XX(is_tcp, IPPROTO_TCP, TCP_DEFER_ACCEPT, opts.defer_accept);
+    XX(is_tcp, IPPROTO_TCP, TCP_FASTOPEN, opts.fastopen);
+    XX(true, SOL_SOCKET, SO_KEEPALIVE, opts.keepalive);
+    XX(is_tcp, IPPROTO_TCP, TCP_KEEPIDLE, opts.keepidle);
+    XX(is_tcp, IPPROTO_TCP, TCP_KEEPINTVL, opts.keepintvl);
+    XX(is_tcp, IPPROTO_TCP, TCP_KEEPCNT, opts.keepcnt);
+#undef XX
+
+    return sock->listen(opts.backlog > 0 ? opts.backlog : SOMAXCONN);
+}
+
+/**
+ * @brief 每个工作线程创建一个监听 socket
+ *
+ * 同一地址的 socket 组成 reuseport 组 内核按四元组哈希分配新连接
+ * 开启 cbpf 时 组内第 i 个 socket 接收 CPU i (取模) 上收到的连接
+ *
+ * @param addr 监听地址
+ * @return true
+ * @return false
+ */
+bool TcpServer::bindReusePort(Address::ptr addr) {
+    const std::vector<int> &threads = m_worker->getThreadIds();
+    if (threads.empty()) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "bind reuse port fail worker has no thread addr = ["
+            << addr->toString() << "]";
+        return false;
+    }
+
+    size_t begin = m_socks.size();
+    // 端口为 0 时 后续的 socket 绑定第一个 socket 分配到的端口
+    Address::ptr bind_addr = addr;
+    for (auto &thread : threads) {
+        Socket::ptr sock = createSocket(bind_addr);
+        sock->setReusePort(true);
+        if (!bindOrAttach(sock, bind_addr) || !listen(sock)) {
+            LJRSERVER_LOG_ERROR(g_logger)
+                << "bind reuse port fail errno = " << errno
+                << " errno-string = " << strerror(errno) << " addr = ["
+                << bind_addr->toString() << "]";
+            // 丢弃这个地址已经创建的 socket
+            m_socks.resize(begin);
+            m_sockThreads.resize(begin);
+            return false;
+        }
+        bind_addr = sock->getLocalAddress();
+        m_socks.push_back(sock);
+        m_sockThreads.push_back(thread);
+    }
+
+    if (m_reusePortCbpf && threads.size() > 1) {
+        // A = 当前 CPU; A %= 组大小; 返回 A 作为组内下标
+        struct sock_filter code[] = {
+            {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)},
+            {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)threads.size()},
+            {BPF_RET | BPF_A, 0, 0, 0}};
+        struct sock_fprog prog;
+        prog.len = sizeof(code) / sizeof(code[0]);
+        prog.filter = code;
+        // 组内任意一个 socket 设置即对整组生效
+        if (!m_socks[begin]->setOption(SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                                       prog)) {
+            // 退回内核默认的哈希分配
+            LJRSERVER_LOG_WARN(g_logger)
+                << "attach reuse port cbpf fail errno = " << errno
+                << " errno-string = " << strerror(errno) << " addr = ["
+                << bind_addr->toString() << "]";
+        }
+    }
+    return true;
+}
+
 /**
  * @brief 启动 tcp 服务器 虚函数
  *
@@ -133,10 +344,16 @@ bool TcpServer::start() {
     m_isStop = false;
 
     // 循环访问 socket 对象
-    for (auto &sock : m_socks) {
+    for (size_t i = 0; i < m_socks.size(); ++i) {
         // 开始接收连接 并处理
-        m_acceptWorker->schedule(
-            std::bind(&TcpServer::startAccept, shared_from_this(), sock));
+        auto cb = std::bind(&TcpServer::startAccept, shared_from_this(),
+                            m_socks[i]);
+        if (m_sockThreads[i] == -1) {
+            m_acceptWorker->schedule(cb);
+        } else {
+            // 在所属的工作线程上 accept
+            m_worker->schedule(cb, m_sockThreads[i]);
+        }
     }
     return true;
 }
@@ -154,14 +371,26 @@ void TcpServer::stop() {
     // 调度任务
     m_acceptWorker->schedule([this, self]() {
         // 循环访问 socket 对象
-        for (auto &sock : m_socks) {
+        for (size_t i = 0; i < m_socks.size(); ++i) {
+            if (m_sockThreads[i] != -1) {
+                // 每线程监听的 socket 注册在工作 IOManager 上
+                Socket::ptr sock = m_socks[i];
+                m_worker->schedule(
+                    [sock]() {
+                        sock->cancelAll();
+                        sock->close();
+                    },
+                    m_sockThreads[i]);
+                continue;
+            }
             // 取消所有事件
-            sock->cancelAll();
+            m_socks[i]->cancelAll();
             // 关闭 socket
-            sock->close();
+            m_socks[i]->close();
         }
         // 清空
         m_socks.clear();
+        m_sockThreads.clear();
     });
 }
 
@@ -180,25 +409,117 @@ void TcpServer::handleClient(Socket::ptr client) {
  * @param sock socket 对象指针
  */
 void TcpServer::startAccept(Socket::ptr sock) {
+    // 每线程监听时 连接留在 accept 的线程处理
+    int thread = -1;
+    if (m_reusePort && IOManager::GetThis() == m_worker) {
+        thread = ljrserver::GetThreadId();
+        if (m_reusePortCbpf) {
+            // cbpf 把 CPU c 上收到的连接交给组内第 c % n 个 socket
+            // 本线程只在这些 CPU 上运行 从本线程当前允许的 CPU 中选
+            // 包含进程的亲和性和调度器池配置的 affinity
+            const std::vector<int> &threads = m_worker->getThreadIds();
+            for (size_t i = 0; i < threads.size(); ++i) {
+                if (threads[i] != thread) {
+                    continue;
+                }
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int cpu : GetAllowedCpus()) {
+                    if (cpu % threads.size() == i) {
+                        CPU_SET(cpu, &set);
+                    }
+                }
+                if (CPU_COUNT(&set) == 0) {
+                    // 没有对应的 CPU 保持原来的亲和性
+                    LJRSERVER_LOG_DEBUG(g_logger)
+                        << "reuse port cbpf no allowed cpu for index = " << i;
+                    break;
+                }
+                int rt = pthread_setaffinity_np(pthread_self(), sizeof(set),
+                                                &set);
+                if (rt) {
+                    LJRSERVER_LOG_WARN(g_logger)
+                        << "pthread_setaffinity_np fail rt = " << rt
+                        << " index = " << i;
+                }
+                break;
+            }
+        }
+    }
+
+    std::vector<Socket::ptr> clients;
     // 只要 tcp 服务器没有关闭
     while (!m_isStop) {
-        // 等待接受客户端 connect 连接
-        Socket::ptr client = sock->accept();
+        uint64_t max_conns = m_maxConnections;
+        size_t batch = m_acceptBatch;
+        if (max_conns) {
+            uint64_t conns = m_connections;
+            if (conns >= max_conns) {
+                // 达到上限 暂停 accept 新连接留在内核 backlog
+                ++m_pausedCount;
+                while (!m_isStop && m_connections >= max_conns) {
+                    usleep(s_accept_pause_us);
+                }
+                continue;
+            }
+            batch = std::min<uint64_t>(batch, max_conns - conns);
+        }
 
-        if (client) {
-            // 连接成功
-            // 设置客户端接收超时
-            client->setRecvTimeout(m_recvTimeout);
-            // 处理连接
-            m_worker->schedule(std::bind(&TcpServer::handleClient,
-                                         shared_from_this(), client));
-        } else {
+        // 等待接受客户端 connect 连接 一次取完 backlog
+        clients.clear();
+        if (sock->acceptBatch(clients, batch) < 0) {
             // 连接失败
             LJRSERVER_LOG_ERROR(g_logger)
                 << "accept errno = " << errno
                 << " errno-string = " << strerror(errno);
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+                errno == ENOMEM) {
+                // 句柄或内存耗尽 连接留在 backlog 稍后再试 避免空转
+                ++m_pausedCount;
+                usleep(s_accept_pause_us);
+            }
+            continue;
+        }
+
+        for (auto &client : clients) {
+            if (++m_connections > max_conns && max_conns) {
+                // 其他监听 socket 同时 accept 超出上限
+                --m_connections;
+                ++m_rejectedCount;
+                client->close();
+                continue;
+            }
+            ++m_acceptedCount;
+
+            // 连接成功
+            // 设置客户端接收超时
+            client->setRecvTimeout(m_recvTimeout);
+            if (m_sockOptions.quickack >= 0 && client->getFamily() != AF_UNIX) {
+                // TCP_QUICKACK 不会继承
+                client->setOption(IPPROTO_TCP, TCP_QUICKACK,
+                                  m_sockOptions.quickack);
+            }
+            if (m_sockOptions.zerocopy > 0) {
+                // 零拷贝发送 内核不支持时拷贝发送
+                client->setZeroCopy(true);
+            }
+            // 处理连接 accept 协程被事件唤醒后可能换了线程
+            // 留在当前线程处理 不必跨线程唤醒
+            m_worker->schedule(std::bind(&TcpServer::runClient,
+                                         shared_from_this(), client),
+                               thread == -1 ? -1 : GetThreadId());
         }
     }
 }
 
+/**
+ * @brief 处理客户端的连接 返回后连接数减一
+ *
+ * @param client 连接成功的 socket 对象
+ */
+void TcpServer::runClient(Socket::ptr client) {
+    handleClient(client);
+    --m_connections;
+}
+
 }  // namespace ljrserver
@@ -4,13 +4,56 @@
 
 #include <memory>
 #include <functional>
+#include <atomic>
 
 #include "iomanager.h"
 #include "socket.h"
+#include "ssl_socket.h"
 #include "noncopyable.h"
 
 namespace ljrserver {
 
+/**
+ * @brief tcp 服务器的 socket 选项 -1 表示不设置 使用系统默认
+ *
+ * 除 quickack zerocopy 外都设置在监听 socket 上 接受的连接继承
+ */
+struct TcpSocketOptions {
+    // TCP_NODELAY 不延迟发
+    int nodelay = 1;
+    // TCP_DEFER_ACCEPT 秒 收到数据后才完成 accept
+    int defer_accept = -1;
+    // TCP_FASTOPEN 队列长度
+    int fastopen = -1;
+    // SO_RCVBUF 字节
+    int rcvbuf = -1;
+    // SO_SNDBUF 字节
+    int sndbuf = -1;
+    // TCP_QUICKACK 不会继承 每个连接设置
+    int quickack = -1;
+    // SO_KEEPALIVE
+    int keepalive = -1;
+    // TCP_KEEPIDLE 秒
+    int keepidle = -1;
+    // TCP_KEEPINTVL 秒
+    int keepintvl = -1;
+    // TCP_KEEPCNT 次数
+    int keepcnt = -1;
+    // listen 队列长度
+    int backlog = SOMAXCONN;
+    // SO_ZEROCOPY 大响应零拷贝发送 每个连接设置
+    int zerocopy = -1;
+
+    bool operator==(const TcpSocketOptions &oth) const {
+        return nodelay == oth.nodelay && defer_accept == oth.defer_accept &&
+               fastopen == oth.fastopen && rcvbuf == oth.rcvbuf &&
+               sndbuf == oth.sndbuf && quickack == oth.quickack &&
+               keepalive == oth.keepalive && keepidle == oth.keepidle &&
+               keepintvl == oth.keepintvl && keepcnt == oth.keepcnt &&
+               backlog == oth.backlog && zerocopy == oth.zerocopy;
+    }
+};
+
 /**
  * @brief tcp 服务器
  *
@@ -86,6 +129,91 @@ public:
 
     bool isStop() const { return m_isStop; }
 
+    /**
+     * @brief 设置是否每个工作线程一个 SO_REUSEPORT 监听 socket bind 前设置
+     *
+     * 每个线程在自己的监听 socket 上 accept 连接也在本线程处理
+     *
+     * @param v
+     */
+    void setReusePort(bool v) { m_reusePort = v; }
+    bool isReusePort() const { return m_reusePort; }
+
+    /**
+     * @brief 设置是否按收包的 CPU 分配连接 SO_ATTACH_REUSEPORT_CBPF
+     *
+     * 开启后工作线程绑定到对应的 CPU 连接交给同一 CPU 上的线程
+     *
+     * @param v
+     */
+    void setReusePortCbpf(bool v) { m_reusePortCbpf = v; }
+    bool isReusePortCbpf() const { return m_reusePortCbpf; }
+
+    /**
+     * @brief 设置 socket 选项 bind 前设置
+     *
+     * @param v
+     */
+    void setSocketOptions(const TcpSocketOptions &v) { m_sockOptions = v; }
+    const TcpSocketOptions &getSocketOptions() const { return m_sockOptions; }
+
+    /**
+     * @brief 设置最大连接数 0 不限制
+     *
+     * 达到上限时暂停 accept 新连接留在内核 backlog 中
+     *
+     * @param v
+     */
+    void setMaxConnections(uint64_t v) { m_maxConnections = v; }
+    uint64_t getMaxConnections() const { return m_maxConnections; }
+
+    /**
+     * @brief 设置每次 accept 最多取出的连接数
+     *
+     * @param v
+     */
+    void setAcceptBatch(uint32_t v) { m_acceptBatch = v ? v : 1; }
+    uint32_t getAcceptBatch() const { return m_acceptBatch; }
+
+    /**
+     * @brief 加载证书 开启 tls bind 前设置
+     *
+     * 所有监听 socket 共享一个 SSL_CTX 会话缓存和 ticket 密钥
+     * 每线程的 SO_REUSEPORT 监听 socket 接受的连接也能恢复会话
+     *
+     * @param cert_file 证书文件 pem
+     * @param key_file 私钥文件 pem
+     * @return true
+     * @return false
+     */
+    bool loadCertificates(const std::string &cert_file,
+                          const std::string &key_file);
+
+    /**
+     * @brief 设置 SSL_CTX bind 前设置 nullptr 关闭 tls
+     *
+     * @param v
+     */
+    void setSslContext(SslSocket::CtxPtr v) { m_sslCtx = v; }
+    SslSocket::CtxPtr getSslContext() const { return m_sslCtx; }
+    bool isSsl() const { return m_sslCtx != nullptr; }
+
+    /**
+     * @brief 获取监听 socket 热升级时传给新进程
+     *
+     * @return const std::vector<Socket::ptr>&
+     */
+    const std::vector<Socket::ptr> &getSocks() const { return m_socks; }
+
+    // 当前连接数 handleClient 返回视为连接结束
+    uint64_t getConnectionCount() const { return m_connections; }
+    // 接受的连接数
+    uint64_t getAcceptedCount() const { return m_acceptedCount; }
+    // 超过上限被关闭的连接数 多个监听 socket 同时 accept 时可能超出
+    uint64_t getRejectedCount() const { return m_rejectedCount; }
+    // 暂停 accept 的次数 连接数达到上限或句柄耗尽
+    uint64_t getPausedCount() const { return m_pausedCount; }
+
 protected:
     /**
      * @brief 处理客户端的连接 虚函数
@@ -101,10 +229,57 @@ protected:
      */
     virtual void startAccept(Socket::ptr sock);
 
+private:
+    /**
+     * @brief 处理客户端的连接 返回后连接数减一
+     *
+     * @param client 连接成功的 socket 对象
+     */
+    void runClient(Socket::ptr client);
+
+    /**
+     * @brief 设置监听 socket 的选项并 listen
+     *
+     * @param sock bind 成功的 socket
+     * @return true
+     * @return false
+     */
+    bool listen(Socket::ptr sock);
+
+    /**
+     * @brief 创建监听 socket 开启 tls 时创建 SslSocket
+     *
+     * @param addr 监听地址
+     * @return Socket::ptr
+     */
+    Socket::ptr createSocket(Address::ptr addr);
+
+    /**
+     * @brief 绑定地址 有继承自旧进程的同地址监听句柄时接管
+     *
+     * @param sock 新建的 socket
+     * @param addr 监听地址
+     * @return true
+     * @return false
+     */
+    bool bindOrAttach(Socket::ptr sock, Address::ptr addr);
+
+    /**
+     * @brief 每个工作线程创建一个监听 socket
+     *
+     * @param addr 监听地址
+     * @return true
+     * @return false
+     */
+    bool bindReusePort(Address::ptr addr);
+
 private:
     // socket 对象数组
     std::vector<Socket::ptr> m_socks;
 
+    // 监听 socket 所属的工作线程 -1 不指定 和 m_socks 一一对应
+    std::vector<int> m_sockThreads;
+
     // 工作协程 处理客户端连接 handle connect
     IOManager *m_worker;
 
@@ -119,6 +294,36 @@ private:
 
     // 是否关闭
     bool m_isStop;
+
+    // 是否每个工作线程一个 SO_REUSEPORT 监听 socket
+    bool m_reusePort;
+
+    // 是否按 CPU 分配连接
+    bool m_reusePortCbpf;
+
+    // socket 选项
+    TcpSocketOptions m_sockOptions;
+
+    // tls 的 SSL_CTX nullptr 不开启
+    SslSocket::CtxPtr m_sslCtx;
+
+    // 最大连接数 0 不限制
+    uint64_t m_maxConnections;
+
+    // 每次 accept 最多取出的连接数
+    uint32_t m_acceptBatch;
+
+    // 当前连接数
+    std::atomic<uint64_t> m_connections;
+
+    // 接受的连接数
+    std::atomic<uint64_t> m_acceptedCount;
+
+    // 超过上限被关闭的连接数
+    std::atomic<uint64_t> m_rejectedCount;
+
+    // 暂停 accept 的次数
+    std::atomic<uint64_t> m_pausedCount;
 };
 
 }  // namespace ljrserver
@@ -1,6 +1,6 @@
 
 #include "timer.h"
-#include "util.h"
+#include "clock.h"
 
 namespace ljrserver {
 
@@ -36,23 +36,28 @@ bool Timer::Comparator::operator()(const Timer::ptr &lhs,
 /**
  * @brief 重载定时器构造函数 private
  *
- * @param ms
+ * @param us 执行周期 us
  * @param cb
  * @param recurring
  * @param manager
+ * @param slack 允许延后执行的时间 us
  */
-Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring,
-             TimerManager *manager)
-    : m_recurring(recurring), m_ms(ms), m_cb(cb), m_manager(manager) {
-    // 设置下一次执行的时间
-    m_next = ljrserver::GetCurrentMS() + m_ms;
+Timer::Timer(uint64_t us, std::function<void()> cb, bool recurring,
+             TimerManager *manager, uint64_t slack)
+    : m_recurring(recurring),
+      m_us(us),
+      m_slack(slack),
+      m_cb(cb),
+      m_manager(manager) {
+    // 设置下一次执行的时间 单调时钟
+    m_next = ljrserver::Clock::NowUS() + m_us;
 }
 
 /**
  * @brief 重载定时器构造函数 private
  *
  * 用于实例化当前时间的定时器对象
- * Timer::ptr now_timer(new Timer(now_ms));
+ * Timer::ptr now_timer(new Timer(now_us));
  *
  * @param next
  */
@@ -113,7 +118,7 @@ bool Timer::refresh() {
     // 先删除
     m_manager->m_timers.erase(it);
     // 重置时间
-    m_next = ljrserver::GetCurrentMS() + m_ms;
+    m_next = ljrserver::Clock::NowUS() + m_us;
     // 再加入
     m_manager->m_timers.insert(shared_from_this());
 
@@ -129,7 +134,19 @@ bool Timer::refresh() {
  * @return false
  */
 bool Timer::reset(uint64_t ms, bool from_now) {
-    if (ms == m_ms && !from_now) {
+    return resetUS(ms * 1000, from_now);
+}
+
+/**
+ * @brief 重设定时器 us
+ *
+ * @param us 执行周期
+ * @param from_now 是否从现在开始记时
+ * @return true
+ * @return false
+ */
+bool Timer::resetUS(uint64_t us, bool from_now) {
+    if (us == m_us && !from_now) {
         // 周期一样且不从当前开始
         return true;
     }
@@ -154,16 +171,16 @@ bool Timer::reset(uint64_t ms, bool from_now) {
     uint64_t start = 0;
     if (from_now) {
         // 从现在开始
-        start = ljrserver::GetCurrentMS();
+        start = ljrserver::Clock::NowUS();
     } else {
         // 从上次执行时间开始计算
-        start = m_next - m_ms;
+        start = m_next - m_us;
     }
 
     // 设置执行周期
-    m_ms = ms;
+    m_us = us;
     // 下次执行时间
-    m_next = start + m_ms;
+    m_next = start + m_us;
 
     // 由管理器添加定时器
     m_manager->addTimer(shared_from_this(), lock);
@@ -175,10 +192,7 @@ bool Timer::reset(uint64_t ms, bool from_now) {
  * @brief 管理器构造函数
  *
  */
-TimerManager::TimerManager() {
-    // 初始化执行时间
-    m_previousTime = ljrserver::GetCurrentMS();
-}
+TimerManager::TimerManager() {}
 
 /**
  * @brief 管理器析构函数 虚函数
@@ -192,12 +206,27 @@ TimerManager::~TimerManager() {}
  * @param ms 执行周期
  * @param cb 任务函数
  * @param recurring 是否循环执行 [= false]
+ * @param slack_ms 允许延后执行的时间 [= 0]
  * @return Timer::ptr
  */
 Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb,
-                                  bool recurring) {
+                                  bool recurring, uint64_t slack_ms) {
+    return addTimerUS(ms * 1000, cb, recurring, slack_ms * 1000);
+}
+
+/**
+ * @brief 添加定时器 us 精度
+ *
+ * @param us 执行周期
+ * @param cb 任务函数
+ * @param recurring 是否循环执行 [= false]
+ * @param slack_us 允许延后执行的时间 [= 0]
+ * @return Timer::ptr
+ */
+Timer::ptr TimerManager::addTimerUS(uint64_t us, std::function<void()> cb,
+                                    bool recurring, uint64_t slack_us) {
     // 实例化一个定时器对象
-    Timer::ptr timer(new Timer(ms, cb, recurring, this));
+    Timer::ptr timer(new Timer(us, cb, recurring, this, slack_us));
 
     // 上写锁
     RWMutexType::WriteLock lock(m_mutex);
@@ -235,22 +264,62 @@ static void OnTimer(std::weak_ptr<void> weak_condition,
  * @param cb 任务函数
  * @param weak_conditon 执行条件 weak_ptr
  * @param recurring 是否循环执行 [= false]
+ * @param slack_ms 允许延后执行的时间 [= 0]
  * @return Timer::ptr
  */
 Timer::ptr TimerManager::addConditionTimer(uint64_t ms,
                                            std::function<void()> cb,
                                            std::weak_ptr<void> weak_conditon,
-                                           bool recurring) {
+                                           bool recurring, uint64_t slack_ms) {
+    // 添加定时器
+    return addTimerUS(ms * 1000, std::bind(&OnTimer, weak_conditon, cb),
+                      recurring, slack_ms * 1000);
+}
+
+/**
+ * @brief 添加条件定时器 us 精度
+ *
+ * @param us 执行周期
+ * @param cb 任务函数
+ * @param weak_conditon 执行条件 weak_ptr
+ * @param recurring 是否循环执行 [= false]
+ * @param slack_us 允许延后执行的时间 [= 0]
+ * @return Timer::ptr
+ */
+Timer::ptr TimerManager::addConditionTimerUS(uint64_t us,
+                                             std::function<void()> cb,
+                                             std::weak_ptr<void> weak_conditon,
+                                             bool recurring,
+                                             uint64_t slack_us) {
     // 添加定时器
-    return addTimer(ms, std::bind(&OnTimer, weak_conditon, cb), recurring);
+    return addTimerUS(us, std::bind(&OnTimer, weak_conditon, cb), recurring,
+                      slack_us);
 }
 
 /**
  * @brief 下一个定时器任务还要多久执行
  *
- * @return uint64_t 时间
+ * 不足 1ms 向上取整 避免提前唤醒后空转
+ *
+ * @return uint64_t 时间 ms
  */
 uint64_t TimerManager::getNextTimer() {
+    uint64_t next_us = getNextTimerUS();
+    if (next_us == ~0ull) {
+        return ~0ull;
+    }
+    return (next_us + 999) / 1000;
+}
+
+/**
+ * @brief 下一个定时器任务还要多久执行
+ *
+ * 考虑 slack: 取所有定时器 (执行时间 + slack) 的最小值
+ * 这之前到期的定时器在同一次唤醒中一起执行
+ *
+ * @return uint64_t 时间 us
+ */
+uint64_t TimerManager::getNextTimerUS() {
     // 上读锁
     RWMutexType::ReadLock lock(m_mutex);
 
@@ -259,20 +328,33 @@ uint64_t TimerManager::getNextTimer() {
 
     // 没有定时器
     if (m_timers.empty()) {
+        m_nextWakeup = ~0ull;
         return ~0ull;
     }
 
-    // 最近的定时器
-    const Timer::ptr &next = *m_timers.begin();
+    // 最晚的唤醒时间 按执行时间排序 后面的定时器不会让它更早
+    uint64_t deadline = ~0ull;
+    for (auto &timer : m_timers) {
+        if (timer->m_next > deadline) {
+            break;
+        }
+        uint64_t latest = timer->m_next + timer->m_slack;
+        if (latest < deadline) {
+            deadline = latest;
+        }
+    }
     // 当前时间
-    uint64_t now_ms = ljrserver::GetCurrentMS();
+    // 记录计划的唤醒时间 新插入的定时器早于它时需要 tickle
+    m_nextWakeup = deadline;
+
+    uint64_t now_us = ljrserver::Clock::NowUS();
 
-    // 最近一个任务的执行时间已经过了
-    if (now_ms >= next->m_next) {
+    // 唤醒时间已经过了
+    if (now_us >= deadline) {
         return 0;
     } else {
-        // 最近的任务还要多久执行
-        return next->m_next - now_ms;
+        // 还要多久唤醒
+        return deadline - now_us;
     }
 }
 
@@ -284,8 +366,8 @@ uint64_t TimerManager::getNextTimer() {
  * @param cbs 回调函数数组
  */
 void TimerManager::listExpiredCb(std::vector<std::function<void()>> &cbs) {
-    // 获取当前时间
-    uint64_t now_ms = ljrserver::GetCurrentMS();
+    // 获取当前时间 idle 刚刷新过线程缓存 不再读取时钟
+    uint64_t now_us = ljrserver::Clock::CoarseUS();
     // 过期定时器 即要执行的定时任务
     std::vector<Timer::ptr> expired;
 
@@ -301,19 +383,17 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()>> &cbs) {
     // 上读锁
     RWMutexType::WriteLock lock(m_mutex);
 
-    // 检测服务器时间是否被调后了
-    bool rollover = detectClockRollover(now_ms);
-    if (!rollover && ((*m_timers.begin())->m_next > now_ms)) {
-        // 系统时间没有问题且下次任务时间还没到
+    if (m_timers.empty() || (*m_timers.begin())->m_next > now_us) {
+        // 下次任务时间还没到 单调时钟不会回拨
         return;
     }
 
     // 当前时间定时器
-    Timer::ptr now_timer(new Timer(now_ms));
+    Timer::ptr now_timer(new Timer(now_us));
     // 迭代器 lower_bound 小于或等于
-    auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
+    auto it = m_timers.lower_bound(now_timer);
 
-    while (it != m_timers.end() && (*it)->m_next == now_ms) {
+    while (it != m_timers.end() && (*it)->m_next == now_us) {
         // 等于的定时器跳过 还没超时
         ++it;
     }
@@ -325,6 +405,22 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()>> &cbs) {
     // 重设 vector 的大小
     cbs.reserve(expired.size());
 
+    // 本次唤醒执行的不同执行时间个数 有 slack 的定时器参与合并时统计
+    size_t deadlines = 0;
+    bool has_slack = false;
+    uint64_t last_next = ~0ull;
+    for (auto &timer : expired) {
+        if (timer->m_next != last_next) {
+            ++deadlines;
+            last_next = timer->m_next;
+        }
+        has_slack = has_slack || timer->m_slack;
+    }
+    if (has_slack && deadlines > 1) {
+        // 原本需要 deadlines 次唤醒 合并为一次
+        m_savedWakeups += deadlines - 1;
+    }
+
     // 遍历过期的定时器
     for (auto &timer : expired) {
         // 获取定时任务 加入列表
@@ -333,7 +429,7 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()>> &cbs) {
         // 是否循环
         if (timer->m_recurring) {
             // 下次执行时间
-            timer->m_next = now_ms + timer->m_ms;
+            timer->m_next = now_us + timer->m_us;
             // 加入定时器
             m_timers.insert(timer);
         } else {
@@ -365,10 +461,12 @@ bool TimerManager::hasTimer() {
  */
 void TimerManager::addTimer(Timer::ptr timer, RWMutexType::WriteLock &lock) {
     // insert 到定时器 set 集合中
-    auto it = m_timers.insert(timer).first;
+    m_timers.insert(timer);
 
-    // 是否在第一个 说明之前没有定时器
-    bool at_front = (it == m_timers.begin()) && !m_tickled;
+    // 排序只看执行时间 带 slack 的定时器可能排在新定时器之前却更晚唤醒
+    // 所以比较新定时器的最晚执行时间和当前计划的唤醒时间
+    bool at_front =
+        (timer->m_next + timer->m_slack < m_nextWakeup) && !m_tickled;
     if (at_front) {
         // 需要 tickle
         m_tickled = true;
@@ -378,27 +476,9 @@ void TimerManager::addTimer(Timer::ptr timer, RWMutexType::WriteLock &lock) {
     lock.unlock();
 
     if (at_front) {
-        // 之前没有定时器 现在有定时任务了 需要 tickle 唤醒
+        // 早于计划的唤醒时间 需要 tickle 唤醒重新计算等待时间
         onTimerInsertedAtFront();
     }
 }
 
-/**
- * @brief 检测服务器时间是否被调后了
- *
- * @param now_ms 当前时间
- * @return true
- * @return false
- */
-bool TimerManager::detectClockRollover(uint64_t now_ms) {
-    bool rollover = false;
-    if (now_ms < m_previousTime && now_ms < (m_previousTime - 60 * 60 * 1000)) {
-        rollover = true;
-    }
-    // 设置时间
-    m_previousTime = now_ms;
-
-    return rollover;
-}
-
 }  // namespace ljrserver
@@ -5,6 +5,7 @@
 #include <memory>
 #include <vector>
 #include <set>
+#include <atomic>
 #include "thread.h"
 
 namespace ljrserver {
@@ -50,23 +51,41 @@ public:
      */
     bool reset(uint64_t ms, bool from_now);
 
+    /**
+     * @brief 重设定时器 us
+     *
+     * @param us 执行周期
+     * @param from_now 是否从现在开始记时
+     * @return true
+     * @return false
+     */
+    bool resetUS(uint64_t us, bool from_now);
+
+    /**
+     * @brief 获取允许延后执行的时间 us
+     *
+     * @return uint64_t
+     */
+    uint64_t getSlackUS() const { return m_slack; }
+
 private:
     /**
      * @brief 重载定时器构造函数 private
      *
-     * @param ms
+     * @param us 执行周期 us
      * @param cb
      * @param recurring
      * @param manager
+     * @param slack 允许延后执行的时间 us
      */
-    Timer(uint64_t ms, std::function<void()> cb, bool recurring,
-          TimerManager *manager);
+    Timer(uint64_t us, std::function<void()> cb, bool recurring,
+          TimerManager *manager, uint64_t slack = 0);
 
     /**
      * @brief 重载定时器构造函数 private
      *
      * 用于实例化当前时间的定时器对象
-     * Timer::ptr now_timer(new Timer(now_ms));
+     * Timer::ptr now_timer(new Timer(now_us));
      *
      * @param next
      */
@@ -76,12 +95,15 @@ private:
     // 是否循环定时器
     bool m_recurring = false;
 
-    // 执行周期
-    uint64_t m_ms = 0;
+    // 执行周期 us
+    uint64_t m_us = 0;
 
-    // 精确的执行时间
+    // 精确的执行时间 (单调时钟 us)
     uint64_t m_next = 0;
 
+    // 允许延后执行的时间 us 用于和相近的定时器合并唤醒
+    uint64_t m_slack = 0;
+
     // 回调函数，定时器需要执行的任务
     std::function<void()> m_cb;
 
@@ -132,10 +154,25 @@ public:
      * @param ms 执行周期
      * @param cb 任务函数
      * @param recurring 是否循环执行 [= false]
+     * @param slack_ms 允许延后执行的时间 [= 0]
      * @return Timer::ptr
      */
     Timer::ptr addTimer(uint64_t ms, std::function<void()> cb,
-                        bool recurring = false);
+                        bool recurring = false, uint64_t slack_ms = 0);
+
+    /**
+     * @brief 添加定时器 us 精度
+     *
+     * 需要 IOManager 开启 timerfd 高精度模式 否则仍按 ms 唤醒
+     *
+     * @param us 执行周期
+     * @param cb 任务函数
+     * @param recurring 是否循环执行 [= false]
+     * @param slack_us 允许延后执行的时间 [= 0]
+     * @return Timer::ptr
+     */
+    Timer::ptr addTimerUS(uint64_t us, std::function<void()> cb,
+                          bool recurring = false, uint64_t slack_us = 0);
 
     /**
      * @brief 添加条件定时器
@@ -144,19 +181,48 @@ public:
      * @param cb 任务函数
      * @param weak_conditon 执行条件 weak_ptr
      * @param recurring 是否循环执行 [= false]
+     * @param slack_ms 允许延后执行的时间 [= 0]
      * @return Timer::ptr
      */
     Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb,
                                  std::weak_ptr<void> weak_conditon,
-                                 bool recurring = false);
+                                 bool recurring = false,
+                                 uint64_t slack_ms = 0);
+
+    /**
+     * @brief 添加条件定时器 us 精度
+     *
+     * @param us 执行周期
+     * @param cb 任务函数
+     * @param weak_conditon 执行条件 weak_ptr
+     * @param recurring 是否循环执行 [= false]
+     * @param slack_us 允许延后执行的时间 [= 0]
+     * @return Timer::ptr
+     */
+    Timer::ptr addConditionTimerUS(uint64_t us, std::function<void()> cb,
+                                   std::weak_ptr<void> weak_conditon,
+                                   bool recurring = false,
+                                   uint64_t slack_us = 0);
 
     /**
      * @brief 下一个定时器任务还要多久执行
      *
-     * @return uint64_t 时间
+     * 不足 1ms 向上取整 避免提前唤醒后空转
+     *
+     * @return uint64_t 时间 ms
      */
     uint64_t getNextTimer();
 
+    /**
+     * @brief 下一个定时器任务还要多久执行
+     *
+     * 考虑 slack: 取所有定时器 (执行时间 + slack) 的最小值
+     * 这之前到期的定时器在同一次唤醒中一起执行
+     *
+     * @return uint64_t 时间 us
+     */
+    uint64_t getNextTimerUS();
+
     /**
      * @brief 获取需要执行的定时器的回调函数列表
      *
@@ -174,11 +240,18 @@ public:
      */
     bool hasTimer();
 
+    /**
+     * @brief 合并唤醒节省的唤醒次数
+     *
+     * @return uint64_t
+     */
+    uint64_t getSavedWakeups() const { return m_savedWakeups; }
+
 protected:
     /**
      * @brief 纯虚函数 管理器类是抽象类
      *
-     * 当有新的定时器插入到定时器的首部 执行该函数
+     * 当新的定时器早于当前计划的唤醒时间 执行该函数
      *
      */
     virtual void onTimerInsertedAtFront() = 0;
@@ -191,16 +264,6 @@ protected:
      */
     void addTimer(Timer::ptr timer, RWMutexType::WriteLock &lock);
 
-private:
-    /**
-     * @brief 检测服务器时间是否被调后了
-     *
-     * @param now_ms 当前时间
-     * @return true
-     * @return false
-     */
-    bool detectClockRollover(uint64_t now_ms);
-
 private:
     // 读写锁
     RWMutexType m_mutex;
@@ -211,8 +274,11 @@ private:
     // tickle
     bool m_tickled = false;
 
-    // 上次执行时间
-    uint64_t m_previousTime = 0;
+    // 当前计划的唤醒时间 (单调时钟 us) 无定时器为 ~0ull
+    std::atomic<uint64_t> m_nextWakeup = {~0ull};
+
+    // 合并唤醒节省的唤醒次数
+    std::atomic<uint64_t> m_savedWakeups = {0};
 };
 
 }  // namespace ljrserver
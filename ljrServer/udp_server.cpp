@@ -0,0 +1,376 @@
+/**
+ * @file udp_server.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief udp 服务器
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "udp_server.h"
+#include "config.h"
+#include "log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace ljrserver {
+
+// 配置 udp 服务器是否每个工作线程一个 SO_REUSEPORT socket
+static ljrserver::ConfigVar<bool>::ptr g_udp_server_reuse_port =
+    ljrserver::Config::Lookup("udp_server.reuse_port", true,
+                              "udp server socket per worker thread");
+
+// 配置 udp 服务器每次 recvmmsg 最多接收的数据报个数
+static ljrserver::ConfigVar<uint32_t>::ptr g_udp_server_batch =
+    ljrserver::Config::Lookup("udp_server.batch", (uint32_t)32,
+                              "udp server datagrams per recvmmsg");
+
+// 配置 udp 服务器单个数据报的最大长度
+static ljrserver::ConfigVar<uint32_t>::ptr g_udp_server_max_datagram_size =
+    ljrserver::Config::Lookup("udp_server.max_datagram_size", (uint32_t)2048,
+                              "udp server max datagram size");
+
+// system 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
+
+// 内存不足接收失败时的重试间隔 10ms
+static const uint64_t s_recv_pause_us = 10 * 1000;
+
+/**
+ * @brief udp 服务器的构造函数
+ *
+ * @param worker 处理数据报的协程调度器 [= ljrserver::IOManager::GetThis()]
+ * @param recvworker 接收数据报的协程调度器 [=
+ * ljrserver::IOManager::GetThis()]
+ */
+UdpServer::UdpServer(ljrserver::IOManager *worker,
+                     ljrserver::IOManager *recvworker)
+    : m_worker(worker),
+      m_recvWorker(recvworker),
+      m_name("ljrserver/1.0.0"),
+      m_isStop(true),
+      m_reusePort(g_udp_server_reuse_port->getValue()),
+      m_batch(std::max(g_udp_server_batch->getValue(), 1u)),
+      m_maxDatagramSize(g_udp_server_max_datagram_size->getValue()),
+      m_poolCapacity(0),
+      m_receivedCount(0),
+      m_batchCount(0) {
+    // 初始化列表要和成员变量声明顺序一致
+}
+
+/**
+ * @brief udp 服务器的析构函数 基类析构函数设置为虚函数
+ *
+ */
+UdpServer::~UdpServer() {
+    for (auto &sock : m_socks) {
+        sock->close();
+    }
+    m_socks.clear();
+    m_sockThreads.clear();
+}
+
+/**
+ * @brief 服务器绑定地址 虚函数
+ *
+ * @param addr 地址
+ * @return true
+ * @return false
+ */
+bool UdpServer::bind(ljrserver::Address::ptr addr) {
+    std::vector<Address::ptr> addrs;
+    std::vector<Address::ptr> fails;
+    addrs.push_back(addr);
+    return bind(addrs, fails);
+}
+
+/**
+ * @brief 服务器绑定多个地址 虚函数
+ *
+ * 有一个 bind 失败则返回 false
+ *
+ * @param addrs 要绑定的地址数组
+ * @param fails 绑定失败的地址数组
+ * @return true
+ * @return false
+ */
+bool UdpServer::bind(const std::vector<Address::ptr> &addrs,
+                     std::vector<Address::ptr> &fails) {
+    for (auto &addr : addrs) {
+        // 每个工作线程一个 socket unix 域 socket 不支持
+        if (m_reusePort && addr->getFamily() != AF_UNIX) {
+            if (!bindReusePort(addr)) {
+                fails.push_back(addr);
+            }
+            continue;
+        }
+
+        Socket::ptr sock = Socket::CreateUDP(addr);
+        if (!sock->bind(addr)) {
+            LJRSERVER_LOG_ERROR(g_logger)
+                << "bind fail errno = " << errno
+                << " errno-string = " << strerror(errno) << " addr = ["
+                << addr->toString() << "]";
+            fails.push_back(addr);
+            continue;
+        }
+        m_socks.push_back(sock);
+        m_sockThreads.push_back(-1);
+    }
+
+    if (!fails.empty()) {
+        // 有绑定失败的 清空
+        m_socks.clear();
+        m_sockThreads.clear();
+        return false;
+    }
+
+    for (auto &sock : m_socks) {
+        LJRSERVER_LOG_INFO(g_logger) << "udp server bind success: " << *sock;
+    }
+    return true;
+}
+
+/**
+ * @brief 每个工作线程创建一个 socket
+ *
+ * 同一地址的 socket 组成 reuseport 组 内核按四元组哈希分配数据报
+ *
+ * @param addr 地址
+ * @return true
+ * @return false
+ */
+bool UdpServer::bindReusePort(Address::ptr addr) {
+    const std::vector<int> &threads = m_worker->getThreadIds();
+    if (threads.empty()) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "bind reuse port fail worker has no thread addr = ["
+            << addr->toString() << "]";
+        return false;
+    }
+
+    size_t begin = m_socks.size();
+    // 端口为 0 时 后续的 socket 绑定第一个 socket 分配到的端口
+    Address::ptr bind_addr = addr;
+    for (auto &thread : threads) {
+        Socket::ptr sock = Socket::CreateUDP(bind_addr);
+        sock->setReusePort(true);
+        if (!sock->bind(bind_addr)) {
+            LJRSERVER_LOG_ERROR(g_logger)
+                << "bind reuse port fail errno = " << errno
+                << " errno-string = " << strerror(errno) << " addr = ["
+                << bind_addr->toString() << "]";
+            m_socks.resize(begin);
+            m_sockThreads.resize(begin);
+            return false;
+        }
+        bind_addr = sock->getLocalAddress();
+        m_socks.push_back(sock);
+        m_sockThreads.push_back(thread);
+    }
+    return true;
+}
+
+/**
+ * @brief 启动 udp 服务器 虚函数
+ *
+ * @return true
+ * @return false
+ */
+bool UdpServer::start() {
+    if (!m_isStop) {
+        return true;
+    }
+    m_isStop = false;
+    m_poolCapacity = (size_t)m_batch * 4 * m_socks.size();
+
+    for (size_t i = 0; i < m_socks.size(); ++i) {
+        auto cb =
+            std::bind(&UdpServer::startRecv, shared_from_this(), m_socks[i]);
+        if (m_sockThreads[i] == -1) {
+            m_recvWorker->schedule(cb);
+        } else {
+            // 在所属的工作线程上接收
+            m_worker->schedule(cb, m_sockThreads[i]);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 停止 udp 服务器 虚函数
+ *
+ */
+void UdpServer::stop() {
+    m_isStop = true;
+
+    auto self = shared_from_this();
+    m_recvWorker->schedule([this, self]() {
+        for (size_t i = 0; i < m_socks.size(); ++i) {
+            if (m_sockThreads[i] != -1) {
+                // 每线程的 socket 注册在工作 IOManager 上
+                Socket::ptr sock = m_socks[i];
+                m_worker->schedule(
+                    [sock]() {
+                        sock->cancelAll();
+                        sock->close();
+                    },
+                    m_sockThreads[i]);
+                continue;
+            }
+            m_socks[i]->cancelAll();
+            m_socks[i]->close();
+        }
+        m_socks.clear();
+        m_sockThreads.clear();
+    });
+}
+
+/**
+ * @brief 处理一个数据报 虚函数
+ *
+ * @param sock 收到数据报的 socket 用于回复
+ * @param data 数据报 position 为 0 可读长度为数据报长度
+ * @param from 来源地址
+ */
+void UdpServer::handleDatagram(Socket::ptr sock, ByteArray::ptr data,
+                               Address::ptr from) {
+    LJRSERVER_LOG_INFO(g_logger) << "handleDatagram: " << data->getReadSize()
+                                 << " bytes from " << *from;
+}
+
+/**
+ * @brief 处理一批数据报 虚函数 默认逐个调用 handleDatagram
+ *
+ * @param sock 收到数据报的 socket 用于回复
+ * @param batch 数据报
+ */
+void UdpServer::handleBatch(Socket::ptr sock, std::vector<Datagram> &batch) {
+    for (auto &dgram : batch) {
+        handleDatagram(sock, dgram.first, dgram.second);
+    }
+}
+
+/**
+ * @brief 开始接收数据报 虚函数
+ *
+ * @param sock socket 对象指针
+ */
+void UdpServer::startRecv(Socket::ptr sock) {
+    // 每线程的 socket 数据报留在接收的线程处理
+    int thread = -1;
+    if (m_reusePort && IOManager::GetThis() == m_worker) {
+        thread = ljrserver::GetThreadId();
+    }
+
+    std::vector<ByteArray::ptr> datas(m_batch);
+    std::vector<Address::ptr> froms(m_batch);
+    while (!m_isStop) {
+        // 补齐上一批交出去的缓存和地址
+        for (size_t i = 0; i < datas.size(); ++i) {
+            if (!datas[i]) {
+                datas[i] = getBuffer();
+            }
+            if (!froms[i]) {
+                if (sock->getFamily() == AF_INET6) {
+                    froms[i].reset(new IPv6Address);
+                } else {
+                    froms[i].reset(new IPv4Address);
+                }
+            }
+        }
+
+        // 没有数据报时挂起协程
+        int rt = sock->recvBatch(datas, froms, m_maxDatagramSize);
+        if (rt <= 0) {
+            if (m_isStop) {
+                break;
+            }
+            int err = errno;
+            if (rt < 0 && (err == EINTR || err == EAGAIN || err == ETIMEDOUT ||
+                           err == ECONNREFUSED)) {
+                // 被中断 接收超时或之前发送的 ICMP 错误 继续接收
+                continue;
+            }
+            LJRSERVER_LOG_ERROR(g_logger)
+                << "recvmmsg rt = " << rt << " errno = " << err
+                << " errno-string = " << strerror(err);
+            if (rt < 0 && (err == ENOMEM || err == ENOBUFS)) {
+                // 内存不足 稍后再试 避免空转
+                usleep(s_recv_pause_us);
+                continue;
+            }
+            // socket 已经关闭等不可恢复的错误 重试只会空转
+            LJRSERVER_LOG_ERROR(g_logger) << "stop recv " << *sock;
+            break;
+        }
+        m_receivedCount += rt;
+        ++m_batchCount;
+
+        // 一批数据报作为一个任务
+        auto batch = std::make_shared<std::vector<Datagram> >();
+        batch->reserve(rt);
+        for (int i = 0; i < rt; ++i) {
+            datas[i]->setPostion(0);
+            batch->push_back(Datagram(datas[i], froms[i]));
+            datas[i] = nullptr;
+            froms[i] = nullptr;
+        }
+        m_worker->schedule(std::bind(&UdpServer::runBatch, shared_from_this(),
+                                     sock, batch),
+                           thread);
+    }
+}
+
+/**
+ * @brief 处理一批数据报 处理完的缓存放回缓存池
+ *
+ * @param sock 收到数据报的 socket
+ * @param batch 数据报
+ */
+void UdpServer::runBatch(Socket::ptr sock,
+                         std::shared_ptr<std::vector<Datagram> > batch) {
+    handleBatch(sock, *batch);
+    for (auto &dgram : *batch) {
+        putBuffer(std::move(dgram.first));
+    }
+}
+
+/**
+ * @brief 从缓存池取一个缓存 没有则创建
+ *
+ * @return ByteArray::ptr
+ */
+ByteArray::ptr UdpServer::getBuffer() {
+    {
+        MutexType::Lock lock(m_poolMutex);
+        if (!m_pool.empty()) {
+            ByteArray::ptr ba = m_pool.back();
+            m_pool.pop_back();
+            return ba;
+        }
+    }
+    // 一个内存块放下一个数据报
+    return ByteArray::ptr(new ByteArray(m_maxDatagramSize));
+}
+
+/**
+ * @brief 缓存放回缓存池 其他地方还持有时不放回
+ *
+ * @param ba
+ */
+void UdpServer::putBuffer(ByteArray::ptr ba) {
+    if (!ba || ba.use_count() > 1 || ba->getBaseSize() != m_maxDatagramSize) {
+        return;
+    }
+    ba->clear();
+    MutexType::Lock lock(m_poolMutex);
+    if (m_pool.size() < m_poolCapacity) {
+        m_pool.push_back(ba);
+    }
+}
+
+}  // namespace ljrserver
@@ -0,0 +1,245 @@
+/**
+ * @file udp_server.h
+ * @author lijianran (lijianran@outlook.com)
+ * @brief udp 服务器
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#pragma once
+
+#include <memory>
+#include <functional>
+#include <atomic>
+
+#include "iomanager.h"
+#include "socket.h"
+#include "bytearray.h"
+#include "noncopyable.h"
+
+namespace ljrserver {
+
+/**
+ * @brief udp 服务器
+ *
+ * 每个 socket 一个接收协程 recvmmsg 批量接收到缓存池中的 ByteArray
+ * 一批数据报作为一个任务交给工作 IOManager 逐个调用 handleDatagram
+ * 开启 reuse_port 时每个工作线程一个 SO_REUSEPORT socket 在本线程接收和处理
+ *
+ * 继承自 std::enable_shared_from_this
+ * 继承自 Noncopyable 不可复制
+ */
+class UdpServer : public std::enable_shared_from_this<UdpServer>, Noncopyable {
+public:
+    // 智能指针
+    typedef std::shared_ptr<UdpServer> ptr;
+
+    // 互斥锁 缓存池
+    typedef Mutex MutexType;
+
+    // 数据报 数据和来源地址
+    typedef std::pair<ByteArray::ptr, Address::ptr> Datagram;
+
+    /**
+     * @brief udp 服务器的构造函数
+     *
+     * @param worker 处理数据报的协程调度器 [= ljrserver::IOManager::GetThis()]
+     * @param recvworker 接收数据报的协程调度器 [=
+     * ljrserver::IOManager::GetThis()]
+     */
+    UdpServer(
+        ljrserver::IOManager *worker = ljrserver::IOManager::GetThis(),
+        ljrserver::IOManager *recvworker = ljrserver::IOManager::GetThis());
+
+    /**
+     * @brief udp 服务器的析构函数 基类析构函数设置为虚函数
+     *
+     */
+    virtual ~UdpServer();
+
+    /**
+     * @brief 服务器绑定地址 虚函数
+     *
+     * @param addr 地址
+     * @return true
+     * @return false
+     */
+    virtual bool bind(ljrserver::Address::ptr addr);
+
+    /**
+     * @brief 服务器绑定多个地址 虚函数
+     *
+     * 有一个 bind 失败则返回 false
+     *
+     * @param addrs 要绑定的地址数组
+     * @param fails 绑定失败的地址数组
+     * @return true
+     * @return false
+     */
+    virtual bool bind(const std::vector<Address::ptr> &addrs,
+                      std::vector<Address::ptr> &fails);
+
+    /**
+     * @brief 启动 udp 服务器 虚函数
+     *
+     * @return true
+     * @return false
+     */
+    virtual bool start();
+
+    /**
+     * @brief 停止 udp 服务器 虚函数
+     *
+     */
+    virtual void stop();
+
+public:
+    std::string getName() const { return m_name; }
+    void setName(const std::string &v) { m_name = v; }
+
+    bool isStop() const { return m_isStop; }
+
+    /**
+     * @brief 设置是否每个工作线程一个 SO_REUSEPORT socket bind 前设置
+     *
+     * @param v
+     */
+    void setReusePort(bool v) { m_reusePort = v; }
+    bool isReusePort() const { return m_reusePort; }
+
+    /**
+     * @brief 设置每次 recvmmsg 最多接收的数据报个数
+     *
+     * @param v
+     */
+    void setBatch(uint32_t v) { m_batch = v ? v : 1; }
+    uint32_t getBatch() const { return m_batch; }
+
+    /**
+     * @brief 设置单个数据报的最大长度 超出的部分被截断
+     *
+     * @param v
+     */
+    void setMaxDatagramSize(uint32_t v) { m_maxDatagramSize = v; }
+    uint32_t getMaxDatagramSize() const { return m_maxDatagramSize; }
+
+    /**
+     * @brief 获取绑定成功的 socket
+     *
+     * @return const std::vector<Socket::ptr>&
+     */
+    const std::vector<Socket::ptr> &getSocks() const { return m_socks; }
+
+    // 接收的数据报个数
+    uint64_t getReceivedCount() const { return m_receivedCount; }
+    // recvmmsg 返回数据的次数 平均每批 = 数据报个数 / 批数
+    uint64_t getBatchCount() const { return m_batchCount; }
+
+protected:
+    /**
+     * @brief 处理一个数据报 虚函数
+     *
+     * 调用返回后 data 回到缓存池 需要保留时持有 data 即可 不会被复用
+     *
+     * @param sock 收到数据报的 socket 用于回复
+     * @param data 数据报 position 为 0 可读长度为数据报长度
+     * @param from 来源地址
+     */
+    virtual void handleDatagram(Socket::ptr sock, ByteArray::ptr data,
+                                Address::ptr from);
+
+    /**
+     * @brief 处理一批数据报 虚函数 默认逐个调用 handleDatagram
+     *
+     * 需要批量回复时重载 如用 Socket::sendBatch 一次发回
+     *
+     * @param sock 收到数据报的 socket 用于回复
+     * @param batch 数据报
+     */
+    virtual void handleBatch(Socket::ptr sock, std::vector<Datagram> &batch);
+
+    /**
+     * @brief 开始接收数据报 虚函数
+     *
+     * @param sock socket 对象指针
+     */
+    virtual void startRecv(Socket::ptr sock);
+
+private:
+    /**
+     * @brief 处理一批数据报 处理完的缓存放回缓存池
+     *
+     * @param sock 收到数据报的 socket
+     * @param batch 数据报
+     */
+    void runBatch(Socket::ptr sock,
+                  std::shared_ptr<std::vector<Datagram> > batch);
+
+    /**
+     * @brief 每个工作线程创建一个 socket
+     *
+     * @param addr 地址
+     * @return true
+     * @return false
+     */
+    bool bindReusePort(Address::ptr addr);
+
+    /**
+     * @brief 从缓存池取一个缓存 没有则创建
+     *
+     * @return ByteArray::ptr
+     */
+    ByteArray::ptr getBuffer();
+
+    /**
+     * @brief 缓存放回缓存池 其他地方还持有时不放回
+     *
+     * @param ba
+     */
+    void putBuffer(ByteArray::ptr ba);
+
+private:
+    // socket 对象数组
+    std::vector<Socket::ptr> m_socks;
+
+    // socket 所属的工作线程 -1 不指定 和 m_socks 一一对应
+    std::vector<int> m_sockThreads;
+
+    // 处理数据报的协程调度器
+    IOManager *m_worker;
+
+    // 接收数据报的协程调度器
+    IOManager *m_recvWorker;
+
+    // udp 服务器名称
+    std::string m_name;
+
+    // 是否关闭
+    bool m_isStop;
+
+    // 是否每个工作线程一个 SO_REUSEPORT socket
+    bool m_reusePort;
+
+    // 每次最多接收的数据报个数
+    uint32_t m_batch;
+
+    // 单个数据报的最大长度
+    uint32_t m_maxDatagramSize;
+
+    // 缓存池锁
+    MutexType m_poolMutex;
+
+    // 缓存池
+    std::vector<ByteArray::ptr> m_pool;
+
+    // 缓存池容量 每个 socket 四批
+    size_t m_poolCapacity;
+
+    // 接收的数据报个数
+    std::atomic<uint64_t> m_receivedCount;
+
+    // recvmmsg 返回数据的次数
+    std::atomic<uint64_t> m_batchCount;
+};
+
+}  // namespace ljrserver
@@ -0,0 +1,240 @@
+/**
+ * @file upgrade.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 热升级 监听 socket 交接
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "upgrade.h"
+#include "env.h"
+#include "hook.h"
+#include "log.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// 进程的环境变量
+extern char **environ;
+
+namespace ljrserver {
+
+// system 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
+
+// 环境变量 继承的监听句柄 逗号分隔
+static const char *s_env_listen_fds = "LJRSERVER_LISTEN_FDS";
+
+// 环境变量 旧进程 pid
+static const char *s_env_upgrade_pid = "LJRSERVER_UPGRADE_PID";
+
+/**
+ * @brief 关闭 [low, high] 的句柄 fork 后的子进程中调用
+ *
+ * 不能走 hook 句柄管理器的锁可能在 fork 时被其他线程持有
+ *
+ * @param low
+ * @param high
+ */
+static void close_fds(unsigned int low, unsigned int high) {
+    if (low > high || syscall(SYS_close_range, low, high, 0) == 0) {
+        return;
+    }
+    // 内核不支持 close_range 逐个关闭
+    long max = sysconf(_SC_OPEN_MAX);
+    for (long fd = low; fd <= (long)high && fd < max; ++fd) {
+        close_f(fd);
+    }
+}
+
+/**
+ * @brief 热升级构造函数 解析继承的监听句柄
+ *
+ */
+HotUpgrade::HotUpgrade() : m_parent(0) {
+    const char *pid = getenv(s_env_upgrade_pid);
+    const char *fds = getenv(s_env_listen_fds);
+    if (pid) {
+        m_parent = atoi(pid);
+    }
+    if (fds) {
+        std::stringstream items(fds);
+        std::string item;
+        while (std::getline(items, item, ',')) {
+            if (item.empty() || !add(atoi(item.c_str()))) {
+                LJRSERVER_LOG_ERROR(g_logger)
+                    << "invalid inherited listen fd = " << item;
+            }
+        }
+    }
+    // 子进程不再继承
+    unsetenv(s_env_upgrade_pid);
+    unsetenv(s_env_listen_fds);
+}
+
+/**
+ * @brief 登记一个监听句柄 按本机地址接管
+ *
+ * @param fd 已经 bind 的 socket 句柄
+ * @return true
+ * @return false 不是 bind 过的 socket
+ */
+bool HotUpgrade::add(int fd) {
+    struct stat st;
+    sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    if (fstat(fd, &st) || !S_ISSOCK(st.st_mode) ||
+        getsockname(fd, (sockaddr *)&addr, &addrlen)) {
+        return false;
+    }
+    // 再次热升级时由 exec 决定传哪些句柄
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    Address::ptr local = Address::Create((const sockaddr *)&addr, addrlen);
+    if (!local) {
+        return false;
+    }
+    MutexType::Lock lock(m_mutex);
+    m_fds.insert(std::make_pair(local->toString(), fd));
+    LJRSERVER_LOG_INFO(g_logger)
+        << "listen fd = " << fd << " addr = " << *local;
+    return true;
+}
+
+/**
+ * @brief 取出一个地址相同的继承句柄
+ *
+ * @param addr 监听地址
+ * @return int 句柄 没有返回 -1
+ */
+int HotUpgrade::take(Address::ptr addr) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_fds.find(addr->toString());
+    if (it == m_fds.end()) {
+        return -1;
+    }
+    int fd = it->second;
+    m_fds.erase(it);
+    return fd;
+}
+
+/**
+ * @brief 关闭没有被接管的继承句柄
+ *
+ */
+void HotUpgrade::closeUnused() {
+    MutexType::Lock lock(m_mutex);
+    for (auto &i : m_fds) {
+        LJRSERVER_LOG_INFO(g_logger) << "close unused inherited listen fd = "
+                                     << i.second << " addr = " << i.first;
+        ::close(i.second);
+    }
+    m_fds.clear();
+}
+
+/**
+ * @brief 新进程启动完成 通知旧进程退出
+ *
+ * @return true
+ * @return false
+ */
+bool HotUpgrade::notifyParent() {
+    if (m_parent <= 0) {
+        return false;
+    }
+    LJRSERVER_LOG_INFO(g_logger) << "notify old process pid = " << m_parent;
+    if (kill(m_parent, SIGQUIT)) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "kill(" << m_parent << ", SIGQUIT) errno = " << errno
+            << " errno-string = " << strerror(errno);
+        return false;
+    }
+    m_parent = 0;
+    return true;
+}
+
+/**
+ * @brief 启动新进程 旧进程调用
+ *
+ * 子进程中只调用 async-signal-safe 的函数 参数在 fork 前准备好
+ *
+ * @param argv 启动参数
+ * @param fds 传给新进程的监听句柄
+ * @return pid_t 新进程 pid 失败返回 -1
+ */
+pid_t HotUpgrade::exec(char **argv, const std::vector<int> &fds) {
+    std::string exe = EnvMgr::GetInstance()->getExe();
+    if (exe.empty()) {
+        LJRSERVER_LOG_ERROR(g_logger) << "hot upgrade fail unknown exe path";
+        return -1;
+    }
+
+    // 环境变量 去掉旧的热升级变量
+    std::vector<int> keep(fds);
+    std::sort(keep.begin(), keep.end());
+    std::stringstream ss;
+    for (size_t i = 0; i < keep.size(); ++i) {
+        ss << (i ? "," : "") << keep[i];
+    }
+    std::vector<std::string> envs;
+    for (char **e = environ; *e; ++e) {
+        if (strncmp(*e, s_env_listen_fds, strlen(s_env_listen_fds)) &&
+            strncmp(*e, s_env_upgrade_pid, strlen(s_env_upgrade_pid))) {
+            envs.push_back(*e);
+        }
+    }
+    envs.push_back(std::string(s_env_listen_fds) + "=" + ss.str());
+    envs.push_back(std::string(s_env_upgrade_pid) + "=" +
+                   std::to_string(getpid()));
+    std::vector<char *> envp;
+    for (auto &e : envs) {
+        envp.push_back(&e[0]);
+    }
+    envp.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        LJRSERVER_LOG_ERROR(g_logger)
+            << "hot upgrade fork fail errno = " << errno
+            << " errno-string = " << strerror(errno);
+        return -1;
+    }
+
+    if (pid == 0) {
+        // 子进程 恢复信号屏蔽字 exec 后继承
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+        // 监听句柄 exec 后保留
+        for (int fd : keep) {
+            fcntl_f(fd, F_SETFD, 0);
+        }
+        // 其他句柄关闭 连接 epoll 等不能泄漏到新进程
+        unsigned int low = 3;
+        for (int fd : keep) {
+            if ((unsigned int)fd > low) {
+                close_fds(low, fd - 1);
+            }
+            low = fd + 1;
+        }
+        close_fds(low, ~0u);
+
+        execve(exe.c_str(), argv, &envp[0]);
+        _exit(127);
+    }
+
+    LJRSERVER_LOG_INFO(g_logger)
+        << "hot upgrade exec " << exe << " pid = " << pid
+        << " listen fds = " << ss.str();
+    return pid;
+}
+
+}  // namespace ljrserver
@@ -0,0 +1,118 @@
+/**
+ * @file upgrade.h
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 热升级 监听 socket 交接
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#pragma once
+
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "address.h"
+#include "singleton.h"
+#include "thread.h"
+
+namespace ljrserver {
+
+/**
+ * @brief 热升级
+ *
+ * 旧进程 fork + exec 新的二进制文件 监听句柄通过继承传给新进程
+ * 句柄号写在环境变量 LJRSERVER_LISTEN_FDS 中 旧进程 pid 写在
+ * LJRSERVER_UPGRADE_PID 中
+ *
+ * 新进程 bind 时按地址接管继承的句柄 不会重新 bind 监听一直没有中断
+ * 新进程启动完成后给旧进程发 SIGQUIT 旧进程停止 accept 处理完已有的连接后退出
+ */
+class HotUpgrade {
+public:
+    // 互斥锁
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 热升级构造函数 解析继承的监听句柄
+     *
+     */
+    HotUpgrade();
+
+    /**
+     * @brief 是否由热升级启动的新进程
+     *
+     * @return true
+     * @return false
+     */
+    bool isUpgrading() const { return m_parent > 0; }
+
+    /**
+     * @brief 获取旧进程 pid
+     *
+     * @return pid_t 不是热升级启动返回 0
+     */
+    pid_t getParent() const { return m_parent; }
+
+    /**
+     * @brief 登记一个监听句柄 按本机地址接管
+     *
+     * prefork 时主进程 bind 后登记 fork 出的工作进程各自接管
+     *
+     * @param fd 已经 bind 的 socket 句柄
+     * @return true
+     * @return false 不是 bind 过的 socket
+     */
+    bool add(int fd);
+
+    /**
+     * @brief 取出一个地址相同的继承句柄
+     *
+     * @param addr 监听地址
+     * @return int 句柄 没有返回 -1
+     */
+    int take(Address::ptr addr);
+
+    /**
+     * @brief 关闭没有被接管的继承句柄
+     *
+     * 没人 accept 的监听 socket 留在 SO_REUSEPORT 组中会分走连接
+     *
+     */
+    void closeUnused();
+
+    /**
+     * @brief 新进程启动完成 通知旧进程退出
+     *
+     * @return true
+     * @return false
+     */
+    bool notifyParent();
+
+    /**
+     * @brief 启动新进程 旧进程调用
+     *
+     * fork 后子进程只保留标准输入输出和监听句柄 exec 程序二进制文件
+     *
+     * @param argv 启动参数
+     * @param fds 传给新进程的监听句柄
+     * @return pid_t 新进程 pid 失败返回 -1
+     */
+    pid_t exec(char **argv, const std::vector<int> &fds);
+
+private:
+    // 锁
+    MutexType m_mutex;
+
+    // 旧进程 pid
+    pid_t m_parent;
+
+    // 继承的监听句柄 本机地址 -> 句柄
+    std::multimap<std::string, int> m_fds;
+};
+
+typedef ljrserver::Singleton<HotUpgrade> HotUpgradeMgr;
+
+}  // namespace ljrserver
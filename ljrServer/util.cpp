@@ -22,6 +22,11 @@
 // kill
 #include <signal.h>
 
+// sched_getaffinity
+#include <sched.h>
+// std::min
+#include <algorithm>
+
 
 
 namespace ljrserver {
@@ -129,6 +134,179 @@ std::string Time2Str(time_t ts, const std::string &format) {
     return buf;
 }
 
+/**
+ * @brief 获取当前进程可以运行的 CPU 编号 sched_getaffinity
+ *
+ * @return std::vector<int>
+ */
+std::vector<int> GetAllowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; ++i) {
+            if (CPU_ISSET(i, &set)) {
+                cpus.push_back(i);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long i = 0; i < n; ++i) {
+            cpus.push_back(i);
+        }
+    }
+    return cpus;
+}
+
+/**
+ * @brief 从 /proc/self/cgroup 中找进程所在的 cgroup 路径
+ *
+ * 每行格式为 层级id:控制器列表:路径 v2 统一层级为 0::路径
+ *
+ * @param proc_cgroup /proc/self/cgroup
+ * @param controller v1 的控制器名 空找 v2 统一层级
+ * @param path 输出 cgroup 路径 如 /kubepods/pod1
+ * @return true
+ * @return false 没有找到
+ */
+static bool cgroup_path(const std::string &proc_cgroup,
+                        const std::string &controller, std::string &path) {
+    std::ifstream ifs(proc_cgroup);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        size_t first = line.find(':');
+        if (first == std::string::npos) {
+            continue;
+        }
+        size_t second = line.find(':', first + 1);
+        if (second == std::string::npos) {
+            continue;
+        }
+        std::string controllers = line.substr(first + 1, second - first - 1);
+        if (controller.empty()) {
+            if (line.compare(0, first, "0") != 0 || !controllers.empty()) {
+                continue;
+            }
+        } else {
+            bool found = false;
+            std::stringstream items(controllers);
+            std::string item;
+            while (std::getline(items, item, ',')) {
+                if (item == controller) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                continue;
+            }
+        }
+        path = line.substr(second + 1);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief 从进程所在的 cgroup 向上到挂载点 取最小的 CPU 配额
+ *
+ * 上层 cgroup 的配额同样限制下层 没有 cgroup 命名空间的容器里
+ * 宿主机上的路径不存在 向上找到挂载点为止
+ *
+ * @param mount cgroup 挂载点
+ * @param path 进程所在的 cgroup 路径
+ * @param read 读取一层的配额 返回 -1 文件不存在 0 没有限制
+ * @return double 可用的 CPU 个数 没有限制返回 0 都不存在返回 -1
+ */
+static double cgroup_min_quota(const std::string &mount, std::string path,
+                               std::function<double(const std::string &)> read) {
+    double result = -1;
+    while (true) {
+        double quota = read(path == "/" ? mount : mount + path);
+        if (quota > 0 && (result <= 0 || quota < result)) {
+            result = quota;
+        } else if (quota == 0 && result < 0) {
+            result = 0;
+        }
+        if (path.empty() || path == "/") {
+            break;
+        }
+        size_t pos = path.rfind('/');
+        path = (pos == 0 || pos == std::string::npos) ? "/" : path.substr(0, pos);
+    }
+    return result;
+}
+
+/**
+ * @brief 读取 cgroup 的 CPU 配额
+ *
+ * @param proc_cgroup 进程的 cgroup 信息 [= /proc/self/cgroup]
+ * @param mount cgroup 挂载点 [= /sys/fs/cgroup]
+ * @return double 可用的 CPU 个数 没有限制返回 0
+ */
+double GetCgroupCpuQuota(const std::string &proc_cgroup,
+                         const std::string &mount) {
+    std::string path;
+    // cgroup v2 "quota period" 或 "max period"
+    if (cgroup_path(proc_cgroup, "", path)) {
+        double quota = cgroup_min_quota(
+            mount, path, [](const std::string &dir) -> double {
+                std::ifstream ifs(dir + "/cpu.max");
+                std::string quota;
+                double period = 0;
+                if (!(ifs >> quota >> period)) {
+                    return -1;
+                }
+                if (quota == "max" || period <= 0) {
+                    return 0;
+                }
+                return atof(quota.c_str()) / period;
+            });
+        if (quota >= 0) {
+            return quota;
+        }
+    }
+    // cgroup v1 quota 为 -1 没有限制
+    if (!cgroup_path(proc_cgroup, "cpu", path)) {
+        path = "/";
+    }
+    double quota = cgroup_min_quota(
+        mount + "/cpu", path, [](const std::string &dir) -> double {
+            std::ifstream q(dir + "/cpu.cfs_quota_us");
+            std::ifstream p(dir + "/cpu.cfs_period_us");
+            double quota = 0;
+            double period = 0;
+            if (!(q >> quota && p >> period)) {
+                return -1;
+            }
+            if (quota <= 0 || period <= 0) {
+                return 0;
+            }
+            return quota / period;
+        });
+    return quota > 0 ? quota : 0;
+}
+
+/**
+ * @brief 获取当前进程可用的 CPU 个数
+ *
+ * @return uint32_t 至少为 1
+ */
+uint32_t GetCpuCount() {
+    uint32_t count = GetAllowedCpus().size();
+    double quota = GetCgroupCpuQuota();
+    if (quota > 0) {
+        // 配额 1.5 个 CPU 按 2 个算
+        uint32_t limit = (uint32_t)quota;
+        if (limit < quota) {
+            ++limit;
+        }
+        count = std::min(count, limit);
+    }
+    return count ? count : 1;
+}
+
 /**
  * @brief 列出文件夹下所有文件
  *
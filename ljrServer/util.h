@@ -74,6 +74,36 @@ uint64_t GetCurrentUS();
 std::string Time2Str(time_t ts = time(0),
                      const std::string& format = "%Y-%m-%d %H:%M:%s");
 
+/**
+ * @brief 获取当前进程可以运行的 CPU 编号 sched_getaffinity
+ *
+ * @return std::vector<int>
+ */
+std::vector<int> GetAllowedCpus();
+
+/**
+ * @brief 读取 cgroup 的 CPU 配额
+ *
+ * 按 proc_cgroup 中进程所在的 cgroup 路径 从该层向上取最小的配额
+ * 先找 v2 的 cpu.max 没有再找 v1 的 cpu.cfs_quota_us
+ *
+ * @param proc_cgroup 进程的 cgroup 信息 [= /proc/self/cgroup]
+ * @param mount cgroup 挂载点 [= /sys/fs/cgroup]
+ * @return double 可用的 CPU 个数 没有限制返回 0
+ */
+double GetCgroupCpuQuota(const std::string &proc_cgroup = "/proc/self/cgroup",
+                         const std::string &mount = "/sys/fs/cgroup");
+
+/**
+ * @brief 获取当前进程可用的 CPU 个数
+ *
+ * 取 CPU 亲和性和 cgroup 的 CPU 配额 (v2 cpu.max / v1 cfs_quota_us) 中较小的
+ * 容器中按配额而不是宿主机的核数创建线程
+ *
+ * @return uint32_t 至少为 1
+ */
+uint32_t GetCpuCount();
+
 /**
  * @brief Class 文件相关工具类
  *
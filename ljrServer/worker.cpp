@@ -0,0 +1,223 @@
+/**
+ * @file worker.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 命名的 IO 调度器池
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "worker.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sstream>
+
+namespace ljrserver {
+
+// system 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_NAME("system");
+
+template <>
+class LexicalCast<std::string, IOManagerConf> {
+public:
+    IOManagerConf operator()(const std::string &v) {
+        YAML::Node node = YAML::Load(v);
+        IOManagerConf conf;
+        conf.threads = node["threads"].as<std::string>(conf.threads);
+        conf.affinity = node["affinity"].as<std::string>(conf.affinity);
+        return conf;
+    }
+};
+
+template <>
+class LexicalCast<IOManagerConf, std::string> {
+public:
+    std::string operator()(const IOManagerConf &conf) {
+        YAML::Node node;
+        node["threads"] = conf.threads;
+        node["affinity"] = conf.affinity;
+        std::stringstream ss;
+        ss << node;
+        return ss.str();
+    }
+};
+
+// 配置 IO 调度器池 名称 -> 配置
+static ljrserver::ConfigVar<std::map<std::string, IOManagerConf>>::ptr
+    g_iomanagers_conf = ljrserver::Config::Lookup(
+        "iomanagers", std::map<std::string, IOManagerConf>(),
+        "named iomanager pools config");
+
+/**
+ * @brief 解析线程数
+ *
+ * @param v 数字或 auto
+ * @return uint32_t 错误返回 0
+ */
+uint32_t WorkerManager::ParseThreads(const std::string &v) {
+    if (v == "auto") {
+        return GetCpuCount();
+    }
+    // 必须整个是数字 4abc 是错误的
+    char *end = nullptr;
+    long n = strtol(v.c_str(), &end, 10);
+    if (v.empty() || *end || n <= 0 || n > UINT32_MAX) {
+        return 0;
+    }
+    return n;
+}
+
+/**
+ * @brief 解析绑定的 CPU
+ *
+ * @param v 空 auto 或 CPU 列表 如 0-3,6
+ * @param cpus 线程依次绑定的 CPU 空不绑定
+ * @return true
+ * @return false 格式错误
+ */
+bool WorkerManager::ParseAffinity(const std::string &v,
+                                  std::vector<int> &cpus) {
+    cpus.clear();
+    if (v.empty()) {
+        return true;
+    }
+    if (v == "auto") {
+        cpus = GetAllowedCpus();
+        return true;
+    }
+    std::stringstream items(v);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        // 单个 CPU 或 low-high 整项都要解析完 4abc 是错误的
+        const char *p = item.c_str();
+        char *end = nullptr;
+        long low = strtol(p, &end, 10);
+        if (end == p) {
+            return false;
+        }
+        long high = low;
+        if (*end == '-') {
+            p = end + 1;
+            high = strtol(p, &end, 10);
+            if (end == p) {
+                return false;
+            }
+        }
+        if (*end) {
+            return false;
+        }
+        if (low < 0 || high < low || high >= CPU_SETSIZE) {
+            return false;
+        }
+        for (int i = low; i <= high; ++i) {
+            cpus.push_back(i);
+        }
+    }
+    return !cpus.empty();
+}
+
+/**
+ * @brief 按配置 iomanagers 创建调度器
+ *
+ * @return true
+ * @return false 配置错误
+ */
+bool WorkerManager::init() {
+    auto confs = g_iomanagers_conf->getValue();
+    for (auto &i : confs) {
+        uint32_t threads = ParseThreads(i.second.threads);
+        std::vector<int> cpus;
+        if (!threads || !ParseAffinity(i.second.affinity, cpus)) {
+            LJRSERVER_LOG_ERROR(g_logger)
+                << "invalid iomanager " << i.first
+                << " threads = " << i.second.threads
+                << " affinity = " << i.second.affinity;
+            return false;
+        }
+
+        RWMutexType::WriteLock lock(m_mutex);
+        if (m_iomanagers.count(i.first)) {
+            continue;
+        }
+        IOManager::ptr iom(new IOManager(threads, false, i.first));
+        m_iomanagers[i.first] = iom;
+        lock.unlock();
+
+        // 在每个线程中绑定自己的 CPU
+        const std::vector<int> &ids = iom->getThreadIds();
+        for (size_t n = 0; n < ids.size() && !cpus.empty(); ++n) {
+            int cpu = cpus[n % cpus.size()];
+            std::string name = i.first;
+            iom->schedule(
+                [name, cpu]() {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    CPU_SET(cpu, &set);
+                    int rt = pthread_setaffinity_np(pthread_self(),
+                                                    sizeof(set), &set);
+                    if (rt) {
+                        LJRSERVER_LOG_WARN(g_logger)
+                            << "iomanager " << name
+                            << " pthread_setaffinity_np fail rt = " << rt
+                            << " cpu = " << cpu;
+                    }
+                },
+                ids[n]);
+        }
+        LJRSERVER_LOG_INFO(g_logger)
+            << "iomanager " << i.first << " threads = " << threads
+            << " affinity = " << i.second.affinity;
+    }
+    return true;
+}
+
+/**
+ * @brief 按名称获取调度器
+ *
+ * @param name 名称
+ * @return IOManager* 没有返回 nullptr
+ */
+IOManager *WorkerManager::get(const std::string &name) {
+    RWMutexType::ReadLock lock(m_mutex);
+    auto it = m_iomanagers.find(name);
+    return it == m_iomanagers.end() ? nullptr : it->second.get();
+}
+
+/**
+ * @brief 停止所有调度器
+ *
+ */
+void WorkerManager::stop() {
+    std::map<std::string, IOManager::ptr> iomanagers;
+    {
+        RWMutexType::WriteLock lock(m_mutex);
+        iomanagers.swap(m_iomanagers);
+    }
+    for (auto &i : iomanagers) {
+        i.second->stop();
+    }
+}
+
+/**
+ * @brief 输出调度器池信息
+ *
+ * @param os
+ * @return std::ostream&
+ */
+std::ostream &WorkerManager::dump(std::ostream &os) {
+    RWMutexType::ReadLock lock(m_mutex);
+    for (auto &i : m_iomanagers) {
+        os << "[iomanager name=" << i.first
+           << " threads=" << i.second->getThreadIds().size() << "]"
+           << std::endl;
+    }
+    return os;
+}
+
+}  // namespace ljrserver
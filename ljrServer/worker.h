@@ -0,0 +1,114 @@
+/**
+ * @file worker.h
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 命名的 IO 调度器池
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "iomanager.h"
+#include "singleton.h"
+#include "thread.h"
+
+namespace ljrserver {
+
+/**
+ * @brief IO 调度器池配置
+ *
+ * iomanagers:
+ *     accept:
+ *         threads: 1
+ *     io:
+ *         threads: auto
+ *         affinity: auto
+ */
+struct IOManagerConf {
+    // 线程数 数字或 auto auto 为进程可用的 CPU 个数 考虑 cgroup 配额
+    std::string threads = "1";
+
+    // 线程绑定的 CPU 空不绑定 auto 依次绑定可用的 CPU 或 CPU 列表 如 0-3,6
+    std::string affinity;
+
+    bool operator==(const IOManagerConf &oth) const {
+        return threads == oth.threads && affinity == oth.affinity;
+    }
+};
+
+/**
+ * @brief 命名的 IO 调度器池
+ *
+ * 按配置 iomanagers 创建 http_servers 中按名称选择 accept 和处理连接的调度器
+ * 调度器不使用调用线程 在 fork 出的工作进程中创建
+ */
+class WorkerManager {
+public:
+    // 读写锁
+    typedef RWMutex RWMutexType;
+
+    /**
+     * @brief 按配置 iomanagers 创建调度器
+     *
+     * @return true
+     * @return false 配置错误
+     */
+    bool init();
+
+    /**
+     * @brief 按名称获取调度器
+     *
+     * @param name 名称
+     * @return IOManager* 没有返回 nullptr
+     */
+    IOManager *get(const std::string &name);
+
+    /**
+     * @brief 停止所有调度器
+     *
+     */
+    void stop();
+
+    /**
+     * @brief 输出调度器池信息
+     *
+     * @param os
+     * @return std::ostream&
+     */
+    std::ostream &dump(std::ostream &os);
+
+public:
+    /**
+     * @brief 解析线程数
+     *
+     * @param v 数字或 auto
+     * @return uint32_t 错误返回 0
+     */
+    static uint32_t ParseThreads(const std::string &v);
+
+    /**
+     * @brief 解析绑定的 CPU
+     *
+     * @param v 空 auto 或 CPU 列表 如 0-3,6
+     * @param cpus 线程依次绑定的 CPU 空不绑定
+     * @return true
+     * @return false 格式错误
+     */
+    static bool ParseAffinity(const std::string &v, std::vector<int> &cpus);
+
+private:
+    // 锁
+    RWMutexType m_mutex;
+
+    // 调度器 名称 -> 调度器
+    std::map<std::string, IOManager::ptr> m_iomanagers;
+};
+
+typedef ljrserver::Singleton<WorkerManager> WorkerMgr;
+
+}  // namespace ljrserver
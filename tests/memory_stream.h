@@ -0,0 +1,83 @@
+/**
+ * @file memory_stream.h
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试用的内存流
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#pragma once
+
+#include "../ljrServer/stream.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+/**
+ * @brief 内存流 从 m_input 读 写到 m_output 每次最多读取 chunk 字节
+ * 记录读写次数
+ *
+ */
+class MemoryStream : public ljrserver::Stream {
+public:
+    typedef std::shared_ptr<MemoryStream> ptr;
+
+    MemoryStream(const std::string &input, size_t chunk)
+        : m_input(input), m_chunk(chunk) {}
+
+    void close() override {}
+
+    int read(void *buffer, size_t length) override {
+        ++m_reads;
+        size_t len = std::min(length, m_chunk);
+        len = std::min(len, m_input.size() - m_pos);
+        memcpy(buffer, m_input.data() + m_pos, len);
+        m_pos += len;
+        return len;
+    }
+
+    int read(ljrserver::ByteArray::ptr ba, size_t length) override {
+        std::string buf(length, 0);
+        int rt = read(&buf[0], length);
+        if (rt > 0) {
+            ba->write(buf.data(), rt);
+        }
+        return rt;
+    }
+
+    int write(const void *buffer, size_t length) override {
+        ++m_writes;
+        if (m_writeChunk) {
+            length = std::min(length, m_writeChunk);
+        }
+        m_output.append((const char *)buffer, length);
+        return length;
+    }
+
+    int write(ljrserver::ByteArray::ptr ba, size_t length) override {
+        std::string buf(length, 0);
+        ba->read(&buf[0], length);
+        return write(buf.data(), length);
+    }
+
+    /**
+     * @brief 写入的数据作为输入 从头读取
+     *
+     */
+    void rewind() {
+        m_input.swap(m_output);
+        m_output.clear();
+        m_pos = 0;
+    }
+
+    std::string m_input;
+    size_t m_chunk;
+    size_t m_pos = 0;
+    std::string m_output;
+    int m_reads = 0;
+    int m_writes = 0;
+    // 每次最多写入的字节数 0 不限制
+    size_t m_writeChunk = 0;
+};
@@ -0,0 +1,85 @@
+/**
+ * @file test_async_file.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试异步文件 IO
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/async_file.h"
+#include "../ljrServer/iomanager.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/macro.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+/**
+ * @brief 测试 AsyncFile 和 hook pread
+ *
+ */
+void test_async_file() {
+    // 定时输出 验证调度线程没有被文件 IO 阻塞
+    auto ticker = ljrserver::IOManager::GetThis()->addTimer(
+        10, []() { LJRSERVER_LOG_DEBUG(g_logger) << "tick"; }, true);
+
+    ljrserver::AsyncFile::ptr file = ljrserver::AsyncFile::Open(
+        "/tmp/test_async_file.dat", O_RDWR | O_CREAT | O_TRUNC);
+    LJRSERVER_ASSERT(file);
+
+    // 写入 16MB 每 1MB 内容不同 读回时能发现错位
+    const size_t block_size = 1024 * 1024;
+    const int blocks = 16;
+    for (int i = 0; i < blocks; ++i) {
+        std::string block(block_size, 'a' + i);
+        ssize_t rt = file->pwrite(block.c_str(), block.size(), i * block_size);
+        LJRSERVER_ASSERT(rt == (ssize_t)block.size());
+    }
+    LJRSERVER_ASSERT(file->fsync() == 0);
+    LJRSERVER_ASSERT(file->getSize() == (int64_t)block_size * blocks);
+    LJRSERVER_LOG_INFO(g_logger) << "write size=" << file->getSize();
+
+    // AsyncFile::pread 读回
+    std::string buff(block_size, 0);
+    for (int i = 0; i < blocks; ++i) {
+        ssize_t rt = file->pread(&buff[0], buff.size(), i * block_size);
+        LJRSERVER_ASSERT(rt == (ssize_t)block_size);
+        LJRSERVER_ASSERT(buff == std::string(block_size, 'a' + i));
+    }
+
+    // hook pread 读回
+    int64_t total = 0;
+    ssize_t rt = 0;
+    while ((rt = pread(file->getFd(), &buff[0], buff.size(), total)) > 0) {
+        LJRSERVER_ASSERT(rt == (ssize_t)block_size);
+        char expect = 'a' + total / block_size;
+        LJRSERVER_ASSERT(buff == std::string(block_size, expect));
+        total += rt;
+    }
+    LJRSERVER_ASSERT(rt == 0);
+    LJRSERVER_ASSERT(total == (int64_t)block_size * blocks);
+    LJRSERVER_LOG_INFO(g_logger) << "pread total=" << total << " ok";
+
+    // 读到文件末尾之后
+    LJRSERVER_ASSERT(file->pread(&buff[0], buff.size(), total) == 0);
+
+    ticker->cancel();
+    LJRSERVER_ASSERT(file->close() == 0);
+    unlink("/tmp/test_async_file.dat");
+}
+
+/**
+ * @brief 测试
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char const *argv[]) {
+    ljrserver::IOManager iom(1, false, "main");
+    iom.schedule(test_async_file);
+    return 0;
+}
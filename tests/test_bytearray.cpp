@@ -2,8 +2,10 @@
 #include "../ljrServer/bytearray.h"
 #include "../ljrServer/log.h"
 #include "../ljrServer/macro.h"
+#include "../ljrServer/util.h"
 
 #include <iostream>
+#include <sstream>
 
 // 日志
 static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
@@ -106,6 +108,323 @@ void test_file() {
 #undef XX
 }
 
+/**
+ * @brief 测试 内存块池 reserve
+ *
+ */
+void test_pool() {
+    ljrserver::ByteArrayPool::Stats before =
+        ljrserver::ByteArrayPool::GetStats();
+    // 每个消息一个 ByteArray 内存块被复用
+    for (int i = 0; i < 1000; ++i) {
+        ljrserver::ByteArray::ptr ba(new ljrserver::ByteArray(1024));
+        for (int j = 0; j < 1000; ++j) {
+            ba->writeFint32(j);
+        }
+        ba->setPostion(0);
+        for (int j = 0; j < 1000; ++j) {
+            LJRSERVER_ASSERT(ba->readFint32() == j);
+        }
+    }
+    ljrserver::ByteArrayPool::Stats after =
+        ljrserver::ByteArrayPool::GetStats();
+    LJRSERVER_ASSERT(after.alloc - before.alloc == 4000);
+    LJRSERVER_ASSERT(after.miss - before.miss <= 4);
+
+    // 预留的连续内存 节点之间没有间隔
+    ljrserver::ByteArray::ptr ba(new ljrserver::ByteArray(16));
+    ba->writeFint32(1);
+    ba->reserve(100);
+    std::vector<iovec> iovs;
+    ba->getWriteBuffers(iovs, 100);
+    for (size_t i = 2; i < iovs.size(); ++i) {
+        LJRSERVER_ASSERT((char *)iovs[i - 1].iov_base + 16 ==
+                         iovs[i].iov_base);
+    }
+    std::string data(100, 'x');
+    ba->write(data.c_str(), data.size());
+    ba->setPostion(4);
+    LJRSERVER_ASSERT(ba->toString() == data);
+    ba->clear();
+
+    std::stringstream ss;
+    ljrserver::ByteArrayPool::Dump(ss);
+    LJRSERVER_LOG_INFO(g_logger) << ss.str();
+}
+
+/**
+ * @brief 测试 切片 append 不拷贝数据
+ *
+ */
+void test_slice() {
+    std::string data;
+    for (int i = 0; i < 200; ++i) {
+        data.push_back('a' + i % 26);
+    }
+    ljrserver::ByteArray::ptr ba(new ljrserver::ByteArray(16));
+    ba->write(data.c_str(), data.size());
+
+    // 切片共享内存块
+    ljrserver::ByteArray::ptr sl = ba->slice(10, 100);
+    LJRSERVER_ASSERT(sl->getPosition() == 0 && sl->getSize() == 100);
+    LJRSERVER_ASSERT(sl->toString() == data.substr(10, 100));
+    std::vector<iovec> a, b;
+    ba->getReadBuffers(a, 100, 10);
+    sl->getReadBuffers(b);
+    LJRSERVER_ASSERT(a.size() == b.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        LJRSERVER_ASSERT(a[i].iov_base == b[i].iov_base &&
+                         a[i].iov_len == b[i].iov_len);
+    }
+
+    // 切片的切片 读取 跨越节点
+    ljrserver::ByteArray::ptr sl2 = sl->slice(5, 50);
+    LJRSERVER_ASSERT(sl2->toString() == data.substr(15, 50));
+    sl2->setPostion(20);
+    std::string buf(30, 0);
+    sl2->read(&buf[0], buf.size());
+    LJRSERVER_ASSERT(buf == data.substr(35, 30));
+
+    // 切片之后的写入不覆盖原来的数据
+    sl->setPostion(sl->getSize());
+    sl->writeFint32(0x12345678);
+    LJRSERVER_ASSERT(ba->slice(110, 4)->toString() == data.substr(110, 4));
+
+    // clear 之后的写入不影响切片
+    ba->clear();
+    ba->write(std::string(200, 'z').c_str(), 200);
+    LJRSERVER_ASSERT(sl2->slice(0, 50)->toString() == data.substr(15, 50));
+
+    // append 接上节点链表
+    ljrserver::ByteArray::ptr head(new ljrserver::ByteArray(16));
+    head->write("0123456789", 10);
+    head->setPostion(2);
+    ljrserver::ByteArray::ptr tail(new ljrserver::ByteArray(7));
+    tail->write(data.c_str(), data.size());
+    tail->setPostion(3);
+    head->append(std::move(*tail));
+    LJRSERVER_ASSERT(tail->getSize() == 0 && tail->getReadSize() == 0);
+    LJRSERVER_ASSERT(head->getPosition() == 2);
+    LJRSERVER_ASSERT(head->toString() == "23456789" + data.substr(3));
+    sl2->setPostion(0);
+    head->append(std::move(*sl2));
+    head->setPostion(head->getSize());
+    head->writeStringVint("end");
+    head->setPostion(10 + 197);
+    buf.resize(50);
+    head->read(&buf[0], buf.size());
+    LJRSERVER_ASSERT(buf == data.substr(15, 50));
+    LJRSERVER_ASSERT(head->readStringVint() == "end");
+    LJRSERVER_ASSERT(head->getReadSize() == 0);
+    LJRSERVER_LOG_INFO(g_logger) << "test_slice ok";
+}
+
+/**
+ * @brief 测试 批量 varint 与逐个读写结果相同
+ *
+ */
+void test_varint_array() {
+    // 不同长度的值混合 小内存块使编码跨越节点
+    std::vector<uint32_t> u32;
+    std::vector<int64_t> i64;
+    for (int i = 0; i < 10000; ++i) {
+        int bits = rand() % 33;
+        u32.push_back(bits ? (uint32_t)rand() >> (32 - bits) : 0);
+        i64.push_back(((int64_t)rand() << 32 | rand()) >> (rand() % 64));
+    }
+    u32[100] = 0xFFFFFFFF;
+    i64[100] = INT64_MIN;
+    i64[101] = INT64_MAX;
+
+    for (size_t base : {7, 4096}) {
+        ljrserver::ByteArray::ptr ba(new ljrserver::ByteArray(base));
+        ljrserver::ByteArray::ptr one(new ljrserver::ByteArray(base));
+        ba->writeUint32Array(&u32[0], u32.size());
+        ba->writeInt64Array(&i64[0], i64.size());
+        for (auto &v : u32) {
+            one->writeUint32(v);
+        }
+        for (auto &v : i64) {
+            one->writeInt64(v);
+        }
+        ba->setPostion(0);
+        one->setPostion(0);
+        LJRSERVER_ASSERT(ba->getSize() == one->getSize());
+        LJRSERVER_ASSERT(ba->toString() == one->toString());
+
+        std::vector<uint32_t> r32(u32.size());
+        std::vector<int64_t> r64(i64.size());
+        ba->readUint32Array(&r32[0], r32.size());
+        ba->readInt64Array(&r64[0], r64.size());
+        LJRSERVER_ASSERT(r32 == u32 && r64 == i64);
+        LJRSERVER_ASSERT(ba->getReadSize() == 0);
+
+        // 差值编码
+        std::vector<int32_t> sorted;
+        for (int i = 0; i < 1000; ++i) {
+            sorted.push_back(i * 3 - 500 + rand() % 3);
+        }
+        ba->clear();
+        ba->writeInt32ArrayDelta(&sorted[0], sorted.size());
+        LJRSERVER_ASSERT(ba->getSize() < sorted.size() * 2);
+        ba->setPostion(0);
+        std::vector<int32_t> r(sorted.size());
+        ba->readInt32ArrayDelta(&r[0], r.size());
+        LJRSERVER_ASSERT(r == sorted);
+    }
+    LJRSERVER_LOG_INFO(g_logger) << "test_varint_array ok";
+}
+
+/**
+ * @brief 性能测试 逐个和批量读写 varint
+ *
+ * @param name
+ * @param max 值的上限
+ */
+template <class T>
+void bench_varint(const char *name, T max) {
+    const size_t count = 1000000;
+    std::vector<T> values(count);
+    for (auto &v : values) {
+        v = ((T)rand() << 31 | rand()) % max;
+    }
+    std::vector<T> result(count);
+    ljrserver::ByteArray::ptr ba(new ljrserver::ByteArray);
+
+    uint64_t t0 = ljrserver::GetCurrentUS();
+    for (auto &v : values) {
+        sizeof(T) == 4 ? ba->writeUint32(v) : ba->writeUint64(v);
+    }
+    uint64_t t1 = ljrserver::GetCurrentUS();
+    ba->setPostion(0);
+    for (auto &v : result) {
+        v = sizeof(T) == 4 ? ba->readUint32() : ba->readUint64();
+    }
+    uint64_t t2 = ljrserver::GetCurrentUS();
+    LJRSERVER_ASSERT(result == values);
+
+    ba->clear();
+    if (sizeof(T) == 4) {
+        ba->writeUint32Array((const uint32_t *)&values[0], count);
+    } else {
+        ba->writeUint64Array((const uint64_t *)&values[0], count);
+    }
+    uint64_t t3 = ljrserver::GetCurrentUS();
+    ba->setPostion(0);
+    if (sizeof(T) == 4) {
+        ba->readUint32Array((uint32_t *)&result[0], count);
+    } else {
+        ba->readUint64Array((uint64_t *)&result[0], count);
+    }
+    uint64_t t4 = ljrserver::GetCurrentUS();
+    LJRSERVER_ASSERT(result == values);
+
+    LJRSERVER_LOG_INFO(g_logger)
+        << name << " count=" << count << " size=" << ba->getSize()
+        << " write=" << (t1 - t0) << "us read=" << (t2 - t1)
+        << "us writeArray=" << (t3 - t2) << "us readArray=" << (t4 - t3)
+        << "us";
+}
+
+/**
+ * @brief 测试 批量固定长度 与逐个读写结果相同
+ *
+ */
+void test_fixed_array() {
+    std::vector<int16_t> i16;
+    std::vector<uint32_t> u32;
+    std::vector<int64_t> i64;
+    std::vector<double> f64;
+    for (int i = 0; i < 1000; ++i) {
+        i16.push_back(rand());
+        u32.push_back(rand());
+        i64.push_back((int64_t)rand() << 32 | rand());
+        f64.push_back(rand() / 3.0);
+    }
+
+    for (bool little : {false, true}) {
+        for (size_t base : {3, 4096}) {
+            ljrserver::ByteArray::ptr ba(new ljrserver::ByteArray(base));
+            ljrserver::ByteArray::ptr one(new ljrserver::ByteArray(base));
+            ba->setLittleEndian(little);
+            one->setLittleEndian(little);
+            ba->writeFixedArray(&i16[0], i16.size());
+            ba->writeFixedArray(&u32[0], u32.size());
+            ba->writeFixedArray(&i64[0], i64.size());
+            ba->writeFixedArray(&f64[0], f64.size());
+#define XX(vec, write_fun)     \
+    for (auto &v : vec) {      \
+        one->write_fun(v);     \
+    }
+            XX(i16, writeFint16);
+            XX(u32, writeFuint32);
+            XX(i64, writeFint64);
+            XX(f64, writeDouble);
+#undef XX
+            ba->setPostion(0);
+            one->setPostion(0);
+            LJRSERVER_ASSERT(ba->toString() == one->toString());
+
+            // 批量读取 逐个读取
+            std::vector<int16_t> r16(i16.size());
+            std::vector<uint32_t> r32(u32.size());
+            ba->readFixedArray(&r16[0], r16.size());
+            ba->readFixedArray(&r32[0], r32.size());
+            LJRSERVER_ASSERT(r16 == i16 && r32 == u32);
+            for (auto &v : i64) {
+                LJRSERVER_ASSERT(ba->readFint64() == v);
+            }
+            for (auto &v : f64) {
+                LJRSERVER_ASSERT(ba->readDouble() == v);
+            }
+            LJRSERVER_ASSERT(ba->getReadSize() == 0);
+        }
+    }
+    LJRSERVER_LOG_INFO(g_logger) << "test_fixed_array ok";
+}
+
+/**
+ * @brief 性能测试 逐个和批量读写固定长度
+ *
+ * @param little 是否小端
+ */
+void bench_fixed(bool little) {
+    const size_t count = 1000000;
+    std::vector<uint32_t> values(count);
+    for (auto &v : values) {
+        v = rand();
+    }
+    std::vector<uint32_t> result(count);
+    ljrserver::ByteArray::ptr ba(new ljrserver::ByteArray);
+    ba->setLittleEndian(little);
+
+    uint64_t t0 = ljrserver::GetCurrentUS();
+    for (auto &v : values) {
+        ba->writeFuint32(v);
+    }
+    uint64_t t1 = ljrserver::GetCurrentUS();
+    ba->setPostion(0);
+    for (auto &v : result) {
+        v = ba->readFuint32();
+    }
+    uint64_t t2 = ljrserver::GetCurrentUS();
+    LJRSERVER_ASSERT(result == values);
+
+    ba->clear();
+    ba->writeFixedArray(&values[0], count);
+    uint64_t t3 = ljrserver::GetCurrentUS();
+    ba->setPostion(0);
+    ba->readFixedArray(&result[0], count);
+    uint64_t t4 = ljrserver::GetCurrentUS();
+    LJRSERVER_ASSERT(result == values);
+
+    LJRSERVER_LOG_INFO(g_logger)
+        << "fuint32 " << (little ? "little" : "big") << " count=" << count
+        << " write=" << (t1 - t0) << "us read=" << (t2 - t1)
+        << "us writeArray=" << (t3 - t2) << "us readArray=" << (t4 - t3)
+        << "us";
+}
+
 /**
  * @brief 测试
  *
@@ -122,5 +441,28 @@ int main(int argc, char const *argv[]) {
     LJRSERVER_LOG_INFO(g_logger) << "测试文件操作";
     test_file();
 
+    // 测试内存块池
+    LJRSERVER_LOG_INFO(g_logger) << "测试内存块池";
+    test_pool();
+
+    // 测试切片
+    LJRSERVER_LOG_INFO(g_logger) << "测试切片";
+    test_slice();
+
+    // 测试批量 varint
+    LJRSERVER_LOG_INFO(g_logger) << "测试批量 varint";
+    test_varint_array();
+    bench_varint<uint32_t>("varint32 <128", 128);
+    bench_varint<uint32_t>("varint32 <2^14", 1 << 14);
+    bench_varint<uint32_t>("varint32 <2^28", 1 << 28);
+    bench_varint<uint64_t>("varint64 <128", 128);
+    bench_varint<uint64_t>("varint64 <2^56", 1ull << 56);
+
+    // 测试批量固定长度
+    LJRSERVER_LOG_INFO(g_logger) << "测试批量固定长度";
+    test_fixed_array();
+    bench_fixed(false);
+    bench_fixed(true);
+
     return 0;
 }
@@ -0,0 +1,157 @@
+/**
+ * @file test_codec.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试 分帧编解码
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/codec.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/macro.h"
+#include "memory_stream.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+/**
+ * @brief iovec 拼接成字符串
+ *
+ * @param iovs
+ * @return std::string
+ */
+static std::string join(const std::vector<iovec> &iovs) {
+    std::string s;
+    for (auto &iov : iovs) {
+        s.append((const char *)iov.iov_base, iov.iov_len);
+    }
+    return s;
+}
+
+/**
+ * @brief 编码 100 帧 从 ByteArray 和带缓存的流中解码
+ *
+ * @param codec
+ * @param name
+ */
+static void test_codec(ljrserver::FrameCodec::ptr codec, const char *name) {
+    std::vector<std::string> frames;
+    for (int i = 0; i < 100; ++i) {
+        frames.push_back(std::string(rand() % 300, 'a' + i % 26));
+    }
+
+    // ByteArray 内存块很小 帧和分隔符跨越内存块
+    ljrserver::ByteArray::ptr ba(new ljrserver::ByteArray(7));
+    for (auto &f : frames) {
+        LJRSERVER_ASSERT(codec->encode(ba, f.data(), f.size()));
+    }
+    ba->setPostion(0);
+    std::vector<iovec> iovs;
+    for (auto &f : frames) {
+        LJRSERVER_ASSERT(codec->decode(ba, iovs) > 0);
+        LJRSERVER_ASSERT(join(iovs) == f);
+    }
+    LJRSERVER_ASSERT(codec->decode(ba, iovs) == 0);
+
+    // 编码写入流 批量解码
+    MemoryStream::ptr ms(new MemoryStream("", 1000));
+    for (auto &f : frames) {
+        LJRSERVER_ASSERT(codec->encode(ms, f.data(), f.size()) > 0);
+    }
+    ms->rewind();
+    ljrserver::BufferedStream::ptr bs(
+        new ljrserver::BufferedStream(ms, codec->getMinReadBufferSize()));
+    std::vector<ljrserver::FrameCodec::Frame> batch;
+    size_t index = 0;
+    int rt = 0;
+    while ((rt = codec->readBatch(bs, batch)) > 0) {
+        for (auto &f : batch) {
+            LJRSERVER_ASSERT(std::string(f.first, f.second) == frames[index]);
+            ++index;
+        }
+    }
+    LJRSERVER_ASSERT(rt == 0 && index == frames.size());
+    LJRSERVER_LOG_INFO(g_logger)
+        << name << " ok frames=" << index << " reads=" << ms->m_reads;
+}
+
+/**
+ * @brief 测试 帧超过上限
+ *
+ */
+static void test_limit() {
+    ljrserver::LengthFieldCodec::ptr codec(
+        new ljrserver::LengthFieldCodec(4, 100));
+    std::string big(101, 'x');
+    ljrserver::ByteArray::ptr ba(new ljrserver::ByteArray);
+    LJRSERVER_ASSERT(!codec->encode(ba, big.data(), big.size()));
+
+    // 长度字段超过上限 不等帧内容到达
+    const char head[] = {0, 0, 0, 101};
+    ljrserver::FrameCodec::Frame frame;
+    LJRSERVER_ASSERT(codec->decode(head, 4, frame) == -1 && errno == EMSGSIZE);
+
+    ljrserver::LineCodec::ptr line(new ljrserver::LineCodec(10));
+    std::string data = "012345678\r\n";
+    LJRSERVER_ASSERT(line->decode(data.data(), data.size(), frame) == 11);
+    LJRSERVER_ASSERT(frame.second == 9);
+    data = "0123456789ab\n";
+    LJRSERVER_ASSERT(line->decode(data.data(), data.size(), frame) == -1);
+    LJRSERVER_LOG_INFO(g_logger) << "test_limit ok";
+}
+
+/**
+ * @brief 测试 超过默认读缓存 4KB 的帧
+ *
+ * @param codec 默认上限 codec.max_frame_size
+ * @param name
+ */
+static void test_big_frame(ljrserver::FrameCodec::ptr codec, const char *name) {
+    std::vector<std::string> frames;
+    frames.push_back(std::string(10000, 'x'));
+    frames.push_back(std::string(100, 'y'));
+    frames.push_back(std::string(codec->getMaxFrameSize() - 1, 'z'));
+    MemoryStream::ptr ms(new MemoryStream("", 1000));
+    for (auto &f : frames) {
+        LJRSERVER_ASSERT(codec->encode(ms, f.data(), f.size()) > 0);
+    }
+    ms->rewind();
+
+    // 读缓存放不下最大的帧 不读取直接失败
+    ljrserver::FrameCodec::Frame frame;
+    ljrserver::BufferedStream::ptr small(
+        new ljrserver::BufferedStream(ms, 4096, 4096, false));
+    LJRSERVER_ASSERT(codec->read(small, frame) == -1 && errno == EINVAL);
+    LJRSERVER_ASSERT(ms->m_reads == 0);
+
+    ljrserver::BufferedStream::ptr bs(
+        new ljrserver::BufferedStream(ms, codec->getMinReadBufferSize()));
+    for (auto &f : frames) {
+        LJRSERVER_ASSERT(codec->read(bs, frame) == 1);
+        LJRSERVER_ASSERT(std::string(frame.first, frame.second) == f);
+    }
+    LJRSERVER_ASSERT(codec->read(bs, frame) == 0);
+    LJRSERVER_LOG_INFO(g_logger)
+        << name << " big frame ok min read buffer = "
+        << codec->getMinReadBufferSize();
+}
+
+int main(int argc, char **argv) {
+    test_codec(std::make_shared<ljrserver::LengthFieldCodec>(0), "varint");
+    test_codec(std::make_shared<ljrserver::LengthFieldCodec>(2), "fixed16");
+    test_codec(std::make_shared<ljrserver::LengthFieldCodec>(4), "fixed32");
+    test_codec(std::make_shared<ljrserver::DelimiterCodec>("\r\n\r\n"),
+               "delimiter");
+    test_codec(std::make_shared<ljrserver::LineCodec>(), "line");
+    test_limit();
+    test_big_frame(std::make_shared<ljrserver::LengthFieldCodec>(0), "varint");
+    test_big_frame(std::make_shared<ljrserver::LengthFieldCodec>(4),
+                   "fixed32");
+    test_big_frame(std::make_shared<ljrserver::DelimiterCodec>("\r\n\r\n"),
+                   "delimiter");
+    return 0;
+}
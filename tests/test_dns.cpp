@@ -0,0 +1,227 @@
+/**
+ * @file test_dns.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试域名解析 使用本地的 dns 桩服务器
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/dns.h"
+#include "../ljrServer/socket.h"
+#include "../ljrServer/iomanager.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/config.h"
+#include "../ljrServer/macro.h"
+
+#include <fstream>
+#include <unistd.h>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+// 桩服务器收到的查询次数
+static int s_stub_queries = 0;
+
+/**
+ * @brief dns 桩服务器
+ *
+ * test.ljrserver A 10.0.0.1 TTL 1s
+ * v6.ljrserver AAAA ::1 TTL 60s
+ * slow.ljrserver 不响应
+ * spoof.ljrserver 响应的问题 class 不对 A 10.0.0.1
+ * 其他 NXDOMAIN
+ *
+ * @param sock 绑定的 UDP socket
+ */
+void run_stub_server(ljrserver::Socket::ptr sock) {
+    uint8_t buf[512];
+    while (true) {
+        ljrserver::Address::ptr from(new ljrserver::IPv4Address);
+        int n = sock->recvFrom(buf, sizeof(buf), from);
+        if (n <= 12) {
+            break;
+        }
+        ++s_stub_queries;
+
+        // 解析查询的域名
+        std::string name;
+        size_t pos = 12;
+        while (pos < (size_t)n && buf[pos]) {
+            if (!name.empty()) {
+                name += ".";
+            }
+            name.append((char *)buf + pos + 1, buf[pos]);
+            pos += buf[pos] + 1;
+        }
+        uint16_t qtype = (buf[pos + 1] << 8) | buf[pos + 2];
+        size_t qend = pos + 5;
+
+        if (name == "slow.ljrserver") {
+            continue;
+        }
+
+        // 响应 复制 id 和问题
+        std::string rsp((char *)buf, qend);
+        bool found = (name == "test.ljrserver" && qtype == 1) ||
+                     (name == "v6.ljrserver" && qtype == 28) ||
+                     name == "spoof.ljrserver";
+        if (name == "spoof.ljrserver") {
+            rsp[qend - 1] = 3;
+        }
+        rsp[2] = (char)0x81;
+        rsp[3] = found ? (char)0x80 : (char)0x83;
+        rsp[6] = 0;
+        rsp[7] = found ? 1 : 0;
+        rsp[8] = rsp[9] = rsp[10] = rsp[11] = 0;
+
+        if (found) {
+            // 压缩指针指向问题中的域名
+            rsp.append("\xc0\x0c", 2);
+            rsp.push_back(0);
+            rsp.push_back((char)qtype);
+            rsp.append("\x00\x01", 2);
+            if (qtype == 1 || name == "spoof.ljrserver") {
+                rsp.append("\x00\x00\x00\x01", 4);
+                rsp.append("\x00\x04", 2);
+                rsp.append("\x0a\x00\x00\x01", 4);
+            } else {
+                rsp.append("\x00\x00\x00\x3c", 4);
+                rsp.append("\x00\x10", 2);
+                rsp.append(15, '\0');
+                rsp.push_back(1);
+            }
+        }
+        sock->sendTo(rsp.c_str(), rsp.size(), from);
+    }
+}
+
+/**
+ * @brief 测试解析 缓存 负缓存 hosts
+ *
+ */
+void test_dns() {
+    // 启动桩服务器
+    auto addr = ljrserver::IPv4Address::Create("127.0.0.1", 0);
+    auto server = ljrserver::Socket::CreateUDP(addr);
+    server->bind(addr);
+    ljrserver::IOManager::GetThis()->schedule(
+        std::bind(run_stub_server, server));
+
+    // 不依赖本机的 resolv.conf 和 hosts 没有 search 域
+    {
+        std::ofstream ofs("/tmp/test_dns_resolv.conf");
+        ofs << "nameserver 127.0.0.1\noptions ndots:1\n";
+    }
+    {
+        std::ofstream ofs("/tmp/test_dns_hosts");
+    }
+    ljrserver::Config::Lookup<std::string>("dns.resolv_conf")
+        ->setValue("/tmp/test_dns_resolv.conf");
+    ljrserver::Config::Lookup<std::string>("dns.hosts")
+        ->setValue("/tmp/test_dns_hosts");
+    ljrserver::Config::Lookup<int>("dns.timeout")->setValue(500);
+    ljrserver::Config::Lookup<int>("dns.attempts")->setValue(1);
+
+    ljrserver::DnsResolver resolver;
+    // 桩服务器的端口 resolv.conf 无法指定
+    ljrserver::IPAddress::ptr stub =
+        std::dynamic_pointer_cast<ljrserver::IPAddress>(
+            server->getLocalAddress());
+    resolver.setNameservers({stub});
+
+    // 查询
+    std::vector<ljrserver::IPAddress::ptr> result;
+    auto rt = resolver.resolve(result, "test.ljrserver");
+    LJRSERVER_ASSERT(rt == ljrserver::DnsResolver::SUCCESS);
+    LJRSERVER_ASSERT(result.size() == 1);
+    LJRSERVER_LOG_INFO(g_logger) << "test.ljrserver " << result[0]->toString();
+    LJRSERVER_ASSERT(s_stub_queries == 1);
+
+    // 命中缓存
+    result.clear();
+    rt = resolver.resolve(result, "TEST.ljrserver.");
+    LJRSERVER_ASSERT(rt == ljrserver::DnsResolver::SUCCESS);
+    LJRSERVER_ASSERT(s_stub_queries == 1);
+    LJRSERVER_ASSERT(resolver.getCacheHits() == 1);
+
+    // TTL 1s 过期后重新查询
+    sleep(2);
+    result.clear();
+    rt = resolver.resolve(result, "test.ljrserver");
+    LJRSERVER_ASSERT(rt == ljrserver::DnsResolver::SUCCESS);
+    LJRSERVER_ASSERT(s_stub_queries == 2);
+
+    // 不存在 负缓存
+    result.clear();
+    rt = resolver.resolve(result, "missing.ljrserver");
+    LJRSERVER_ASSERT(rt == ljrserver::DnsResolver::NOT_FOUND);
+    LJRSERVER_ASSERT(s_stub_queries == 3);
+    rt = resolver.resolve(result, "missing.ljrserver");
+    LJRSERVER_ASSERT(rt == ljrserver::DnsResolver::NOT_FOUND);
+    LJRSERVER_ASSERT(s_stub_queries == 3);
+
+    // AAAA
+    result.clear();
+    rt = resolver.resolve(result, "v6.ljrserver", AF_INET6);
+    LJRSERVER_ASSERT(rt == ljrserver::DnsResolver::SUCCESS);
+    LJRSERVER_LOG_INFO(g_logger) << "v6.ljrserver " << result[0]->toString();
+
+    // hosts
+    {
+        std::ofstream ofs("/tmp/test_dns_hosts");
+        ofs << "# test\n10.0.0.2 hosts.ljrserver alias.ljrserver\n";
+    }
+    resolver.loadHosts("/tmp/test_dns_hosts");
+    unlink("/tmp/test_dns_hosts");
+    result.clear();
+    int queries = s_stub_queries;
+    rt = resolver.resolve(result, "alias.ljrserver");
+    LJRSERVER_ASSERT(rt == ljrserver::DnsResolver::SUCCESS);
+    LJRSERVER_ASSERT(s_stub_queries == queries);
+    LJRSERVER_LOG_INFO(g_logger) << "alias.ljrserver " << result[0]->toString();
+
+    // search 域 短域名补全为 test.ljrserver
+    {
+        std::ofstream ofs("/tmp/test_dns_resolv.conf");
+        ofs << "nameserver 127.0.0.1\nsearch ljrserver\noptions ndots:1\n";
+    }
+    LJRSERVER_ASSERT(resolver.loadResolvConf("/tmp/test_dns_resolv.conf"));
+    resolver.setNameservers({stub});
+    result.clear();
+    rt = resolver.resolve(result, "test");
+    LJRSERVER_ASSERT(rt == ljrserver::DnsResolver::SUCCESS);
+    LJRSERVER_ASSERT(result.size() == 1);
+    LJRSERVER_ASSERT(result[0]->toString() == "10.0.0.1:0");
+    unlink("/tmp/test_dns_resolv.conf");
+
+    // 问题和查询不一致的响应被忽略 不进入缓存
+    result.clear();
+    rt = resolver.resolve(result, "spoof.ljrserver");
+    LJRSERVER_ASSERT(rt == ljrserver::DnsResolver::TIMEOUT);
+    LJRSERVER_ASSERT(result.empty());
+
+    // 超时 协程挂起 不阻塞线程
+    result.clear();
+    rt = resolver.resolve(result, "slow.ljrserver");
+    LJRSERVER_ASSERT(rt == ljrserver::DnsResolver::TIMEOUT);
+
+    LJRSERVER_LOG_INFO(g_logger)
+        << "hits=" << resolver.getCacheHits()
+        << " misses=" << resolver.getCacheMisses()
+        << " queries=" << resolver.getQueries();
+
+    server->close();
+}
+
+/**
+ * @brief 测试
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char const *argv[]) {
+    ljrserver::IOManager iom(1, false, "main");
+    iom.schedule(test_dns);
+    return 0;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file test_fd_manager.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试句柄管理器 挂起期间句柄被关闭复用 hook read 的额外开销
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/fd_manager.h"
+#include "../ljrServer/hook.h"
+#include "../ljrServer/iomanager.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/clock.h"
+#include "../ljrServer/macro.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+// 循环次数
+static const int s_count = 1000000;
+
+/**
+ * @brief 对比 hook read 和系统 read
+ *
+ * socket 由用户设置为非阻塞 每次 read 都立即返回 EAGAIN
+ * 两者的差值就是 hook 层 (句柄管理器查询) 的开销
+ *
+ */
+void test_read_overhead() {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    // 加入句柄管理器
+    ljrserver::FdMgr::GetInstance()->get(fds[0], true);
+    // 用户非阻塞 do_io 直接调用系统函数
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    char c;
+    uint64_t start = ljrserver::Clock::NowUS();
+    for (int i = 0; i < s_count; ++i) {
+        read_f(fds[0], &c, 1);
+    }
+    uint64_t raw = ljrserver::Clock::NowUS() - start;
+
+    start = ljrserver::Clock::NowUS();
+    for (int i = 0; i < s_count; ++i) {
+        read(fds[0], &c, 1);
+    }
+    uint64_t hooked = ljrserver::Clock::NowUS() - start;
+
+    start = ljrserver::Clock::NowUS();
+    for (int i = 0; i < s_count; ++i) {
+        ljrserver::FdMgr::GetInstance()->get(fds[0]);
+    }
+    uint64_t lookup = ljrserver::Clock::NowUS() - start;
+
+    LJRSERVER_LOG_INFO(g_logger)
+        << "read_f " << raw * 1000 / s_count << "ns/op"
+        << " hooked read " << hooked * 1000 / s_count << "ns/op"
+        << " FdManager::get " << lookup * 1000 / s_count << "ns/op";
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/**
+ * @brief 协程挂起在句柄上时 句柄被关闭 号码被新的 socket 复用
+ *
+ * 挂起的 recv 返回 EBADF 不会在新的句柄上重试
+ * 新的句柄上没有残留的事件 可以正常等待
+ *
+ */
+void test_close_reuse() {
+    auto iom = ljrserver::IOManager::GetThis();
+    int sv[2];
+    LJRSERVER_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    // 注册到句柄管理器 hook 的 recv 才会挂起协程
+    LJRSERVER_ASSERT(ljrserver::FdMgr::GetInstance()->get(sv[0], true));
+    int fd = sv[0];
+
+    std::shared_ptr<int> old_rt(new int(0));
+    std::shared_ptr<int> old_errno(new int(0));
+    iom->schedule([fd, old_rt, old_errno]() {
+        char c;
+        *old_rt = recv(fd, &c, 1, 0);
+        *old_errno = errno;
+    });
+    usleep(10 * 1000);
+    LJRSERVER_ASSERT(*old_rt == 0);
+
+    // 关闭后挂起的协程已被唤醒 还没有执行 号码马上被复用
+    LJRSERVER_ASSERT(close(fd) == 0);
+    int sv2[2];
+    LJRSERVER_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv2) == 0);
+    LJRSERVER_ASSERT(sv2[0] == fd);
+    LJRSERVER_ASSERT(ljrserver::FdMgr::GetInstance()->get(fd, true));
+
+    // 已经失效的代数不能注册事件
+    LJRSERVER_ASSERT(iom->addEventIf(fd, ljrserver::IOManager::READ,
+                                     []() { return false; }) == -1);
+    LJRSERVER_ASSERT(errno == EBADF);
+
+    // 新的句柄上等待 旧的协程不会占用 READ 事件
+    std::shared_ptr<int> new_rt(new int(0));
+    std::shared_ptr<char> new_c(new char(0));
+    iom->schedule([fd, new_rt, new_c]() {
+        *new_rt = recv(fd, new_c.get(), 1, 0);
+    });
+    usleep(10 * 1000);
+    LJRSERVER_ASSERT(*old_rt == -1 && *old_errno == EBADF);
+    LJRSERVER_ASSERT(*new_rt == 0);
+
+    // 旧的连接已经关闭 新的对端写入后唤醒新的协程
+    LJRSERVER_ASSERT(send(sv[1], "x", 1, MSG_NOSIGNAL) == -1 && errno == EPIPE);
+    LJRSERVER_ASSERT(write(sv2[1], "y", 1) == 1);
+    usleep(10 * 1000);
+    LJRSERVER_ASSERT(*new_rt == 1 && *new_c == 'y');
+
+    close(sv[1]);
+    close(sv2[0]);
+    close(sv2[1]);
+    LJRSERVER_LOG_INFO(g_logger) << "test_close_reuse ok";
+}
+
+/**
+ * @brief 测试
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char const *argv[]) {
+    ljrserver::IOManager iom(1, false, "main");
+    iom.schedule([]() {
+        test_close_reuse();
+        test_read_overhead();
+    });
+    return 0;
+}
@@ -2,11 +2,17 @@
 #include "../ljrServer/hook.h"
 #include "../ljrServer/log.h"
 #include "../ljrServer/iomanager.h"
+#include "../ljrServer/socket_stream.h"
+#include "../ljrServer/clock.h"
+#include "../ljrServer/fd_manager.h"
+#include "../ljrServer/macro.h"
 
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // 日志
 ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
@@ -98,6 +104,190 @@ void test_sock() {
     LJRSERVER_LOG_INFO(g_logger) << "响应消息:" << std::endl << buff;
 }
 
+/**
+ * @brief 测试 hook sendfile 本地回环发送 8MB 文件
+ *
+ */
+void test_sendfile() {
+    static const size_t size = 8 * 1024 * 1024;
+
+    // 临时文件 内容按偏移变化 便于校验
+    char path[] = "/tmp/test_sendfile_XXXXXX";
+    int fd = mkstemp(path);
+    LJRSERVER_ASSERT(fd >= 0);
+    unlink(path);
+    std::string block(1024 * 1024, 0);
+    for (size_t i = 0; i < size / block.size(); ++i) {
+        for (size_t j = 0; j < block.size(); ++j) {
+            block[j] = (char)((i * block.size() + j) % 251);
+        }
+        LJRSERVER_ASSERT(write(fd, block.c_str(), block.size()) ==
+                         (ssize_t)block.size());
+    }
+
+    // 监听本地回环 随机端口
+    auto addr = ljrserver::IPv4Address::Create("127.0.0.1", 0);
+    auto server = ljrserver::Socket::CreateTCP(addr);
+    LJRSERVER_ASSERT(server->bind(addr));
+    LJRSERVER_ASSERT(server->listen());
+    auto local = server->getLocalAddress();
+
+    // 客户端接收并校验
+    ljrserver::IOManager::GetThis()->schedule([local]() {
+        auto client = ljrserver::Socket::CreateTCP(local);
+        LJRSERVER_ASSERT(client->connect(local));
+        std::string buff(64 * 1024, 0);
+        size_t total = 0;
+        int rt = 0;
+        while ((rt = client->recv(&buff[0], buff.size())) > 0) {
+            for (int i = 0; i < rt; ++i) {
+                LJRSERVER_ASSERT(buff[i] == (char)((total + i) % 251));
+            }
+            total += rt;
+        }
+        LJRSERVER_LOG_INFO(g_logger) << "client recv total=" << total;
+        LJRSERVER_ASSERT(rt == 0);
+        LJRSERVER_ASSERT(total == size);
+    });
+
+    // 服务端发送文件
+    auto sock = server->accept();
+    LJRSERVER_ASSERT(sock);
+    ljrserver::SocketStream ss(sock);
+    int64_t rt = ss.sendFile(fd, 0, size - 100);
+    LJRSERVER_LOG_INFO(g_logger) << "sendfile rt=" << rt << " errno=" << errno;
+    LJRSERVER_ASSERT(rt == (int64_t)size - 100);
+    // 文件比 length 短 返回实际发送的字节数
+    LJRSERVER_ASSERT(ss.sendFile(fd, size - 100, 4096) == 100);
+    // 已经在文件末尾
+    LJRSERVER_ASSERT(ss.sendFile(fd, size, 10) == 0);
+    ss.close();
+    close(fd);
+}
+
+/**
+ * @brief 测试 hook poll/select/epoll_wait 等待期间其他协程照常执行
+ *
+ */
+void test_poll() {
+    int fds[2];
+    LJRSERVER_ASSERT(pipe(fds) == 0);
+
+    // 定时计数 验证调度线程没有被阻塞
+    std::shared_ptr<int> ticks(new int(0));
+    auto ticker = ljrserver::IOManager::GetThis()->addTimer(
+        100, [ticks]() { ++*ticks; }, true);
+
+    // 500ms 后写入管道
+    ljrserver::IOManager::GetThis()->schedule([fds]() {
+        usleep(500 * 1000);
+        write(fds[1], "x", 1);
+    });
+
+    // poll 等待管道可读
+    struct pollfd pfd;
+    pfd.fd = fds[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int rt = poll(&pfd, 1, 2000);
+    LJRSERVER_LOG_INFO(g_logger) << "poll rt=" << rt << " revents="
+                                 << pfd.revents << " ticks=" << *ticks;
+    LJRSERVER_ASSERT(rt == 1 && (pfd.revents & POLLIN));
+    // 等待期间定时器照常执行
+    LJRSERVER_ASSERT(*ticks >= 3);
+
+    char c;
+    LJRSERVER_ASSERT(read(fds[0], &c, 1) == 1 && c == 'x');
+
+    // select 超时
+    fd_set rset;
+    FD_ZERO(&rset);
+    FD_SET(fds[0], &rset);
+    struct timeval tv = {0, 300 * 1000};
+    int before = *ticks;
+    uint64_t start = ljrserver::Clock::NowMS();
+    rt = select(fds[0] + 1, &rset, nullptr, nullptr, &tv);
+    uint64_t used = ljrserver::Clock::NowMS() - start;
+    LJRSERVER_LOG_INFO(g_logger) << "select rt=" << rt << " used=" << used;
+    LJRSERVER_ASSERT(rt == 0 && !FD_ISSET(fds[0], &rset));
+    LJRSERVER_ASSERT(used >= 300);
+    LJRSERVER_ASSERT(*ticks > before);
+
+    // epoll_wait 等待管道可写
+    int epfd = epoll_create1(0);
+    struct epoll_event ev;
+    ev.events = EPOLLOUT;
+    ev.data.fd = fds[1];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fds[1], &ev);
+    rt = epoll_wait(epfd, &ev, 1, 1000);
+    LJRSERVER_LOG_INFO(g_logger) << "epoll_wait rt=" << rt;
+    LJRSERVER_ASSERT(rt == 1 && ev.data.fd == fds[1] && (ev.events & EPOLLOUT));
+
+    ticker->cancel();
+    close(epfd);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/**
+ * @brief 测试 poll 一个别的协程正在 recv 的句柄
+ *
+ * 同一个事件不能注册两次 poll 退化为定时器轮询 不能 assert 终止
+ */
+void test_poll_shared() {
+    int sv[2];
+    LJRSERVER_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    // 注册到句柄管理器 hook 的 recv 才会挂起协程
+    LJRSERVER_ASSERT(ljrserver::FdMgr::GetInstance()->get(sv[0], true));
+
+    // 先阻塞在 recv 上 占用 READ 事件
+    std::shared_ptr<int> received(new int(-1));
+    ljrserver::IOManager::GetThis()->schedule([sv, received]() {
+        char c;
+        *received = recv(sv[0], &c, 1, 0);
+    });
+    // 200ms 后写入两个字节 recv 读走一个 poll 看到剩下的一个
+    ljrserver::IOManager::GetThis()->schedule([sv]() {
+        usleep(200 * 1000);
+        LJRSERVER_ASSERT(write(sv[1], "ab", 2) == 2);
+    });
+    usleep(10 * 1000);
+
+    struct pollfd pfd;
+    pfd.fd = sv[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    uint64_t start = ljrserver::Clock::NowMS();
+    int rt = poll(&pfd, 1, 2000);
+    uint64_t used = ljrserver::Clock::NowMS() - start;
+    LJRSERVER_LOG_INFO(g_logger) << "shared poll rt=" << rt << " revents="
+                                 << pfd.revents << " used=" << used
+                                 << " received=" << *received;
+    LJRSERVER_ASSERT(rt == 1 && (pfd.revents & POLLIN));
+    LJRSERVER_ASSERT(used < 1000);
+    LJRSERVER_ASSERT(*received == 1);
+
+    char c;
+    LJRSERVER_ASSERT(recv(sv[0], &c, 1, 0) == 1 && c == 'b');
+
+    // 没有数据 轮询到超时
+    start = ljrserver::Clock::NowMS();
+    ljrserver::IOManager::GetThis()->schedule([sv, received]() {
+        char c;
+        *received = recv(sv[0], &c, 1, 0);
+    });
+    usleep(10 * 1000);
+    rt = poll(&pfd, 1, 100);
+    used = ljrserver::Clock::NowMS() - start;
+    LJRSERVER_ASSERT(rt == 0 && used >= 100);
+
+    // 关闭对端 recv 返回 0
+    close(sv[1]);
+    usleep(10 * 1000);
+    LJRSERVER_ASSERT(*received == 0);
+    close(sv[0]);
+}
+
 /**
  * @brief 测试
  *
@@ -112,6 +302,19 @@ int main(int argc, char const *argv[]) {
     // 测试 socket
     // test_sock();
 
+    // 测试 sendfile
+    {
+        ljrserver::IOManager iom;
+        iom.schedule(test_sendfile);
+    }
+
+    // 测试 poll
+    {
+        ljrserver::IOManager iom(1);
+        iom.schedule(test_poll);
+        iom.schedule(test_poll_shared);
+    }
+
     // 测试调度
     // IO 调度器
     ljrserver::IOManager iom;
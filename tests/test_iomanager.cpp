@@ -2,6 +2,9 @@
 // #include "../ljrServer/ljrserver.h"
 #include "../ljrServer/iomanager.h"
 #include "../ljrServer/log.h"
+#include "../ljrServer/clock.h"
+#include "../ljrServer/config.h"
+#include "../ljrServer/macro.h"
 
 // string
 #include <string.h>
@@ -10,12 +13,15 @@
 #include <sys/socket.h>
 // fcntl
 #include <fcntl.h>
+// usleep
+#include <unistd.h>
 // 网络
 #include <arpa/inet.h>
 // epoll
 #include <sys/epoll.h>
 // io
 #include <iostream>
+#include <vector>
 
 // 日志
 ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
@@ -132,6 +138,131 @@ void test_timer() {
         true);
 }
 
+/**
+ * @brief 测试定时器 slack 合并唤醒
+ *
+ */
+void test_timer_slack() {
+    // 调度抖动的余量 ms
+    static const uint64_t tolerance = 15;
+
+    // 5 个相隔 3ms 的定时器 允许延后 20ms 合并为一次唤醒
+    std::vector<uint64_t> fired(5, 0);
+    uint64_t start = 0;
+    uint64_t saved = 0;
+    {
+        ljrserver::IOManager iom(1, false, "slack");
+        start = ljrserver::Clock::NowMS();
+        for (int i = 0; i < 5; ++i) {
+            iom.addTimer(
+                100 + i * 3,
+                [&fired, start, i]() {
+                    fired[i] = ljrserver::Clock::NowMS() - start;
+                },
+                false, 20);
+        }
+        iom.addTimer(300, [&iom, &saved]() { saved = iom.getSavedWakeups(); });
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        LJRSERVER_LOG_INFO(g_logger)
+            << "slack timer i = " << i << " fired = " << fired[i] << "ms";
+        // 不会提前执行 也不会超过 slack 允许的时间
+        LJRSERVER_ASSERT(fired[i] >= 100u + i * 3);
+        LJRSERVER_ASSERT(fired[i] <= 100u + i * 3 + 20 + tolerance);
+    }
+    LJRSERVER_LOG_INFO(g_logger) << "saved wakeups = " << saved;
+    // 至少合并了一次唤醒
+    LJRSERVER_ASSERT(saved >= 1);
+
+    // 新定时器排在带 slack 的定时器之后 但早于计划的唤醒时间
+    // 需要 tickle 否则会推迟到 slack 定时器的唤醒时间才执行
+    uint64_t late_fired = 0;
+    {
+        ljrserver::IOManager iom(1, false, "slack_late");
+        start = ljrserver::Clock::NowMS();
+        iom.addTimer(50, []() {}, false, 200);
+        // 等待调度线程按 250ms 进入 epoll_wait
+        usleep(10 * 1000);
+        start = ljrserver::Clock::NowMS();
+        iom.addTimer(100, [&late_fired, start]() {
+            late_fired = ljrserver::Clock::NowMS() - start;
+        });
+        // 析构时的 stop 也会 tickle 等定时器执行完再退出
+        usleep(300 * 1000);
+    }
+    LJRSERVER_LOG_INFO(g_logger) << "late timer fired = " << late_fired << "ms";
+    LJRSERVER_ASSERT(late_fired >= 100);
+    LJRSERVER_ASSERT(late_fired <= 100 + tolerance);
+}
+
+/**
+ * @brief 测试高精度定时器 timerfd
+ *
+ */
+void test_hires_timer() {
+    ljrserver::Config::Lookup<bool>("iomanager.hires_timer")->setValue(true);
+
+    // 亚毫秒级的定时器
+    static const uint64_t delays[] = {300, 800, 1500, 2500};
+    static const size_t count = sizeof(delays) / sizeof(delays[0]);
+    std::vector<uint64_t> fired(count, 0);
+    std::vector<size_t> order;
+
+    uint64_t start = 0;
+    {
+        ljrserver::IOManager iom(1, false, "hires");
+        LJRSERVER_ASSERT(iom.isHighResolution());
+
+        start = ljrserver::Clock::NowUS();
+        for (size_t i = 0; i < count; ++i) {
+            iom.addTimerUS(delays[i], [&fired, &order, start, i]() {
+                fired[i] = ljrserver::Clock::NowUS() - start;
+                order.push_back(i);
+            });
+        }
+
+        // 之前的定时器全部执行完毕
+        iom.addTimer(20, [&iom]() { LJRSERVER_ASSERT(!iom.hasTimer()); });
+    }
+
+    LJRSERVER_ASSERT(order.size() == count);
+    for (size_t i = 0; i < count; ++i) {
+        LJRSERVER_LOG_INFO(g_logger)
+            << "hires timer delay = " << delays[i] << "us fired = " << fired[i]
+            << "us";
+        LJRSERVER_ASSERT(order[i] == i);
+        // 不会提前执行 误差在 ms 以内 (留出调度抖动的余量)
+        LJRSERVER_ASSERT(fired[i] >= delays[i]);
+        LJRSERVER_ASSERT(fired[i] < delays[i] + 1000);
+    }
+
+    ljrserver::Config::Lookup<bool>("iomanager.hires_timer")->setValue(false);
+}
+
+/**
+ * @brief 测试任务不断时时间缓存也会刷新
+ *
+ */
+void test_coarse_clock() {
+    int64_t diff = -1;
+    {
+        ljrserver::IOManager iom(1, false, "coarse");
+        // 定时器在 idle 中触发 线程已经开始维护时间缓存
+        iom.addTimer(10, [&iom, &diff]() {
+            // 忙等不让出 下一个任务直接执行 中间不进入 idle
+            uint64_t start = ljrserver::Clock::NowMS();
+            while (ljrserver::Clock::NowMS() - start < 500) {
+            }
+            iom.schedule([&diff]() {
+                diff = ljrserver::Clock::NowMS() - ljrserver::Clock::CoarseMS();
+            });
+        });
+    }
+    LJRSERVER_LOG_INFO(g_logger) << "coarse clock diff = " << diff << "ms";
+    LJRSERVER_ASSERT(diff >= 0 && diff < 100);
+}
+
 /**
  * @brief 测试
  *
@@ -146,5 +277,14 @@ int main(int argc, char const *argv[]) {
     // 测试定时器
     // test_timer();
 
+    // 测试定时器合并唤醒
+    test_timer_slack();
+
+    // 测试高精度定时器
+    test_hires_timer();
+
+    // 测试时间缓存
+    test_coarse_clock();
+
     return 0;
 }
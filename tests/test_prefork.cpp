@@ -0,0 +1,122 @@
+/**
+ * @file test_prefork.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试 prefork 工作进程异常退出后重启 共享的工作进程信息
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/daemon.h"
+#include "../ljrServer/config.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/macro.h"
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+// 工作进程个数
+static const uint32_t s_workers = 2;
+
+/**
+ * @brief 工作进程每次启动的记录 放在共享内存中 主进程检查
+ *
+ */
+struct WorkerRun {
+    // 进程 id
+    pid_t pid = 0;
+    // 看到的 WorkerInfo 序号
+    uint32_t index = ~0u;
+    // 看到的重启次数
+    uint32_t restart_count = ~0u;
+    // 看到的上一次进程留下的接受连接数
+    uint64_t accepted = ~0ull;
+};
+
+// [工作进程序号][第几次启动]
+static WorkerRun (*s_runs)[2] = nullptr;
+
+/**
+ * @brief 工作进程 第一次启动异常退出 重启后正常退出
+ *
+ * @param index 工作进程序号
+ * @return int
+ */
+int worker_main(uint32_t index) {
+    ljrserver::WorkerInfo *info = ljrserver::GetWorkerInfo();
+    LJRSERVER_ASSERT(info);
+
+    // 主进程 fork 返回后才写入 pid
+    for (int i = 0; i < 1000 && info->pid != getpid(); ++i) {
+        usleep(1000);
+    }
+    LJRSERVER_ASSERT(info->pid == getpid());
+
+    uint32_t n = info->restart_count;
+    LJRSERVER_ASSERT(n < 2);
+    WorkerRun &run = s_runs[index][n];
+    run.pid = getpid();
+    run.index = info->index;
+    run.restart_count = n;
+    run.accepted = info->accepted;
+
+    if (n == 0) {
+        // 统计写在共享内存中 重启后还在
+        info->accepted += 1;
+        LJRSERVER_LOG_INFO(g_logger) << "worker crash " << info->toString();
+        ljrserver::LoggerMgr::GetInstance()->flush();
+        _exit(1);
+    }
+    LJRSERVER_LOG_INFO(g_logger) << "worker done " << info->toString();
+    return 0;
+}
+
+/**
+ * @brief 测试
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char **argv) {
+    // 1 秒后重启 不输出汇总统计
+    ljrserver::Config::Lookup<uint32_t>("daemon.restart_interval")->setValue(1);
+    ljrserver::Config::Lookup<uint32_t>("daemon.stats_interval")->setValue(0);
+
+    void *mem = mmap(nullptr, sizeof(WorkerRun) * 2 * s_workers,
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    LJRSERVER_ASSERT(mem != MAP_FAILED);
+    s_runs = (WorkerRun(*)[2])mem;
+    for (uint32_t i = 0; i < 2 * s_workers; ++i) {
+        new (&s_runs[i / 2][i % 2]) WorkerRun();
+    }
+
+    uint64_t start = time(0);
+    int rt = ljrserver::start_prefork(s_workers, worker_main);
+    if (ljrserver::GetWorkerInfo()) {
+        // 工作进程
+        ljrserver::LoggerMgr::GetInstance()->flush();
+        _exit(rt);
+    }
+
+    // 主进程 所有工作进程正常退出后返回
+    LJRSERVER_ASSERT(rt == 0);
+    LJRSERVER_ASSERT(time(0) - start >= 1);
+    for (uint32_t i = 0; i < s_workers; ++i) {
+        const WorkerRun &first = s_runs[i][0];
+        const WorkerRun &second = s_runs[i][1];
+        LJRSERVER_ASSERT(first.index == i && second.index == i);
+        LJRSERVER_ASSERT(first.restart_count == 0);
+        LJRSERVER_ASSERT(second.restart_count == 1);
+        LJRSERVER_ASSERT(first.pid > 0 && second.pid > 0);
+        LJRSERVER_ASSERT(first.pid != second.pid);
+        LJRSERVER_ASSERT(first.accepted == 0 && second.accepted == 1);
+    }
+    LJRSERVER_ASSERT(s_runs[0][0].pid != s_runs[1][0].pid);
+    LJRSERVER_LOG_INFO(g_logger) << "prefork respawn ok";
+
+    munmap(mem, sizeof(WorkerRun) * 2 * s_workers);
+    return 0;
+}
@@ -0,0 +1,317 @@
+/**
+ * @file test_ssl.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试 tls 服务器 会话恢复 kTLS sendFile 读写协程并发
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/ssl_socket.h"
+#include "../ljrServer/socket_stream.h"
+#include "../ljrServer/tcp_server.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/iomanager.h"
+#include "../ljrServer/macro.h"
+#include "../ljrServer/config.h"
+#include "../ljrServer/util.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+// 自签名证书 私钥 发送的文件
+static const char *s_cert_file = "/tmp/ljrserver_test_ssl.crt";
+static const char *s_key_file = "/tmp/ljrserver_test_ssl.key";
+static const char *s_data_file = "/tmp/ljrserver_test_ssl.dat";
+
+// 发送的文件大小
+static const size_t s_file_size = 1024 * 1024 + 123;
+
+/**
+ * @brief 生成 P-256 自签名证书
+ *
+ * @return true
+ * @return false
+ */
+static bool gen_cert() {
+    EVP_PKEY *pkey = EVP_EC_gen("P-256");
+    X509 *x509 = X509_new();
+    if (!pkey || !x509) {
+        return false;
+    }
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x509), 3600);
+    X509_set_pubkey(x509, pkey);
+    X509_NAME *name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               (const unsigned char *)"localhost", -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    X509_sign(x509, pkey, EVP_sha256());
+
+    FILE *fp = fopen(s_cert_file, "w");
+    PEM_write_X509(fp, x509);
+    fclose(fp);
+    fp = fopen(s_key_file, "w");
+    PEM_write_PrivateKey(fp, pkey, nullptr, nullptr, 0, nullptr, nullptr);
+    fclose(fp);
+
+    X509_free(x509);
+    EVP_PKEY_free(pkey);
+    return true;
+}
+
+/**
+ * @brief 生成发送的文件 内容为 i % 251
+ *
+ */
+static void gen_file() {
+    std::string data(s_file_size, 0);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = i % 251;
+    }
+    int fd = open(s_data_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    write(fd, data.data(), data.size());
+    close(fd);
+}
+
+/**
+ * @brief tls echo 服务器 收到 "file" 时 sendFile 发回文件
+ *
+ */
+class EchoServer : public ljrserver::TcpServer {
+protected:
+    void handleClient(ljrserver::Socket::ptr client) override {
+        LJRSERVER_LOG_INFO(g_logger) << "handleClient " << *client;
+        char buf[4096];
+        while (true) {
+            int rt = client->recv(buf, sizeof(buf));
+            if (rt <= 0) {
+                break;
+            }
+            if (rt == 4 && memcmp(buf, "file", 4) == 0) {
+                int fd = open(s_data_file, O_RDONLY);
+                ljrserver::SocketStream ss(client, false);
+                int64_t n = ss.sendFile(fd, 0, s_file_size);
+                close(fd);
+                LJRSERVER_LOG_INFO(g_logger) << "sendFile " << n << " " << *client;
+                continue;
+            }
+            client->send(buf, rt);
+        }
+        client->close();
+    }
+};
+
+/**
+ * @brief 连接一次 发送 hello 收到回显
+ *
+ * @param addr 服务器地址
+ * @param host 主机名 客户端会话缓存的键
+ * @return ljrserver::SslSocket::ptr 连接的 socket
+ */
+static ljrserver::SslSocket::ptr echo_once(
+    ljrserver::Address::ptr addr, const std::string &host = "localhost") {
+    ljrserver::SslSocket::ptr sock = ljrserver::SslSocket::CreateTCP(addr);
+    sock->setHostname(host);
+    LJRSERVER_ASSERT(sock->connect(addr));
+
+    const char msg[] = "hello tls";
+    LJRSERVER_ASSERT(sock->send(msg, sizeof(msg)) == sizeof(msg));
+    char buf[64];
+    int rt = sock->recv(buf, sizeof(buf));
+    LJRSERVER_ASSERT(rt == sizeof(msg) && memcmp(buf, msg, rt) == 0);
+
+    LJRSERVER_LOG_INFO(g_logger)
+        << "echo ok version = " << sock->getVersion()
+        << " cipher = " << sock->getCipher()
+        << " reused = " << sock->isSessionReused()
+        << " ktls_send = " << sock->isKtlsSend()
+        << " ktls_recv = " << sock->isKtlsRecv();
+    return sock;
+}
+
+/**
+ * @brief 不支持的 flags 和 MSG_DONTWAIT
+ *
+ * @param sock 已握手的 socket
+ */
+static void test_flags(ljrserver::SslSocket::ptr sock) {
+    char buf[64];
+    errno = 0;
+    LJRSERVER_ASSERT(sock->send("x", 1, MSG_OOB) == -1 && errno == EOPNOTSUPP);
+    errno = 0;
+    LJRSERVER_ASSERT(sock->recv(buf, sizeof(buf), MSG_WAITALL) == -1 &&
+                     errno == EOPNOTSUPP);
+
+    // 没有数据 不等待
+    errno = 0;
+    LJRSERVER_ASSERT(sock->recv(buf, sizeof(buf), MSG_DONTWAIT) == -1 &&
+                     errno == EAGAIN);
+
+    // MSG_NOSIGNAL 正常发送
+    LJRSERVER_ASSERT(sock->send("flags", 5, MSG_NOSIGNAL) == 5);
+    LJRSERVER_ASSERT(sock->recv(buf, sizeof(buf), MSG_PEEK) == 5);
+    LJRSERVER_ASSERT(sock->recv(buf, sizeof(buf)) == 5);
+    LJRSERVER_ASSERT(memcmp(buf, "flags", 5) == 0);
+}
+
+/**
+ * @brief 一个协程写 另一个协程同时读 回显的数据完整
+ *
+ * 数据超过 socket 缓冲 读写必须同时进行
+ *
+ * @param sock 已握手的 socket
+ */
+static void test_duplex(ljrserver::SslSocket::ptr sock) {
+    static const size_t size = 4 * 1024 * 1024;
+    std::shared_ptr<bool> done(new bool(false));
+
+    ljrserver::IOManager::GetThis()->schedule([sock, done]() {
+        std::string buf(64 * 1024, 0);
+        size_t total = 0;
+        while (total < size) {
+            int rt = sock->recv(&buf[0], buf.size());
+            LJRSERVER_ASSERT(rt > 0);
+            for (int i = 0; i < rt; ++i) {
+                LJRSERVER_ASSERT((unsigned char)buf[i] == (total + i) % 253);
+            }
+            total += rt;
+        }
+        *done = true;
+    });
+
+    std::string data(10000, 0);
+    size_t offset = 0;
+    while (offset < size) {
+        size_t n = std::min(data.size(), size - offset);
+        for (size_t i = 0; i < n; ++i) {
+            data[i] = (char)((offset + i) % 253);
+        }
+        LJRSERVER_ASSERT(sock->send(data.data(), n) == (int)n);
+        offset += n;
+    }
+    while (!*done) {
+        usleep(10 * 1000);
+    }
+    LJRSERVER_LOG_INFO(g_logger) << "duplex ok " << size << " bytes";
+}
+
+/**
+ * @brief 服务器不回应握手 等待握手的协程按接收超时返回
+ *
+ */
+static void test_handshake_timeout() {
+    // 只监听不接受 握手没有回应
+    auto addr = ljrserver::IPv4Address::Create("127.0.0.1", 18041);
+    auto listener = ljrserver::Socket::CreateTCP(addr);
+    LJRSERVER_ASSERT(listener->bind(addr) && listener->listen());
+
+    ljrserver::SslSocket::ptr sock = ljrserver::SslSocket::CreateTCP(addr);
+    // 先绑定创建句柄 才能设置超时
+    LJRSERVER_ASSERT(
+        sock->bind(ljrserver::IPv4Address::Create("127.0.0.1", 0)));
+    sock->setRecvTimeout(300);
+    std::shared_ptr<int> waited(new int(0));
+    uint64_t start = ljrserver::GetCurrentMS();
+    // 连接的协程握手时 另一个协程读 等待握手结束
+    ljrserver::IOManager::GetThis()->schedule([sock, waited]() {
+        LJRSERVER_ASSERT(sock->recv(waited.get(), 1) == -1);
+        *waited = 1;
+    });
+    LJRSERVER_ASSERT(!sock->connect(addr));
+    while (!*waited) {
+        usleep(10 * 1000);
+    }
+    uint64_t used = ljrserver::GetCurrentMS() - start;
+    LJRSERVER_LOG_INFO(g_logger) << "handshake timeout used = " << used;
+    LJRSERVER_ASSERT(used >= 300 && used < 2000);
+    listener->close();
+}
+
+/**
+ * @brief 客户端会话缓存淘汰最久没有使用的服务器
+ *
+ * @param addr 服务器地址
+ */
+static void test_session_lru(ljrserver::Address::ptr addr) {
+    auto size = ljrserver::Config::Lookup<uint32_t>(
+        "ssl.client_session_cache_size");
+    uint32_t old_size = size->getValue();
+    size->setValue(2);
+
+    echo_once(addr, "a.lru")->close();
+    echo_once(addr, "b.lru")->close();
+    // 使用 a 之后 b 是最久没有使用的
+    auto sock = echo_once(addr, "a.lru");
+    LJRSERVER_ASSERT(sock->isSessionReused());
+    sock->close();
+    echo_once(addr, "c.lru")->close();
+
+    sock = echo_once(addr, "a.lru");
+    LJRSERVER_ASSERT(sock->isSessionReused());
+    sock->close();
+    sock = echo_once(addr, "b.lru");
+    LJRSERVER_ASSERT(!sock->isSessionReused());
+    sock->close();
+
+    size->setValue(old_size);
+    LJRSERVER_LOG_INFO(g_logger) << "session lru ok";
+}
+
+void run() {
+    LJRSERVER_ASSERT(gen_cert());
+    gen_file();
+
+    EchoServer::ptr server(new EchoServer);
+    LJRSERVER_ASSERT(server->loadCertificates(s_cert_file, s_key_file));
+    auto addr = ljrserver::IPv4Address::Create("127.0.0.1", 18040);
+    if (!server->bind(addr)) {
+        return;
+    }
+    server->start();
+
+    // 第一次完整握手 第二次恢复会话
+    auto first = echo_once(addr);
+    first->close();
+    auto second = echo_once(addr);
+    LJRSERVER_LOG_INFO(g_logger)
+        << "session reused = " << second->isSessionReused();
+    LJRSERVER_ASSERT(second->isSessionReused());
+
+    // sendFile 内核不支持 kTLS 时用户态加密
+    LJRSERVER_ASSERT(second->send("file", 4) == 4);
+    std::string data(s_file_size, 0);
+    ljrserver::SocketStream ss(second, false);
+    LJRSERVER_ASSERT(ss.readFixSize(&data[0], data.size()) > 0);
+    for (size_t i = 0; i < data.size(); ++i) {
+        LJRSERVER_ASSERT((unsigned char)data[i] == i % 251);
+    }
+    LJRSERVER_LOG_INFO(g_logger) << "sendFile ok " << data.size() << " bytes";
+
+    test_flags(second);
+    test_duplex(second);
+    second->close();
+
+    test_session_lru(addr);
+    test_handshake_timeout();
+
+    server->stop();
+}
+
+int main(int argc, char **argv) {
+    // 对端关闭后写不触发 SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    ljrserver::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file test_stream.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试 带缓存的流
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/buffered_stream.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/macro.h"
+#include "memory_stream.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+/**
+ * @brief 测试 预读 readLine readUntil
+ *
+ */
+void test_read() {
+    std::string input;
+    for (int i = 0; i < 100; ++i) {
+        input += "line " + std::to_string(i) + "\r\n";
+    }
+    input += "tail";
+    // 每次只能读到 7 字节 分隔符会跨两次读取
+    MemoryStream::ptr ms(new MemoryStream(input, 7));
+    ljrserver::BufferedStream::ptr bs(new ljrserver::BufferedStream(ms, 64));
+
+    for (int i = 0; i < 100; ++i) {
+        const char *data = nullptr;
+        int len = bs->readUntil("\r\n", 2, data);
+        std::string expect = "line " + std::to_string(i) + "\r\n";
+        LJRSERVER_ASSERT(len == (int)expect.size());
+        LJRSERVER_ASSERT(std::string(data, len) == expect);
+    }
+    const char *data = nullptr;
+    LJRSERVER_ASSERT(bs->peek(data, 4) == 4 && memcmp(data, "tail", 4) == 0);
+    // 没有分隔符 对端关闭
+    LJRSERVER_ASSERT(bs->readLine(data) == 0);
+
+    // 超过上限
+    ms.reset(new MemoryStream(std::string(100, 'x') + "\n", 100));
+    bs.reset(new ljrserver::BufferedStream(ms, 64));
+    LJRSERVER_ASSERT(bs->readLine(data) == -1 && errno == EMSGSIZE);
+
+    // 大块读取不经过缓存
+    ms.reset(new MemoryStream(std::string(1000, 'y'), 1000));
+    bs.reset(new ljrserver::BufferedStream(ms, 64));
+    std::string buf(1000, 0);
+    LJRSERVER_ASSERT(bs->readFixSize(&buf[0], buf.size()) == 1000);
+    LJRSERVER_ASSERT(ms->m_reads == 1 && buf == std::string(1000, 'y'));
+    LJRSERVER_LOG_INFO(g_logger) << "test_read ok";
+}
+
+/**
+ * @brief 测试 小块写入合并
+ *
+ */
+void test_write() {
+    MemoryStream::ptr ms(new MemoryStream("", 0));
+    ljrserver::BufferedStream::ptr bs(new ljrserver::BufferedStream(ms, 64, 64));
+    std::string expect;
+    for (int i = 0; i < 10; ++i) {
+        std::string s = "w" + std::to_string(i) + ";";
+        bs->write(s.data(), s.size());
+        expect += s;
+    }
+    LJRSERVER_ASSERT(ms->m_writes == 0);
+    LJRSERVER_ASSERT(bs->flush());
+    LJRSERVER_ASSERT(ms->m_writes == 1 && ms->m_output == expect);
+
+    // 大块数据先发送缓存 再直接写入
+    std::string big(100, 'z');
+    bs->write("head", 4);
+    bs->writeFixSize(big.data(), big.size());
+    LJRSERVER_ASSERT(ms->m_writes == 3);
+    LJRSERVER_ASSERT(ms->m_output == expect + "head" + big);
+    LJRSERVER_LOG_INFO(g_logger) << "test_write ok";
+}
+
+/**
+ * @brief 测试 分散写入 部分写入后继续
+ *
+ */
+void test_writev() {
+    std::string head = "head:";
+    std::string body(1000, 'b');
+    std::string tail = ":tail";
+    iovec iovs[4];
+    iovs[0] = {(void *)head.data(), head.size()};
+    iovs[1] = {nullptr, 0};
+    iovs[2] = {(void *)body.data(), body.size()};
+    iovs[3] = {(void *)tail.data(), tail.size()};
+
+    // 每次只能写 7 字节
+    MemoryStream::ptr ms(new MemoryStream("", 0));
+    ms->m_writeChunk = 7;
+    int rt = ms->writeFixSizeV(iovs, 4);
+    LJRSERVER_ASSERT(rt == (int)(head.size() + body.size() + tail.size()));
+    LJRSERVER_ASSERT(ms->m_output == head + body + tail);
+
+    // 小块攒在缓存中 超过阈值时和缓存一起写入
+    ms.reset(new MemoryStream("", 0));
+    ljrserver::BufferedStream::ptr bs(new ljrserver::BufferedStream(ms, 64, 64));
+    LJRSERVER_ASSERT(bs->writeFixSizeV(iovs, 2) == (int)head.size());
+    LJRSERVER_ASSERT(ms->m_writes == 0 && bs->getWriteSize() == head.size());
+    LJRSERVER_ASSERT(bs->writeFixSizeV(iovs + 2, 2) ==
+                     (int)(body.size() + tail.size()));
+    LJRSERVER_ASSERT(bs->getWriteSize() == 0);
+    LJRSERVER_ASSERT(ms->m_output == head + body + tail);
+    LJRSERVER_LOG_INFO(g_logger) << "test_writev ok";
+}
+
+int main(int argc, char **argv) {
+    test_read();
+    test_write();
+    test_writev();
+    return 0;
+}
@@ -1,41 +1,427 @@
+/**
+ * @file test_tcpserver.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试 tcp 服务器
+ * @version 0.1
+ * @date 2022-02-20
+ */
 
 #include "../ljrServer/tcp_server.h"
-// #include "../ljrServer/iomanager.h"
+#include "../ljrServer/iomanager.h"
+#include "../ljrServer/fd_manager.h"
+#include "../ljrServer/util.h"
 #include "../ljrServer/log.h"
+#include "../ljrServer/macro.h"
+
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
 
 // 日志
 static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
 
 /**
- * @brief 测试 tcp 服务器
+ * @brief 测试用的 tcp 服务器 收到 ping 回复 pong 对端关闭后返回
+ *
+ * 记录处理连接的线程
+ */
+class EchoServer : public ljrserver::TcpServer {
+public:
+    typedef std::shared_ptr<EchoServer> ptr;
+
+    EchoServer(ljrserver::IOManager *worker)
+        : ljrserver::TcpServer(worker, worker) {}
+
+    /**
+     * @brief 各线程处理的连接数
+     *
+     * @return std::map<int, int> 线程 id -> 连接数
+     */
+    std::map<int, int> getThreads() {
+        ljrserver::Mutex::Lock lock(m_mutex);
+        return m_threads;
+    }
+
+    /**
+     * @brief 接受的连接
+     *
+     * @return std::vector<ljrserver::Socket::ptr>
+     */
+    std::vector<ljrserver::Socket::ptr> getClients() {
+        ljrserver::Mutex::Lock lock(m_mutex);
+        return m_clients;
+    }
+
+protected:
+    void handleClient(ljrserver::Socket::ptr client) override {
+        {
+            ljrserver::Mutex::Lock lock(m_mutex);
+            ++m_threads[ljrserver::GetThreadId()];
+            m_clients.push_back(client);
+        }
+        char buf[4];
+        while (client->recv(buf, sizeof(buf), MSG_WAITALL) == 4) {
+            if (memcmp(buf, "ping", 4) || client->send("pong", 4) != 4) {
+                break;
+            }
+        }
+        client->close();
+    }
+
+private:
+    ljrserver::Mutex m_mutex;
+    std::map<int, int> m_threads;
+    std::vector<ljrserver::Socket::ptr> m_clients;
+};
+
+/**
+ * @brief 等待条件成立 最多 timeout_ms
+ *
+ * @param cond
+ * @param timeout_ms
+ * @return bool
+ */
+static bool wait_for(std::function<bool()> cond, int timeout_ms = 2000) {
+    for (int i = 0; i < timeout_ms / 10 && !cond(); ++i) {
+        usleep(10 * 1000);
+    }
+    return cond();
+}
+
+/**
+ * @brief 在调度器中执行 等待执行完成
+ *
+ * 监听 socket 要在开启 hook 的线程中创建 才会加入句柄管理器
+ *
+ * @param iom 调度器
+ * @param cb
+ */
+static void run_in(ljrserver::IOManager *iom, std::function<void()> cb) {
+    ljrserver::Semaphore sem;
+    iom->schedule([cb, &sem]() {
+        cb();
+        sem.notify();
+    });
+    sem.wait();
+}
+
+/**
+ * @brief 测试每个工作线程一个 SO_REUSEPORT 监听 socket
+ *
+ * @param iom 工作调度器
+ * @param cbpf 是否按收包的 CPU 分配连接
+ */
+void test_reuse_port(ljrserver::IOManager *iom, bool cbpf) {
+    const std::vector<int> &threads = iom->getThreadIds();
+
+    EchoServer::ptr server(new EchoServer(iom));
+    server->setReusePort(true);
+    server->setReusePortCbpf(cbpf);
+    auto addr = ljrserver::Address::LookupAny("127.0.0.1:0");
+    run_in(iom, [server, addr]() { LJRSERVER_ASSERT(server->bind(addr)); });
+
+    // 每个工作线程一个监听 socket 端口相同
+    auto &socks = server->getSocks();
+    LJRSERVER_ASSERT(socks.size() == threads.size());
+    auto local = socks[0]->getLocalAddress();
+    for (auto &sock : socks) {
+        int reuse = 0;
+        LJRSERVER_ASSERT(sock->getOption(SOL_SOCKET, SO_REUSEPORT, reuse));
+        LJRSERVER_ASSERT(reuse == 1);
+        LJRSERVER_ASSERT(sock->getLocalAddress()->toString() ==
+                         local->toString());
+    }
+
+    // 还没有 accept 连接留在内核分配的监听 socket 的队列中
+    // 回环连接在发送的 CPU 上收包 固定客户端的 CPU
+    int cpu = ljrserver::GetAllowedCpus()[0];
+    cpu_set_t set;
+    cpu_set_t old;
+    pthread_getaffinity_np(pthread_self(), sizeof(old), &old);
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    const int clients = 32;
+    std::vector<ljrserver::Socket::ptr> conns;
+    for (int i = 0; i < clients; ++i) {
+        auto sock = ljrserver::Socket::CreateTCP(local);
+        LJRSERVER_ASSERT(sock->connect(local, 1000));
+        conns.push_back(sock);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(old), &old);
+
+    // 有连接排队的监听 socket 可读
+    size_t ready = 0;
+    for (size_t i = 0; i < socks.size(); ++i) {
+        pollfd pfd = {socks[i]->getSocket(), POLLIN, 0};
+        if (poll(&pfd, 1, 0) == 1) {
+            ++ready;
+            if (cbpf) {
+                // cbpf 全部交给 CPU 对应的 socket
+                LJRSERVER_ASSERT(i == cpu % socks.size());
+            }
+        }
+    }
+    LJRSERVER_ASSERT(ready >= 1);
+    if (cbpf) {
+        LJRSERVER_ASSERT(ready == 1);
+    }
+
+    // 开始 accept 每个连接都能收发
+    run_in(iom, [server]() { LJRSERVER_ASSERT(server->start()); });
+    for (auto &sock : conns) {
+        sock->setRecvTimeout(1000);
+        char buf[4];
+        LJRSERVER_ASSERT(sock->send("ping", 4) == 4);
+        LJRSERVER_ASSERT(sock->recv(buf, sizeof(buf), MSG_WAITALL) == 4);
+        LJRSERVER_ASSERT(memcmp(buf, "pong", 4) == 0);
+    }
+
+    // 连接在工作线程上处理
+    auto handled = server->getThreads();
+    int total = 0;
+    for (auto &i : handled) {
+        LJRSERVER_ASSERT(std::find(threads.begin(), threads.end(), i.first) !=
+                         threads.end());
+        total += i.second;
+    }
+    LJRSERVER_ASSERT(total == clients);
+    LJRSERVER_ASSERT(server->getAcceptedCount() == (uint64_t)clients);
+
+    for (auto &sock : conns) {
+        sock->close();
+    }
+    LJRSERVER_ASSERT(wait_for([server]() {
+        return server->getConnectionCount() == 0;
+    }));
+    server->stop();
+    LJRSERVER_LOG_INFO(g_logger)
+        << "test_reuse_port cbpf=" << cbpf << " ready=" << ready << " ok";
+}
+
+/**
+ * @brief 客户端发 ping 等待 pong
  *
+ * @param sock 客户端
+ * @param timeout_ms 接收超时
+ * @return bool 是否收到 pong
  */
-void run() {
-    // 监听地址
-    auto addr = ljrserver::Address::LookupAny("0.0.0.0:8033");
-    // auto addr2 = ljrserver::UnixAddress::ptr(
-    //     new ljrserver::UnixAddress("/tmp/unix_addr"));
+static bool ping(ljrserver::Socket::ptr sock, int timeout_ms = 1000) {
+    sock->setRecvTimeout(timeout_ms);
+    char buf[4];
+    return sock->send("ping", 4) == 4 &&
+           sock->recv(buf, sizeof(buf), MSG_WAITALL) == 4 &&
+           memcmp(buf, "pong", 4) == 0;
+}
 
-    // LJRSERVER_LOG_INFO(g_logger) << *addr << " - " << *addr2;
+/**
+ * @brief 测试 acceptBatch 一次取完 backlog 中已完成的连接
+ *
+ * @param iom 工作调度器
+ */
+void test_accept_batch(ljrserver::IOManager *iom) {
+    ljrserver::Socket::ptr listener;
+    ljrserver::Address::ptr local;
+    run_in(iom, [&listener, &local]() {
+        auto addr = ljrserver::Address::LookupAny("127.0.0.1:0");
+        listener = ljrserver::Socket::CreateTCP(addr);
+        LJRSERVER_ASSERT(listener->bind(addr) && listener->listen());
+        local = listener->getLocalAddress();
+    });
+
+    // 连接排队在 backlog 中
+    const size_t count = 5;
+    std::vector<ljrserver::Socket::ptr> conns;
+    std::vector<std::string> ports;
+    for (size_t i = 0; i < count; ++i) {
+        auto sock = ljrserver::Socket::CreateTCP(local);
+        LJRSERVER_ASSERT(sock->connect(local, 1000));
+        conns.push_back(sock);
+        ports.push_back(sock->getLocalAddress()->toString());
+    }
+
+    std::vector<ljrserver::Socket::ptr> clients;
+    run_in(iom, [listener, &clients]() {
+        // 最多取 2 个 剩下的 3 个一次取完 backlog 空了不再等待
+        LJRSERVER_ASSERT(listener->acceptBatch(clients, 2) == 2);
+        LJRSERVER_ASSERT(clients.size() == 2);
+        LJRSERVER_ASSERT(listener->acceptBatch(clients, 32) == 3);
+        LJRSERVER_ASSERT(clients.size() == 5);
+    });
 
-    LJRSERVER_LOG_INFO(g_logger) << *addr;
+    // 远程地址取自 accept4 和客户端的本机地址一致 新连接已加入句柄管理器
+    for (size_t i = 0; i < count; ++i) {
+        LJRSERVER_ASSERT(clients[i]->getRemoteAddress()->toString() ==
+                         ports[i]);
+        auto ctx = ljrserver::FdMgr::GetInstance()->get(clients[i]->getSocket());
+        LJRSERVER_ASSERT(ctx && ctx->isSocket() && ctx->getSysNonblock());
+        conns[i]->close();
+    }
+    // 在开启 hook 的线程关闭 从句柄管理器中删除
+    run_in(iom, [listener, &clients]() {
+        for (auto &client : clients) {
+            client->close();
+        }
+        listener->close();
+    });
+    LJRSERVER_LOG_INFO(g_logger) << "test_accept_batch ok";
+}
 
-    std::vector<ljrserver::Address::ptr> addrs;
-    std::vector<ljrserver::Address::ptr> fails;
-    addrs.push_back(addr);
-    // addrs.push_back(addr2);
+/**
+ * @brief 测试连接数上限 达到上限暂停 accept 连接关闭后恢复
+ *
+ * @param iom 工作调度器
+ */
+void test_max_connections(ljrserver::IOManager *iom) {
+    const uint64_t max_conns = 4;
+    const size_t count = 10;
 
-    // tcp 服务器
-    ljrserver::TcpServer::ptr tcp_server(new ljrserver::TcpServer);
+    EchoServer::ptr server(new EchoServer(iom));
+    server->setMaxConnections(max_conns);
+    server->setAcceptBatch(32);
+    auto addr = ljrserver::Address::LookupAny("127.0.0.1:0");
+    run_in(iom, [server, addr]() {
+        LJRSERVER_ASSERT(server->bind(addr) && server->start());
+    });
+    auto local = server->getSocks()[0]->getLocalAddress();
 
-    // 循环绑定地址
-    while (!tcp_server->bind(addrs, fails)) {
-        // 失败则等待 2s
-        sleep(2);
+    // 超过上限的连接留在 backlog 中
+    std::vector<ljrserver::Socket::ptr> conns;
+    for (size_t i = 0; i < count; ++i) {
+        auto sock = ljrserver::Socket::CreateTCP(local);
+        LJRSERVER_ASSERT(sock->connect(local, 1000));
+        conns.push_back(sock);
     }
+    LJRSERVER_ASSERT(wait_for([server, max_conns]() {
+        return server->getConnectionCount() == max_conns &&
+               server->getPausedCount() >= 1;
+    }));
+    // 一批最多取到上限 先完成的连接先被 accept
+    LJRSERVER_ASSERT(server->getAcceptedCount() == max_conns);
+    LJRSERVER_ASSERT(server->getRejectedCount() == 0);
+    for (size_t i = 0; i < max_conns; ++i) {
+        LJRSERVER_ASSERT(ping(conns[i]));
+    }
+    // 暂停期间没有被处理
+    LJRSERVER_ASSERT(!ping(conns[max_conns], 100));
+
+    // 关闭两个连接 恢复 accept 再接受两个
+    conns[0]->close();
+    conns[1]->close();
+    LJRSERVER_ASSERT(wait_for([server, max_conns]() {
+        return server->getAcceptedCount() == max_conns + 2;
+    }));
+    LJRSERVER_ASSERT(server->getConnectionCount() == max_conns);
+    uint64_t paused = server->getPausedCount();
+    LJRSERVER_ASSERT(paused >= 2);
+
+    // 依次关闭 剩下的连接全部被处理
+    for (size_t i = 2; i < count; ++i) {
+        if (i >= max_conns) {
+            // 前面暂停时已经发过 ping 还没有收到的 pong 先读出来
+            char buf[4];
+            if (i == max_conns) {
+                LJRSERVER_ASSERT(conns[i]->recv(buf, 4, MSG_WAITALL) == 4);
+            } else {
+                LJRSERVER_ASSERT(ping(conns[i]));
+            }
+        }
+        conns[i]->close();
+    }
+    LJRSERVER_ASSERT(wait_for([server]() {
+        return server->getConnectionCount() == 0;
+    }));
+    LJRSERVER_ASSERT(server->getAcceptedCount() == count);
+    LJRSERVER_ASSERT(server->getRejectedCount() == 0);
+    server->stop();
+    LJRSERVER_LOG_INFO(g_logger)
+        << "test_max_connections paused=" << server->getPausedCount()
+        << " ok";
+}
+
+/**
+ * @brief 读取 int 类型的 socket 选项
+ *
+ * @param sock
+ * @param level
+ * @param option
+ * @return int 失败返回 -1
+ */
+static int get_option(ljrserver::Socket::ptr sock, int level, int option) {
+    int v = 0;
+    return sock->getOption(level, option, v) ? v : -1;
+}
+
+/**
+ * @brief 测试 TcpSocketOptions 设置到监听 socket 接受的连接继承
+ *
+ * @param iom 工作调度器
+ */
+void test_socket_options(ljrserver::IOManager *iom) {
+    ljrserver::TcpSocketOptions opts;
+    // 默认开启 TCP_NODELAY 设置为 0 才能看出选项生效
+    opts.nodelay = 0;
+    opts.rcvbuf = 32 * 1024;
+    opts.sndbuf = 48 * 1024;
+    opts.keepalive = 1;
+    opts.keepidle = 30;
+    opts.keepintvl = 5;
+    opts.keepcnt = 3;
+    opts.quickack = 1;
+    opts.zerocopy = 1;
+
+    EchoServer::ptr server(new EchoServer(iom));
+    server->setSocketOptions(opts);
+    auto addr = ljrserver::Address::LookupAny("127.0.0.1:0");
+    run_in(iom, [server, addr]() {
+        LJRSERVER_ASSERT(server->bind(addr) && server->start());
+    });
+    auto listener = server->getSocks()[0];
+    auto local = listener->getLocalAddress();
+
+    auto sock = ljrserver::Socket::CreateTCP(local);
+    LJRSERVER_ASSERT(sock->connect(local, 1000));
+    LJRSERVER_ASSERT(ping(sock));
+    auto clients = server->getClients();
+    LJRSERVER_ASSERT(clients.size() == 1);
+
+    // 监听 socket 和接受的连接 内核返回的缓冲区大小是设置值的两倍
+    for (auto &s : {listener, clients[0]}) {
+        LJRSERVER_ASSERT(get_option(s, IPPROTO_TCP, TCP_NODELAY) == 0);
+        LJRSERVER_ASSERT(get_option(s, SOL_SOCKET, SO_RCVBUF) >= opts.rcvbuf);
+        LJRSERVER_ASSERT(get_option(s, SOL_SOCKET, SO_SNDBUF) >= opts.sndbuf);
+        LJRSERVER_ASSERT(get_option(s, SOL_SOCKET, SO_KEEPALIVE) == 1);
+        LJRSERVER_ASSERT(get_option(s, IPPROTO_TCP, TCP_KEEPIDLE) ==
+                         opts.keepidle);
+        LJRSERVER_ASSERT(get_option(s, IPPROTO_TCP, TCP_KEEPINTVL) ==
+                         opts.keepintvl);
+        LJRSERVER_ASSERT(get_option(s, IPPROTO_TCP, TCP_KEEPCNT) ==
+                         opts.keepcnt);
+    }
+    // 零拷贝只设置在接受的连接上 内核不支持时关闭
+    if (clients[0]->isZeroCopy()) {
+        LJRSERVER_ASSERT(get_option(clients[0], SOL_SOCKET, SO_ZEROCOPY) == 1);
+    }
+    LJRSERVER_ASSERT(get_option(listener, SOL_SOCKET, SO_ZEROCOPY) != 1);
+
+    // 客户端没有设置 保持默认
+    LJRSERVER_ASSERT(get_option(sock, IPPROTO_TCP, TCP_NODELAY) == 1);
+    LJRSERVER_ASSERT(get_option(sock, SOL_SOCKET, SO_KEEPALIVE) == 0);
 
-    // 开启 tcp 服务器
-    tcp_server->start();
+    sock->close();
+    LJRSERVER_ASSERT(wait_for([server]() {
+        return server->getConnectionCount() == 0;
+    }));
+    server->stop();
+    LJRSERVER_LOG_INFO(g_logger) << "test_socket_options ok";
 }
 
 /**
@@ -46,9 +432,12 @@ void run() {
  * @return int
  */
 int main(int argc, char const *argv[]) {
-    // IO 管理器
-    ljrserver::IOManager iom(2);
-    // 调度任务
-    iom.schedule(run);
+    // 工作调度器 不使用主线程 主线程不开启 hook 作为阻塞的客户端
+    ljrserver::IOManager iom(2, false, "worker");
+    test_reuse_port(&iom, false);
+    test_reuse_port(&iom, true);
+    test_accept_batch(&iom);
+    test_max_connections(&iom);
+    test_socket_options(&iom);
     return 0;
 }
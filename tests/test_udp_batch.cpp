@@ -0,0 +1,229 @@
+/**
+ * @file test_udp_batch.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试 UDP 批量收发 recvmmsg/sendmmsg 与单个数据报收发的对比
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/socket.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/iomanager.h"
+#include "../ljrServer/clock.h"
+#include "../ljrServer/macro.h"
+
+#include <string.h>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+// 数据报个数
+static const int s_count = 200000;
+
+// 数据报大小
+static const int s_size = 64;
+
+// 批量个数
+static const int s_batch = 64;
+
+// 一轮测试发送和接收的数据报个数
+static int s_sent = 0;
+static int s_received = 0;
+
+/**
+ * @brief 发送 s_count 个数据报
+ *
+ * @param sock 已连接的 UDP socket
+ * @param batch 是否批量发送
+ */
+void run_send(ljrserver::Socket::ptr sock, bool batch) {
+    char buf[s_batch][s_size];
+    memset(buf, 'x', sizeof(buf));
+
+    uint64_t start = ljrserver::Clock::NowUS();
+    int sent = 0;
+    if (!batch) {
+        for (int i = 0; i < s_count; ++i) {
+            if (sock->send(buf[0], s_size) == s_size) {
+                ++sent;
+            }
+        }
+    } else {
+        iovec iovs[s_batch];
+        mmsghdr msgs[s_batch];
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < s_batch; ++i) {
+            iovs[i].iov_base = buf[i];
+            iovs[i].iov_len = s_size;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        while (sent < s_count) {
+            int n = std::min(s_batch, s_count - sent);
+            int rt = sock->sendBatch(msgs, n);
+            if (rt <= 0) {
+                break;
+            }
+            sent += rt;
+        }
+    }
+    uint64_t used = ljrserver::Clock::NowUS() - start;
+    s_sent = sent;
+
+    LJRSERVER_LOG_INFO(g_logger)
+        << (batch ? "sendmmsg" : "send") << " sent=" << sent
+        << " used=" << used << "us pps=" << (sent * 1000000ull / (used + 1));
+}
+
+/**
+ * @brief 接收数据报 直到 500ms 没有数据
+ *
+ * @param sock 绑定的 UDP socket
+ * @param batch 是否批量接收
+ */
+void run_recv(ljrserver::Socket::ptr sock, bool batch) {
+    std::vector<ljrserver::ByteArray::ptr> datas;
+    std::vector<ljrserver::Address::ptr> froms;
+    for (int i = 0; i < s_batch; ++i) {
+        datas.push_back(std::make_shared<ljrserver::ByteArray>());
+        froms.push_back(std::make_shared<ljrserver::IPv4Address>());
+    }
+    char buf[s_size];
+    ljrserver::Address::ptr from = std::make_shared<ljrserver::IPv4Address>();
+
+    uint64_t start = 0;
+    uint64_t last = 0;
+    int received = 0;
+    while (true) {
+        int rt = 0;
+        if (!batch) {
+            rt = sock->recvFrom(buf, sizeof(buf), from) == s_size ? 1 : -1;
+        } else {
+            for (auto &i : datas) {
+                i->clear();
+            }
+            rt = sock->recvBatch(datas, froms, s_size);
+        }
+        if (rt <= 0) {
+            // 超时 发送结束
+            break;
+        }
+        // 每个数据报完整收到
+        for (int i = 0; batch && i < rt; ++i) {
+            LJRSERVER_ASSERT(datas[i]->getPosition() == s_size);
+            datas[i]->setPostion(0);
+            LJRSERVER_ASSERT(datas[i]->toString() == std::string(s_size, 'x'));
+        }
+        last = ljrserver::Clock::NowUS();
+        if (!start) {
+            start = last;
+        }
+        received += rt;
+    }
+
+    s_received = received;
+    LJRSERVER_LOG_INFO(g_logger)
+        << (batch ? "recvmmsg" : "recvfrom") << " received=" << received
+        << " used=" << (last - start) << "us pps="
+        << (received * 1000000ull / (last - start + 1));
+}
+
+/**
+ * @brief 一轮测试 收发各在一个 IO 管理器中
+ *
+ * @param batch 是否批量收发
+ */
+void test_udp(bool batch) {
+    auto addr = ljrserver::IPv4Address::Create("127.0.0.1", 0);
+    auto server = ljrserver::Socket::CreateUDP(addr);
+    server->bind(addr);
+    server->setOption(SOL_SOCKET, SO_RCVBUF, 8 * 1024 * 1024);
+    server->setRecvTimeout(500);
+
+    auto client = ljrserver::Socket::CreateUDP(addr);
+    client->connect(server->getLocalAddress());
+
+    s_sent = s_received = 0;
+    {
+        ljrserver::IOManager recv_iom(1, false, "recv");
+        recv_iom.schedule(std::bind(run_recv, server, batch));
+
+        ljrserver::IOManager send_iom(1, false, "send");
+        send_iom.schedule(std::bind(run_send, client, batch));
+    }
+
+    // 回环上发送不会失败 接收缓存满时可能丢包
+    LJRSERVER_ASSERT(s_sent == s_count);
+    LJRSERVER_ASSERT(s_received > 0 && s_received <= s_sent);
+}
+
+/**
+ * @brief 测试 ByteArray 批量收发的内容 数量 地址 包括空的数据报
+ *
+ */
+void test_batch_payload() {
+    auto addr = ljrserver::IPv4Address::Create("127.0.0.1", 0);
+    auto server = ljrserver::Socket::CreateUDP(addr);
+    LJRSERVER_ASSERT(server->bind(addr));
+    server->setRecvTimeout(500);
+    auto client = ljrserver::Socket::CreateUDP(addr);
+    LJRSERVER_ASSERT(client->connect(server->getLocalAddress()));
+
+    // 空的 ByteArray 没有 iovec
+    std::vector<std::string> payloads = {"hello", "", std::string(3000, 'b'),
+                                         "x", ""};
+    std::vector<ljrserver::ByteArray::ptr> datas;
+    for (auto &p : payloads) {
+        // 内存块很小 数据报跨越多个 iovec
+        ljrserver::ByteArray::ptr ba(new ljrserver::ByteArray(128));
+        ba->write(p.data(), p.size());
+        ba->setPostion(0);
+        datas.push_back(ba);
+    }
+    std::vector<ljrserver::Address::ptr> tos;
+    LJRSERVER_ASSERT(client->sendBatch(datas, tos) == (int)payloads.size());
+    for (size_t i = 0; i < payloads.size(); ++i) {
+        LJRSERVER_ASSERT(datas[i]->getReadSize() == 0);
+    }
+
+    // 多准备一个 只收到发送的个数
+    std::vector<ljrserver::ByteArray::ptr> recvs;
+    std::vector<ljrserver::Address::ptr> froms;
+    for (size_t i = 0; i <= payloads.size(); ++i) {
+        recvs.push_back(std::make_shared<ljrserver::ByteArray>(128));
+        froms.push_back(std::make_shared<ljrserver::IPv4Address>());
+    }
+    int rt = server->recvBatch(recvs, froms, 4096, MSG_WAITFORONE);
+    LJRSERVER_ASSERT(rt == (int)payloads.size());
+    std::string local = client->getLocalAddress()->toString();
+    for (size_t i = 0; i < payloads.size(); ++i) {
+        LJRSERVER_ASSERT(recvs[i]->getPosition() == payloads[i].size());
+        recvs[i]->setPostion(0);
+        LJRSERVER_ASSERT(recvs[i]->toString() == payloads[i]);
+        LJRSERVER_ASSERT(froms[i]->toString() == local);
+    }
+    LJRSERVER_ASSERT(recvs[payloads.size()]->getPosition() == 0);
+    LJRSERVER_LOG_INFO(g_logger) << "test_batch_payload ok";
+}
+
+/**
+ * @brief 测试
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char const *argv[]) {
+    g_logger->setLevel(ljrserver::LogLevel::INFO);
+    LJRSERVER_LOG_NAME("system")->setLevel(ljrserver::LogLevel::INFO);
+
+    test_batch_payload();
+
+    // 单个数据报
+    test_udp(false);
+
+    // 批量
+    test_udp(true);
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file test_upgrade.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试热升级 监听句柄继承 Socket::attach 接管
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/upgrade.h"
+#include "../ljrServer/socket.h"
+#include "../ljrServer/iomanager.h"
+#include "../ljrServer/env.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/macro.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <fstream>
+#include <sstream>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+// 新进程写日志的文件 _exit 前刷新
+static const char *s_log_file = "/tmp/ljrserver_test_upgrade.log";
+
+/**
+ * @brief 新进程 接管继承的监听句柄 通知旧进程 处理一个连接
+ *
+ * @param port 监听端口
+ * @return int
+ */
+int run_new(int port) {
+    auto upgrade = ljrserver::HotUpgradeMgr::GetInstance();
+    LJRSERVER_ASSERT(upgrade->isUpgrading());
+    LJRSERVER_ASSERT(upgrade->getParent() == getppid());
+
+    // 按地址接管 同一地址只能取出一次
+    auto addr = ljrserver::IPv4Address::Create("127.0.0.1", port);
+    int fd = upgrade->take(addr);
+    LJRSERVER_ASSERT(fd != -1);
+    LJRSERVER_ASSERT(upgrade->take(addr) == -1);
+
+    // 协议簇不同不能接管
+    auto sock6 = ljrserver::Socket::CreateTCPSocket6();
+    LJRSERVER_ASSERT(!sock6->attach(fd));
+
+    auto sock = ljrserver::Socket::CreateTCP(addr);
+    LJRSERVER_ASSERT(sock->attach(fd));
+    LJRSERVER_ASSERT(sock->getSocket() == fd);
+    LJRSERVER_ASSERT(sock->getLocalAddress()->toString() == addr->toString());
+    upgrade->closeUnused();
+
+    // 通知旧进程退出
+    LJRSERVER_ASSERT(upgrade->notifyParent());
+    LJRSERVER_ASSERT(!upgrade->isUpgrading());
+
+    // 旧进程关闭后 连接由接管的句柄 accept
+    auto client = sock->accept();
+    LJRSERVER_ASSERT(client);
+    char buf[16];
+    LJRSERVER_ASSERT(client->recv(buf, 4) == 4 && memcmp(buf, "ping", 4) == 0);
+    std::string rsp = "pong " + std::to_string(getpid());
+    LJRSERVER_ASSERT(client->send(rsp.c_str(), rsp.size()) == (int)rsp.size());
+    client->close();
+
+    // 日志写到文件 _exit 前刷新
+    g_logger->addAppender(
+        ljrserver::LogAppender::ptr(new ljrserver::FileLogAppender(s_log_file)));
+    LJRSERVER_LOG_INFO(g_logger) << "new process done pid = " << getpid();
+    ljrserver::LoggerMgr::GetInstance()->flush();
+    _exit(0);
+}
+
+/**
+ * @brief 旧进程 监听后启动新进程 收到 SIGQUIT 后关闭监听
+ *
+ * @param argv0 程序路径
+ */
+void run_old(const char *argv0) {
+    unlink(s_log_file);
+
+    auto addr = ljrserver::IPv4Address::Create("127.0.0.1", 0);
+    auto listener = ljrserver::Socket::CreateTCP(addr);
+    LJRSERVER_ASSERT(listener->bind(addr) && listener->listen());
+    auto local = std::dynamic_pointer_cast<ljrserver::IPv4Address>(
+        listener->getLocalAddress());
+    int port = local->getPort();
+
+    // 不传递的句柄
+    int fds[2];
+    LJRSERVER_ASSERT(pipe(fds) == 0);
+
+    // 新进程启动完成后发 SIGQUIT
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGQUIT);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+
+    std::string port_str = std::to_string(port);
+    std::string pipe_str = std::to_string(fds[0]);
+    char *argv[] = {(char *)argv0,  (char *)"-port", &port_str[0],
+                    (char *)"-pipe", &pipe_str[0],    nullptr};
+    pid_t pid = ljrserver::HotUpgradeMgr::GetInstance()->exec(
+        argv, {listener->getSocket()});
+    LJRSERVER_ASSERT(pid > 0);
+
+    siginfo_t info;
+    timespec ts = {10, 0};
+    LJRSERVER_ASSERT(sigtimedwait(&mask, &info, &ts) == SIGQUIT);
+    LJRSERVER_ASSERT(info.si_pid == pid);
+
+    // 旧进程不再 accept 连接排队在新进程接管的句柄上
+    listener->close();
+    close(fds[0]);
+    close(fds[1]);
+
+    auto client = ljrserver::Socket::CreateTCP(local);
+    LJRSERVER_ASSERT(client->connect(local));
+    LJRSERVER_ASSERT(client->send("ping", 4) == 4);
+    char buf[64] = {0};
+    int rt = client->recv(buf, sizeof(buf) - 1);
+    LJRSERVER_ASSERT(rt > 0);
+    LJRSERVER_LOG_INFO(g_logger) << "recv " << buf;
+    LJRSERVER_ASSERT(std::string(buf, rt) == "pong " + std::to_string(pid));
+
+    int status = 0;
+    LJRSERVER_ASSERT(waitpid(pid, &status, 0) == pid);
+    LJRSERVER_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // _exit 前的日志已经写入文件
+    std::ifstream ifs(s_log_file);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    LJRSERVER_ASSERT(ss.str().find("new process done pid = " +
+                                   std::to_string(pid)) != std::string::npos);
+    unlink(s_log_file);
+    LJRSERVER_LOG_INFO(g_logger) << "hot upgrade ok";
+}
+
+/**
+ * @brief 测试
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char **argv) {
+    auto env = ljrserver::EnvMgr::GetInstance();
+    LJRSERVER_ASSERT(env->init(argc, argv));
+    if (ljrserver::HotUpgradeMgr::GetInstance()->isUpgrading()) {
+        LJRSERVER_ASSERT(env->has("port") && env->has("pipe"));
+        // 继承的句柄是非阻塞的 在 IOManager 中 hook 的 accept recv 等待数据
+        int port = atoi(env->get("port").c_str());
+        int pipe_fd = atoi(env->get("pipe").c_str());
+        // 没有传递的句柄已经关闭 在创建 IOManager 前检查 句柄号会被复用
+        LJRSERVER_ASSERT(fcntl(pipe_fd, F_GETFD) == -1 && errno == EBADF);
+        ljrserver::IOManager iom(1);
+        iom.schedule([port]() { run_new(port); });
+        return 0;
+    }
+    run_old(argv[0]);
+    return 0;
+}
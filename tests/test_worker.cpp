@@ -0,0 +1,126 @@
+/**
+ * @file test_worker.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试 IO 调度器池配置解析 cgroup CPU 配额
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/worker.h"
+#include "../ljrServer/util.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/macro.h"
+
+#include <stdlib.h>
+#include <fstream>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+/**
+ * @brief 测试线程数和绑定 CPU 的解析
+ *
+ */
+void test_parse() {
+    typedef ljrserver::WorkerManager WM;
+    LJRSERVER_ASSERT(WM::ParseThreads("4") == 4);
+    LJRSERVER_ASSERT(WM::ParseThreads("auto") == ljrserver::GetCpuCount());
+    LJRSERVER_ASSERT(WM::ParseThreads("") == 0);
+    LJRSERVER_ASSERT(WM::ParseThreads("0") == 0);
+    LJRSERVER_ASSERT(WM::ParseThreads("-2") == 0);
+    LJRSERVER_ASSERT(WM::ParseThreads("4abc") == 0);
+    LJRSERVER_ASSERT(WM::ParseThreads("abc") == 0);
+
+    std::vector<int> cpus;
+    LJRSERVER_ASSERT(WM::ParseAffinity("", cpus) && cpus.empty());
+    LJRSERVER_ASSERT(WM::ParseAffinity("auto", cpus) &&
+                     cpus == ljrserver::GetAllowedCpus());
+    LJRSERVER_ASSERT(WM::ParseAffinity("0-3,6", cpus));
+    LJRSERVER_ASSERT((cpus == std::vector<int>{0, 1, 2, 3, 6}));
+    LJRSERVER_ASSERT(WM::ParseAffinity("5", cpus));
+    LJRSERVER_ASSERT((cpus == std::vector<int>{5}));
+
+    // 每一项都要整个解析完
+    LJRSERVER_ASSERT(!WM::ParseAffinity("4abc", cpus));
+    LJRSERVER_ASSERT(!WM::ParseAffinity("0-3x", cpus));
+    LJRSERVER_ASSERT(!WM::ParseAffinity("1,2a", cpus));
+    LJRSERVER_ASSERT(!WM::ParseAffinity("3-", cpus));
+    LJRSERVER_ASSERT(!WM::ParseAffinity("0,,1", cpus));
+    LJRSERVER_ASSERT(!WM::ParseAffinity("3-1", cpus));
+    LJRSERVER_ASSERT(!WM::ParseAffinity("-1", cpus));
+}
+
+/**
+ * @brief 写文件
+ *
+ * @param path
+ * @param content
+ */
+static void write_file(const std::string &path, const std::string &content) {
+    LJRSERVER_ASSERT(ljrserver::FSUtil::Mkdir(path.substr(0, path.rfind('/'))));
+    std::ofstream ofs(path);
+    ofs << content;
+}
+
+/**
+ * @brief 测试按进程所在的 cgroup 读取 CPU 配额
+ *
+ */
+void test_cgroup() {
+    std::string root = "/tmp/ljrserver_test_cgroup";
+    LJRSERVER_ASSERT(system(("rm -rf " + root).c_str()) == 0);
+
+    // v2 进程在 /kubepods/pod1 配额在进程自己的层级 根没有限制
+    write_file(root + "/v2/self", "0::/kubepods/pod1\n");
+    write_file(root + "/v2/fs/cpu.max", "max 100000\n");
+    write_file(root + "/v2/fs/kubepods/pod1/cpu.max", "150000 100000\n");
+    LJRSERVER_ASSERT(ljrserver::GetCgroupCpuQuota(root + "/v2/self",
+                                                  root + "/v2/fs") == 1.5);
+
+    // 上层的配额更小
+    write_file(root + "/v2/fs/kubepods/cpu.max", "50000 100000\n");
+    LJRSERVER_ASSERT(ljrserver::GetCgroupCpuQuota(root + "/v2/self",
+                                                  root + "/v2/fs") == 0.5);
+
+    // 没有 cgroup 命名空间 宿主机的路径不存在 用挂载点的配额
+    write_file(root + "/v2/self", "0::/system.slice/docker-1.scope\n");
+    LJRSERVER_ASSERT(ljrserver::GetCgroupCpuQuota(root + "/v2/self",
+                                                  root + "/v2/fs") == 0);
+    write_file(root + "/v2/fs/cpu.max", "200000 100000\n");
+    LJRSERVER_ASSERT(ljrserver::GetCgroupCpuQuota(root + "/v2/self",
+                                                  root + "/v2/fs") == 2);
+
+    // v1 按 cpu 控制器的路径
+    write_file(root + "/v1/self",
+               "4:memory:/other\n3:cpu,cpuacct:/docker/abc\n0::/\n");
+    write_file(root + "/v1/fs/cpu/cpu.cfs_quota_us", "-1\n");
+    write_file(root + "/v1/fs/cpu/cpu.cfs_period_us", "100000\n");
+    write_file(root + "/v1/fs/cpu/docker/abc/cpu.cfs_quota_us", "300000\n");
+    write_file(root + "/v1/fs/cpu/docker/abc/cpu.cfs_period_us", "100000\n");
+    LJRSERVER_ASSERT(ljrserver::GetCgroupCpuQuota(root + "/v1/self",
+                                                  root + "/v1/fs") == 3);
+
+    // 都没有限制
+    write_file(root + "/v1/fs/cpu/docker/abc/cpu.cfs_quota_us", "-1\n");
+    LJRSERVER_ASSERT(ljrserver::GetCgroupCpuQuota(root + "/v1/self",
+                                                  root + "/v1/fs") == 0);
+
+    LJRSERVER_ASSERT(system(("rm -rf " + root).c_str()) == 0);
+    LJRSERVER_LOG_INFO(g_logger)
+        << "cpu count = " << ljrserver::GetCpuCount()
+        << " quota = " << ljrserver::GetCgroupCpuQuota();
+}
+
+/**
+ * @brief 测试
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char **argv) {
+    test_parse();
+    test_cgroup();
+    LJRSERVER_LOG_INFO(g_logger) << "test worker ok";
+    return 0;
+}
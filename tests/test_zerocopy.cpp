@@ -0,0 +1,221 @@
+/**
+ * @file test_zerocopy.cpp
+ * @author lijianran (lijianran@outlook.com)
+ * @brief 测试 MSG_ZEROCOPY 零拷贝发送 完成通知回收 与拷贝发送的 CPU 时间对比
+ * @version 0.1
+ * @date 2022-02-20
+ */
+
+#include "../ljrServer/socket.h"
+#include "../ljrServer/log.h"
+#include "../ljrServer/iomanager.h"
+#include "../ljrServer/macro.h"
+#include "../ljrServer/clock.h"
+#include "../ljrServer/config.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
+#include <vector>
+
+// 日志
+static ljrserver::Logger::ptr g_logger = LJRSERVER_LOG_ROOT();
+
+// 每次发送的大小 1MB
+static const size_t s_size = 1024 * 1024;
+
+// 发送次数
+static const int s_count = 256;
+
+/**
+ * @brief 当前线程的 CPU 时间 微秒
+ *
+ * @return uint64_t
+ */
+static uint64_t thread_cpu_us() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief 接收端 普通线程阻塞读 校验数据
+ *
+ * 第 i 次发送的 1MB 内容全部为 'a' + i % 8
+ *
+ * @param fd 已连接的 socket 句柄
+ * @param total 收到的字节数
+ * @param intact 数据是否完整
+ */
+static void run_recv(int fd, size_t *total, bool *intact) {
+    // 普通线程没有 hook 改回阻塞
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    static char buf[256 * 1024];
+    *total = 0;
+    *intact = true;
+    int rt = 0;
+    while ((rt = ::recv(fd, buf, sizeof(buf), 0)) > 0) {
+        for (int i = 0; i < rt; ++i) {
+            if (buf[i] != (char)('a' + (*total + i) / s_size % 8)) {
+                *intact = false;
+            }
+        }
+        *total += rt;
+    }
+    ::close(fd);
+}
+
+/**
+ * @brief 通过 loopback 发送 count * s_size 字节
+ *
+ * @param zerocopy 是否零拷贝
+ * @param count 发送次数
+ * @param flush 是否在关闭前等待零拷贝完成 否则由 close 等待
+ */
+void run_send(bool zerocopy, int count, bool flush) {
+    auto addr = ljrserver::IPv4Address::Create("127.0.0.1", 0);
+    auto listener = ljrserver::Socket::CreateTCP(addr);
+    LJRSERVER_ASSERT(listener->bind(addr) && listener->listen());
+
+    auto client = ljrserver::Socket::CreateTCP(addr);
+    LJRSERVER_ASSERT(client->connect(listener->getLocalAddress()));
+    auto server = listener->accept();
+    LJRSERVER_ASSERT(server);
+
+    if (zerocopy && !client->setZeroCopy(true)) {
+        LJRSERVER_LOG_WARN(g_logger) << "SO_ZEROCOPY not supported";
+        return;
+    }
+
+    // 接收端在普通线程 不占用发送线程的 CPU
+    int fd = dup(server->getSocket());
+    server->close();
+    size_t total = 0;
+    bool intact = false;
+    std::thread receiver(run_recv, fd, &total, &intact);
+
+    // 多块缓冲轮流发送 零拷贝时由 holder 持有到内核发送完成
+    std::vector<std::shared_ptr<std::string> > bufs;
+    for (int i = 0; i < 8; ++i) {
+        bufs.push_back(std::make_shared<std::string>(s_size, 'a' + i));
+    }
+
+    uint64_t cpu = thread_cpu_us();
+    uint64_t start = ljrserver::Clock::NowMS();
+    for (int i = 0; i < count; ++i) {
+        auto &buf = bufs[i % bufs.size()];
+        size_t offset = 0;
+        while (offset < s_size) {
+            int rt = zerocopy ? client->sendZeroCopy(buf->c_str() + offset,
+                                                     s_size - offset, buf)
+                              : client->send(buf->c_str() + offset,
+                                             s_size - offset);
+            LJRSERVER_ASSERT(rt > 0);
+            offset += rt;
+        }
+    }
+    if (zerocopy && flush) {
+        // 完成通知全部回收
+        LJRSERVER_ASSERT(client->flushZeroCopy(5000));
+        LJRSERVER_ASSERT(client->getZeroCopyPending() == 0);
+    }
+    cpu = thread_cpu_us() - cpu;
+    uint64_t ms = ljrserver::Clock::NowMS() - start;
+
+    LJRSERVER_LOG_INFO(g_logger)
+        << (zerocopy ? "zerocopy" : "copy    ") << " sent "
+        << (s_size * count >> 20) << "MB in " << ms
+        << "ms sender cpu=" << cpu / 1000 << "ms"
+        << " pending=" << client->getZeroCopyPending()
+        << " copied=" << client->getZeroCopyCopied();
+
+    // close 等待剩余的零拷贝发送完成
+    client->close();
+    LJRSERVER_ASSERT(client->getZeroCopyPending() == 0);
+    // holder 全部释放
+    for (auto &i : bufs) {
+        LJRSERVER_ASSERT(i.use_count() == 1);
+    }
+
+    receiver.join();
+    LJRSERVER_ASSERT(total == s_size * count);
+    LJRSERVER_ASSERT(intact);
+}
+
+/**
+ * @brief 对端不读 关闭时等待零拷贝超时 复位连接 holder 延后释放
+ *
+ */
+void test_close_timeout() {
+    auto timeout = ljrserver::Config::Lookup<uint32_t>(
+        "socket.zerocopy_close_timeout");
+    uint32_t old_timeout = timeout->getValue();
+    timeout->setValue(100);
+
+    auto addr = ljrserver::IPv4Address::Create("127.0.0.1", 0);
+    auto listener = ljrserver::Socket::CreateTCP(addr);
+    LJRSERVER_ASSERT(listener->bind(addr) && listener->listen());
+    auto client = ljrserver::Socket::CreateTCP(addr);
+    LJRSERVER_ASSERT(client->connect(listener->getLocalAddress()));
+    auto server = listener->accept();
+    LJRSERVER_ASSERT(server);
+    if (!client->setZeroCopy(true)) {
+        LJRSERVER_LOG_WARN(g_logger) << "SO_ZEROCOPY not supported";
+        return;
+    }
+
+    // 写满两端的缓冲 剩下的数据还在发送队列中 没有完成通知
+    auto buf = std::make_shared<std::string>(s_size, 'z');
+    client->setSendTimeout(100);
+    while (client->sendZeroCopy(buf->c_str(), s_size, buf) > 0) {
+    }
+    LJRSERVER_ASSERT(errno == ETIMEDOUT);
+    LJRSERVER_ASSERT(client->getZeroCopyPending() > 0);
+
+    uint64_t start = ljrserver::Clock::NowMS();
+    client->close();
+    uint64_t used = ljrserver::Clock::NowMS() - start;
+    LJRSERVER_ASSERT(used >= 100 && used < 1000);
+    // 定时器还持有 holder
+    LJRSERVER_ASSERT(buf.use_count() > 1);
+
+    // 连接被复位
+    char tmp[4096];
+    int rt = 0;
+    while ((rt = server->recv(tmp, sizeof(tmp))) > 0) {
+    }
+    LJRSERVER_ASSERT(rt < 0 && errno == ECONNRESET);
+
+    usleep(200 * 1000);
+    LJRSERVER_ASSERT(buf.use_count() == 1);
+    LJRSERVER_LOG_INFO(g_logger) << "close timeout reset ok used=" << used;
+
+    server->close();
+    timeout->setValue(old_timeout);
+}
+
+/**
+ * @brief 测试 loopback 上内核会退回拷贝 (copied 计数) 真实网卡才有收益
+ *
+ */
+void test_zerocopy() {
+    run_send(false, s_count, true);
+    run_send(true, s_count, true);
+    // 不调用 flush 直接关闭
+    run_send(true, 16, false);
+    test_close_timeout();
+}
+
+/**
+ * @brief 测试
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char const *argv[]) {
+    ljrserver::IOManager iom(1, false, "main");
+    iom.schedule(test_zerocopy);
+    return 0;
+}